@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: Apache-2.0
+// Compares the compression work of the former dreport check_size budgeting,
+// which re-archived the whole dump every time the size limit was crossed,
+// with the incremental budgeting of archive::Writer.
+//
+// usage: archive_budget_bench [xz|gzip|zstd] [item size in KiB]
+#include "dump_archive.hpp"
+
+#include <array>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+// Share of the unlimited compressed dump size allowed by the budget
+constexpr double BUDGET_SHARE = 0.5;
+
+const std::filesystem::path workDir = "/tmp/archive_budget_bench";
+
+struct Run
+{
+    double cpuMs = 0;
+    uint64_t size = 0;
+    size_t items = 0;
+};
+
+double cpuMs()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/** @brief Write a plugin output resembling a service log */
+std::filesystem::path makeItem(const std::filesystem::path& dir, size_t index,
+                               size_t size)
+{
+    static const std::vector<std::string> words = {
+        "sensor",  "reading", "threshold", "asserted", "deasserted",
+        "service", "started", "property",  "changed",  "inventory",
+        "fan",     "temp",    "voltage",   "power",    "state"};
+
+    std::mt19937 rng(index);
+    auto number = [&rng](unsigned limit) {
+        return static_cast<unsigned>(rng() % limit);
+    };
+    auto word = [&]() { return words[number(words.size())].c_str(); };
+
+    auto path = dir / ("plugin" + std::to_string(index) + ".log");
+    std::ofstream os(path);
+    size_t written = 0;
+    std::array<char, 256> line{};
+    while (written < size)
+    {
+        auto length = std::snprintf(
+            line.data(), line.size(),
+            "Oct 17 02:%02u:%02u bmc %s[%u]: %s %s %u\n", number(60),
+            number(60), word(), number(4096), word(), word(), number(100000));
+        os.write(line.data(), length);
+        written += length;
+    }
+    return path;
+}
+
+/** @brief Size of an archive of a directory, created from scratch */
+uint64_t archiveSize(const std::filesystem::path& dir,
+                     archive::Algorithm algorithm)
+{
+    auto path = workDir / ("legacy." + archive::extension(algorithm));
+    {
+        archive::Writer writer(path, algorithm);
+        writer.add(dir, dir.filename());
+        writer.commit();
+    }
+    auto size = std::filesystem::file_size(path);
+    std::filesystem::remove(path);
+    return size;
+}
+
+/** @brief The former check_size algorithm of dreport */
+Run legacy(size_t count, size_t itemSize, uint64_t budget,
+           archive::Algorithm algorithm)
+{
+    auto stage = workDir / "obmcdump";
+    std::filesystem::create_directories(stage);
+
+    Run run;
+    auto start = cpuMs();
+    uint64_t curSize = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto item = makeItem(stage, i, itemSize);
+        auto size = archive::tarSize(item);
+        if (size + curSize > budget)
+        {
+            size = archiveSize(stage, algorithm);
+            if (size > budget)
+            {
+                std::filesystem::remove(item);
+                continue;
+            }
+        }
+        curSize += size;
+        ++run.items;
+    }
+    run.size = archiveSize(stage, algorithm);
+    run.cpuMs = cpuMs() - start;
+
+    std::filesystem::remove_all(stage);
+    return run;
+}
+
+/** @brief The budgeting of archive::Writer */
+Run incremental(size_t count, size_t itemSize, uint64_t budget,
+                archive::Algorithm algorithm)
+{
+    auto path = workDir / ("incremental." + archive::extension(algorithm));
+
+    Run run;
+    auto start = cpuMs();
+    {
+        archive::Writer writer(path, algorithm);
+        writer.addDirectory("obmcdump");
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto item = makeItem(workDir, i, itemSize);
+            auto name = "obmcdump/" + item.filename().string();
+            if (writer.add(item, name, budget) == archive::Admission::added)
+            {
+                ++run.items;
+            }
+            std::filesystem::remove(item);
+        }
+        writer.commit();
+    }
+    run.cpuMs = cpuMs() - start;
+    run.size = std::filesystem::file_size(path);
+
+    std::filesystem::remove(path);
+    return run;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    auto algorithm = archive::toAlgorithm(argc > 1 ? argv[1] : "xz");
+    if (!algorithm)
+    {
+        std::cerr << "Unsupported compression algorithm\n";
+        return 1;
+    }
+    size_t itemSize = (argc > 2 ? std::stoul(argv[2]) : 64) * 1024;
+
+    std::filesystem::remove_all(workDir);
+    std::filesystem::create_directories(workDir);
+
+    std::printf("%s, %zu KiB per plugin, budget %.0f%% of the unlimited "
+                "compressed size\n",
+                archive::extension(*algorithm).c_str(), itemSize / 1024,
+                BUDGET_SHARE * 100);
+    std::printf("%8s %11s %14s %12s %6s %14s %12s %6s\n", "plugins",
+                "budget KiB", "legacy CPU ms", "legacy KiB", "items",
+                "increm. CPU ms", "increm. KiB", "items");
+
+    for (size_t count : {8, 16, 32, 64})
+    {
+        auto unlimited = incremental(count, itemSize, UINT64_MAX, *algorithm);
+        auto budget = static_cast<uint64_t>(unlimited.size * BUDGET_SHARE);
+
+        auto old = legacy(count, itemSize, budget, *algorithm);
+        auto now = incremental(count, itemSize, budget, *algorithm);
+        std::printf("%8zu %11llu %14.1f %12llu %6zu %14.1f %12llu %6zu\n",
+                    count, static_cast<unsigned long long>(budget / 1024),
+                    old.cpuMs, static_cast<unsigned long long>(old.size / 1024),
+                    old.items, now.cpuMs,
+                    static_cast<unsigned long long>(now.size / 1024),
+                    now.items);
+    }
+
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
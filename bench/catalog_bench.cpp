@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: Apache-2.0
+// Compares the work of restore() scanning every dump directory, which reads
+// the dump file name, its size and the serialized entry of every dump and
+// walks the dump directory for the space ledger, with replaying the dump
+// catalog.
+//
+// usage: catalog_bench [dumps]
+//
+// The page cache is dropped before every run if the benchmark may write
+// /proc/sys/vm/drop_caches, the cold runs are left out otherwise.
+#include "dump_catalog.hpp"
+#include "dump_record.hpp"
+#include "dump_space.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <regex>
+#include <set>
+#include <string>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+const std::filesystem::path workDir = "/tmp/catalog_bench";
+
+/** @brief Drop the page cache, false if not permitted */
+bool dropCaches()
+{
+    std::ofstream os("/proc/sys/vm/drop_caches");
+    os << "3";
+    os.close();
+    return os.good();
+}
+
+/** @brief Dump directories with a dump file and the serialized entry of
+ *         earlier versions or its record, and their catalog.
+ */
+void generate(size_t dumps, bool binary)
+{
+    std::filesystem::remove_all(workDir);
+    std::filesystem::create_directories(workDir);
+    std::map<uint32_t, record::Record> records;
+    for (uint32_t id = 1; id <= dumps; ++id)
+    {
+        auto dir = workDir / std::to_string(id);
+        std::filesystem::create_directories(dir / ".preserve");
+
+        record::Record r;
+        r.dumpId = id;
+        r.originatorId = "12345";
+        r.startTime = (1700000000ULL + id * 60) * 1000000;
+        r.completedTime = r.startTime + 5000000;
+        r.dumpType = "user";
+        r.fileName = "obmcdump_" + std::to_string(id) + "_" +
+                     std::to_string(r.completedTime / 1000000) + ".tar.xz";
+        r.size = 64 * 1024;
+        for (const auto* plugin : {"bmcstate", "journal", "network", "ps"})
+        {
+            r.collectorOutcomes[plugin] = "ok";
+            r.itemHashes[std::string(plugin) + ".log"] = "0123456789abcdef";
+        }
+
+        std::ofstream(dir / r.fileName, std::ios::binary)
+            << std::string(r.size, 'x');
+        if (binary)
+        {
+            record::save(dir / ".preserve" / record::RECORD_FILE, r);
+        }
+        else
+        {
+            nlohmann::json j;
+            j["version"] = 1;
+            j["dumpId"] = id;
+            j["originatorId"] = r.originatorId;
+            j["originatorType"] = "xyz.openbmc_project.Common.OriginatedBy."
+                                  "OriginatorTypes.Client";
+            j["startTime"] = r.startTime;
+            j["collectorOutcomes"] = r.collectorOutcomes;
+            j["itemHashes"] = r.itemHashes;
+            j["dumpType"] = r.dumpType;
+            std::ofstream(dir / ".preserve" / "serialized_entry.json")
+                << j.dump(4);
+        }
+        records.emplace(id, std::move(r));
+    }
+
+    catalog::Catalog catalog(workDir / catalog::CATALOG_FILE);
+    catalog.rebuild(records);
+
+    // Offloaded afterwards
+    for (auto& [id, r] : records)
+    {
+        if (id % 3 == 0)
+        {
+            r.offloaded = true;
+            catalog.put(r);
+        }
+    }
+}
+
+/** @brief The scan of restore(), number of dumps restored */
+size_t scan(bool binary)
+{
+    std::regex fileRegex("obmcdump_([0-9]+)_([0-9]+).([a-zA-Z0-9]+)");
+    size_t restored = 0;
+    for (const auto& p : std::filesystem::directory_iterator(workDir))
+    {
+        auto idStr = p.path().filename().string();
+        if (!p.is_directory() ||
+            !std::all_of(idStr.begin(), idStr.end(), ::isdigit))
+        {
+            continue;
+        }
+        for (const auto& file : std::filesystem::directory_iterator(p))
+        {
+            if (file.path().filename() == ".preserve")
+            {
+                continue;
+            }
+
+            // extractDumpDetails
+            std::smatch match;
+            auto name = file.path().filename().string();
+            if (!std::regex_search(name, match, fileRegex))
+            {
+                continue;
+            }
+            auto size = std::filesystem::file_size(file);
+
+            // deserialize
+            auto dir = p.path() / ".preserve";
+            if (binary)
+            {
+                auto r = record::load(dir / record::RECORD_FILE);
+                restored += r && size != 0;
+            }
+            else
+            {
+                std::ifstream is(dir / "serialized_entry.json",
+                                 std::ios::binary);
+                nlohmann::json j;
+                is >> j;
+                restored += j.contains("startTime") && size != 0;
+            }
+        }
+    }
+
+    // Seed of the space ledger
+    space::Ledger ledger(workDir, UINT64_MAX);
+    ledger.seed();
+    return ledger.usage() != 0 ? restored : 0;
+}
+
+/** @brief The restore() of the catalog, number of dumps restored */
+size_t replay()
+{
+    catalog::Catalog catalog(workDir / catalog::CATALOG_FILE);
+    auto records = catalog.load();
+    if (!records)
+    {
+        return 0;
+    }
+
+    std::set<uint32_t> present;
+    for (const auto& p : std::filesystem::directory_iterator(workDir))
+    {
+        auto idStr = p.path().filename().string();
+        if (p.is_directory() &&
+            std::all_of(idStr.begin(), idStr.end(), ::isdigit))
+        {
+            present.insert(std::stoul(idStr));
+        }
+    }
+
+    std::map<std::string, uint64_t> estimates;
+    for (const auto& [id, r] : *records)
+    {
+        if (present.contains(id))
+        {
+            estimates.emplace(std::to_string(id), (r.size + 1023) / 1024 + 1);
+        }
+    }
+    space::Ledger ledger(workDir, UINT64_MAX);
+    ledger.seed(std::move(estimates));
+    return ledger.usage() != 0 ? records->size() : 0;
+}
+
+template <typename Func>
+void run(const char* name, bool cold, Func func)
+{
+    if (cold)
+    {
+        dropCaches();
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto restored = func();
+    auto ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    std::printf("%-28s %6s %10.1f %10zu\n", name, cold ? "cold" : "warm", ms,
+                restored);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t dumps = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    bool cold = dropCaches();
+
+    std::printf("%zu dumps\n%-28s %6s %10s %10s\n", dumps, "restore", "cache",
+                "ms", "dumps");
+    for (bool binary : {false, true})
+    {
+        generate(dumps, binary);
+        const char* name =
+            binary ? "scan, binary records" : "scan, json records";
+        for (bool c : {true, false})
+        {
+            if (c && !cold)
+            {
+                continue;
+            }
+            run(name, c, [binary]() { return scan(binary); });
+            run("catalog", c, replay);
+        }
+    }
+    std::printf("catalog size: %ju bytes\n",
+                static_cast<uintmax_t>(std::filesystem::file_size(
+                    workDir / catalog::CATALOG_FILE)));
+
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
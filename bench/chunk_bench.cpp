@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: Apache-2.0
+// Compares the space of successive dumps kept as archives with the space
+// of the same dumps in the chunk store. Every dump repeats the static items
+// of the previous one, inventory, BIOS tables and settings, with a journal
+// which grows and some readings which change.
+//
+// usage: chunk_bench [xz|gzip|zstd] [dumps]
+#include "dump_archive.hpp"
+#include "dump_chunk.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+const std::filesystem::path workDir = "/tmp/chunk_bench";
+
+/** @brief Write a file of lines resembling a plugin output */
+void writeItem(const std::filesystem::path& path, unsigned seed, size_t size)
+{
+    static const std::array<const char*, 10> words = {
+        "sensor", "reading", "threshold", "inventory", "fan",
+        "temp",   "voltage", "power",     "state",     "property"};
+    std::mt19937 rng(seed);
+    std::ofstream os(path);
+    size_t written = 0;
+    std::array<char, 128> line{};
+    while (written < size)
+    {
+        auto length = std::snprintf(line.data(), line.size(), "%s %s %u\n",
+                                    words[rng() % words.size()],
+                                    words[rng() % words.size()],
+                                    static_cast<unsigned>(rng() % 100000));
+        os.write(line.data(), length);
+        written += length;
+    }
+}
+
+/** @brief The items of a dump, which change with its number */
+void makeDump(const std::filesystem::path& dir, unsigned number)
+{
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    // Static between the dumps
+    writeItem(dir / "inventory.json", 1, 96 * 1024);
+    writeItem(dir / "bios_tables.bin", 2, 64 * 1024);
+    writeItem(dir / "settings.json", 3, 32 * 1024);
+    writeItem(dir / "os-release", 4, 512);
+
+    // The journal grows, the older entries are unchanged
+    std::ofstream journal(dir / "journal.log");
+    for (unsigned i = 0; i <= number; ++i)
+    {
+        std::mt19937 rng(100 + i);
+        for (unsigned line = 0; line < 400; ++line)
+        {
+            journal << "Oct 17 02:" << i % 60 << " bmc service[" << rng() % 999
+                    << "]: state changed " << rng() << "\n";
+        }
+    }
+    journal.close();
+
+    // Changed completely
+    writeItem(dir / "readings.log", 1000 + number, 8 * 1024);
+}
+
+/** @brief Size of a file of the dump directory in kilobytes, as accounted
+ *         by the space ledger */
+uint64_t kilobytes(uint64_t size)
+{
+    return (size + 1023) / 1024;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto algorithm =
+        archive::toAlgorithm(argc > 1 ? argv[1] : "xz").value_or(
+            archive::Algorithm::xz);
+    unsigned dumps = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8;
+
+    std::filesystem::remove_all(workDir);
+    auto dumpDir = workDir / "dumps";
+    chunk::Store store(dumpDir / chunk::STORE_DIR);
+
+    uint64_t archives = 0;
+    uint64_t recipes = 0;
+    double ingestMs = 0;
+    double streamMs = 0;
+    const std::atomic<bool> cancelled = false;
+    std::printf("%6s %14s %16s\n", "dumps", "archives KiB", "chunk store KiB");
+    for (unsigned id = 1; id <= dumps; ++id)
+    {
+        makeDump(workDir / "items", id);
+        auto dir = dumpDir / std::to_string(id);
+        std::filesystem::create_directories(dir);
+        auto path = dir / ("obmcdump_" + std::to_string(id) + "_0." +
+                           archive::extension(algorithm));
+        {
+            archive::Writer writer(path, algorithm);
+            if (!writer.add(workDir / "items", "dump") || !writer.commit())
+            {
+                std::fprintf(stderr, "Failed to write %s\n", path.c_str());
+                return 1;
+            }
+        }
+        archives += kilobytes(std::filesystem::file_size(path));
+
+        auto recipe = path;
+        recipe += chunk::RECIPE_SUFFIX;
+        auto start = std::chrono::steady_clock::now();
+        auto ingested = store.ingest(id, path, recipe);
+        ingestMs += std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        if (!ingested)
+        {
+            std::fprintf(stderr, "Failed to ingest %s\n", path.c_str());
+            return 1;
+        }
+        recipes += kilobytes(std::filesystem::file_size(recipe));
+
+        // The archive GetFileHandle streams from the chunk files
+        int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        start = std::chrono::steady_clock::now();
+        auto streamed = fd >= 0 && chunk::writeArchive(recipe, fd, cancelled);
+        streamMs += std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if (!streamed)
+        {
+            std::fprintf(stderr, "Failed to stream %s\n", path.c_str());
+            return 1;
+        }
+        std::filesystem::remove(path);
+
+        std::printf("%6u %14ju %16ju\n", id, static_cast<uintmax_t>(archives),
+                    static_cast<uintmax_t>(recipes + store.usage()));
+    }
+    std::printf("ingest %.1f ms, stream %.1f ms per dump\n",
+                ingestMs / dumps, streamMs / dumps);
+
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: Apache-2.0
+// Measures the throughput of the archive compression with an increasing
+// number of compression threads, in MB/s of input and in MB/s per CPU
+// second, the cost of the compression to the rest of the BMC.
+//
+// usage: compression_threads_bench [xz|gzip|zstd] [input size in MiB]
+//                                  [maximum threads]
+#include "dump_archive.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+const std::filesystem::path workDir = "/tmp/compression_threads_bench";
+
+double cpuSeconds()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** @brief Write a journal like file, compressing about as well as the
+ *         logs making up most of a dump.
+ */
+void writeInput(const std::filesystem::path& path, size_t size)
+{
+    std::mt19937 rng(0);
+    std::vector<std::string> words;
+    for (size_t i = 0; i < 4096; ++i)
+    {
+        std::string word;
+        for (size_t length = 3 + rng() % 10; word.size() < length;)
+        {
+            word += static_cast<char>('a' + rng() % 26);
+        }
+        words.push_back(word);
+    }
+
+    std::ofstream os(path);
+    std::array<char, 128> prefix{};
+    for (size_t written = 0; written < size;)
+    {
+        auto length = std::snprintf(
+            prefix.data(), prefix.size(), "%u.%06u bmc service[%u]: ",
+            1700000000 + static_cast<unsigned>(written / 4096),
+            static_cast<unsigned>(rng() % 1000000),
+            static_cast<unsigned>(rng() % 4096));
+        std::string line(prefix.data(), length);
+        for (size_t count = 4 + rng() % 12; count > 0; --count)
+        {
+            line += words[rng() % words.size()] + " ";
+        }
+        line += "\n";
+        os << line;
+        written += line.size();
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    auto name = argc > 1 ? argv[1] : "xz";
+    size_t mib = argc > 2 ? std::stoul(argv[2]) : 64;
+    unsigned maxThreads = argc > 3 ? std::stoul(argv[3])
+                                   : std::thread::hardware_concurrency();
+
+    auto algorithm = archive::toAlgorithm(name);
+    if (!algorithm)
+    {
+        std::cerr << "Unknown or unsupported algorithm " << name << "\n";
+        return 1;
+    }
+
+    std::filesystem::remove_all(workDir);
+    std::filesystem::create_directories(workDir);
+    auto input = workDir / "journal.log";
+    writeInput(input, mib * 1024 * 1024);
+    auto inputSize = archive::tarSize(input);
+
+    std::printf("%s, %.1f MiB of input\n", name, inputSize / 1048576.0);
+    std::printf("%8s %10s %10s %10s %8s\n", "threads", "MB/s", "MB/s/core",
+                "speedup", "ratio");
+    double baseline = 0;
+    for (unsigned threads = 1; threads <= std::max(maxThreads, 1U);
+         threads *= 2)
+    {
+        auto path = workDir / "archive";
+        auto cpuStart = cpuSeconds();
+        auto start = std::chrono::steady_clock::now();
+        {
+            archive::Writer writer(path, *algorithm, nullptr, {threads, 0});
+            if (!writer.add(input, input.filename()) || !writer.commit())
+            {
+                std::cerr << "Failed to write the archive\n";
+                return 1;
+            }
+        }
+        std::chrono::duration<double> wall =
+            std::chrono::steady_clock::now() - start;
+        auto cpu = cpuSeconds() - cpuStart;
+        auto size = std::filesystem::file_size(path);
+        std::filesystem::remove(path);
+
+        auto rate = inputSize / 1e6 / wall.count();
+        baseline = baseline == 0 ? rate : baseline;
+        std::printf("%8u %10.1f %10.1f %10.2f %8.2f\n", threads, rate,
+                    inputSize / 1e6 / cpu, rate / baseline,
+                    static_cast<double>(inputSize) / size);
+    }
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
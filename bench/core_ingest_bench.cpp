@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: Apache-2.0
+// Compares the ingestion of a sparse core file by copying it into the
+// staging directory and archiving the copy, which the corefile plugin did,
+// with streaming it into the archive and skipping its holes, on synthetic
+// ELF cores of 50 to 500 MB with 5% of their pages holding data.
+//
+// usage: core_ingest_bench [xz|gzip|zstd] [core size in MB]...
+#include "dump_archive.hpp"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+const std::filesystem::path workDir = "/tmp/core_ingest_bench";
+
+constexpr size_t PAGE_SIZE = 4096;
+
+// Share of the pages of a core holding data, the rest are holes
+constexpr double DATA_SHARE = 0.05;
+
+double cpuSeconds()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** @brief Bytes passed to read(2) by this process so far */
+uint64_t bytesRead()
+{
+    std::ifstream is("/proc/self/io");
+    std::string key;
+    uint64_t value = 0;
+    while (is >> key >> value)
+    {
+        if (key == "rchar:")
+        {
+            return value;
+        }
+    }
+    return 0;
+}
+
+/** @brief Write a sparse ELF core of a size, the ELF header and one PT_LOAD
+ *         program header per 1 MiB segment, the segments hold a few runs
+ *         of heap like pages and are holes otherwise.
+ */
+void writeCore(const std::filesystem::path& path, uint64_t size)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) < 0)
+    {
+        throw std::runtime_error("Failed to create " + path.string());
+    }
+
+    constexpr uint64_t SEGMENT = 1024 * 1024;
+    auto segments = size / SEGMENT - 1;
+    Elf64_Ehdr ehdr{};
+    std::copy_n(ELFMAG, SELFMAG, ehdr.e_ident);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_CORE;
+    ehdr.e_machine = EM_ARM;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_phoff = sizeof(ehdr);
+    ehdr.e_ehsize = sizeof(ehdr);
+    ehdr.e_phentsize = sizeof(Elf64_Phdr);
+    ehdr.e_phnum = segments;
+
+    std::vector<Elf64_Phdr> phdrs(segments);
+    for (size_t i = 0; i < segments; ++i)
+    {
+        phdrs[i].p_type = PT_LOAD;
+        phdrs[i].p_offset = (i + 1) * SEGMENT;
+        phdrs[i].p_vaddr = 0x10000000 + i * SEGMENT;
+        phdrs[i].p_filesz = SEGMENT;
+        phdrs[i].p_memsz = SEGMENT;
+        phdrs[i].p_flags = PF_R | PF_W;
+    }
+    if (pwrite(fd, &ehdr, sizeof(ehdr), 0) < 0 ||
+        pwrite(fd, phdrs.data(), phdrs.size() * sizeof(Elf64_Phdr),
+               sizeof(ehdr)) < 0)
+    {
+        throw std::runtime_error("Failed to write " + path.string());
+    }
+
+    // Runs of 16 pages of pointers and small integers, which compress
+    // about as well as a heap
+    std::mt19937_64 rng(size);
+    std::vector<uint64_t> run(16 * PAGE_SIZE / sizeof(uint64_t));
+    auto runs = static_cast<uint64_t>(size * DATA_SHARE) /
+                (run.size() * sizeof(uint64_t));
+    for (uint64_t i = 0; i < runs; ++i)
+    {
+        for (auto& word : run)
+        {
+            word = rng() % 4 ? 0x10000000 + rng() % (size / 8) * 8
+                             : rng() % 256;
+        }
+        auto page = SEGMENT / PAGE_SIZE + rng() % (segments * SEGMENT /
+                                                   PAGE_SIZE - 16);
+        if (pwrite(fd, run.data(), run.size() * sizeof(uint64_t),
+                   page * PAGE_SIZE) < 0)
+        {
+            throw std::runtime_error("Failed to write " + path.string());
+        }
+    }
+    close(fd);
+}
+
+/** @brief Copy a file reading and writing every byte, as "cp -Lr" into
+ *         the staging directory did */
+bool copyDense(const std::filesystem::path& from,
+               const std::filesystem::path& to)
+{
+    int in = open(from.c_str(), O_RDONLY);
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    std::vector<char> buf(64 * 1024);
+    ssize_t count = in >= 0 && out >= 0 ? 1 : -1;
+    while (count > 0 && (count = read(in, buf.data(), buf.size())) > 0)
+    {
+        if (write(out, buf.data(), count) != count)
+        {
+            count = -1;
+            break;
+        }
+    }
+    close(in);
+    close(out);
+    return count == 0;
+}
+
+struct Sample
+{
+    double wall = 0;
+    double cpu = 0;
+    uint64_t read = 0;
+    uint64_t staged = 0;
+    uint64_t size = 0;
+};
+
+template <typename Func>
+Sample measure(const std::filesystem::path& archivePath, Func func)
+{
+    Sample sample;
+    auto readStart = bytesRead();
+    auto cpuStart = cpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+    if (!func(sample))
+    {
+        throw std::runtime_error("Failed to write the archive");
+    }
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - start;
+    sample.wall = wall.count();
+    sample.cpu = cpuSeconds() - cpuStart;
+    sample.read = bytesRead() - readStart;
+    sample.size = std::filesystem::file_size(archivePath);
+    std::filesystem::remove(archivePath);
+    return sample;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    auto name = argc > 1 ? argv[1] : "xz";
+    std::vector<uint64_t> sizes;
+    for (int i = 2; i < argc; ++i)
+    {
+        sizes.push_back(std::stoull(argv[i]));
+    }
+    if (sizes.empty())
+    {
+        sizes = {50, 100, 250, 500};
+    }
+
+    auto algorithm = archive::toAlgorithm(name);
+    if (!algorithm)
+    {
+        std::cerr << "Unknown or unsupported algorithm " << name << "\n";
+        return 1;
+    }
+
+    std::filesystem::remove_all(workDir);
+    std::filesystem::create_directories(workDir / "staging");
+    auto archivePath = workDir / "archive";
+
+    std::printf("%s, %.0f%% of the core pages holding data\n", name,
+                DATA_SHARE * 100);
+    std::printf("%6s %-8s %9s %8s %10s %10s %10s\n", "MB", "ingest", "wall s",
+                "CPU s", "read MB", "staged MB", "archive KB");
+    for (auto mb : sizes)
+    {
+        auto core = workDir / ("core." + std::to_string(mb));
+        writeCore(core, mb * 1000 * 1000);
+
+        auto copied = measure(archivePath, [&](Sample& sample) {
+            auto staged = workDir / "staging" / core.filename();
+            archive::Writer writer(archivePath, *algorithm);
+            auto added = copyDense(core, staged) &&
+                         writer.add(staged, core.filename()) &&
+                         writer.commit();
+            sample.staged = std::filesystem::file_size(staged);
+            std::filesystem::remove(staged);
+            return added;
+        });
+        auto streamed = measure(archivePath, [&](Sample&) {
+            archive::Writer writer(archivePath, *algorithm);
+            return writer.add(core, core.filename()) && writer.commit();
+        });
+
+        for (const auto& [label, sample] :
+             {std::pair{"copy", copied}, std::pair{"stream", streamed}})
+        {
+            std::printf("%6llu %-8s %9.2f %8.2f %10.1f %10.1f %10.1f\n",
+                        static_cast<unsigned long long>(mb), label,
+                        sample.wall, sample.cpu, sample.read / 1e6,
+                        sample.staged / 1e6, sample.size / 1e3);
+        }
+        std::filesystem::remove(core);
+    }
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: Apache-2.0
+// Compares the compression ratio and speed of small dumps with xz, gzip and
+// zstd, at the presets create_archive uses, with zstd using a dictionary
+// trained from other dumps.
+//
+// usage: dictionary_bench [dump directory]
+//
+// Without a directory a synthetic corpus of journal, busctl and /proc like
+// output is used. With a directory the obmcdump_* archives in it are used,
+// three quarters of them for training and the rest for the comparison.
+#include "dump_archive.hpp"
+#include "dump_dictionary.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+// Number of synthetic dumps, and the share of them used for training
+constexpr size_t SYNTHETIC_DUMPS = 64;
+constexpr size_t TRAINING_SHARE = 4;
+
+// Size of the synthetic plugin outputs
+constexpr size_t FILE_SIZE = 16 * 1024;
+
+const std::filesystem::path workDir = "/tmp/dictionary_bench";
+
+// Files of a dump, contents by name
+using Dump = std::vector<std::pair<std::string, std::string>>;
+
+double cpuMs()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/** @brief Messages shared by all the synthetic dumps, like the log
+ *         messages and property names of the BMC services are.
+ */
+const std::vector<std::string>& messages()
+{
+    static const std::vector<std::string> messages = []() {
+        std::mt19937 rng(0);
+        std::vector<std::string> words;
+        for (size_t i = 0; i < 1024; ++i)
+        {
+            std::string word;
+            for (size_t length = 4 + rng() % 12; word.size() < length;)
+            {
+                word += static_cast<char>('a' + rng() % 26);
+            }
+            words.push_back(word);
+        }
+
+        std::vector<std::string> messages;
+        for (size_t i = 0; i < 512; ++i)
+        {
+            std::string message = words[rng() % words.size()];
+            for (size_t count = 2 + rng() % 6; count > 0; --count)
+            {
+                message += " " + words[rng() % words.size()];
+            }
+            messages.push_back(message);
+        }
+        return messages;
+    }();
+    return messages;
+}
+
+/** @brief A dump resembling the output of the journal, busctl and /proc
+ *         plugins, the values differ between dumps, the messages and the
+ *         structure don't.
+ */
+Dump makeDump(size_t index)
+{
+    std::mt19937 rng(index + 1);
+    auto number = [&rng](unsigned limit) {
+        return static_cast<unsigned>(rng() % limit);
+    };
+    auto message = [&]() {
+        return messages()[number(messages().size())].c_str();
+    };
+
+    std::array<char, 512> line{};
+    auto fill = [&](auto&& format) {
+        std::string data;
+        while (data.size() < FILE_SIZE)
+        {
+            data.append(line.data(), format());
+        }
+        return data;
+    };
+
+    Dump dump;
+    dump.emplace_back("journal.json", fill([&]() {
+        return std::snprintf(
+            line.data(), line.size(),
+            "{\"__REALTIME_TIMESTAMP\":\"17921%08u\",\"PRIORITY\":\"%u\","
+            "\"_PID\":\"%u\",\"MESSAGE\":\"%s\"}\n",
+            number(100000000), number(8), number(4096), message());
+    }));
+    dump.emplace_back("inventory.log", fill([&]() {
+        return std::snprintf(
+            line.data(), line.size(),
+            "    MESSAGE \"a{sv}\" {\n        STRING \"%s\";\n"
+            "        VARIANT \"u\" {\n            UINT32 %u;\n"
+            "        };\n    };\n",
+            message(), number(100000));
+    }));
+    dump.emplace_back("meminfo.log", fill([&]() {
+        return std::snprintf(line.data(), line.size(),
+                             "%s: %8u kB\n", message(), number(1048576));
+    }));
+    return dump;
+}
+
+/** @brief Read the dumps of a directory, files are named by position */
+std::vector<Dump> readDumps(const std::filesystem::path& dir)
+{
+    std::vector<std::filesystem::path> files;
+    for (const auto& p : std::filesystem::recursive_directory_iterator(dir))
+    {
+        if (p.is_regular_file() &&
+            p.path().filename().string().starts_with("obmcdump_"))
+        {
+            files.push_back(p.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<Dump> dumps;
+    for (const auto& file : files)
+    {
+        std::vector<std::string> samples;
+        if (archive::readSamples(file, samples))
+        {
+            Dump dump;
+            for (auto& sample : samples)
+            {
+                dump.emplace_back("file" + std::to_string(dump.size()),
+                                  std::move(sample));
+            }
+            dumps.push_back(std::move(dump));
+        }
+    }
+    return dumps;
+}
+
+struct Mode
+{
+    std::string name;
+    archive::Algorithm algorithm;
+    std::shared_ptr<const archive::Dictionary> dictionary;
+    double cpuMs = 0;
+    uint64_t size = 0;
+};
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::vector<Dump> dumps;
+    if (argc > 1)
+    {
+        dumps = readDumps(argv[1]);
+    }
+    else
+    {
+        for (size_t i = 0; i < SYNTHETIC_DUMPS; ++i)
+        {
+            dumps.push_back(makeDump(i));
+        }
+    }
+
+    auto training = dumps.size() * (TRAINING_SHARE - 1) / TRAINING_SHARE;
+    if (training == 0 || training == dumps.size())
+    {
+        std::cerr << "Not enough dumps\n";
+        return 1;
+    }
+
+    std::vector<std::string> samples;
+    for (size_t i = 0; i < training; ++i)
+    {
+        for (const auto& [name, contents] : dumps[i])
+        {
+            samples.push_back(contents.substr(0, archive::MAX_SAMPLE_SIZE));
+        }
+    }
+    auto start = cpuMs();
+    auto trained = archive::trainDictionary(
+        samples, archive::DEFAULT_DICTIONARY_SIZE, 0);
+    if (trained.empty())
+    {
+        std::cerr << "Dictionary training failed\n";
+        return 1;
+    }
+    auto dictionary = std::make_shared<const archive::Dictionary>(trained);
+    std::printf("Dictionary trained from %zu dumps in %.0f ms\n", training,
+                cpuMs() - start);
+
+    std::vector<Mode> modes;
+    for (const auto* name : {"xz", "gzip", "zstd"})
+    {
+        if (auto algorithm = archive::toAlgorithm(name); algorithm)
+        {
+            modes.push_back({name, *algorithm, nullptr});
+        }
+    }
+    modes.push_back({"zstd+dict", archive::Algorithm::zstd, dictionary});
+
+    std::filesystem::remove_all(workDir);
+    uint64_t input = 0;
+    for (size_t i = training; i < dumps.size(); ++i)
+    {
+        auto dir = workDir / ("obmcdump_" + std::to_string(i));
+        std::filesystem::create_directories(dir);
+        for (const auto& [name, contents] : dumps[i])
+        {
+            std::ofstream(dir / name) << contents;
+        }
+        input += archive::tarSize(dir);
+
+        for (auto& mode : modes)
+        {
+            auto path = workDir / "archive";
+            start = cpuMs();
+            {
+                archive::Writer writer(path, mode.algorithm, mode.dictionary);
+                writer.add(dir, dir.filename());
+                writer.commit();
+            }
+            mode.cpuMs += cpuMs() - start;
+            mode.size += std::filesystem::file_size(path);
+            std::filesystem::remove(path);
+        }
+        std::filesystem::remove_all(dir);
+    }
+    std::filesystem::remove_all(workDir);
+
+    std::printf("%zu dumps, %.1f KiB of tar per dump\n",
+                dumps.size() - training,
+                input / 1024.0 / (dumps.size() - training));
+    std::printf("%10s %14s %8s %10s\n", "mode", "KiB per dump", "ratio",
+                "MB/s");
+    for (const auto& mode : modes)
+    {
+        std::printf("%10s %14.1f %8.2f %10.1f\n", mode.name.c_str(),
+                    mode.size / 1024.0 / (dumps.size() - training),
+                    static_cast<double>(input) / mode.size,
+                    input / 1e3 / mode.cpuMs);
+    }
+    return 0;
+}
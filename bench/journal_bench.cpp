@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: Apache-2.0
+// Compares the native journal collector with the journalctl commands of the
+// journalpretty and journalpid plugins, in wall-clock and CPU time and in
+// the size of the output before and after the compression.
+//
+// usage: journal_bench [entries] [journal directory] [pid] [unit]
+//
+// Without a directory a journal of the given number of entries (default
+// 300000) is generated with systemd-journal-remote, the pid and unit
+// filters default to a process and unit of the generated journal.
+#include "dump_archive.hpp"
+#include "dump_journal.hpp"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+const std::filesystem::path workDir = "/tmp/journal_bench";
+
+// Output share of the journal with the default 200 KiB dump limit
+constexpr uint64_t BUDGET = 200 * 1024 * 25 / 100 * 6;
+
+// pid of a process of the generated journal
+constexpr unsigned BENCH_PID = 1042;
+
+double cpuSeconds(int who)
+{
+    rusage usage{};
+    getrusage(who, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/** @brief Generate a journal with the given number of entries, the entries
+ *         are spread over the last day.
+ *  @return false if systemd-journal-remote is not available.
+ */
+bool generate(const std::filesystem::path& dir, size_t entries)
+{
+    std::filesystem::path remote;
+    for (const auto* p : {"/usr/lib/systemd/systemd-journal-remote",
+                          "/lib/systemd/systemd-journal-remote"})
+    {
+        if (access(p, X_OK) == 0)
+        {
+            remote = p;
+            break;
+        }
+    }
+    if (remote.empty())
+    {
+        return false;
+    }
+
+    auto command = remote.string() + " --output=" +
+                   (dir / "remote.journal").string() + " - 2>/dev/null";
+    auto* pipe = popen(command.c_str(), "w");
+    if (pipe == nullptr)
+    {
+        return false;
+    }
+
+    std::mt19937 rng(0);
+    std::vector<std::string> words;
+    for (size_t i = 0; i < 2048; ++i)
+    {
+        std::string word;
+        for (size_t length = 3 + rng() % 10; word.size() < length;)
+        {
+            word += static_cast<char>('a' + rng() % 26);
+        }
+        words.push_back(word);
+    }
+
+    auto now = std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count();
+    uint64_t step = 86400ULL * 1000000 / entries;
+    for (size_t i = 0; i < entries; ++i)
+    {
+        auto service = rng() % 64;
+        std::string message;
+        for (size_t count = 4 + rng() % 12; count > 0; --count)
+        {
+            message += words[rng() % words.size()] + " ";
+        }
+        std::fprintf(
+            pipe,
+            "__REALTIME_TIMESTAMP=%llu\n__MONOTONIC_TIMESTAMP=%llu\n"
+            "_BOOT_ID=0123456789abcdef0123456789abcdef\n"
+            "_HOSTNAME=bmc\n_PID=%u\n_COMM=service%u\n"
+            "_SYSTEMD_UNIT=service%u.service\nSYSLOG_IDENTIFIER=service%u\n"
+            "PRIORITY=%u\nCODE_FILE=service.cpp\nCODE_LINE=%u\n"
+            "MESSAGE=%s\nSENSOR=sensor%u\n\n",
+            static_cast<unsigned long long>(now - (entries - i) * step),
+            static_cast<unsigned long long>(i * step),
+            service == 0 ? BENCH_PID : 1000 + static_cast<unsigned>(service),
+            static_cast<unsigned>(service), static_cast<unsigned>(service),
+            static_cast<unsigned>(service),
+            static_cast<unsigned>(3 + rng() % 5),
+            static_cast<unsigned>(rng() % 1000), message.c_str(),
+            static_cast<unsigned>(rng() % 128));
+    }
+    return pclose(pipe) == 0;
+}
+
+/** @brief Size of a file compressed into a dump archive */
+uint64_t compressedSize(const std::filesystem::path& file)
+{
+    archive::Writer writer(archive::Algorithm::xz, nullptr);
+    if (!writer.add(file, file.filename()))
+    {
+        return 0;
+    }
+    auto data = writer.take();
+    return data ? data->size() : 0;
+}
+
+/** @brief Run a case and print its line */
+template <typename Run>
+void measure(const std::string& name, Run run)
+{
+    auto file = workDir / "output.log";
+    auto cpuStart = cpuSeconds(RUSAGE_SELF) + cpuSeconds(RUSAGE_CHILDREN);
+    auto start = std::chrono::steady_clock::now();
+    auto entries = run(file);
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - start;
+    auto cpu = cpuSeconds(RUSAGE_SELF) + cpuSeconds(RUSAGE_CHILDREN) -
+               cpuStart;
+
+    std::error_code ec;
+    auto size = std::filesystem::file_size(file, ec);
+    std::printf("%-34s %8.2f %8.2f %10.2f %10.3f %8s\n", name.c_str(),
+                wall.count(), cpu, size / 1048576.0,
+                compressedSize(file) / 1048576.0,
+                entries.empty() ? "-" : entries.c_str());
+    std::filesystem::remove(file, ec);
+}
+
+/** @brief Run journalctl on the journal directory */
+auto journalctl(const std::filesystem::path& dir, const std::string& args)
+{
+    return [=](const std::filesystem::path& file) {
+        auto command = "journalctl -q -D " + dir.string() + " " + args +
+                       " > " + file.string() + " 2>/dev/null";
+        if (std::system(command.c_str()) != 0)
+        {
+            std::cerr << "Failed to run " << command << "\n";
+        }
+        return std::string();
+    };
+}
+
+/** @brief Run the native collector on the journal directory */
+auto native(const std::filesystem::path& dir, const journal::Filter& filter)
+{
+    return [=](const std::filesystem::path& file) {
+        journal::Extractor extractor(dir);
+        int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0644);
+        auto extract = extractor.write(fd, filter);
+        close(fd);
+        return std::to_string(extract.entries);
+    };
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    size_t entries = argc > 1 ? std::stoul(argv[1]) : 300000;
+    std::filesystem::path dir = argc > 2 ? argv[2] : "";
+    std::string pid = argc > 3 ? argv[3] : std::to_string(BENCH_PID);
+    std::string unit = argc > 4 ? argv[4] : "service1.service";
+
+    std::filesystem::remove_all(workDir);
+    std::filesystem::create_directories(workDir);
+    if (dir.empty())
+    {
+        dir = workDir / "journal";
+        std::filesystem::create_directories(dir);
+        if (!generate(dir, entries))
+        {
+            std::cerr << "systemd-journal-remote is needed to generate the "
+                         "journal, pass a journal directory instead\n";
+            std::filesystem::remove_all(workDir);
+            return 77;
+        }
+        std::printf("Generated %zu entries\n", entries);
+    }
+
+    std::printf("%-34s %8s %8s %10s %10s %8s\n", "case", "wall s", "cpu s",
+                "output MiB", "xz MiB", "entries");
+
+    measure("journalctl -o json-pretty -r",
+            journalctl(dir, "-o json-pretty -r"));
+    measure("native, whole journal", native(dir, {}));
+
+    journal::Filter budget;
+    budget.maxBytes = BUDGET;
+    measure("native, 25% of a 200 KiB dump", native(dir, budget));
+
+    journal::Filter window;
+    window.window = std::chrono::hours(1);
+    measure("native, last hour", native(dir, window));
+
+    measure("journalctl -o verbose _PID=" + pid,
+            journalctl(dir, "-o verbose _PID=" + pid));
+    journal::Filter byPid;
+    byPid.pid = std::stoi(pid);
+    measure("native, _PID=" + pid, native(dir, byPid));
+
+    journal::Filter byUnit;
+    byUnit.units = {unit};
+    byUnit.maxBytes = BUDGET;
+    measure("native, " + unit, native(dir, byUnit));
+
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
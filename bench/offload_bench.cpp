@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: Apache-2.0
+// Compares the offload of a dump read into a buffer of its size and then
+// written to the socket, which requestOffload did, with streaming it to the
+// socket with sendfile, in MB/s and in peak RSS of the sending process.
+//
+// usage: offload_bench [dump size in MiB]...
+#include "dump_transfer.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+const std::filesystem::path workDir = "/tmp/offload_bench";
+
+/** @brief Write an incompressible file, as a compressed dump is */
+void writeDump(const std::filesystem::path& path, uint64_t size)
+{
+    std::mt19937_64 rng(size);
+    std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    for (uint64_t done = 0; fd >= 0 && done < size;)
+    {
+        for (auto& word : block)
+        {
+            word = rng();
+        }
+        auto count = std::min<uint64_t>(size - done,
+                                        block.size() * sizeof(uint64_t));
+        if (write(fd, block.data(), count) != static_cast<ssize_t>(count))
+        {
+            break;
+        }
+        done += count;
+    }
+    close(fd);
+}
+
+/** @brief Wait until a socket takes more data */
+void waitWritable(int socket)
+{
+    struct pollfd state{};
+    state.fd = socket;
+    state.events = POLLOUT;
+    if (poll(&state, 1, transfer::SOCKET_TIMEOUT * 1000) <= 0)
+    {
+        throw std::runtime_error("poll() on the socket failed");
+    }
+}
+
+/** @brief Write a buffer to a non-blocking socket */
+void send(int socket, const void* data, uint64_t size)
+{
+    const auto* bytes = static_cast<const char*>(data);
+    for (uint64_t done = 0; done < size;)
+    {
+        auto count = transfer::sendSome(socket, bytes + done, size - done);
+        if (count == 0)
+        {
+            waitWritable(socket);
+        }
+        done += count;
+    }
+}
+
+/** @brief Send a range of a file to a non-blocking socket with sendfile */
+void sendFile(int socket, int fd, uint64_t offset, uint64_t size)
+{
+    for (uint64_t done = 0; done < size;)
+    {
+        auto count =
+            transfer::sendFileSome(socket, fd, offset + done, size - done);
+        if (count == 0)
+        {
+            waitWritable(socket);
+        }
+        done += count;
+    }
+}
+
+/** @brief The previous offload, the whole dump read into memory */
+void sendBuffered(int socket, int fd, uint64_t size)
+{
+    std::unique_ptr<char[]> buffer(new char[size]);
+    for (uint64_t done = 0; done < size;)
+    {
+        auto count = pread(fd, buffer.get() + done, size - done, done);
+        if (count <= 0)
+        {
+            throw std::runtime_error("read() failed");
+        }
+        done += count;
+    }
+    send(socket, buffer.get(), size);
+}
+
+struct Sample
+{
+    double seconds = 0;
+    long peakKiB = 0;
+};
+
+/** @brief Offload a dump from a child process to a reader in this one, the
+ *         peak RSS is the one of the child.
+ */
+template <typename Func>
+Sample offload(const std::filesystem::path& dump, Func func)
+{
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0)
+    {
+        throw std::runtime_error("socketpair() failed");
+    }
+    auto size = std::filesystem::file_size(dump);
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(sockets[0]);
+        fcntl(sockets[1], F_SETFL, O_NONBLOCK);
+        int fd = open(dump.c_str(), O_RDONLY);
+        try
+        {
+            func(sockets[1], fd, size);
+        }
+        catch (const std::exception&)
+        {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    close(sockets[1]);
+
+    std::vector<char> buf(256 * 1024);
+    uint64_t received = 0;
+    ssize_t count = 0;
+    while ((count = read(sockets[0], buf.data(), buf.size())) > 0)
+    {
+        received += count;
+    }
+    close(sockets[0]);
+
+    int status = 0;
+    struct rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || received != size)
+    {
+        throw std::runtime_error("Offload failed");
+    }
+    return {wall.count(), usage.ru_maxrss};
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::vector<uint64_t> sizes;
+    for (int i = 1; i < argc; ++i)
+    {
+        sizes.push_back(std::stoull(argv[i]));
+    }
+    if (sizes.empty())
+    {
+        sizes = {16, 64, 256, 1024};
+    }
+
+    std::filesystem::remove_all(workDir);
+    std::filesystem::create_directories(workDir);
+
+    std::printf("%8s %-9s %10s %14s\n", "MiB", "offload", "MB/s",
+                "peak RSS KiB");
+    for (auto mib : sizes)
+    {
+        auto dump = workDir / ("dump." + std::to_string(mib));
+        writeDump(dump, mib * 1024 * 1024);
+
+        // Both read the dump from the page cache
+        auto buffered = offload(dump, sendBuffered);
+        auto streamed = offload(dump, [](int socket, int fd, uint64_t size) {
+            sendFile(socket, fd, 0, size);
+        });
+        for (const auto& [label, sample] :
+             {std::pair{"buffered", buffered}, std::pair{"sendfile", streamed}})
+        {
+            std::printf("%8llu %-9s %10.1f %14ld\n",
+                        static_cast<unsigned long long>(mib), label,
+                        mib * 1.048576 / sample.seconds, sample.peakKiB);
+        }
+        std::filesystem::remove(dump);
+    }
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
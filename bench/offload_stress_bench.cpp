@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: Apache-2.0
+// Offloads different dumps to several unix socket readers at once, each
+// through its own offload::Session on one sd_event loop, and reports the
+// aggregate throughput against the offloads run one after the other. The
+// content each reader receives is checked against its dump, and one more
+// session than BMC_DUMP_MAX_OFFLOADS is checked to be refused.
+//
+// usage: offload_stress_bench [dump size in MiB] [sessions]
+#include "config.h"
+
+#include "dump_offload.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <sdeventplus/event.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+const std::filesystem::path workDir = "/tmp/offload_stress_bench";
+
+/** @brief FNV-1a of a buffer, continued from a previous hash */
+uint64_t fnv(uint64_t hash, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 0x100000001b3;
+    }
+    return hash;
+}
+
+constexpr uint64_t FNV_BASIS = 0xcbf29ce484222325;
+
+/** @brief Write an incompressible dump, the hash of its content */
+uint64_t writeDump(const std::filesystem::path& path, uint64_t size)
+{
+    std::mt19937_64 rng(std::hash<std::string>{}(path.string()));
+    std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+    uint64_t hash = FNV_BASIS;
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    for (uint64_t done = 0; fd >= 0 && done < size;)
+    {
+        for (auto& word : block)
+        {
+            word = rng();
+        }
+        auto count = std::min<uint64_t>(size - done,
+                                        block.size() * sizeof(uint64_t));
+        auto data = reinterpret_cast<const char*>(block.data());
+        if (write(fd, data, count) != static_cast<ssize_t>(count))
+        {
+            throw std::runtime_error("Failed to write " + path.string());
+        }
+        hash = fnv(hash, data, count);
+        done += count;
+    }
+    close(fd);
+    return hash;
+}
+
+/** @brief Connect to the socket of a session and read until the end of
+ *         the offload, as the Redfish front end does.
+ *  @return The hash of what was read.
+ */
+uint64_t readOffload(const std::string& socketPath, uint64_t& received)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    if (fd < 0 ||
+        connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) <
+            0)
+    {
+        throw std::runtime_error("Failed to connect to " + socketPath);
+    }
+
+    std::vector<char> buf(256 * 1024);
+    uint64_t hash = FNV_BASIS;
+    ssize_t count = 0;
+    while ((count = read(fd, buf.data(), buf.size())) > 0)
+    {
+        hash = fnv(hash, buf.data(), count);
+        received += count;
+    }
+    close(fd);
+    return hash;
+}
+
+struct Dump
+{
+    std::filesystem::path file;
+    uint64_t hash = 0;
+};
+
+/** @brief Offload dumps in rounds of a number of concurrent sessions.
+ *  @return Seconds taken.
+ */
+double offloadAll(const std::vector<Dump>& dumps, size_t concurrent)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t first = 0; first < dumps.size(); first += concurrent)
+    {
+        // A loop which exited doesn't run again
+        auto event = sdeventplus::Event::get_new();
+        auto count = std::min(concurrent, dumps.size() - first);
+        std::map<size_t, std::unique_ptr<offload::Session>> sessions;
+        size_t finished = 0;
+        size_t failed = 0;
+        for (size_t i = first; i < first + count; ++i)
+        {
+            offload::Target target;
+            target.path = workDir / ("socket." + std::to_string(i));
+            sessions.emplace(
+                i, std::make_unique<offload::Session>(
+                       event, dumps[i].file, i, target, "",
+                       [&, i](const offload::Result& result) {
+                           failed += !result.sent;
+                           sessions.erase(i);
+                           if (++finished == count)
+                           {
+                               event.exit(0);
+                           }
+                       }));
+        }
+
+        if (offload::Session::inProgress() ==
+            static_cast<size_t>(BMC_DUMP_MAX_OFFLOADS))
+        {
+            bool refused = false;
+            try
+            {
+                offload::Target target;
+                target.path = workDir / "socket.extra";
+                offload::Session extra(event, dumps[first].file, 0, target, "",
+                                       [](const offload::Result&) {});
+            }
+            catch (const std::exception&)
+            {
+                refused = true;
+            }
+            if (!refused)
+            {
+                throw std::runtime_error("An offload over the limit started");
+            }
+        }
+
+        std::atomic<size_t> mismatches = 0;
+        std::vector<std::thread> readers;
+        for (size_t i = first; i < first + count; ++i)
+        {
+            readers.emplace_back([&, i] {
+                uint64_t received = 0;
+                auto socketPath = workDir / ("socket." + std::to_string(i));
+                try
+                {
+                    if (readOffload(socketPath, received) == dumps[i].hash &&
+                        received == std::filesystem::file_size(dumps[i].file))
+                    {
+                        return;
+                    }
+                }
+                catch (const std::exception&)
+                {}
+                ++mismatches;
+            });
+        }
+        event.loop();
+        for (auto& reader : readers)
+        {
+            reader.join();
+        }
+        if (failed != 0 || mismatches != 0)
+        {
+            throw std::runtime_error("Offload failed");
+        }
+    }
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - start;
+    return wall.count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    uint64_t mib = argc > 1 ? std::stoull(argv[1]) : 256;
+    size_t count = argc > 2 ? std::stoull(argv[2]) : BMC_DUMP_MAX_OFFLOADS;
+    count = std::clamp<size_t>(count, 1, BMC_DUMP_MAX_OFFLOADS);
+
+    std::filesystem::remove_all(workDir);
+    std::filesystem::create_directories(workDir);
+
+    std::vector<Dump> dumps;
+    for (size_t i = 0; i < count; ++i)
+    {
+        Dump dump;
+        dump.file = workDir / ("dump." + std::to_string(i));
+        dump.hash = writeDump(dump.file, mib * 1024 * 1024);
+        dumps.push_back(dump);
+    }
+
+    std::printf("%zu dumps of %llu MiB\n", count,
+                static_cast<unsigned long long>(mib));
+    std::printf("%-12s %10s %14s\n", "offloads", "wall s", "aggregate MB/s");
+    for (auto concurrent : {size_t(1), count})
+    {
+        // Both read the dumps from the page cache
+        auto seconds = offloadAll(dumps, concurrent);
+        std::printf("%-12s %10.2f %14.1f\n",
+                    concurrent == 1 ? "sequential" : "concurrent", seconds,
+                    count * mib * 1.048576 / seconds);
+    }
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: Apache-2.0
+// Compares the rotation of getAllowedSize, which looked for the first dump
+// without delta dumps from the start of the entries once per victim, with
+// the eviction order of rotation::Index, on synthetic dumps.
+//
+// usage: rotation_bench [share of the dump space to free in percent]
+#include "dump_rotation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+// Every DELTA_EVERY-th dump is a baseline with the next dumps as deltas
+constexpr uint32_t DELTA_EVERY = 8;
+
+struct Dump
+{
+    uint32_t baselineId;
+    uint64_t size;
+};
+
+/** @brief Synthetic dumps of 100 KiB to 2 MiB */
+std::map<uint32_t, Dump> makeDumps(uint32_t count)
+{
+    std::mt19937 rng(count);
+    std::uniform_int_distribution<uint64_t> size(100, 2048);
+    std::map<uint32_t, Dump> dumps;
+    for (uint32_t id = 1; id <= count; ++id)
+    {
+        uint32_t base = id - (id - 1) % DELTA_EVERY;
+        dumps.emplace(id, Dump{base == id ? 0 : base, size(rng)});
+    }
+    return dumps;
+}
+
+/** @brief The rotation loop before the index, in microseconds */
+double linear(std::map<uint32_t, Dump> dumps, uint64_t needed, size_t& evicted)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto getDeltas = [&dumps](uint32_t baselineId) {
+        std::vector<uint32_t> deltas;
+        for (const auto& [id, dump] : dumps)
+        {
+            if (dump.baselineId == baselineId)
+            {
+                deltas.push_back(id);
+            }
+        }
+        return deltas;
+    };
+
+    uint64_t freed = 0;
+    evicted = 0;
+    while (freed < needed)
+    {
+        auto victim =
+            std::find_if(dumps.begin(), dumps.end(), [&](const auto& d) {
+                return getDeltas(d.first).empty();
+            });
+        if (victim == dumps.end())
+        {
+            break;
+        }
+        // Entry::delete_ checks for delta dumps of the victim again
+        getDeltas(victim->first);
+        freed += victim->second.size;
+        dumps.erase(victim);
+        ++evicted;
+    }
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+/** @brief Eviction through the index, in microseconds */
+double indexed(rotation::Index& index, uint64_t needed, size_t& evicted)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto victims = index.select(needed);
+    for (auto id : victims)
+    {
+        index.erase(id);
+    }
+    evicted = victims.size();
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    double share = argc > 1 ? std::atof(argv[1]) / 100 : 0.1;
+    std::vector<rotation::Criterion> policy = {rotation::Criterion::offloaded,
+                                               rotation::Criterion::oldest};
+
+    std::printf("evicting %.0f%% of the dump space, policy offloaded,oldest\n",
+                share * 100);
+    std::printf("%8s %8s %14s %14s %12s\n", "dumps", "victims", "linear us",
+                "index us", "update us");
+    for (uint32_t count : {1000, 4000, 16000})
+    {
+        auto dumps = makeDumps(count);
+        uint64_t total = 0;
+        for (const auto& [id, dump] : dumps)
+        {
+            total += dump.size;
+        }
+        uint64_t needed = total * share;
+
+        size_t linearEvicted = 0;
+        auto linearTime = linear(dumps, needed, linearEvicted);
+
+        rotation::Index index(policy);
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& [id, dump] : dumps)
+        {
+            rotation::Candidate candidate;
+            candidate.id = id;
+            candidate.timestamp = id;
+            candidate.size = dump.size;
+            candidate.baselineId = dump.baselineId;
+            index.insert(candidate);
+        }
+        auto updateTime = std::chrono::duration<double, std::micro>(
+                              std::chrono::steady_clock::now() - start)
+                              .count() /
+                          count;
+
+        size_t indexEvicted = 0;
+        auto indexTime = indexed(index, needed, indexEvicted);
+
+        std::printf("%8u %8zu %14.0f %14.0f %12.2f\n", count, indexEvicted,
+                    linearTime, indexTime, updateTime);
+        if (linearEvicted != indexEvicted)
+        {
+            std::printf("  linear rotation evicted %zu dumps\n",
+                        linearEvicted);
+        }
+    }
+    return 0;
+}
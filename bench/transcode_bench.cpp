@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: Apache-2.0
+// Offloads an xz dump archive as stored and recompressed to zstd and gzip
+// while it is sent, pinned to one CPU as on a BMC, and reports the rate
+// the client receives the archive at, the rate of the dump contents, the
+// CPU time and the size of the offloaded archive. The tar stream of every
+// offloaded archive is checked against the one of the dump.
+//
+// usage: transcode_bench [dump contents in MiB]
+#include "config.h"
+
+#include "dump_archive.hpp"
+#include "dump_offload.hpp"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <sdeventplus/event.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace phosphor::dump;
+
+namespace
+{
+
+const std::filesystem::path workDir = "/tmp/transcode_bench";
+
+double cpuSeconds()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** @brief Write the contents of a dump, journal like logs and a few binary
+ *         files, about a size.
+ */
+void writeContents(const std::filesystem::path& dir, uint64_t size)
+{
+    std::filesystem::create_directories(dir);
+    std::mt19937_64 rng(size);
+    const char* units[] = {"phosphor-dump-manager", "bmcweb", "ipmid",
+                           "phosphor-fan-control", "xyz.openbmc_project.State"};
+    const char* messages[] = {"Sensor reading out of range",
+                              "Property changed", "Request completed",
+                              "Fan speed adjusted", "Host state transition"};
+
+    std::ofstream log(dir / "journal.log");
+    uint64_t written = 0;
+    for (uint64_t line = 0; written < size * 3 / 4; ++line)
+    {
+        char buf[256];
+        auto count = std::snprintf(
+            buf, sizeof(buf), "Oct 17 %02llu:%02llu:%02llu bmc %s[%llu]: %s "
+            "id=%llu value=%llu\n",
+            static_cast<unsigned long long>(line / 3600 % 24),
+            static_cast<unsigned long long>(line / 60 % 60),
+            static_cast<unsigned long long>(line % 60), units[rng() % 5],
+            static_cast<unsigned long long>(rng() % 4000),
+            messages[rng() % 5], static_cast<unsigned long long>(rng() % 100),
+            static_cast<unsigned long long>(rng() % 100000));
+        log.write(buf, count);
+        written += count;
+    }
+
+    // Memory like data, pointers and small integers
+    std::ofstream bin(dir / "memory.bin", std::ios::binary);
+    std::vector<uint64_t> block(64 * 1024);
+    for (; written < size; written += block.size() * sizeof(uint64_t))
+    {
+        for (auto& word : block)
+        {
+            word = rng() % 4 ? 0x10000000 + rng() % 65536 * 8 : rng() % 256;
+        }
+        bin.write(reinterpret_cast<const char*>(block.data()),
+                  block.size() * sizeof(uint64_t));
+    }
+}
+
+/** @brief The decompressed tar stream of an archive */
+std::vector<uint8_t> tarStream(const std::filesystem::path& archive)
+{
+    archive::Reader reader(archive);
+    std::vector<uint8_t> stream;
+    std::vector<uint8_t> buf(256 * 1024);
+    ssize_t count = 0;
+    while ((count = reader.readStream(buf.data(), buf.size())) > 0)
+    {
+        stream.insert(stream.end(), buf.begin(), buf.begin() + count);
+    }
+    if (count < 0)
+    {
+        throw std::runtime_error("Failed to read " + archive.string());
+    }
+    return stream;
+}
+
+/** @brief Read an offload into a file, as the Redfish front end does */
+void receive(const std::string& socketPath, const std::filesystem::path& to)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    std::ofstream out(to, std::ios::binary);
+    if (fd < 0 ||
+        connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) <
+            0)
+    {
+        throw std::runtime_error("Failed to connect to " + socketPath);
+    }
+    std::vector<char> buf(256 * 1024);
+    ssize_t count = 0;
+    while ((count = read(fd, buf.data(), buf.size())) > 0)
+    {
+        out.write(buf.data(), count);
+    }
+    close(fd);
+}
+
+struct Sample
+{
+    double wall = 0;
+    double cpu = 0;
+    uint64_t size = 0;
+};
+
+/** @brief Offload an archive in an algorithm, std::nullopt as stored */
+Sample offloadAs(const std::filesystem::path& dump,
+                 std::optional<archive::Algorithm> codec,
+                 const std::filesystem::path& received)
+{
+    auto event = sdeventplus::Event::get_new();
+    offload::Target target;
+    target.path = workDir / "socket";
+    target.codec = codec;
+
+    bool sent = false;
+    auto cpuStart = cpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<offload::Session> session;
+    session = std::make_unique<offload::Session>(
+        event, dump, 1, target, "", [&](const offload::Result& result) {
+            sent = result.complete;
+            session.reset();
+            event.exit(0);
+        });
+    std::thread client([&] { receive(target.path, received); });
+    event.loop();
+    client.join();
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - start;
+    if (!sent)
+    {
+        throw std::runtime_error("Offload failed");
+    }
+    return {wall.count(), cpuSeconds() - cpuStart,
+            std::filesystem::file_size(received)};
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    uint64_t mib = argc > 1 ? std::stoull(argv[1]) : 64;
+
+    // A client closing its socket fails the write, as in the dump manager
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+
+    // One CPU, as on a BMC, the client and the recompression share it
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(sched_getcpu(), &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+
+    auto xz = archive::toAlgorithm("xz");
+    if (!xz)
+    {
+        std::fprintf(stderr, "xz is not built in\n");
+        return 1;
+    }
+
+    std::filesystem::remove_all(workDir);
+    writeContents(workDir / "contents", mib * 1024 * 1024);
+    auto dump = workDir / "dump.tar.xz";
+    {
+        archive::Writer writer(dump, *xz);
+        if (!writer.add(workDir / "contents", "contents") || !writer.commit())
+        {
+            std::fprintf(stderr, "Failed to write the dump\n");
+            return 1;
+        }
+    }
+    std::filesystem::remove_all(workDir / "contents");
+    auto stream = tarStream(dump);
+
+    std::printf("xz dump of %.1f MB, %.1f MB of tar stream, on one CPU\n",
+                std::filesystem::file_size(dump) / 1e6, stream.size() / 1e6);
+    std::printf("%-10s %8s %8s %12s %14s %10s\n", "offload", "wall s",
+                "CPU s", "sent MB/s", "contents MB/s", "sent MB");
+    for (const auto& name : {"xz", "zstd", "gzip"})
+    {
+        auto codec = archive::toAlgorithm(name);
+        if (!codec)
+        {
+            continue;
+        }
+        auto received = workDir / ("received." + archive::extension(*codec));
+        auto sample = offloadAs(dump, codec, received);
+        if (tarStream(received) != stream)
+        {
+            std::fprintf(stderr, "The %s offload differs from the dump\n",
+                         name);
+            return 1;
+        }
+        std::printf("%-10s %8.2f %8.2f %12.1f %14.1f %10.1f\n",
+                    *codec == *xz ? "as stored" : name, sample.wall,
+                    sample.cpu, sample.size / 1e6 / sample.wall,
+                    stream.size() / 1e6 / sample.wall, sample.size / 1e6);
+        std::filesystem::remove(received);
+    }
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
@@ -1,10 +1,14 @@
 #include "bmc_dump_entry.hpp"
 
+#include "dump_chunk.hpp"
 #include "dump_manager.hpp"
 #include "dump_offload.hpp"
 #include "dump_utils.hpp"
 
+#include <phosphor-logging/elog-errors.hpp>
+#include <phosphor-logging/elog.hpp>
 #include <phosphor-logging/lg2.hpp>
+#include <xyz/openbmc_project/Common/error.hpp>
 
 namespace phosphor
 {
@@ -13,27 +17,104 @@ namespace dump
 namespace bmc
 {
 
+using namespace phosphor::logging;
+
 void Entry::delete_()
 {
-    // Delete Dump file from Permanent location
-    try
-    {
-        std::filesystem::remove_all(file.parent_path());
-    }
-    catch (const std::filesystem::filesystem_error& e)
+    // The unchanged items of delta dumps are read from this dump
+    if (auto deltas = parent.getDeltas(id); !deltas.empty())
     {
-        // Log Error message and continue
-        lg2::error("Failed to delete dump file, errormsg: {ERROR}", "ERROR", e);
+        using NotAllowed =
+            sdbusplus::xyz::openbmc_project::Common::Error::NotAllowed;
+        using Reason = xyz::openbmc_project::Common::NotAllowed::REASON;
+        lg2::error("Dump {ID} is the baseline of {COUNT} delta dumps, "
+                   "delete them first",
+                   "ID", id, "COUNT", deltas.size());
+        elog<NotAllowed>(
+            Reason("The dump is the baseline of delta dumps, delete them "
+                   "first"));
     }
 
-    // Remove Dump entry D-bus object
+    // Remove Dump entry D-bus object, the manager removes the dump
+    // directory in the background
     phosphor::dump::Entry::delete_();
 }
 
 void Entry::initiateOffload(std::string uri)
 {
-    phosphor::dump::offload::requestOffload(file, id, uri);
-    offloaded(true);
+    parent.offloadStarted(id);
+
+    // A delta dump is offloaded complete, with the items of its baseline
+    std::filesystem::path baseline;
+    if (baselineId != 0)
+    {
+        baseline = parent.getDumpFile(baselineId);
+        if (baseline.empty())
+        {
+            lg2::error("Baseline {BASELINE} of dump {ID} is not available",
+                       "BASELINE", baselineId, "ID", id);
+            elog<sdbusplus::xyz::openbmc_project::Common::Error::Unavailable>();
+        }
+    }
+
+    // One offload at a time goes through the socket of an entry
+    if (offloadSession)
+    {
+        using NotAllowed =
+            sdbusplus::xyz::openbmc_project::Common::Error::NotAllowed;
+        using Reason = xyz::openbmc_project::Common::NotAllowed::REASON;
+        lg2::error("Dump {ID} is already being offloaded", "ID", id);
+        elog<NotAllowed>(Reason("An offload of the dump is in progress"));
+    }
+
+    // The URI may ask for a range of the dump, to resume an offload, and
+    // for another compression algorithm
+    auto target = phosphor::dump::offload::parseUri(uri);
+    if (!target)
+    {
+        using InvalidArgument =
+            sdbusplus::xyz::openbmc_project::Common::Error::InvalidArgument;
+        using Argument = xyz::openbmc_project::Common::InvalidArgument;
+        lg2::error("Invalid offload URI {URI} of dump {ID}", "URI", uri, "ID",
+                   id);
+        elog<InvalidArgument>(Argument::ARGUMENT_NAME("URI"),
+                              Argument::ARGUMENT_VALUE(uri.c_str()));
+    }
+
+    // The client has the stream from its start up to the offset, if it
+    // reads from 0 or resumes where an offload from 0 was interrupted
+    auto fromStart = target->range.offset == 0 ||
+                     (resumable &&
+                      resumable->range.offset == target->range.offset &&
+                      resumable->codec == target->codec);
+
+    // The offload proceeds from the event loop, the method returns once
+    // the socket is listened on
+    offloadSession = std::make_unique<phosphor::dump::offload::Session>(
+        sdeventplus::Event::get_default(), file, id, *target, baseline,
+        [this, request = *target,
+         fromStart](const phosphor::dump::offload::Result& result) {
+            if (result.complete && fromStart)
+            {
+                resumable.reset();
+                offloaded(true);
+                serialize();
+            }
+            else if (!result.sent)
+            {
+                // A reconnecting client resumes from the URI it reads
+                // back, once it dropped what it has past the offset
+                auto rest = request;
+                rest.range = result.rest;
+                offloadUri(phosphor::dump::offload::makeUri(rest));
+                if (fromStart)
+                {
+                    resumable = rest;
+                }
+            }
+            offloadSession.reset();
+        });
+    offloadUri(uri);
 }
 
 void Entry::updateFromFile(const std::filesystem::path& dumpPath)
@@ -61,7 +142,8 @@ void Entry::updateFromFile(const std::filesystem::path& dumpPath)
     startTime(extractedTimestamp);
     elapsed(extractedTimestamp);
     completedTime(extractedTimestamp);
-    size(extractedSize);
+    size(chunk::isRecipe(dumpPath) ? chunk::archiveSize(dumpPath)
+                                   : extractedSize);
     status(OperationStatus::Completed);
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "dump_entry.hpp"
+#include "dump_offload.hpp"
 #include "xyz/openbmc_project/Dump/Entry/BMC/server.hpp"
 #include "xyz/openbmc_project/Dump/Entry/server.hpp"
 #include "xyz/openbmc_project/Object/Delete/server.hpp"
@@ -10,6 +11,8 @@
 #include <sdbusplus/server/object.hpp>
 
 #include <filesystem>
+#include <memory>
+#include <optional>
 
 namespace phosphor
 {
@@ -136,6 +139,32 @@ class Entry : virtual public phosphor::dump::Entry, virtual public EntryIfaces
         }
     }
 
+    /**
+     * @brief Create an entry from its record in the catalog, without
+     *        reading the dump directory
+     * @param[in] bus - Bus to attach to.
+     * @param[in] objPath - Object path to attach to.
+     * @param[in] filePath - Path to the dump file.
+     * @param[in] record - The record of the entry.
+     * @param[in] parent - The dump entry's parent.
+     * @return A unique pointer to the created entry.
+     */
+    static std::unique_ptr<Entry> restoreEntry(
+        sdbusplus::bus_t& bus, const std::string& objPath,
+        const std::filesystem::path& filePath, const record::Record& record,
+        phosphor::dump::Manager& parent)
+    {
+        auto entry = std::unique_ptr<Entry>(
+            new Entry(bus, objPath, record.dumpId, filePath, parent));
+        entry->elapsed(record.completedTime);
+        entry->completedTime(record.completedTime);
+        entry->size(record.size);
+        entry->status(OperationStatus::Completed);
+        entry->applyRecord(record);
+        entry->emitSignal();
+        return entry;
+    }
+
   private:
     /**
      *  @brief A minimal private constructor for the Dump Entry Object
@@ -160,6 +189,18 @@ class Entry : virtual public phosphor::dump::Entry, virtual public EntryIfaces
     {
         this->phosphor::dump::bmc::EntryIfaces::emit_object_added();
     }
+
+    /** @brief The offload in progress, if any */
+    std::unique_ptr<phosphor::dump::offload::Session> offloadSession;
+
+    /** @brief The rest of an interrupted offload which was read from the
+     *         start of the stream, as handed out in OffloadUri.
+     *  @details An offload which reaches the end of the stream marks the
+     *  dump offloaded only if it starts at 0 or here, so a client which
+     *  read only the tail of the dump doesn't get it rotated or dropped
+     *  from the RAM tier first.
+     */
+    std::optional<phosphor::dump::offload::Target> resumable;
 };
 
 } // namespace bmc
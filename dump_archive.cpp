@@ -0,0 +1,2125 @@
+#include "config.h"
+
+#include "dump_archive.hpp"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace phosphor
+{
+namespace dump
+{
+namespace archive
+{
+
+namespace
+{
+
+// Largest value of the 12 byte octal tar size field
+constexpr uint64_t MAX_OCTAL_SIZE = 077777777777;
+
+// Largest value of the 8 byte octal tar id fields
+constexpr uint64_t MAX_OCTAL_ID = 07777777;
+
+// Space kept for the end of the archive, the trailer blocks and the end of
+// the compressed stream
+constexpr uint64_t END_RESERVE = BLOCK_SIZE;
+
+// Default compression levels of the xz, gzip and zstd tools
+constexpr uint32_t XZ_LEVEL = 6;
+constexpr int GZIP_LEVEL = 6;
+constexpr int ZSTD_LEVEL = 3;
+
+// Largest pax extended header or GNU long name read from an archive
+constexpr uint64_t MAX_EXTENDED_HEADER = 1024 * 1024;
+
+// Holes a regular file needs to be stored as a sparse member
+constexpr uint64_t SPARSE_MIN_HOLES = 64 * 1024;
+
+// Largest map of the data extents of a sparse member read from an archive
+constexpr uint64_t MAX_SPARSE_MAP = 16 * 1024 * 1024;
+
+// Size of the blocks compressed in parallel, also the xz dictionary size of
+// a block, which keeps the memory of an xz thread at about 12 MiB
+constexpr size_t PARALLEL_BLOCK_SIZE = 1024 * 1024;
+
+/** @struct Header
+ *  @brief POSIX ustar header block.
+ */
+struct Header
+{
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+};
+static_assert(sizeof(Header) == BLOCK_SIZE);
+
+/** @brief Write a number as a NUL terminated octal field */
+template <size_t N>
+void setOctal(char (&field)[N], uint64_t value)
+{
+    for (size_t i = N - 1; i > 0; --i)
+    {
+        field[i - 1] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+    field[N - 1] = '\0';
+}
+
+/** @brief Copy a string into a field, NUL terminated if it is shorter */
+template <size_t N>
+void setString(char (&field)[N], const std::string& value)
+{
+    std::memcpy(field, value.data(), std::min(value.size(), N));
+}
+
+/** @brief Split a path into the ustar prefix and name fields.
+ *  @return true if the path fits.
+ */
+bool splitName(const std::string& path, Header& header)
+{
+    if (path.size() <= sizeof(header.name))
+    {
+        setString(header.name, path);
+        return true;
+    }
+
+    auto pos = path.find('/', path.size() - sizeof(header.name) - 1);
+    if (pos == std::string::npos || pos > sizeof(header.prefix))
+    {
+        return false;
+    }
+    setString(header.prefix, path.substr(0, pos));
+    setString(header.name, path.substr(pos + 1));
+    return true;
+}
+
+/** @brief Fill in the numeric fields, the type and the checksum of a
+ *         header whose name fields are set.
+ */
+void fillHeader(Header& header, uint64_t mode, uint64_t uid, uint64_t gid,
+                uint64_t size, time_t mtime, char type)
+{
+    setOctal(header.mode, mode);
+    setOctal(header.uid, uid);
+    setOctal(header.gid, gid);
+    setOctal(header.size, size);
+    setOctal(header.mtime, static_cast<uint64_t>(std::max<time_t>(mtime, 0)));
+    header.typeflag = type;
+    std::memcpy(header.magic, "ustar", sizeof(header.magic));
+    std::memcpy(header.version, "00", sizeof(header.version));
+
+    // The checksum is calculated with the checksum field set to spaces
+    std::memset(header.chksum, ' ', sizeof(header.chksum));
+    unsigned sum = 0;
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&header);
+    for (size_t i = 0; i < sizeof(header); ++i)
+    {
+        sum += bytes[i];
+    }
+    // Six digits, a NUL and a space
+    char chksum[7];
+    setOctal(chksum, sum);
+    std::memcpy(header.chksum, chksum, sizeof(chksum));
+    header.chksum[sizeof(chksum)] = ' ';
+}
+
+/** @brief Format a pax extended header record, "<length> <key>=<value>\n"
+ */
+std::string paxRecord(const std::string& key, const std::string& value)
+{
+    auto record = " " + key + "=" + value + "\n";
+    auto length = record.size() + 1;
+    while (std::to_string(length).size() + record.size() > length)
+    {
+        ++length;
+    }
+    return std::to_string(length) + record;
+}
+
+/** @brief The data extents of an opened regular file, a single extent
+ *         covering the file if the file system can't tell its holes.
+ */
+std::vector<Extent> dataExtents(int fd, uint64_t size)
+{
+    std::vector<Extent> extents;
+    for (uint64_t offset = 0; offset < size;)
+    {
+        auto data = lseek(fd, offset, SEEK_DATA);
+        if (data < 0)
+        {
+            // ENXIO: no data after the offset, the rest is a hole
+            if (errno != ENXIO)
+            {
+                return {{0, size}};
+            }
+            break;
+        }
+        auto hole = lseek(fd, data, SEEK_HOLE);
+        if (hole < 0)
+        {
+            return {{0, size}};
+        }
+        auto end = std::min<uint64_t>(hole, size);
+        if (static_cast<uint64_t>(data) >= end)
+        {
+            break;
+        }
+        extents.emplace_back(data, end - data);
+        offset = end;
+    }
+
+    // A file ending in a hole ends with an empty extent at its size, as
+    // GNU tar writes it
+    if (extents.empty() || extents.back().first + extents.back().second < size)
+    {
+        extents.emplace_back(size, 0);
+    }
+    lseek(fd, 0, SEEK_SET);
+    return extents;
+}
+
+/** @brief The map of the data extents of a sparse member, which precedes
+ *         them in its contents, padded to the tar block size.
+ */
+std::string sparseMap(const std::vector<Extent>& extents)
+{
+    auto map = std::to_string(extents.size()) + "\n";
+    for (const auto& [offset, length] : extents)
+    {
+        map += std::to_string(offset) + "\n" + std::to_string(length) + "\n";
+    }
+    map.resize((map.size() + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE, '\0');
+    return map;
+}
+
+/** @brief Size of the tar representation of a regular file */
+uint64_t fileTarSize(const std::filesystem::path& path)
+{
+    auto blocks = [](uint64_t size) {
+        return (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    };
+
+    struct stat st{};
+    if (stat(path.c_str(), &st) < 0)
+    {
+        return 0;
+    }
+    uint64_t size = st.st_size;
+    uint64_t allocated = static_cast<uint64_t>(st.st_blocks) * 512;
+    if (allocated + SPARSE_MIN_HOLES > size)
+    {
+        return blocks(size);
+    }
+
+    // The extents are allocated, the map takes at most 42 bytes for each of
+    // them and the pax header of the member two blocks
+    return blocks(allocated) + blocks((allocated / 4096 + 2) * 42) +
+           2 * BLOCK_SIZE;
+}
+
+#ifdef HAVE_LZMA
+/** @class Xz
+ *  @brief xz compressor, the equivalent of "xz -6" by default.
+ */
+class Xz : public Compressor
+{
+  public:
+    /** @brief Constructor
+     *  @param[in] fd - Descriptor the compressed data is written to.
+     *  @param[in] dictSize - Upper bound of the dictionary size, for input
+     *                        known to be small, 0 for the preset size.
+     *  @param[in] level - Preset level, 0 to 9.
+     */
+    explicit Xz(int fd, uint32_t dictSize = 0, uint32_t level = XZ_LEVEL) :
+        Compressor(fd)
+    {
+        lzma_options_lzma options{};
+        lzma_lzma_preset(&options, level);
+        if (dictSize != 0)
+        {
+            options.dict_size = std::clamp<uint32_t>(
+                dictSize, LZMA_DICT_SIZE_MIN, options.dict_size);
+        }
+        const std::array<lzma_filter, 2> filters{{
+            {LZMA_FILTER_LZMA2, &options},
+            {LZMA_VLI_UNKNOWN, nullptr},
+        }};
+        auto rc = lzma_stream_encoder(&stream, filters.data(),
+                                      LZMA_CHECK_CRC64);
+        if (rc != LZMA_OK)
+        {
+            throw std::runtime_error("lzma_stream_encoder failed: " +
+                                     std::to_string(rc));
+        }
+    }
+
+    ~Xz() override
+    {
+        lzma_end(&stream);
+    }
+
+    bool write(const void* data, size_t size) override
+    {
+        stream.next_in = static_cast<const uint8_t*>(data);
+        stream.avail_in = size;
+        return code(LZMA_RUN);
+    }
+
+    bool flush() override
+    {
+        return code(LZMA_SYNC_FLUSH);
+    }
+
+    bool finish() override
+    {
+        return code(LZMA_FINISH);
+    }
+
+  private:
+    bool code(lzma_action action)
+    {
+        while (true)
+        {
+            stream.next_out = buffer.data();
+            stream.avail_out = buffer.size();
+            auto rc = lzma_code(&stream, action);
+            if (rc != LZMA_OK && rc != LZMA_STREAM_END)
+            {
+                lg2::error("xz compression failed, rc: {RC}", "RC",
+                           static_cast<int>(rc));
+                return false;
+            }
+            if (!output(buffer.data(), buffer.size() - stream.avail_out))
+            {
+                return false;
+            }
+            if (action == LZMA_RUN ? stream.avail_in == 0
+                                   : rc == LZMA_STREAM_END)
+            {
+                return true;
+            }
+        }
+    }
+
+    lzma_stream stream = LZMA_STREAM_INIT;
+};
+#endif
+
+#ifdef HAVE_ZLIB
+/** @class Gzip
+ *  @brief gzip compressor, the equivalent of "gzip -6" by default.
+ */
+class Gzip : public Compressor
+{
+  public:
+    explicit Gzip(int fd, int level = GZIP_LEVEL) : Compressor(fd)
+    {
+        // 16 added to the window bits selects the gzip format
+        auto rc = deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8,
+                               Z_DEFAULT_STRATEGY);
+        if (rc != Z_OK)
+        {
+            throw std::runtime_error("deflateInit2 failed: " +
+                                     std::to_string(rc));
+        }
+    }
+
+    ~Gzip() override
+    {
+        deflateEnd(&stream);
+    }
+
+    bool write(const void* data, size_t size) override
+    {
+        stream.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+        stream.avail_in = size;
+        return code(Z_NO_FLUSH);
+    }
+
+    bool flush() override
+    {
+        return code(Z_SYNC_FLUSH);
+    }
+
+    bool finish() override
+    {
+        return code(Z_FINISH);
+    }
+
+  private:
+    bool code(int mode)
+    {
+        while (true)
+        {
+            stream.next_out = buffer.data();
+            stream.avail_out = buffer.size();
+            auto rc = deflate(&stream, mode);
+            if (rc == Z_STREAM_ERROR)
+            {
+                lg2::error("gzip compression failed, rc: {RC}", "RC", rc);
+                return false;
+            }
+            if (!output(buffer.data(), buffer.size() - stream.avail_out))
+            {
+                return false;
+            }
+            if (mode == Z_FINISH ? rc == Z_STREAM_END
+                                 : stream.avail_in == 0 && stream.avail_out != 0)
+            {
+                return true;
+            }
+        }
+    }
+
+    z_stream stream{};
+};
+#endif
+
+#ifdef HAVE_ZSTD
+/** @class Zstd
+ *  @brief zstd compressor, the equivalent of "zstd -3" by default. With a
+ *         dictionary the level of the dictionary applies.
+ */
+class Zstd : public Compressor
+{
+  public:
+    Zstd(int fd, const Dictionary* dictionary, int level = ZSTD_LEVEL) :
+        Compressor(fd), ctx(ZSTD_createCCtx())
+    {
+        if (ctx == nullptr)
+        {
+            throw std::runtime_error("ZSTD_createCCtx failed");
+        }
+        ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, level);
+        ZSTD_CCtx_setParameter(ctx, ZSTD_c_checksumFlag, 1);
+        if (dictionary != nullptr &&
+            ZSTD_isError(ZSTD_CCtx_refCDict(ctx, dictionary->get())))
+        {
+            ZSTD_freeCCtx(ctx);
+            throw std::runtime_error("ZSTD_CCtx_refCDict failed");
+        }
+    }
+
+    ~Zstd() override
+    {
+        ZSTD_freeCCtx(ctx);
+    }
+
+    bool write(const void* data, size_t size) override
+    {
+        ZSTD_inBuffer in{data, size, 0};
+        return code(in, ZSTD_e_continue);
+    }
+
+    bool flush() override
+    {
+        ZSTD_inBuffer in{nullptr, 0, 0};
+        return code(in, ZSTD_e_flush);
+    }
+
+    bool finish() override
+    {
+        ZSTD_inBuffer in{nullptr, 0, 0};
+        return code(in, ZSTD_e_end);
+    }
+
+  private:
+    bool code(ZSTD_inBuffer& in, ZSTD_EndDirective mode)
+    {
+        while (true)
+        {
+            ZSTD_outBuffer out{buffer.data(), buffer.size(), 0};
+            auto rc = ZSTD_compressStream2(ctx, &out, &in, mode);
+            if (ZSTD_isError(rc))
+            {
+                lg2::error("zstd compression failed, error: {ERROR}", "ERROR",
+                           ZSTD_getErrorName(rc));
+                return false;
+            }
+            if (!output(buffer.data(), out.pos))
+            {
+                return false;
+            }
+            if (mode == ZSTD_e_continue ? in.pos == in.size : rc == 0)
+            {
+                return true;
+            }
+        }
+    }
+
+    ZSTD_CCtx* ctx;
+};
+#endif
+
+/** @brief Whether a compression algorithm is built in */
+bool isSupported(Algorithm algorithm)
+{
+    switch (algorithm)
+    {
+#ifdef HAVE_LZMA
+        case Algorithm::xz:
+            return true;
+#endif
+#ifdef HAVE_ZLIB
+        case Algorithm::gzip:
+            return true;
+#endif
+#ifdef HAVE_ZSTD
+        case Algorithm::zstd:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+/** @class Parallel
+ *  @brief Compresses blocks of the input on a pool of threads.
+ *  @details Every block is compressed into a complete stream of its own,
+ *  the streams are written in input order. At most two blocks per thread
+ *  are held in memory.
+ */
+class Parallel : public Compressor
+{
+  public:
+    Parallel(int fd, Algorithm algorithm, const Dictionary* dictionary,
+             const Parallelism& parallelism) :
+        Compressor(fd), algorithm(algorithm), dictionary(dictionary),
+        parallelism(parallelism)
+    {
+        block.reserve(PARALLEL_BLOCK_SIZE);
+    }
+
+    ~Parallel() override
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        queued.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    bool write(const void* data, size_t size) override
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        while (size > 0)
+        {
+            auto count = std::min(size, PARALLEL_BLOCK_SIZE - block.size());
+            block.insert(block.end(), bytes, bytes + count);
+            bytes += count;
+            size -= count;
+            if (block.size() == PARALLEL_BLOCK_SIZE && !submit())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool flush() override
+    {
+        return (block.empty() || submit()) && drain(0);
+    }
+
+    bool finish() override
+    {
+        if (!flush())
+        {
+            return false;
+        }
+        // An empty input still has to produce a valid stream
+        return getOutputSize() != 0 || (submit() && drain(0));
+    }
+
+  private:
+    /** @struct Job
+     *  @brief A block and its compressed stream.
+     */
+    struct Job
+    {
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+        bool done = false;
+        bool compressed = false;
+    };
+
+    /** @brief Queue the current block for compression.
+     *  @return true on success.
+     */
+    bool submit()
+    {
+        if (workers.size() < parallelism.threads)
+        {
+            try
+            {
+                workers.emplace_back(&Parallel::work, this);
+            }
+            catch (const std::system_error& e)
+            {
+                // Carry on with the workers already running
+                if (workers.empty())
+                {
+                    lg2::error("Failed to start a compression thread, "
+                               "error: {ERROR}",
+                               "ERROR", e);
+                    return false;
+                }
+            }
+        }
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(std::make_unique<Job>());
+            jobs.back()->input = std::move(block);
+            queue.push_back(jobs.back().get());
+        }
+        queued.notify_one();
+        block = {};
+        block.reserve(PARALLEL_BLOCK_SIZE);
+        return drain(2 * parallelism.threads);
+    }
+
+    /** @brief Write out the compressed blocks in order.
+     *  @param[in] keep - Number of blocks which may stay in flight.
+     *  @return true on success.
+     */
+    bool drain(size_t keep)
+    {
+        std::unique_lock lock(mutex);
+        while (!jobs.empty())
+        {
+            auto* front = jobs.front().get();
+            if (!front->done)
+            {
+                if (jobs.size() <= keep)
+                {
+                    break;
+                }
+                done.wait(lock, [front]() { return front->done; });
+            }
+            auto job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            if (!job->compressed ||
+                !output(job->output.data(), job->output.size()))
+            {
+                return false;
+            }
+            lock.lock();
+        }
+        return true;
+    }
+
+    /** @brief Compress the queued blocks, runs on the worker threads */
+    void work()
+    {
+        // A nice value applies to the calling thread only on Linux
+        errno = 0;
+        auto priority = getpriority(PRIO_PROCESS, 0);
+        if (parallelism.nice != 0 && errno == 0)
+        {
+            setpriority(PRIO_PROCESS, 0,
+                        std::min(priority + parallelism.nice, 19));
+        }
+
+        while (true)
+        {
+            Job* job = nullptr;
+            {
+                std::unique_lock lock(mutex);
+                queued.wait(lock,
+                            [this]() { return stopping || !queue.empty(); });
+                if (stopping)
+                {
+                    return;
+                }
+                job = queue.front();
+                queue.pop_front();
+            }
+
+            auto compressor = makeBlockCompressor();
+            auto compressed =
+                compressor &&
+                compressor->write(job->input.data(), job->input.size()) &&
+                compressor->finish();
+            {
+                std::lock_guard lock(mutex);
+                job->input = {};
+                if (compressed)
+                {
+                    job->output = compressor->take();
+                }
+                job->compressed = compressed;
+                job->done = true;
+            }
+            done.notify_all();
+        }
+    }
+
+    /** @brief Create a compressor for a single block, in memory */
+    std::unique_ptr<Compressor> makeBlockCompressor() const
+    {
+#ifdef HAVE_LZMA
+        if (algorithm == Algorithm::xz)
+        {
+            try
+            {
+                return std::make_unique<Xz>(-1, PARALLEL_BLOCK_SIZE);
+            }
+            catch (const std::exception& e)
+            {
+                lg2::error("Failed to initialize the compressor, "
+                           "error: {ERROR}",
+                           "ERROR", e);
+                return nullptr;
+            }
+        }
+#endif
+        return makeCompressor(algorithm, -1, dictionary);
+    }
+
+    /** @brief Compression algorithm */
+    Algorithm algorithm;
+
+    /** @brief Dictionary for zstd */
+    const Dictionary* dictionary;
+
+    /** @brief Threads compressing the blocks */
+    Parallelism parallelism;
+
+    /** @brief Block being filled */
+    std::vector<uint8_t> block;
+
+    /** @brief Blocks in flight, in input order */
+    std::deque<std::unique_ptr<Job>> jobs;
+
+    /** @brief Blocks waiting for a worker */
+    std::deque<Job*> queue;
+
+    /** @brief Guards the jobs and the queue */
+    std::mutex mutex;
+
+    /** @brief Signals a queued block or stopping */
+    std::condition_variable queued;
+
+    /** @brief Signals a compressed block */
+    std::condition_variable done;
+
+    /** @brief Whether the workers have to exit */
+    bool stopping = false;
+
+    /** @brief Worker threads, started on demand */
+    std::vector<std::thread> workers;
+};
+
+} // namespace
+
+/** @class Decompressor
+ *  @brief Streaming decompressor reading from a file descriptor.
+ */
+class Decompressor
+{
+  public:
+    Decompressor() = delete;
+    Decompressor(const Decompressor&) = delete;
+    Decompressor& operator=(const Decompressor&) = delete;
+    Decompressor(Decompressor&&) = delete;
+    Decompressor& operator=(Decompressor&&) = delete;
+    virtual ~Decompressor() = default;
+
+    /** @brief Constructor
+     *  @param[in] fd - Descriptor the compressed data is read from.
+     */
+    explicit Decompressor(int fd) : fd(fd) {}
+
+    /** @brief Decompress data.
+     *  @return Number of bytes decompressed, 0 at the end of the data, -1
+     *          on an error.
+     */
+    virtual ssize_t read(uint8_t* data, size_t size) = 0;
+
+  protected:
+    /** @brief Read the next compressed data into the input buffer.
+     *  @return Number of bytes read, 0 at the end of the file, -1 on an
+     *          error.
+     */
+    ssize_t fill()
+    {
+        while (true)
+        {
+            auto count = ::read(fd, input.data(), input.size());
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count < 0)
+            {
+                auto error = errno;
+                lg2::error("Failed to read the archive, errno: {ERRNO}",
+                           "ERRNO", error);
+            }
+            eof = count == 0;
+            return count;
+        }
+    }
+
+    /** @brief Buffer for the compressed data */
+    std::vector<uint8_t> input = std::vector<uint8_t>(64 * 1024);
+
+    /** @brief Whether the end of the file was reached */
+    bool eof = false;
+
+  private:
+    /** @brief Descriptor the compressed data is read from */
+    int fd;
+};
+
+namespace
+{
+
+#ifdef HAVE_LZMA
+/** @class UnXz
+ *  @brief xz decompressor, reads concatenated streams as one.
+ */
+class UnXz : public Decompressor
+{
+  public:
+    explicit UnXz(int fd) : Decompressor(fd)
+    {
+        auto rc = lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED);
+        if (rc != LZMA_OK)
+        {
+            throw std::runtime_error("lzma_stream_decoder failed: " +
+                                     std::to_string(rc));
+        }
+    }
+
+    ~UnXz() override
+    {
+        lzma_end(&stream);
+    }
+
+    ssize_t read(uint8_t* data, size_t size) override
+    {
+        stream.next_out = data;
+        stream.avail_out = size;
+        while (stream.avail_out > 0 && !ended)
+        {
+            if (stream.avail_in == 0 && !eof)
+            {
+                auto count = fill();
+                if (count < 0)
+                {
+                    return -1;
+                }
+                stream.next_in = input.data();
+                stream.avail_in = count;
+            }
+            auto rc = lzma_code(&stream, eof ? LZMA_FINISH : LZMA_RUN);
+            if (rc == LZMA_STREAM_END)
+            {
+                ended = true;
+            }
+            else if (rc != LZMA_OK)
+            {
+                lg2::error("xz decompression failed, rc: {RC}", "RC",
+                           static_cast<int>(rc));
+                return -1;
+            }
+        }
+        return size - stream.avail_out;
+    }
+
+  private:
+    lzma_stream stream = LZMA_STREAM_INIT;
+
+    /** @brief Whether the last stream ended */
+    bool ended = false;
+};
+#endif
+
+#ifdef HAVE_ZLIB
+/** @class Gunzip
+ *  @brief gzip decompressor, reads concatenated members as one.
+ */
+class Gunzip : public Decompressor
+{
+  public:
+    explicit Gunzip(int fd) : Decompressor(fd)
+    {
+        if (inflateInit2(&stream, 15 + 16) != Z_OK)
+        {
+            throw std::runtime_error("inflateInit2 failed");
+        }
+    }
+
+    ~Gunzip() override
+    {
+        inflateEnd(&stream);
+    }
+
+    ssize_t read(uint8_t* data, size_t size) override
+    {
+        stream.next_out = data;
+        stream.avail_out = size;
+        while (stream.avail_out > 0)
+        {
+            if (stream.avail_in == 0)
+            {
+                auto count = eof ? 0 : fill();
+                if (count < 0)
+                {
+                    return -1;
+                }
+                if (count == 0)
+                {
+                    if (!boundary)
+                    {
+                        lg2::error("gzip decompression failed, truncated");
+                        return -1;
+                    }
+                    break;
+                }
+                stream.next_in = input.data();
+                stream.avail_in = count;
+            }
+            auto rc = inflate(&stream, Z_NO_FLUSH);
+            if (rc == Z_STREAM_END)
+            {
+                // Another member may follow
+                boundary = true;
+                inflateReset(&stream);
+            }
+            else if (rc == Z_OK || (rc == Z_BUF_ERROR && stream.avail_in == 0))
+            {
+                boundary = false;
+            }
+            else
+            {
+                lg2::error("gzip decompression failed, rc: {RC}", "RC", rc);
+                return -1;
+            }
+        }
+        return size - stream.avail_out;
+    }
+
+  private:
+    z_stream stream{};
+
+    /** @brief Whether the last member ended */
+    bool boundary = true;
+};
+#endif
+
+#ifdef HAVE_ZSTD
+/** @class Unzstd
+ *  @brief zstd decompressor, reads all the frames.
+ */
+class Unzstd : public Decompressor
+{
+  public:
+    Unzstd(int fd, const Dictionary* dictionary) :
+        Decompressor(fd), ctx(ZSTD_createDCtx())
+    {
+        if (ctx == nullptr)
+        {
+            throw std::runtime_error("ZSTD_createDCtx failed");
+        }
+        if (dictionary != nullptr &&
+            ZSTD_isError(ZSTD_DCtx_refDDict(ctx, dictionary->getDDict())))
+        {
+            ZSTD_freeDCtx(ctx);
+            throw std::runtime_error("ZSTD_DCtx_refDDict failed");
+        }
+    }
+
+    ~Unzstd() override
+    {
+        ZSTD_freeDCtx(ctx);
+    }
+
+    ssize_t read(uint8_t* data, size_t size) override
+    {
+        ZSTD_outBuffer out{data, size, 0};
+        while (out.pos < out.size)
+        {
+            if (in.pos == in.size && !eof)
+            {
+                auto count = fill();
+                if (count < 0)
+                {
+                    return -1;
+                }
+                in = {input.data(), static_cast<size_t>(count), 0};
+            }
+            auto before = out.pos;
+            auto consumed = in.pos;
+            auto rc = ZSTD_decompressStream(ctx, &out, &in);
+            if (ZSTD_isError(rc))
+            {
+                lg2::error("zstd decompression failed, error: {ERROR}",
+                           "ERROR", ZSTD_getErrorName(rc));
+                return -1;
+            }
+
+            // Past the end of a frame without input the hint is the size
+            // of the next frame header
+            if (in.pos != consumed || out.pos != before)
+            {
+                pending = rc;
+            }
+            if (in.pos == in.size && eof && out.pos == before)
+            {
+                if (pending != 0)
+                {
+                    lg2::error("zstd decompression failed, truncated");
+                    return -1;
+                }
+                break;
+            }
+        }
+        return out.pos;
+    }
+
+  private:
+    ZSTD_DCtx* ctx;
+
+    /** @brief Compressed data not consumed yet */
+    ZSTD_inBuffer in{nullptr, 0, 0};
+
+    /** @brief Whether the last frame is incomplete */
+    size_t pending = 0;
+};
+#endif
+
+/** @brief Parse a numeric tar header field, octal or base-256 */
+uint64_t parseNumber(const char* field, size_t size)
+{
+    uint64_t value = 0;
+    if (static_cast<uint8_t>(field[0]) & 0x80)
+    {
+        for (size_t i = 1; i < size; ++i)
+        {
+            value = (value << 8) | static_cast<uint8_t>(field[i]);
+        }
+        return value;
+    }
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (field[i] >= '0' && field[i] <= '7')
+        {
+            value = (value << 3) | (field[i] - '0');
+        }
+        else if (field[i] != ' ')
+        {
+            break;
+        }
+    }
+    return value;
+}
+
+/** @brief Read a NUL terminated or full length string field */
+template <size_t N>
+std::string getString(const char (&field)[N])
+{
+    return std::string(field, strnlen(field, N));
+}
+
+/** @brief Parse the records of a pax extended header,
+ *         "<length> <key>=<value>\n".
+ */
+std::map<std::string, std::string> parsePax(const std::string& records)
+{
+    std::map<std::string, std::string> values;
+    for (size_t pos = 0; pos < records.size();)
+    {
+        auto length = std::strtoull(records.c_str() + pos, nullptr, 10);
+        if (length == 0 || pos + length > records.size())
+        {
+            break;
+        }
+        auto record = records.substr(pos, length - 1);
+        auto key = record.find(' ');
+        auto equal = record.find('=', key);
+        if (key != std::string::npos && equal != std::string::npos)
+        {
+            values[record.substr(key + 1, equal - key - 1)] =
+                record.substr(equal + 1);
+        }
+        pos += length;
+    }
+    return values;
+}
+
+} // namespace
+
+std::optional<Algorithm> toAlgorithm(const std::string& name)
+{
+#ifdef HAVE_LZMA
+    if (name == "xz")
+    {
+        return Algorithm::xz;
+    }
+#endif
+#ifdef HAVE_ZLIB
+    if (name == "gzip")
+    {
+        return Algorithm::gzip;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (name == "zstd")
+    {
+        return Algorithm::zstd;
+    }
+#endif
+    return std::nullopt;
+}
+
+std::string toString(Algorithm algorithm)
+{
+    switch (algorithm)
+    {
+        case Algorithm::gzip:
+            return "gzip";
+        case Algorithm::zstd:
+            return "zstd";
+        case Algorithm::xz:
+        default:
+            return "xz";
+    }
+}
+
+std::string extension(Algorithm algorithm)
+{
+    switch (algorithm)
+    {
+        case Algorithm::gzip:
+            return "tar.gz";
+        case Algorithm::zstd:
+            return "tar.zst";
+        case Algorithm::xz:
+        default:
+            return "tar.xz";
+    }
+}
+
+uint64_t tarSize(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    uint64_t size = BLOCK_SIZE;
+    if (!std::filesystem::is_directory(
+            std::filesystem::symlink_status(path, ec)))
+    {
+        return size + fileTarSize(path);
+    }
+    for (const auto& p :
+         std::filesystem::recursive_directory_iterator(path, ec))
+    {
+        size += BLOCK_SIZE;
+        if (p.is_regular_file(ec))
+        {
+            size += fileTarSize(p.path());
+        }
+    }
+    return size;
+}
+
+bool Compressor::output(const uint8_t* data, size_t size)
+{
+    if (fd < 0)
+    {
+        collected.insert(collected.end(), data, data + size);
+        outputSize += size;
+        return true;
+    }
+    while (size > 0)
+    {
+        auto wrote = ::write(fd, data, size);
+        if (wrote < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            auto error = errno;
+            lg2::error("Failed to write the archive, errno: {ERRNO}", "ERRNO",
+                       error);
+            return false;
+        }
+        data += wrote;
+        size -= wrote;
+        outputSize += wrote;
+    }
+    return true;
+}
+
+Dictionary::Dictionary([[maybe_unused]] const std::vector<uint8_t>& data)
+{
+#ifdef HAVE_ZSTD
+    id = ZSTD_getDictID_fromDict(data.data(), data.size());
+    if (id == 0)
+    {
+        throw std::invalid_argument("not a zstd dictionary");
+    }
+    cdict = ZSTD_createCDict(data.data(), data.size(), ZSTD_LEVEL);
+    if (cdict == nullptr)
+    {
+        throw std::invalid_argument("ZSTD_createCDict failed");
+    }
+    ddict = ZSTD_createDDict(data.data(), data.size());
+    if (ddict == nullptr)
+    {
+        ZSTD_freeCDict(cdict);
+        throw std::invalid_argument("ZSTD_createDDict failed");
+    }
+#else
+    throw std::invalid_argument("zstd is not supported");
+#endif
+}
+
+Dictionary::~Dictionary()
+{
+#ifdef HAVE_ZSTD
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+#endif
+}
+
+std::shared_ptr<const Dictionary> Dictionary::load(
+    const std::filesystem::path& file)
+{
+    std::ifstream is(file, std::ios::binary);
+    if (!is.is_open())
+    {
+        lg2::error("Failed to open the dictionary {PATH}", "PATH", file);
+        return nullptr;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(is)),
+                              std::istreambuf_iterator<char>());
+
+    try
+    {
+        return std::make_shared<const Dictionary>(data);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        lg2::error("Failed to load the dictionary {PATH}, error: {ERROR}",
+                   "PATH", file, "ERROR", e);
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const Dictionary> Dictionary::configured()
+{
+    if (std::string_view(DUMP_COMPRESSION_DICTIONARY).empty())
+    {
+        return nullptr;
+    }
+    return load(DUMP_COMPRESSION_DICTIONARY);
+}
+
+std::unique_ptr<Compressor> makeCompressor(
+    Algorithm algorithm, int fd, [[maybe_unused]] const Dictionary* dictionary,
+    const Parallelism& parallelism)
+{
+    if (parallelism.threads > 1 && isSupported(algorithm))
+    {
+        return std::make_unique<Parallel>(fd, algorithm, dictionary,
+                                          parallelism);
+    }
+    try
+    {
+        switch (algorithm)
+        {
+#ifdef HAVE_LZMA
+            case Algorithm::xz:
+                return std::make_unique<Xz>(fd);
+#endif
+#ifdef HAVE_ZLIB
+            case Algorithm::gzip:
+                return std::make_unique<Gzip>(fd);
+#endif
+#ifdef HAVE_ZSTD
+            case Algorithm::zstd:
+                return std::make_unique<Zstd>(fd, dictionary);
+#endif
+            default:
+                break;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to initialize the compressor, error: {ERROR}",
+                   "ERROR", e);
+        return nullptr;
+    }
+    lg2::error("Compression algorithm {ALGORITHM} is not supported",
+               "ALGORITHM", extension(algorithm));
+    return nullptr;
+}
+
+int defaultLevel(Algorithm algorithm)
+{
+    switch (algorithm)
+    {
+        case Algorithm::xz:
+            return XZ_LEVEL;
+        case Algorithm::gzip:
+            return GZIP_LEVEL;
+        case Algorithm::zstd:
+            return ZSTD_LEVEL;
+    }
+    return 0;
+}
+
+std::unique_ptr<Compressor> makeLevelCompressor(
+    Algorithm algorithm, int fd, int level, uint64_t inputSize,
+    [[maybe_unused]] const Dictionary* dictionary)
+{
+    try
+    {
+        switch (algorithm)
+        {
+#ifdef HAVE_LZMA
+            case Algorithm::xz:
+                return std::make_unique<Xz>(
+                    fd,
+                    static_cast<uint32_t>(
+                        std::min<uint64_t>(inputSize, UINT32_MAX)),
+                    std::clamp(level, 0, 9));
+#endif
+#ifdef HAVE_ZLIB
+            case Algorithm::gzip:
+                return std::make_unique<Gzip>(fd, std::clamp(level, 1, 9));
+#endif
+#ifdef HAVE_ZSTD
+            case Algorithm::zstd:
+                return std::make_unique<Zstd>(
+                    fd, dictionary, std::clamp(level, 1, ZSTD_maxCLevel()));
+#endif
+            default:
+                break;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to initialize the compressor, error: {ERROR}",
+                   "ERROR", e);
+        return nullptr;
+    }
+    lg2::error("Compression algorithm {ALGORITHM} is not supported",
+               "ALGORITHM", extension(algorithm));
+    return nullptr;
+}
+
+std::optional<std::vector<uint8_t>> compress(
+    Algorithm algorithm, const void* data, size_t size,
+    const Dictionary* dictionary)
+{
+    std::unique_ptr<Compressor> compressor;
+#ifdef HAVE_LZMA
+    if (algorithm == Algorithm::xz)
+    {
+        try
+        {
+            compressor = std::make_unique<Xz>(
+                -1, static_cast<uint32_t>(std::min<size_t>(size, UINT32_MAX)));
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error("Failed to initialize the compressor, error: {ERROR}",
+                       "ERROR", e);
+            return std::nullopt;
+        }
+    }
+#endif
+    if (!compressor)
+    {
+        compressor = makeCompressor(algorithm, -1, dictionary);
+    }
+    if (!compressor || !compressor->write(data, size) ||
+        !compressor->finish())
+    {
+        return std::nullopt;
+    }
+    return compressor->take();
+}
+
+std::filesystem::path Writer::partialPath(const std::filesystem::path& archive)
+{
+    return archive.parent_path() /
+           ("." + archive.filename().string() + ".part");
+}
+
+Writer::Writer(const std::filesystem::path& archive, Algorithm algorithm,
+               std::shared_ptr<const Dictionary> dictionary,
+               const Parallelism& parallelism) :
+    archive(archive), partial(partialPath(archive)), algorithm(algorithm),
+    dictionary(std::move(dictionary)), parallelism(parallelism)
+{
+    fd = open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+              0644);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "open " + partial.string());
+    }
+    output = fd;
+    compressor = makeCompressor(algorithm, fd, this->dictionary.get(),
+                                parallelism);
+    if (!compressor)
+    {
+        close(fd);
+        std::error_code ec;
+        std::filesystem::remove(partial, ec);
+        throw std::system_error(std::make_error_code(std::errc::not_supported),
+                                "compressor " + extension(algorithm));
+    }
+}
+
+Writer::Writer(Algorithm algorithm,
+               std::shared_ptr<const Dictionary> dictionary) :
+    algorithm(algorithm), dictionary(std::move(dictionary))
+{
+    compressor = makeCompressor(algorithm, -1, this->dictionary.get());
+    if (!compressor)
+    {
+        throw std::system_error(std::make_error_code(std::errc::not_supported),
+                                "compressor " + extension(algorithm));
+    }
+}
+
+Writer::Writer(int output, Algorithm algorithm,
+               std::shared_ptr<const Dictionary> dictionary) :
+    output(output), algorithm(algorithm), dictionary(std::move(dictionary))
+{
+    compressor = makeCompressor(algorithm, output, this->dictionary.get());
+    if (!compressor)
+    {
+        throw std::system_error(std::make_error_code(std::errc::not_supported),
+                                "compressor " + extension(algorithm));
+    }
+}
+
+Writer::~Writer()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    if (!committed && !partial.empty())
+    {
+        std::error_code ec;
+        std::filesystem::remove(partial, ec);
+    }
+}
+
+bool Writer::writeHeader(const std::string& name, const struct stat& st,
+                         char type, const std::string& link,
+                         const std::string& records)
+{
+    uint64_t size = (type == '0') ? st.st_size : 0;
+
+    Header header{};
+    std::string pax = records;
+    if (!splitName(name, header))
+    {
+        pax += paxRecord("path", name);
+        setString(header.name, name.substr(0, sizeof(header.name)));
+    }
+    if (link.size() > sizeof(header.linkname))
+    {
+        pax += paxRecord("linkpath", link);
+    }
+    if (size > MAX_OCTAL_SIZE)
+    {
+        pax += paxRecord("size", std::to_string(size));
+    }
+
+    // Values which don't fit the ustar header are stored in a pax extended
+    // header preceding the entry
+    if (!pax.empty())
+    {
+        Header paxHeader{};
+        setString(paxHeader.name,
+                  "PaxHeaders/" + std::filesystem::path(name)
+                                      .filename()
+                                      .string()
+                                      .substr(0, 80));
+        fillHeader(paxHeader, 0644, 0, 0, pax.size(), st.st_mtime, 'x');
+        if (!write(&paxHeader, sizeof(paxHeader)) ||
+            !write(pax.data(), pax.size()) || !pad(pax.size()))
+        {
+            return false;
+        }
+    }
+
+    setString(header.linkname, link);
+    fillHeader(header, st.st_mode & 07777,
+               st.st_uid <= MAX_OCTAL_ID ? st.st_uid : 0,
+               st.st_gid <= MAX_OCTAL_ID ? st.st_gid : 0,
+               size <= MAX_OCTAL_SIZE ? size : 0, st.st_mtime, type);
+    return write(&header, sizeof(header));
+}
+
+bool Writer::write(const void* data, size_t size)
+{
+    pending += size;
+    return compressor->write(data, size);
+}
+
+bool Writer::pad(uint64_t size)
+{
+    static const std::array<char, BLOCK_SIZE> zeros{};
+    auto rem = size % BLOCK_SIZE;
+    return rem == 0 || write(zeros.data(), BLOCK_SIZE - rem);
+}
+
+bool Writer::writeContents(int in, uint64_t size)
+{
+    return writeRange(in, size) && pad(size);
+}
+
+bool Writer::writeSparse(const std::string& name, const struct stat& st,
+                         int in, const std::vector<Extent>& extents)
+{
+    // The member is stored under a name of its own, which tools without
+    // support for sparse members extract as a file holding the map and the
+    // extents
+    auto path = std::filesystem::path(name);
+    auto stored = (path.parent_path() / "GNUSparseFile.0" / path.filename())
+                      .string();
+    auto records = paxRecord("GNU.sparse.major", "1") +
+                   paxRecord("GNU.sparse.minor", "0") +
+                   paxRecord("GNU.sparse.name", name) +
+                   paxRecord("GNU.sparse.realsize", std::to_string(st.st_size));
+
+    auto map = sparseMap(extents);
+    struct stat member = st;
+    member.st_size = map.size();
+    for (const auto& [offset, length] : extents)
+    {
+        member.st_size += length;
+    }
+    if (!writeHeader(stored, member, '0', {}, records) ||
+        !write(map.data(), map.size()))
+    {
+        return false;
+    }
+    for (const auto& [offset, length] : extents)
+    {
+        if (lseek(in, offset, SEEK_SET) < 0 || !writeRange(in, length))
+        {
+            return false;
+        }
+    }
+    return pad(member.st_size);
+}
+
+bool Writer::writeRange(int in, uint64_t size)
+{
+    std::array<char, 64 * 1024> buf{};
+    uint64_t done = 0;
+    while (done < size)
+    {
+        auto count = read(in, buf.data(), std::min<uint64_t>(buf.size(),
+                                                             size - done));
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        if (count == 0)
+        {
+            // The file shrunk since its size was recorded in the header,
+            // fill up with zeros to keep the archive valid.
+            buf.fill(0);
+            count = std::min<uint64_t>(buf.size(), size - done);
+        }
+        if (!write(buf.data(), count))
+        {
+            return false;
+        }
+        done += count;
+    }
+    return true;
+}
+
+bool Writer::addDirectory(const std::string& name)
+{
+    struct stat st{};
+    st.st_mode = S_IFDIR | 0755;
+    st.st_mtime = std::time(nullptr);
+    return writeHeader(name + "/", st, '5');
+}
+
+bool Writer::add(const std::filesystem::path& path, const std::string& name)
+{
+    struct stat st{};
+    if (lstat(path.c_str(), &st) < 0)
+    {
+        return false;
+    }
+
+    if (S_ISDIR(st.st_mode))
+    {
+        if (!writeHeader(name + "/", st, '5'))
+        {
+            return false;
+        }
+        std::error_code ec;
+        std::vector<std::filesystem::path> children;
+        for (const auto& p : std::filesystem::directory_iterator(path, ec))
+        {
+            children.push_back(p.path());
+        }
+        std::sort(children.begin(), children.end());
+        for (const auto& child : children)
+        {
+            if (!add(child, name + "/" + child.filename().string()))
+            {
+                return false;
+            }
+        }
+        return !ec;
+    }
+
+    if (S_ISLNK(st.st_mode))
+    {
+        std::error_code ec;
+        auto target = std::filesystem::read_symlink(path, ec);
+        return !ec && writeHeader(name, st, '2', target.string());
+    }
+
+    if (!S_ISREG(st.st_mode))
+    {
+        // Sockets, fifos and devices are not part of a dump
+        return true;
+    }
+
+    int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+    {
+        return false;
+    }
+
+    // The holes of a sparse file are neither read nor compressed
+    bool added = false;
+    uint64_t data = 0;
+    auto extents = dataExtents(in, st.st_size);
+    for (const auto& [offset, length] : extents)
+    {
+        data += length;
+    }
+    if (data + SPARSE_MIN_HOLES <= static_cast<uint64_t>(st.st_size))
+    {
+        added = writeSparse(name, st, in, extents);
+    }
+    else
+    {
+        added = writeHeader(name, st, '0') && writeContents(in, st.st_size);
+    }
+    close(in);
+    return added;
+}
+
+Admission Writer::add(const std::filesystem::path& path,
+                      const std::string& name, uint64_t limit)
+{
+    // Upper bound of the archive size with the entry added, compressed
+    // data exceeds its input by a small framing overhead at worst
+    auto input = pending + tarSize(path);
+    if (size() + input + input / 1024 + BLOCK_SIZE + END_RESERVE <= limit)
+    {
+        return add(path, name) ? Admission::added : Admission::failed;
+    }
+
+    // Close to the limit, measure the compressed size of the entry
+    if (!restart())
+    {
+        return Admission::failed;
+    }
+    auto offset = size();
+    if (!add(path, name) || !flush())
+    {
+        return Admission::failed;
+    }
+    if (size() + END_RESERVE <= limit)
+    {
+        return Admission::added;
+    }
+    return rollback(offset) ? Admission::rejected : Admission::failed;
+}
+
+bool Writer::add(Reader& reader, const Member& member,
+                 const std::string& name)
+{
+    struct stat st{};
+    st.st_mode = member.mode;
+    st.st_mtime = member.mtime;
+    st.st_size = member.size;
+    if (!writeHeader(name, st, member.type, member.link))
+    {
+        return false;
+    }
+    if (member.type != '0')
+    {
+        return true;
+    }
+
+    std::array<char, 64 * 1024> buf{};
+    for (uint64_t done = 0; done < member.size;)
+    {
+        auto count = reader.read(buf.data(), buf.size());
+        if (count <= 0 || !write(buf.data(), count))
+        {
+            return false;
+        }
+        done += count;
+    }
+    return pad(member.size);
+}
+
+bool Writer::flush()
+{
+    pending = 0;
+    return compressor->flush();
+}
+
+bool Writer::restart()
+{
+    // Nothing written since the last restart or rollback
+    if (pending == 0 && compressor->getOutputSize() == 0)
+    {
+        return true;
+    }
+
+    if (!compressor->finish())
+    {
+        return false;
+    }
+    base += compressor->getOutputSize();
+    pending = 0;
+    compressor =
+        makeCompressor(algorithm, output, dictionary.get(), parallelism);
+    return compressor != nullptr;
+}
+
+bool Writer::rollback(uint64_t offset)
+{
+    if (ftruncate(fd, offset) < 0 || lseek(fd, offset, SEEK_SET) < 0)
+    {
+        auto error = errno;
+        lg2::error("Failed to truncate the archive {PATH}, errno: {ERRNO}",
+                   "PATH", partial, "ERRNO", error);
+        return false;
+    }
+    base = offset;
+    pending = 0;
+    compressor =
+        makeCompressor(algorithm, output, dictionary.get(), parallelism);
+    return compressor != nullptr;
+}
+
+bool Writer::commit()
+{
+    // The end of the archive is marked by two zero blocks
+    static const std::array<char, 2 * BLOCK_SIZE> trailer{};
+    if (!write(trailer.data(), trailer.size()) ||
+        !compressor->finish())
+    {
+        return false;
+    }
+
+    if (fsync(fd) < 0)
+    {
+        auto error = errno;
+        lg2::error("Failed to sync the archive {PATH}, errno: {ERRNO}", "PATH",
+                   partial, "ERRNO", error);
+        return false;
+    }
+    close(fd);
+    fd = -1;
+
+    std::error_code ec;
+    std::filesystem::rename(partial, archive, ec);
+    if (ec)
+    {
+        lg2::error("Failed to rename the archive {PATH}, error: {ERROR}",
+                   "PATH", archive, "ERROR", ec.message());
+        return false;
+    }
+    committed = true;
+    return true;
+}
+
+std::optional<std::vector<uint8_t>> Writer::take()
+{
+    if (output >= 0 || !compressor->finish())
+    {
+        return std::nullopt;
+    }
+    committed = true;
+    return compressor->take();
+}
+
+bool Writer::finish()
+{
+    if (fd >= 0 || output < 0 || !compressor->finish())
+    {
+        return false;
+    }
+    committed = true;
+    return true;
+}
+
+Reader::Reader(const std::filesystem::path& archive,
+               std::shared_ptr<const Dictionary> dictionary) :
+    dictionary(std::move(dictionary))
+{
+    fd = open(archive.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "open " + archive.string());
+    }
+
+    // The compression is told by the magic number of the first stream
+    std::array<uint8_t, 6> magic{};
+    auto count = pread(fd, magic.data(), magic.size(), 0);
+    auto starts = [&](std::initializer_list<uint8_t> prefix) {
+        return count >= static_cast<ssize_t>(prefix.size()) &&
+               std::equal(prefix.begin(), prefix.end(), magic.begin());
+    };
+    try
+    {
+#ifdef HAVE_LZMA
+        if (starts({0xfd, '7', 'z', 'X', 'Z', 0x00}))
+        {
+            algorithm = Algorithm::xz;
+            decompressor = std::make_unique<UnXz>(fd);
+        }
+#endif
+#ifdef HAVE_ZLIB
+        if (starts({0x1f, 0x8b}))
+        {
+            algorithm = Algorithm::gzip;
+            decompressor = std::make_unique<Gunzip>(fd);
+        }
+#endif
+#ifdef HAVE_ZSTD
+        if (starts({0x28, 0xb5, 0x2f, 0xfd}))
+        {
+            algorithm = Algorithm::zstd;
+            decompressor =
+                std::make_unique<Unzstd>(fd, this->dictionary.get());
+        }
+#endif
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to initialize the decompressor, error: {ERROR}",
+                   "ERROR", e);
+    }
+    if (!decompressor)
+    {
+        close(fd);
+        throw std::system_error(std::make_error_code(std::errc::not_supported),
+                                "decompressor " + archive.string());
+    }
+}
+
+Reader::~Reader()
+{
+    close(fd);
+}
+
+bool Reader::readFully(void* data, size_t size)
+{
+    auto* bytes = static_cast<uint8_t*>(data);
+    while (size > 0)
+    {
+        auto count = decompressor->read(bytes, size);
+        if (count <= 0)
+        {
+            return false;
+        }
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool Reader::skip(uint64_t size)
+{
+    std::array<uint8_t, 64 * 1024> buf{};
+    while (size > 0)
+    {
+        auto count = std::min<uint64_t>(size, buf.size());
+        if (!readFully(buf.data(), count))
+        {
+            return false;
+        }
+        size -= count;
+    }
+    return true;
+}
+
+bool Reader::next(Member& member)
+{
+    if (!skip(remaining + padding))
+    {
+        return false;
+    }
+    remaining = padding = 0;
+    extents.clear();
+
+    // Values of the extended headers preceding the member
+    std::map<std::string, std::string> pax;
+    while (true)
+    {
+        Header header{};
+        if (!readFully(&header, sizeof(header)))
+        {
+            return false;
+        }
+        const auto* bytes = reinterpret_cast<const uint8_t*>(&header);
+        if (std::all_of(bytes, bytes + sizeof(header),
+                        [](uint8_t b) { return b == 0; }))
+        {
+            // End of the archive
+            return false;
+        }
+        if (std::memcmp(header.magic, "ustar", 5) != 0)
+        {
+            lg2::error("Invalid tar header in the archive");
+            return false;
+        }
+
+        auto size = parseNumber(header.size, sizeof(header.size));
+        if (auto iter = pax.find("size"); iter != pax.end())
+        {
+            size = std::strtoull(iter->second.c_str(), nullptr, 10);
+        }
+        auto type = header.typeflag == '\0' ? '0' : header.typeflag;
+        auto blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+
+        // pax extended headers and GNU long names apply to the next member
+        if (type == 'x' || type == 'g' || type == 'L' || type == 'K')
+        {
+            if (size > MAX_EXTENDED_HEADER)
+            {
+                lg2::error("Extended tar header too large: {SIZE}", "SIZE",
+                           size);
+                return false;
+            }
+            std::string data(blocks, '\0');
+            if (!readFully(data.data(), data.size()))
+            {
+                return false;
+            }
+            data.resize(size);
+            if (type == 'x')
+            {
+                pax.merge(parsePax(data));
+            }
+            else if (type == 'L')
+            {
+                pax["path"] = data.c_str();
+            }
+            else if (type == 'K')
+            {
+                pax["linkpath"] = data.c_str();
+            }
+            continue;
+        }
+
+        member.name = getString(header.name);
+        if (header.prefix[0] != '\0')
+        {
+            member.name = getString(header.prefix) + "/" + member.name;
+        }
+        member.link = getString(header.linkname);
+        if (auto iter = pax.find("path"); iter != pax.end())
+        {
+            member.name = iter->second;
+        }
+        if (auto iter = pax.find("linkpath"); iter != pax.end())
+        {
+            member.link = iter->second;
+        }
+        member.type = type;
+        member.mode = parseNumber(header.mode, sizeof(header.mode));
+        member.mtime = parseNumber(header.mtime, sizeof(header.mtime));
+        member.size = size;
+        remaining = size;
+        padding = blocks - size;
+
+        // A sparse member is read under its name and size as a file
+        if (auto iter = pax.find("GNU.sparse.major");
+            type == '0' && iter != pax.end() && iter->second == "1")
+        {
+            member.name = pax["GNU.sparse.name"];
+            member.size = sparseSize = std::strtoull(
+                pax["GNU.sparse.realsize"].c_str(), nullptr, 10);
+            return readSparseMap();
+        }
+        return true;
+    }
+}
+
+bool Reader::readSparseMap()
+{
+    // "<count>\n" and "<offset>\n<length>\n" for every extent, padded to
+    // the tar block size
+    std::string map;
+    std::vector<uint64_t> numbers;
+    size_t count = 1;
+    while (numbers.size() < count)
+    {
+        auto end = map.find('\n');
+        if (end != std::string::npos)
+        {
+            numbers.push_back(std::strtoull(map.c_str(), nullptr, 10));
+            map.erase(0, end + 1);
+            count = 1 + 2 * numbers.front();
+            continue;
+        }
+        if (remaining < BLOCK_SIZE || map.size() > MAX_SPARSE_MAP)
+        {
+            lg2::error("Invalid map of a sparse tar member");
+            return false;
+        }
+        std::array<char, BLOCK_SIZE> block{};
+        if (!readFully(block.data(), block.size()))
+        {
+            return false;
+        }
+        remaining -= BLOCK_SIZE;
+        map.append(block.data(), block.size());
+    }
+
+    for (size_t i = 1; i + 1 < numbers.size(); i += 2)
+    {
+        extents.emplace_back(numbers[i], numbers[i + 1]);
+    }
+    extent = 0;
+    offset = 0;
+    return true;
+}
+
+ssize_t Reader::read(void* data, size_t size)
+{
+    if (extents.empty())
+    {
+        auto count = std::min<uint64_t>(size, remaining);
+        if (count == 0)
+        {
+            return 0;
+        }
+        if (!readFully(data, count))
+        {
+            return -1;
+        }
+        remaining -= count;
+        return count;
+    }
+
+    // The holes between the extents of a sparse member are read as zeros
+    auto* bytes = static_cast<uint8_t*>(data);
+    size_t done = 0;
+    while (done < size && offset < sparseSize)
+    {
+        while (extent < extents.size() &&
+               extents[extent].first + extents[extent].second <= offset)
+        {
+            ++extent;
+        }
+        uint64_t count = 0;
+        if (extent == extents.size() || offset < extents[extent].first)
+        {
+            auto end = extent == extents.size()
+                           ? sparseSize
+                           : std::min(extents[extent].first, sparseSize);
+            count = std::min<uint64_t>(size - done, end - offset);
+            std::fill_n(bytes + done, count, 0);
+        }
+        else
+        {
+            count = std::min<uint64_t>(
+                size - done, extents[extent].first + extents[extent].second -
+                                 offset);
+            count = std::min<uint64_t>(count, sparseSize - offset);
+            if (count > remaining || !readFully(bytes + done, count))
+            {
+                return -1;
+            }
+            remaining -= count;
+        }
+        done += count;
+        offset += count;
+    }
+    return done;
+}
+
+ssize_t Reader::readStream(void* data, size_t size)
+{
+    return decompressor->read(static_cast<uint8_t*>(data), size);
+}
+
+} // namespace archive
+} // namespace dump
+} // namespace phosphor
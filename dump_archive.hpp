@@ -0,0 +1,592 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace archive
+{
+
+// Size of a tar block
+constexpr uint64_t BLOCK_SIZE = 512;
+
+/** @brief Compression algorithms of the dump archives */
+enum class Algorithm
+{
+    xz,
+    gzip,
+    zstd,
+};
+
+/** @brief Convert the name of a compression algorithm.
+ *  @param[in] name - "xz", "gzip" or "zstd".
+ *  @return The algorithm, std::nullopt if unknown or not built in.
+ */
+std::optional<Algorithm> toAlgorithm(const std::string& name);
+
+/** @brief Name of a compression algorithm, the inverse of toAlgorithm() */
+std::string toString(Algorithm algorithm);
+
+/** @brief Archive file extension of a compression algorithm, "tar.xz",
+ *         "tar.gz" or "tar.zst".
+ */
+std::string extension(Algorithm algorithm);
+
+/** @brief Size of the tar representation of a file or directory tree, a
+ *         sparse file counts with its data extents */
+uint64_t tarSize(const std::filesystem::path& path);
+
+/** @brief Outcome of adding an entry within a size limit */
+enum class Admission
+{
+    added,
+    rejected,
+    failed,
+};
+
+/** @struct Parallelism
+ *  @brief CPU budget of the compression.
+ */
+struct Parallelism
+{
+    /** @brief Number of compression threads, 1 compresses on the calling
+     *         thread.
+     */
+    unsigned threads = 1;
+
+    /** @brief Niceness added to the priority of the compression threads */
+    int nice = 0;
+};
+
+/** @class Dictionary
+ *  @brief A zstd dictionary, trained on the contents of earlier dumps.
+ *  @details Small, repetitive dumps compress considerably better with a
+ *  dictionary. Its id is stored in the header of every zstd frame, an
+ *  archive is decompressed with "zstd -d -D <dictionary file>".
+ */
+class Dictionary
+{
+  public:
+    Dictionary() = delete;
+    Dictionary(const Dictionary&) = delete;
+    Dictionary& operator=(const Dictionary&) = delete;
+    Dictionary(Dictionary&&) = delete;
+    Dictionary& operator=(Dictionary&&) = delete;
+    ~Dictionary();
+
+    /** @brief Constructor
+     *  @param[in] data - Contents of the dictionary.
+     *  @throws std::invalid_argument if the data is not a zstd dictionary
+     *          or zstd is not built in.
+     */
+    explicit Dictionary(const std::vector<uint8_t>& data);
+
+    /** @brief Load a dictionary file.
+     *  @param[in] file - Dictionary file, as written by "zstd --train".
+     *  @return The dictionary, nullptr if it could not be loaded.
+     */
+    static std::shared_ptr<const Dictionary> load(
+        const std::filesystem::path& file);
+
+    /** @brief Load the dictionary the dump archives are compressed with,
+     *         DUMP_COMPRESSION_DICTIONARY.
+     *  @return The dictionary, nullptr if none is configured or it could
+     *          not be loaded.
+     */
+    static std::shared_ptr<const Dictionary> configured();
+
+    /** @brief Id of the dictionary, stored in the zstd frame headers */
+    uint32_t getId() const
+    {
+        return id;
+    }
+
+    /** @brief The dictionary prepared for compression */
+    const ZSTD_CDict_s* get() const
+    {
+        return cdict;
+    }
+
+    /** @brief The dictionary prepared for decompression */
+    const ZSTD_DDict_s* getDDict() const
+    {
+        return ddict;
+    }
+
+  private:
+    /** @brief Id of the dictionary */
+    uint32_t id = 0;
+
+    /** @brief The dictionary prepared for compression */
+    ZSTD_CDict_s* cdict = nullptr;
+
+    /** @brief The dictionary prepared for decompression */
+    ZSTD_DDict_s* ddict = nullptr;
+};
+
+/** @class Compressor
+ *  @brief Streaming compressor writing to a file descriptor.
+ */
+class Compressor
+{
+  public:
+    Compressor() = delete;
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+    Compressor(Compressor&&) = delete;
+    Compressor& operator=(Compressor&&) = delete;
+    virtual ~Compressor() = default;
+
+    /** @brief Constructor
+     *  @param[in] fd - Descriptor the compressed data is written to, -1
+     *                  collects it in memory, see take().
+     */
+    explicit Compressor(int fd) : fd(fd) {}
+
+    /** @brief Compress data.
+     *  @return true on success.
+     */
+    virtual bool write(const void* data, size_t size) = 0;
+
+    /** @brief Write out all the data compressed so far, the stream stays
+     *         open.
+     *  @return true on success.
+     */
+    virtual bool flush() = 0;
+
+    /** @brief Complete the compressed stream.
+     *  @return true on success.
+     */
+    virtual bool finish() = 0;
+
+    /** @brief Number of compressed bytes written */
+    uint64_t getOutputSize() const
+    {
+        return outputSize;
+    }
+
+    /** @brief Take the compressed data collected in memory */
+    std::vector<uint8_t> take()
+    {
+        return std::exchange(collected, {});
+    }
+
+  protected:
+    /** @brief Write compressed data to the descriptor.
+     *  @return true on success.
+     */
+    bool output(const uint8_t* data, size_t size);
+
+    /** @brief Buffer for the compressed data */
+    std::vector<uint8_t> buffer = std::vector<uint8_t>(64 * 1024);
+
+  private:
+    /** @brief Descriptor the compressed data is written to */
+    int fd;
+
+    /** @brief Compressed data collected in memory, without a descriptor */
+    std::vector<uint8_t> collected;
+
+    /** @brief Number of compressed bytes written */
+    uint64_t outputSize = 0;
+};
+
+/** @brief Create a compressor.
+ *  @details With more than one thread the input is cut into blocks, which
+ *  are compressed in parallel into streams of their own and written in
+ *  order. The xz, gzip and zstd tools decompress the concatenated streams
+ *  as one.
+ *  @param[in] algorithm - Compression algorithm.
+ *  @param[in] fd - Descriptor the compressed data is written to.
+ *  @param[in] dictionary - Dictionary for zstd, may be nullptr.
+ *  @param[in] parallelism - Threads compressing the data.
+ *  @return The compressor, nullptr if it could not be initialized.
+ */
+std::unique_ptr<Compressor> makeCompressor(
+    Algorithm algorithm, int fd, const Dictionary* dictionary = nullptr,
+    const Parallelism& parallelism = {});
+
+/** @brief Level the dump archives are compressed at, the default level of
+ *         the xz, gzip or zstd tool.
+ */
+int defaultLevel(Algorithm algorithm);
+
+/** @brief Create a compressor at a compression level, compressing on the
+ *         calling thread.
+ *  @param[in] algorithm - Compression algorithm.
+ *  @param[in] fd - Descriptor the compressed data is written to.
+ *  @param[in] level - Level of the xz, gzip or zstd tool, clamped to the
+ *                     levels of the algorithm.
+ *  @param[in] inputSize - Size of the input, which bounds the memory of
+ *                         xz, 0 if unknown.
+ *  @param[in] dictionary - Dictionary for zstd, may be nullptr.
+ *  @return The compressor, nullptr if it could not be initialized.
+ */
+std::unique_ptr<Compressor> makeLevelCompressor(
+    Algorithm algorithm, int fd, int level, uint64_t inputSize,
+    const Dictionary* dictionary = nullptr);
+
+/** @brief Compress data into a stream of its own, in memory.
+ *  @details Streams concatenate, the xz, gzip and zstd tools decompress
+ *  them as one. The xz dictionary is bounded by the size of the data.
+ *  @param[in] algorithm - Compression algorithm.
+ *  @param[in] data - Data to compress.
+ *  @param[in] size - Size of the data.
+ *  @param[in] dictionary - Dictionary for zstd, may be nullptr.
+ *  @return The compressed stream, std::nullopt on failure.
+ */
+std::optional<std::vector<uint8_t>> compress(
+    Algorithm algorithm, const void* data, size_t size,
+    const Dictionary* dictionary = nullptr);
+
+/** @brief Offset and length of a data extent of a sparse file */
+using Extent = std::pair<uint64_t, uint64_t>;
+
+/** @struct Member
+ *  @brief A file, link or directory read from an archive.
+ */
+struct Member
+{
+    /** @brief Path in the archive, directories end with a slash */
+    std::string name;
+
+    /** @brief Target of a symbolic link */
+    std::string link;
+
+    /** @brief tar type flag, '0' for a regular file, '2' for a symbolic
+     *         link and '5' for a directory */
+    char type = '0';
+
+    /** @brief Permission bits */
+    uint32_t mode = 0;
+
+    /** @brief Modification time in seconds since the epoch */
+    time_t mtime = 0;
+
+    /** @brief Size of the contents */
+    uint64_t size = 0;
+};
+
+class Decompressor;
+
+/** @class Reader
+ *  @brief Reads a compressed tar archive in a single pass.
+ *  @details The compression is detected from the contents, concatenated
+ *  streams are read as one like the xz, gzip and zstd tools do. pax and GNU
+ *  long name headers are applied to the member they precede, sparse members
+ *  of the pax format 1.0 are read with their holes filled.
+ */
+class Reader
+{
+  public:
+    Reader() = delete;
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+    Reader(Reader&&) = delete;
+    Reader& operator=(Reader&&) = delete;
+    ~Reader();
+
+    /** @brief Constructor
+     *  @param[in] archive - Path of the archive.
+     *  @param[in] dictionary - Dictionary the archive was compressed with,
+     *                          nullptr for none.
+     *  @throws std::system_error if the file can't be opened or its
+     *          compression is not supported.
+     */
+    explicit Reader(const std::filesystem::path& archive,
+                    std::shared_ptr<const Dictionary> dictionary = nullptr);
+
+    /** @brief Move to the next member, skipping the rest of the current one.
+     *  @param[out] member - The member.
+     *  @return true if there is a member, false at the end of the archive
+     *          or on an error.
+     */
+    bool next(Member& member);
+
+    /** @brief Read the contents of the current member.
+     *  @return Number of bytes read, 0 at the end of the contents, -1 on an
+     *          error.
+     */
+    ssize_t read(void* data, size_t size);
+
+    /** @brief Read the decompressed tar stream as is, instead of the
+     *         members, not to be mixed with next() and read().
+     *  @return Number of bytes read, 0 at the end of the archive, -1 on an
+     *          error.
+     */
+    ssize_t readStream(void* data, size_t size);
+
+    /** @brief Compression algorithm of the archive */
+    Algorithm getAlgorithm() const
+    {
+        return algorithm;
+    }
+
+  private:
+    /** @brief Read decompressed data.
+     *  @return true if all of it was read.
+     */
+    bool readFully(void* data, size_t size);
+
+    /** @brief Skip decompressed data.
+     *  @return true on success.
+     */
+    bool skip(uint64_t size);
+
+    /** @brief Descriptor of the archive */
+    int fd = -1;
+
+    /** @brief Compression algorithm */
+    Algorithm algorithm = Algorithm::xz;
+
+    /** @brief Dictionary for zstd */
+    std::shared_ptr<const Dictionary> dictionary;
+
+    /** @brief Decompressor reading the archive */
+    std::unique_ptr<Decompressor> decompressor;
+
+    /** @brief Read the map of the data extents of a sparse member, which
+     *         precedes them in its contents.
+     *  @return true on success.
+     */
+    bool readSparseMap();
+
+    /** @brief Contents of the current member not read yet, as stored */
+    uint64_t remaining = 0;
+
+    /** @brief Padding of the current member to the tar block size */
+    uint64_t padding = 0;
+
+    /** @brief Data extents of the current member if it is sparse, the
+     *         holes between them are read as zeros */
+    std::vector<Extent> extents;
+
+    /** @brief Extent of the current sparse member read next */
+    size_t extent = 0;
+
+    /** @brief Offset of the current sparse member read next */
+    uint64_t offset = 0;
+
+    /** @brief Size of the current sparse member */
+    uint64_t sparseSize = 0;
+};
+
+/** @class Writer
+ *  @brief Writes a compressed tar archive in a single pass.
+ *  @details The archive is written to a hidden temporary file next to its
+ *  final path and renamed into place once complete, so a partial archive
+ *  is never visible under the final name. Regular files with holes, core
+ *  files mostly, are stored as sparse members of the pax format 1.0, which
+ *  GNU tar and bsdtar extract with the holes.
+ */
+class Writer
+{
+  public:
+    Writer() = delete;
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+    Writer(Writer&&) = delete;
+    Writer& operator=(Writer&&) = delete;
+
+    /** @brief Constructor
+     *  @param[in] archive - Final path of the archive.
+     *  @param[in] algorithm - Compression algorithm.
+     *  @param[in] dictionary - Dictionary for zstd, nullptr for none.
+     *  @param[in] parallelism - Threads compressing the archive.
+     *  @throws std::system_error if the file can't be created.
+     */
+    Writer(const std::filesystem::path& archive, Algorithm algorithm,
+           std::shared_ptr<const Dictionary> dictionary = nullptr,
+           const Parallelism& parallelism = {});
+
+    /** @brief Constructor of an archive written to memory, see take().
+     *  @param[in] algorithm - Compression algorithm.
+     *  @param[in] dictionary - Dictionary for zstd, nullptr for none.
+     *  @throws std::system_error if the algorithm is not supported.
+     */
+    explicit Writer(Algorithm algorithm,
+                    std::shared_ptr<const Dictionary> dictionary = nullptr);
+
+    /** @brief Constructor of an archive written to a descriptor, a pipe or
+     *         socket, see finish().
+     *  @param[in] output - Descriptor the compressed data is written to, it
+     *                      stays open.
+     *  @param[in] algorithm - Compression algorithm.
+     *  @param[in] dictionary - Dictionary for zstd, nullptr for none.
+     *  @throws std::system_error if the algorithm is not supported.
+     */
+    Writer(int output, Algorithm algorithm,
+           std::shared_ptr<const Dictionary> dictionary = nullptr);
+
+    /** @brief Destructor, removes the temporary file if the archive was
+     *         not committed.
+     */
+    ~Writer();
+
+    /** @brief Add a directory entry.
+     *  @param[in] name - Path of the directory in the archive.
+     *  @return true on success.
+     */
+    bool addDirectory(const std::string& name);
+
+    /** @brief Add a file, symbolic link or directory tree.
+     *  @param[in] path - Path of the file to add.
+     *  @param[in] name - Path of the file in the archive.
+     *  @return true on success.
+     */
+    bool add(const std::filesystem::path& path, const std::string& name);
+
+    /** @brief Add a file, symbolic link or directory tree if the archive
+     *         stays within a size limit.
+     *  @details While the archive is clearly below the limit the entry is
+     *  added without any extra work. Close to the limit the entry is
+     *  compressed into a stream of its own, which is measured exactly and
+     *  dropped again if the limit is exceeded. The archive then consists
+     *  of concatenated streams, which the xz, gzip and zstd tools
+     *  decompress as one.
+     *  @param[in] path - Path of the file to add.
+     *  @param[in] name - Path of the file in the archive.
+     *  @param[in] limit - Maximum size of the archive in bytes.
+     *  @return Whether the entry was added.
+     */
+    Admission add(const std::filesystem::path& path, const std::string& name,
+                  uint64_t limit);
+
+    /** @brief Copy the current member of another archive.
+     *  @param[in] reader - Archive positioned at the member.
+     *  @param[in] member - The member, as returned by Reader::next().
+     *  @param[in] name - Path of the member in this archive.
+     *  @return true on success.
+     */
+    bool add(Reader& reader, const Member& member, const std::string& name);
+
+    /** @brief Write out all the data compressed so far.
+     *  @return true on success.
+     */
+    bool flush();
+
+    /** @brief Number of compressed bytes written so far */
+    uint64_t size() const
+    {
+        return base + compressor->getOutputSize();
+    }
+
+    /** @brief Complete the archive and move it to its final path.
+     *  @return true on success.
+     */
+    bool commit();
+
+    /** @brief Complete the compressed stream of an archive written to
+     *         memory, without the end of archive blocks.
+     *  @details Another archive appended to the data continues this one,
+     *  the tar tools read the concatenation as a single archive.
+     *  @return The compressed data, std::nullopt on failure.
+     */
+    std::optional<std::vector<uint8_t>> take();
+
+    /** @brief Complete the compressed stream of an archive written to a
+     *         descriptor, without the end of archive blocks, as take().
+     *  @return true on success.
+     */
+    bool finish();
+
+    /** @brief Hidden temporary path an archive is written to */
+    static std::filesystem::path partialPath(
+        const std::filesystem::path& archive);
+
+  private:
+    /** @brief Pass data to the compressor */
+    bool write(const void* data, size_t size);
+
+    /** @brief Complete the current compressed stream and start a new one.
+     *  @return true on success.
+     */
+    bool restart();
+
+    /** @brief Drop everything written after an offset, which has to be at
+     *         a stream boundary.
+     *  @return true on success.
+     */
+    bool rollback(uint64_t offset);
+
+    /** @brief Write a tar header, with a pax extended header if the
+     *         values don't fit or there are pax records for the member.
+     */
+    bool writeHeader(const std::string& name, const struct stat& st,
+                     char type, const std::string& link = {},
+                     const std::string& records = {});
+
+    /** @brief Write the contents of a regular file */
+    bool writeContents(int fd, uint64_t size);
+
+    /** @brief Write a range of a regular file from its current offset,
+     *         without the padding */
+    bool writeRange(int fd, uint64_t size);
+
+    /** @brief Write a sparse regular file, only its data extents are read
+     *         and stored.
+     *  @param[in] name - Path of the file in the archive.
+     *  @param[in] st - Status of the file.
+     *  @param[in] fd - Descriptor of the file.
+     *  @param[in] extents - Offset and length of the data extents.
+     *  @return true on success.
+     */
+    bool writeSparse(const std::string& name, const struct stat& st, int fd,
+                     const std::vector<Extent>& extents);
+
+    /** @brief Pad the current entry to the tar block size */
+    bool pad(uint64_t size);
+
+    /** @brief Final path of the archive */
+    std::filesystem::path archive;
+
+    /** @brief Temporary path of the archive */
+    std::filesystem::path partial;
+
+    /** @brief Descriptor of the temporary file, -1 for an archive written
+     *         to memory or to a descriptor */
+    int fd = -1;
+
+    /** @brief Descriptor the compressor writes to, -1 for an archive
+     *         written to memory */
+    int output = -1;
+
+    /** @brief Compression algorithm */
+    Algorithm algorithm;
+
+    /** @brief Dictionary for zstd */
+    std::shared_ptr<const Dictionary> dictionary;
+
+    /** @brief Threads compressing the archive */
+    Parallelism parallelism;
+
+    /** @brief Compressor writing to the output */
+    std::unique_ptr<Compressor> compressor;
+
+    /** @brief Size of the completed compressed streams */
+    uint64_t base = 0;
+
+    /** @brief Input passed to the compressor since the last flush */
+    uint64_t pending = 0;
+
+    /** @brief Whether the archive was moved to its final path */
+    bool committed = false;
+};
+
+} // namespace archive
+} // namespace dump
+} // namespace phosphor
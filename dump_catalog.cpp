@@ -0,0 +1,242 @@
+#include "dump_catalog.hpp"
+
+#include "dump_tier.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace catalog
+{
+
+namespace
+{
+
+constexpr std::string_view MAGIC = "PDCT";
+
+// Current version of the catalog layout
+constexpr uint16_t VERSION = 1;
+
+// Magic, version and a reserved field
+constexpr size_t HEADER_SIZE = 8;
+
+// Event type and length of the record
+constexpr size_t EVENT_HEADER_SIZE = 5;
+
+std::string header()
+{
+    std::string out(MAGIC);
+    out.push_back(static_cast<char>(VERSION & 0xFF));
+    out.push_back(static_cast<char>(VERSION >> 8));
+    out.append(2, '\0');
+    return out;
+}
+
+void putEvent(std::string& out, uint8_t event, const std::string& data)
+{
+    out.push_back(static_cast<char>(event));
+    for (size_t i = 0; i < 4; ++i)
+    {
+        out.push_back(static_cast<char>(data.size() >> (8 * i)));
+    }
+    out.append(data);
+}
+
+} // namespace
+
+Catalog::~Catalog()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+std::optional<std::map<uint32_t, record::Record>> Catalog::load()
+{
+    std::ifstream is(path, std::ios::binary);
+    if (!is.is_open())
+    {
+        return std::nullopt;
+    }
+    std::string contents{std::istreambuf_iterator<char>(is),
+                         std::istreambuf_iterator<char>()};
+    is.close();
+
+    if (contents.size() < HEADER_SIZE || !contents.starts_with(MAGIC) ||
+        static_cast<uint8_t>(contents[4]) != VERSION || contents[5] != 0)
+    {
+        lg2::error("Invalid dump catalog {PATH}", "PATH", path);
+        return std::nullopt;
+    }
+
+    std::map<uint32_t, record::Record> current;
+    records.clear();
+    events = 0;
+    std::string_view rest(contents);
+    rest.remove_prefix(HEADER_SIZE);
+    while (rest.size() >= EVENT_HEADER_SIZE)
+    {
+        auto event = static_cast<Event>(rest[0]);
+        size_t length = 0;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            length |= static_cast<size_t>(static_cast<uint8_t>(rest[1 + i]))
+                      << (8 * i);
+        }
+        if (rest.size() - EVENT_HEADER_SIZE < length)
+        {
+            break;
+        }
+
+        auto data = rest.substr(EVENT_HEADER_SIZE, length);
+        auto record = record::decode(data);
+        if (!record || (event != Event::put && event != Event::erase))
+        {
+            lg2::error("Damaged event in the dump catalog {PATH} at offset "
+                       "{OFFSET}",
+                       "PATH", path, "OFFSET", contents.size() - rest.size());
+            records.clear();
+            return std::nullopt;
+        }
+        if (event == Event::put)
+        {
+            records.insert_or_assign(record->dumpId, std::string(data));
+            current.insert_or_assign(record->dumpId, std::move(*record));
+        }
+        else
+        {
+            records.erase(record->dumpId);
+            current.erase(record->dumpId);
+        }
+        ++events;
+        rest.remove_prefix(EVENT_HEADER_SIZE + length);
+    }
+
+    if (!rest.empty())
+    {
+        // Torn by a power loss during the append
+        lg2::info("Dropping a torn event at the end of the dump catalog "
+                  "{PATH}, size: {SIZE}",
+                  "PATH", path, "SIZE", rest.size());
+        if (truncate(path.c_str(), contents.size() - rest.size()) < 0)
+        {
+            auto error = errno;
+            lg2::error("Failed to truncate the dump catalog {PATH}, "
+                       "errno: {ERRNO}",
+                       "PATH", path, "ERRNO", error);
+            records.clear();
+            return std::nullopt;
+        }
+    }
+    return current;
+}
+
+void Catalog::put(const record::Record& record)
+{
+    auto data = record::encode(record);
+    records.insert_or_assign(record.dumpId, data);
+    append(Event::put, data);
+}
+
+void Catalog::erase(uint32_t id)
+{
+    if (records.erase(id) == 0)
+    {
+        return;
+    }
+    record::Record record;
+    record.dumpId = id;
+    append(Event::erase, record::encode(record));
+}
+
+void Catalog::rebuild(const std::map<uint32_t, record::Record>& current)
+{
+    records.clear();
+    for (const auto& [id, record] : current)
+    {
+        records.emplace(id, record::encode(record));
+    }
+    compact();
+}
+
+void Catalog::append(Event event, const std::string& data)
+{
+    if (events >= COMPACT_MIN_EVENTS && events >= 2 * records.size())
+    {
+        compact();
+        return;
+    }
+
+    if (fd < 0)
+    {
+        fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                  0644);
+        if (fd < 0)
+        {
+            auto error = errno;
+            lg2::error("Failed to open the dump catalog {PATH}, "
+                       "errno: {ERRNO}",
+                       "PATH", path, "ERRNO", error);
+            return;
+        }
+    }
+
+    // A single write, a power loss leaves at most a torn event at the end
+    std::string out;
+    if (lseek(fd, 0, SEEK_END) == 0)
+    {
+        out = header();
+    }
+    putEvent(out, static_cast<uint8_t>(event), data);
+    auto written = write(fd, out.data(), out.size());
+    if (written != static_cast<ssize_t>(out.size()) || fdatasync(fd) < 0)
+    {
+        auto error = errno;
+        lg2::error("Failed to append to the dump catalog {PATH}, "
+                   "errno: {ERRNO}",
+                   "PATH", path, "ERRNO", error);
+
+        // Rewritten with the records, which drops a partial event
+        close(fd);
+        fd = -1;
+        compact();
+        return;
+    }
+    tier::written(path, out.size());
+    ++events;
+}
+
+void Catalog::compact()
+{
+    std::string out = header();
+    for (const auto& [id, data] : records)
+    {
+        putEvent(out, static_cast<uint8_t>(Event::put), data);
+    }
+
+    // The descriptor refers to the replaced file afterwards
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    if (record::replaceFile(path, out))
+    {
+        events = records.size();
+    }
+}
+
+} // namespace catalog
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "dump_record.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace catalog
+{
+
+// Catalog of the dumps in the dump directory
+constexpr auto CATALOG_FILE = ".catalog";
+
+// The catalog is compacted when the events are more than twice the dumps,
+// and at least this many
+constexpr size_t COMPACT_MIN_EVENTS = 64;
+
+/** @class Catalog
+ *  @brief Append-only log of the dump entries of a dump directory.
+ *  @details Every change of an entry appends an event to the catalog, the
+ *  full record of the entry when it is created, updated or offloaded, and
+ *  its id when it is deleted. Replaying the events restores all entries
+ *  with a single sequential read, instead of a scan of every dump
+ *  directory. The catalog is rewritten with only the current records once
+ *  the events outnumber the dumps.
+ *
+ *  A torn event at the end of the catalog, left by a power loss during an
+ *  append, is dropped. Any other damage makes load() fail, the dump
+ *  directories are scanned then and the catalog is rebuilt with rebuild().
+ */
+class Catalog
+{
+  public:
+    Catalog() = delete;
+    Catalog(const Catalog&) = delete;
+    Catalog& operator=(const Catalog&) = delete;
+    Catalog(Catalog&&) = delete;
+    Catalog& operator=(Catalog&&) = delete;
+
+    /** @brief Constructor
+     *  @param[in] path - Path of the catalog file.
+     */
+    explicit Catalog(const std::filesystem::path& path) : path(path) {}
+
+    ~Catalog();
+
+    /** @brief Replay the catalog.
+     *  @return The current records by dump id, std::nullopt if the catalog
+     *          is missing or damaged.
+     */
+    std::optional<std::map<uint32_t, record::Record>> load();
+
+    /** @brief Record that an entry was created or changed */
+    void put(const record::Record& record);
+
+    /** @brief Record that an entry was deleted */
+    void erase(uint32_t id);
+
+    /** @brief Replace the catalog with the given records, after a scan of
+     *         the dump directories.
+     */
+    void rebuild(const std::map<uint32_t, record::Record>& records);
+
+  private:
+    /** @brief Events of the catalog */
+    enum class Event : uint8_t
+    {
+        put = 1,
+        erase = 2,
+    };
+
+    /** @brief Append an event to the catalog */
+    void append(Event event, const std::string& data);
+
+    /** @brief Rewrite the catalog with the current records */
+    void compact();
+
+    /** @brief Path of the catalog file */
+    std::filesystem::path path;
+
+    /** @brief Descriptor of the catalog file for appending, -1 if closed */
+    int fd = -1;
+
+    /** @brief The current encoded records by dump id */
+    std::map<uint32_t, std::string> records;
+
+    /** @brief Number of events in the catalog file */
+    size_t events = 0;
+};
+
+} // namespace catalog
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,785 @@
+#include "dump_chunk.hpp"
+
+#include "dump_record.hpp"
+#include "dump_tier.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <system_error>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace chunk
+{
+
+namespace
+{
+
+constexpr std::string_view MAGIC = "PDCR";
+
+// Current version of the recipe layout
+constexpr uint16_t VERSION = 1;
+
+// Magic, version, algorithm, a reserved byte, dictionary id and the number
+// of chunks
+constexpr size_t HEADER_SIZE = 16;
+
+// Key, size and stored size of a chunk
+constexpr size_t PIECE_SIZE = 24;
+
+// Size of the reads from the archive and the chunk files
+constexpr size_t COPY_SIZE = 64 * 1024;
+
+/** @brief Random values of the bytes for the gear hash */
+constexpr std::array<uint64_t, 256> makeGear()
+{
+    // splitmix64
+    std::array<uint64_t, 256> gear{};
+    uint64_t state = 0;
+    for (auto& value : gear)
+    {
+        state += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        value = z ^ (z >> 31);
+    }
+    return gear;
+}
+
+constexpr auto GEAR = makeGear();
+
+/** @brief Size of the contents of a tar member, 0 if the block is not a
+ *         ustar header.
+ */
+uint64_t memberSize(const std::array<uint8_t, archive::BLOCK_SIZE>& header)
+{
+    constexpr size_t SIZE_OFFSET = 124;
+    constexpr size_t SIZE_LENGTH = 12;
+    constexpr std::string_view USTAR = "ustar";
+    if (std::string_view(reinterpret_cast<const char*>(header.data()) + 257,
+                         USTAR.size()) != USTAR)
+    {
+        return 0;
+    }
+
+    uint64_t size = 0;
+    if (header[SIZE_OFFSET] & 0x80)
+    {
+        // base-256 of GNU tar for sizes beyond 8 GiB
+        for (size_t i = 1; i < SIZE_LENGTH; ++i)
+        {
+            size = (size << 8) | header[SIZE_OFFSET + i];
+        }
+        return size;
+    }
+    for (size_t i = 0; i < SIZE_LENGTH; ++i)
+    {
+        auto c = header[SIZE_OFFSET + i];
+        if (c == ' ' && size == 0)
+        {
+            continue;
+        }
+        if (c < '0' || c > '7')
+        {
+            break;
+        }
+        size = (size << 3) | (c - '0');
+    }
+    return size;
+}
+
+void putInt(std::string& out, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+uint64_t getInt(std::string_view in, size_t offset, size_t size)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(in[offset + i]))
+                 << (8 * i);
+    }
+    return value;
+}
+
+std::string encodeRecipe(const Recipe& recipe)
+{
+    std::string out(MAGIC);
+    putInt(out, VERSION, 2);
+    putInt(out, static_cast<uint8_t>(recipe.algorithm), 1);
+    putInt(out, 0, 1);
+    putInt(out, recipe.dictionaryId, 4);
+    putInt(out, recipe.pieces.size(), 4);
+    for (const auto& piece : recipe.pieces)
+    {
+        out.append(reinterpret_cast<const char*>(piece.key.bytes.data()),
+                   piece.key.bytes.size());
+        putInt(out, piece.size, 4);
+        putInt(out, piece.stored, 4);
+    }
+    putInt(out, record::crc32(out), 4);
+    return out;
+}
+
+std::optional<Recipe> decodeRecipe(std::string_view in)
+{
+    if (in.size() < HEADER_SIZE + 4 || !in.starts_with(MAGIC) ||
+        getInt(in, 4, 2) != VERSION ||
+        getInt(in, 6, 1) > static_cast<uint8_t>(archive::Algorithm::zstd))
+    {
+        return std::nullopt;
+    }
+    auto count = getInt(in, 12, 4);
+    if ((in.size() - HEADER_SIZE - 4) / PIECE_SIZE != count ||
+        (in.size() - HEADER_SIZE - 4) % PIECE_SIZE != 0 ||
+        record::crc32(in.substr(0, in.size() - 4)) !=
+            getInt(in, in.size() - 4, 4))
+    {
+        return std::nullopt;
+    }
+
+    Recipe recipe;
+    recipe.algorithm = static_cast<archive::Algorithm>(getInt(in, 6, 1));
+    recipe.dictionaryId = getInt(in, 8, 4);
+    recipe.pieces.resize(count);
+    size_t offset = HEADER_SIZE;
+    for (auto& piece : recipe.pieces)
+    {
+        std::copy_n(in.begin() + offset, piece.key.bytes.size(),
+                    piece.key.bytes.begin());
+        piece.size = getInt(in, offset + 16, 4);
+        piece.stored = getInt(in, offset + 20, 4);
+        offset += PIECE_SIZE;
+    }
+    return recipe;
+}
+
+/** @brief Key of a chunk file name, std::nullopt if not a chunk */
+std::optional<Key> parseKey(const std::string& hex)
+{
+    Key key;
+    if (hex.size() != 2 * key.bytes.size())
+    {
+        return std::nullopt;
+    }
+    for (size_t i = 0; i < key.bytes.size(); ++i)
+    {
+        unsigned value = 0;
+        if (std::sscanf(hex.c_str() + 2 * i, "%2x", &value) != 1 ||
+            !std::isxdigit(hex[2 * i]) || !std::isxdigit(hex[2 * i + 1]))
+        {
+            return std::nullopt;
+        }
+        key.bytes[i] = value;
+    }
+    return key;
+}
+
+/** @brief Path of a chunk file in a store directory */
+std::filesystem::path chunkPath(const std::filesystem::path& dir,
+                                const Key& key)
+{
+    auto hex = key.hex();
+    return dir / hex.substr(0, 2) / hex.substr(2);
+}
+
+/** @brief Space used by a file of a size in kilobytes, rounded up */
+uint64_t kilobytes(uint64_t size)
+{
+    return (size + 1023) / 1024;
+}
+
+/** @brief Write all of the data to a descriptor */
+bool writeAll(int fd, const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        auto count = write(fd, data, size);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+/** @brief Write all of the data to a non-blocking descriptor, waiting
+ *         while it is full.
+ *  @return false on an error or once cancelled.
+ */
+bool writeAll(int fd, const uint8_t* data, size_t size,
+              const std::atomic<bool>& cancelled)
+{
+    while (size > 0)
+    {
+        if (cancelled)
+        {
+            return false;
+        }
+        auto count = write(fd, data, size);
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            struct pollfd state{};
+            state.fd = fd;
+            state.events = POLLOUT;
+            poll(&state, 1, WRITE_POLL_INTERVAL.count());
+            continue;
+        }
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+} // namespace
+
+std::string Key::hex() const
+{
+    std::string out;
+    out.reserve(2 * bytes.size());
+    for (auto byte : bytes)
+    {
+        std::array<char, 3> digits{};
+        std::snprintf(digits.data(), digits.size(), "%02x", byte);
+        out.append(digits.data(), 2);
+    }
+    return out;
+}
+
+Key makeKey(std::span<const uint8_t> data, archive::Algorithm algorithm,
+            uint32_t dictionaryId)
+{
+    // FNV-1a and a multiply-xorshift hash, 64 bits each
+    uint64_t fnv = 0xcbf29ce484222325ULL;
+    uint64_t mix = 0x9e3779b97f4a7c15ULL;
+    auto update = [&](uint8_t byte) {
+        fnv = (fnv ^ byte) * 0x100000001b3ULL;
+        mix = (mix ^ byte) * 0xff51afd7ed558ccdULL;
+        mix ^= mix >> 32;
+    };
+
+    std::string prefix;
+    putInt(prefix, static_cast<uint8_t>(algorithm), 1);
+    putInt(prefix, dictionaryId, 4);
+    putInt(prefix, data.size(), 8);
+    for (auto c : prefix)
+    {
+        update(static_cast<uint8_t>(c));
+    }
+    for (auto byte : data)
+    {
+        update(byte);
+    }
+
+    Key key;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        key.bytes[i] = static_cast<uint8_t>(fnv >> (8 * i));
+        key.bytes[8 + i] = static_cast<uint8_t>(mix >> (8 * i));
+    }
+    return key;
+}
+
+bool Chunker::write(const void* data, size_t size)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto byte = bytes[i];
+        buffer.push_back(byte);
+        hash = (hash << 1) + GEAR[byte];
+
+        if (remaining == 0)
+        {
+            header[headerSize++] = byte;
+            if (headerSize == header.size())
+            {
+                headerSize = 0;
+                auto contents = memberSize(header);
+                remaining = (contents + archive::BLOCK_SIZE - 1) /
+                            archive::BLOCK_SIZE * archive::BLOCK_SIZE;
+                if (contents >= MEMBER_CUT_SIZE)
+                {
+                    // The header stays with the preceding members
+                    large = true;
+                    if (!cut())
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+            }
+        }
+        else if (--remaining == 0 && large)
+        {
+            large = false;
+            if (!cut())
+            {
+                return false;
+            }
+            continue;
+        }
+
+        // The top bits depend on the last 64 bytes
+        if ((buffer.size() >= MIN_CHUNK_SIZE &&
+             (hash >> (64 - CHUNK_MASK_BITS)) == 0) ||
+            buffer.size() >= MAX_CHUNK_SIZE)
+        {
+            if (!cut())
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool Chunker::finish()
+{
+    return buffer.empty() || cut();
+}
+
+bool Chunker::cut()
+{
+    auto ok = sink(buffer);
+    buffer.clear();
+    hash = 0;
+    return ok;
+}
+
+std::optional<Recipe> loadRecipe(const std::filesystem::path& path)
+{
+    std::ifstream is(path, std::ios::binary);
+    if (!is.is_open())
+    {
+        return std::nullopt;
+    }
+    std::string contents{std::istreambuf_iterator<char>(is),
+                         std::istreambuf_iterator<char>()};
+    return decodeRecipe(contents);
+}
+
+bool isRecipe(const std::filesystem::path& file)
+{
+    return file.filename().string().ends_with(RECIPE_SUFFIX);
+}
+
+std::filesystem::path chunkFile(const std::filesystem::path& recipe,
+                                const Key& key)
+{
+    // The recipe is <dumpDir>/<id>/<name>.recipe
+    return chunkPath(recipe.parent_path().parent_path() / STORE_DIR, key);
+}
+
+bool writeArchive(const std::filesystem::path& recipe, int fd,
+                  const std::atomic<bool>& cancelled)
+{
+    auto loaded = loadRecipe(recipe);
+    if (!loaded)
+    {
+        lg2::error("Invalid dump recipe {PATH}", "PATH", recipe);
+        return false;
+    }
+
+    std::vector<uint8_t> buf(COPY_SIZE);
+    for (const auto& piece : loaded->pieces)
+    {
+        auto path = chunkFile(recipe, piece.key);
+        int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+        {
+            lg2::error("Missing chunk {PATH} of dump {DUMP}", "PATH", path,
+                       "DUMP", recipe);
+            return false;
+        }
+        uint64_t copied = 0;
+        ssize_t count = 0;
+        auto written = true;
+        while ((count = read(in, buf.data(), buf.size())) > 0 &&
+               (written = writeAll(fd, buf.data(), count, cancelled)))
+        {
+            copied += count;
+        }
+        close(in);
+
+        // A reader closing its end fails the write, which is not an error
+        if (!written)
+        {
+            return false;
+        }
+        if (count != 0 || copied != piece.stored)
+        {
+            lg2::error("Failed to read the chunk {PATH} of dump {DUMP}",
+                       "PATH", path, "DUMP", recipe);
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t archiveSize(const std::filesystem::path& file)
+{
+    if (!isRecipe(file))
+    {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(file, ec);
+        return ec ? 0 : size;
+    }
+
+    uint64_t size = 0;
+    if (auto recipe = loadRecipe(file))
+    {
+        for (const auto& piece : recipe->pieces)
+        {
+            size += piece.stored;
+        }
+    }
+    return size;
+}
+
+Store::Store(const std::filesystem::path& dir, trash::Reaper* reaper) :
+    dir(dir), reaper(reaper), dictionary(archive::Dictionary::configured())
+{}
+
+bool Store::ingest(uint32_t id, const std::filesystem::path& archive,
+                   const std::filesystem::path& recipePath)
+{
+    Recipe recipe;
+    bool ingested = false;
+    try
+    {
+        archive::Reader reader(archive, dictionary);
+        recipe.algorithm = reader.getAlgorithm();
+        if (recipe.algorithm == archive::Algorithm::zstd && dictionary)
+        {
+            recipe.dictionaryId = dictionary->getId();
+        }
+
+        Chunker chunker([&](std::span<const uint8_t> data) {
+            auto key = makeKey(data, recipe.algorithm, recipe.dictionaryId);
+            auto stored = acquire(id, key, data, recipe.algorithm);
+            if (!stored)
+            {
+                return false;
+            }
+            recipe.pieces.push_back({key, static_cast<uint32_t>(data.size()),
+                                     static_cast<uint32_t>(*stored)});
+            return true;
+        });
+
+        std::vector<uint8_t> buf(COPY_SIZE);
+        ssize_t count = 0;
+        while ((count = reader.readStream(buf.data(), buf.size())) > 0)
+        {
+            if (!chunker.write(buf.data(), count))
+            {
+                count = -1;
+                break;
+            }
+        }
+        ingested = count == 0 && chunker.finish();
+    }
+    catch (const std::system_error& e)
+    {
+        lg2::error("Failed to read the dump archive {PATH}, error: {ERROR}",
+                   "PATH", archive, "ERROR", e);
+    }
+
+    // The chunks are durable before the recipe refers to them
+    std::error_code ec;
+    std::filesystem::create_directories(recipePath.parent_path(), ec);
+    if (ingested)
+    {
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        ingested = fd >= 0 && syncfs(fd) == 0;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    if (!ingested || !record::replaceFile(recipePath, encodeRecipe(recipe)))
+    {
+        lg2::error("Failed to move dump {ID} into the chunk store, keeping "
+                   "the archive",
+                   "ID", id);
+        release(id);
+        return false;
+    }
+    return true;
+}
+
+std::optional<uint64_t> Store::acquire(uint32_t id, const Key& key,
+                                       std::span<const uint8_t> data,
+                                       archive::Algorithm algorithm)
+{
+    {
+        std::lock_guard lock(mutex);
+        auto iter = chunks.find(key);
+        if (iter != chunks.end())
+        {
+            iter->second.owners.insert(id);
+            dumps[id].insert(key);
+            return iter->second.stored;
+        }
+    }
+
+    // Compressed and written without the lock, another collection may
+    // store the same chunk meanwhile
+    auto compressed = archive::compress(
+        algorithm, data.data(), data.size(),
+        algorithm == archive::Algorithm::zstd ? dictionary.get() : nullptr);
+    if (!compressed)
+    {
+        return std::nullopt;
+    }
+
+    auto path = chunkPath(dir, key);
+    auto temp = path.parent_path() /
+                ("." + path.filename().string() + "." + std::to_string(id));
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (fd < 0)
+    {
+        auto error = errno;
+        lg2::error("Failed to create the chunk {PATH}, errno: {ERRNO}",
+                   "PATH", temp, "ERRNO", error);
+        return std::nullopt;
+    }
+    auto written = writeAll(fd, compressed->data(), compressed->size());
+    auto error = errno;
+    close(fd);
+    if (!written)
+    {
+        lg2::error("Failed to write the chunk {PATH}, errno: {ERRNO}",
+                   "PATH", temp, "ERRNO", error);
+        std::filesystem::remove(temp, ec);
+        return std::nullopt;
+    }
+
+    std::lock_guard lock(mutex);
+    auto [iter, inserted] = chunks.try_emplace(key);
+    if (!inserted)
+    {
+        std::filesystem::remove(temp, ec);
+    }
+    else if (std::filesystem::rename(temp, path, ec); ec)
+    {
+        lg2::error("Failed to store the chunk {PATH}, error: {ERROR}", "PATH",
+                   path, "ERROR", ec.message());
+        chunks.erase(iter);
+        std::filesystem::remove(temp, ec);
+        return std::nullopt;
+    }
+    else
+    {
+        iter->second.stored = compressed->size();
+        total += kilobytes(iter->second.stored);
+        tier::written(path, iter->second.stored);
+    }
+    iter->second.owners.insert(id);
+    dumps[id].insert(key);
+    return iter->second.stored;
+}
+
+std::vector<uint32_t> Store::release(uint32_t id)
+{
+    std::unique_lock lock(mutex);
+    auto dump = dumps.find(id);
+    if (dump == dumps.end())
+    {
+        return {};
+    }
+
+    std::set<uint32_t> changed;
+    std::vector<std::filesystem::path> orphans;
+    uint64_t size = 0;
+    for (const auto& key : dump->second)
+    {
+        auto iter = chunks.find(key);
+        if (iter == chunks.end())
+        {
+            continue;
+        }
+        auto& owners = iter->second.owners;
+        owners.erase(id);
+        if (owners.size() == 1)
+        {
+            changed.insert(*owners.begin());
+        }
+        else if (owners.empty())
+        {
+            orphans.push_back(chunkPath(dir, key));
+            size += kilobytes(iter->second.stored);
+            chunks.erase(iter);
+        }
+    }
+    dumps.erase(dump);
+    total -= size;
+    lock.unlock();
+
+    // Thousands of chunks for a large dump, unlinked off the event loop
+    if (reaper)
+    {
+        reaper->discard(std::move(orphans), size,
+                        [this](const std::filesystem::path& path) {
+                            return remove(path);
+                        });
+    }
+    else
+    {
+        for (const auto& path : orphans)
+        {
+            remove(path);
+        }
+    }
+    return {changed.begin(), changed.end()};
+}
+
+bool Store::remove(const std::filesystem::path& path)
+{
+    // A collection storing the chunk again holds the lock while it moves
+    // the new file into place
+    auto key = parseKey(path.parent_path().filename().string() +
+                        path.filename().string());
+    std::lock_guard lock(mutex);
+    if (key && chunks.contains(*key))
+    {
+        return true;
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return !ec;
+}
+
+void Store::load(const std::map<uint32_t, std::filesystem::path>& recipes)
+{
+    std::lock_guard lock(mutex);
+    chunks.clear();
+    dumps.clear();
+    total = 0;
+    for (const auto& [id, path] : recipes)
+    {
+        auto recipe = loadRecipe(path);
+        if (!recipe)
+        {
+            lg2::error("Invalid dump recipe {PATH}", "PATH", path);
+            continue;
+        }
+        for (const auto& piece : recipe->pieces)
+        {
+            auto& chunk = chunks[piece.key];
+            if (chunk.owners.empty())
+            {
+                chunk.stored = piece.stored;
+                total += kilobytes(chunk.stored);
+            }
+            chunk.owners.insert(id);
+            dumps[id].insert(piece.key);
+        }
+    }
+
+    // Chunks of interrupted collections and of dumps deleted before a
+    // power loss
+    std::set<Key> found;
+    std::vector<std::filesystem::path> orphans;
+    std::error_code ec;
+    for (auto p = std::filesystem::recursive_directory_iterator(dir, ec);
+         !ec && p != std::filesystem::recursive_directory_iterator();
+         p.increment(ec))
+    {
+        if (p->is_directory(ec))
+        {
+            continue;
+        }
+        auto key = parseKey(p->path().parent_path().filename().string() +
+                            p->path().filename().string());
+        if (key && chunks.contains(*key))
+        {
+            found.insert(*key);
+        }
+        else
+        {
+            orphans.push_back(p->path());
+        }
+    }
+    for (const auto& path : orphans)
+    {
+        std::filesystem::remove(path, ec);
+    }
+    if (!orphans.empty())
+    {
+        lg2::info("Removed {COUNT} unreferenced dump chunks", "COUNT",
+                  orphans.size());
+    }
+    if (found.size() != chunks.size())
+    {
+        lg2::error("{COUNT} chunks of the dumps are missing", "COUNT",
+                   chunks.size() - found.size());
+    }
+}
+
+uint64_t Store::usage() const
+{
+    std::lock_guard lock(mutex);
+    return total;
+}
+
+uint64_t Store::exclusiveUsage(uint32_t id) const
+{
+    std::lock_guard lock(mutex);
+    auto dump = dumps.find(id);
+    if (dump == dumps.end())
+    {
+        return 0;
+    }
+
+    uint64_t size = 0;
+    for (const auto& key : dump->second)
+    {
+        auto iter = chunks.find(key);
+        if (iter != chunks.end() && iter->second.owners.size() == 1)
+        {
+            size += kilobytes(iter->second.stored);
+        }
+    }
+    return size;
+}
+
+} // namespace chunk
+} // namespace dump
+} // namespace phosphor
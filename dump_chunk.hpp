@@ -0,0 +1,315 @@
+#pragma once
+
+#include "dump_archive.hpp"
+#include "dump_trash.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <compare>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace chunk
+{
+
+// Chunks of the dumps, <dumpDir>/<STORE_DIR>/<2 hex digits>/<30 hex digits>
+constexpr auto STORE_DIR = ".chunks";
+
+// Recipe of a dump archive kept in the chunk store, <archive><RECIPE_SUFFIX>
+constexpr auto RECIPE_SUFFIX = ".recipe";
+
+// Longest wait for a full descriptor an archive is written to between
+// checks of the cancellation
+constexpr auto WRITE_POLL_INTERVAL = std::chrono::milliseconds(100);
+
+// Bounds of a content-defined chunk of the tar stream
+constexpr size_t MIN_CHUNK_SIZE = 2 * 1024;
+constexpr size_t MAX_CHUNK_SIZE = 64 * 1024;
+
+// Bits of the rolling hash which are zero at a cut, 8 KiB chunks on average
+constexpr unsigned CHUNK_MASK_BITS = 13;
+
+// Contents of at least this size are cut from their tar header, which
+// holds the modification time and differs between dumps
+constexpr uint64_t MEMBER_CUT_SIZE = 4 * 1024;
+
+/** @struct Key
+ *  @brief Content address of a chunk, 128 bits of hashes of its data, its
+ *         size and its compression.
+ */
+struct Key
+{
+    std::array<uint8_t, 16> bytes{};
+
+    auto operator<=>(const Key&) const = default;
+
+    /** @brief The key in hex digits */
+    std::string hex() const;
+};
+
+/** @brief Content address of a chunk.
+ *  @param[in] data - Data of the chunk.
+ *  @param[in] algorithm - Algorithm the chunk is stored with.
+ *  @param[in] dictionaryId - Id of the zstd dictionary, 0 for none.
+ */
+Key makeKey(std::span<const uint8_t> data, archive::Algorithm algorithm,
+            uint32_t dictionaryId);
+
+/** @class Chunker
+ *  @brief Splits a tar stream into content-defined chunks.
+ *  @details A gear rolling hash places the cuts, an insertion or removal
+ *  moves only the cuts next to it, so the unchanged data of a changed item
+ *  still yields the chunks of the previous dump. Large members are cut
+ *  from their headers and from the next member, which makes their chunks
+ *  independent of the modification times and of their neighbours.
+ */
+class Chunker
+{
+  public:
+    /** @brief Takes a chunk, false to stop the chunking */
+    using Sink = std::function<bool(std::span<const uint8_t>)>;
+
+    Chunker() = delete;
+    Chunker(const Chunker&) = delete;
+    Chunker& operator=(const Chunker&) = delete;
+    Chunker(Chunker&&) = delete;
+    Chunker& operator=(Chunker&&) = delete;
+    ~Chunker() = default;
+
+    /** @brief Constructor
+     *  @param[in] sink - Takes the chunks in stream order.
+     */
+    explicit Chunker(Sink sink) : sink(std::move(sink))
+    {
+        buffer.reserve(MAX_CHUNK_SIZE);
+    }
+
+    /** @brief Chunk the next data of the stream.
+     *  @return false if the sink failed.
+     */
+    bool write(const void* data, size_t size);
+
+    /** @brief Pass the last chunk to the sink.
+     *  @return false if the sink failed.
+     */
+    bool finish();
+
+  private:
+    /** @brief Pass the buffered data to the sink as a chunk */
+    bool cut();
+
+    /** @brief Takes the chunks */
+    Sink sink;
+
+    /** @brief Data of the current chunk */
+    std::vector<uint8_t> buffer;
+
+    /** @brief Rolling hash of the current chunk */
+    uint64_t hash = 0;
+
+    /** @brief The tar header being read */
+    std::array<uint8_t, archive::BLOCK_SIZE> header{};
+
+    /** @brief Bytes of the tar header read so far */
+    size_t headerSize = 0;
+
+    /** @brief Contents and padding of the current member not read yet */
+    uint64_t remaining = 0;
+
+    /** @brief Whether the current member is cut from its neighbours */
+    bool large = false;
+};
+
+/** @struct Piece
+ *  @brief A chunk of an archive.
+ */
+struct Piece
+{
+    /** @brief Content address */
+    Key key;
+
+    /** @brief Size of the chunk in the tar stream */
+    uint32_t size = 0;
+
+    /** @brief Size of the compressed chunk in the store */
+    uint32_t stored = 0;
+};
+
+/** @struct Recipe
+ *  @brief The chunks of an archive in stream order.
+ *  @details Every chunk is stored as a compressed stream of its own, their
+ *  concatenation is a standard dump archive.
+ */
+struct Recipe
+{
+    /** @brief Compression algorithm of the chunks */
+    archive::Algorithm algorithm = archive::Algorithm::xz;
+
+    /** @brief Id of the zstd dictionary, 0 for none */
+    uint32_t dictionaryId = 0;
+
+    /** @brief The chunks */
+    std::vector<Piece> pieces;
+};
+
+/** @brief Read a recipe file.
+ *  @return The recipe, std::nullopt if the file is missing or invalid.
+ */
+std::optional<Recipe> loadRecipe(const std::filesystem::path& path);
+
+/** @brief Whether a dump file is the recipe of an archive */
+bool isRecipe(const std::filesystem::path& file);
+
+/** @brief Path of a chunk of a recipe in the chunk store.
+ *  @param[in] recipe - Path of the recipe, <dumpDir>/<id>/<name>.recipe.
+ *  @param[in] key - A key of the recipe.
+ */
+std::filesystem::path chunkFile(const std::filesystem::path& recipe,
+                                const Key& key);
+
+/** @brief Write the archive of a recipe to a descriptor, the chunk files
+ *         one after another.
+ *  @details For GetFileHandle, the archive is streamed into a pipe and
+ *  never assembled. A full descriptor is waited on, the cancellation is
+ *  checked every WRITE_POLL_INTERVAL meanwhile.
+ *  @param[in] recipe - Path of the recipe, <dumpDir>/<id>/<name>.recipe.
+ *  @param[in] fd - Non-blocking descriptor the archive is written to.
+ *  @param[in] cancelled - Set to stop the writing.
+ *  @return true if the whole archive was written.
+ */
+bool writeArchive(const std::filesystem::path& recipe, int fd,
+                  const std::atomic<bool>& cancelled);
+
+/** @brief Size of the archive a dump file is read as, 0 on error */
+uint64_t archiveSize(const std::filesystem::path& file);
+
+/** @class Store
+ *  @brief Content-addressed store of the chunks of the dump archives.
+ *  @details Dumps repeat large identical items, inventory, settings and
+ *  BIOS tables among others. The store keeps every distinct chunk once,
+ *  with the dumps referencing it, and a dump directory holds only the
+ *  recipe of its archive. A chunk is removed with the last dump
+ *  referencing it, in the background by the reaper.
+ *
+ *  Chunks are ingested on the collection threads, the other methods are
+ *  called on the event loop.
+ */
+class Store
+{
+  public:
+    Store() = delete;
+    Store(const Store&) = delete;
+    Store& operator=(const Store&) = delete;
+    Store(Store&&) = delete;
+    Store& operator=(Store&&) = delete;
+    ~Store() = default;
+
+    /** @brief Constructor
+     *  @param[in] dir - The store directory, <dumpDir>/<STORE_DIR>.
+     *  @param[in] reaper - Removes the chunks no dump references, nullptr
+     *                      to remove them in place.
+     */
+    explicit Store(const std::filesystem::path& dir,
+                   trash::Reaper* reaper = nullptr);
+
+    /** @brief Move an archive into the store.
+     *  @details The chunks are synced before the recipe is written. The
+     *  archive is left for the caller to remove.
+     *  @param[in] id - Dump id.
+     *  @param[in] archive - The archive of the dump.
+     *  @param[in] recipe - Path of the recipe, <dumpDir>/<id>/<archive
+     *                      name><RECIPE_SUFFIX>.
+     *  @return false on failure, the dump is kept as an archive then.
+     */
+    bool ingest(uint32_t id, const std::filesystem::path& archive,
+                const std::filesystem::path& recipe);
+
+    /** @brief Drop the references of a deleted dump, discarding the
+     *         chunks no other dump references.
+     *  @param[in] id - Dump id.
+     *  @return The dumps which are now the only reference of a chunk.
+     */
+    std::vector<uint32_t> release(uint32_t id);
+
+    /** @brief Rebuild the references from the recipes at startup and
+     *         remove the chunks of no recipe.
+     *  @param[in] recipes - Recipe file by dump id.
+     */
+    void load(const std::map<uint32_t, std::filesystem::path>& recipes);
+
+    /** @brief Space used by the chunks in kilobytes, every chunk rounded
+     *         up to a full kilobyte.
+     */
+    uint64_t usage() const;
+
+    /** @brief Space of the chunks only a dump references in kilobytes,
+     *         which deleting it frees.
+     */
+    uint64_t exclusiveUsage(uint32_t id) const;
+
+  private:
+    /** @struct Chunk
+     *  @brief A chunk in the store.
+     */
+    struct Chunk
+    {
+        /** @brief Dumps referencing the chunk */
+        std::set<uint32_t> owners;
+
+        /** @brief Size of the chunk file in bytes */
+        uint64_t stored = 0;
+    };
+
+    /** @brief Reference a chunk, storing it if new.
+     *  @return Size of the chunk file, std::nullopt on failure.
+     */
+    std::optional<uint64_t> acquire(uint32_t id, const Key& key,
+                                    std::span<const uint8_t> data,
+                                    archive::Algorithm algorithm);
+
+    /** @brief Remove a discarded chunk file unless it was stored again
+     *         since, called by the reaper.
+     *  @return false on failure.
+     */
+    bool remove(const std::filesystem::path& path);
+
+    /** @brief The store directory */
+    std::filesystem::path dir;
+
+    /** @brief Removes the discarded chunks */
+    trash::Reaper* reaper;
+
+    /** @brief Dictionary the archives are compressed with, nullptr for
+     *         none */
+    std::shared_ptr<const archive::Dictionary> dictionary;
+
+    /** @brief Guards the chunks and the dumps */
+    mutable std::mutex mutex;
+
+    /** @brief The chunks by key */
+    std::map<Key, Chunk> chunks;
+
+    /** @brief The distinct chunks of every dump */
+    std::map<uint32_t, std::set<Key>> dumps;
+
+    /** @brief Sum of the chunk files in kilobytes */
+    uint64_t total = 0;
+};
+
+} // namespace chunk
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,1167 @@
+#include "config.h"
+
+#include "dump_collector.hpp"
+
+#include "dump_delta.hpp"
+#include "dump_utils.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <thread>
+
+extern char** environ;
+
+namespace phosphor
+{
+namespace dump
+{
+namespace collector
+{
+
+namespace
+{
+
+constexpr auto TYPE_USER = "user";
+constexpr auto TYPE_CORE = "core";
+constexpr auto TYPE_ELOG = "elog";
+constexpr auto TYPE_CHECKSTOP = "checkstop";
+constexpr auto TYPE_RAMOOPS = "ramoops";
+constexpr auto SUMMARY_DUMP = "summary";
+
+// ioprio_set(2) constants, not all C libraries provide them
+constexpr int IOPRIO_WHO_PROCESS = 1;
+constexpr int IOPRIO_CLASS_SHIFT = 13;
+constexpr int IOPRIO_CLASS_BE = 2;
+constexpr int IOPRIO_BE_LOWEST = 7;
+
+/** @brief Time stamp in the format of "date -u" used by dreport logs */
+std::string timeStamp()
+{
+    std::array<char, 64> buf{};
+    auto now = std::time(nullptr);
+    struct tm tm{};
+    gmtime_r(&now, &tm);
+    std::strftime(buf.data(), buf.size(), "%a %b %e %H:%M:%S UTC %Y", &tm);
+    return buf.data();
+}
+
+/** @brief Copy the contents of an opened file, works on /proc files which
+ *         report a zero size.
+ */
+bool copyContents(int inFd, int outFd)
+{
+    std::array<char, 64 * 1024> buf{};
+    while (true)
+    {
+        auto count = read(inFd, buf.data(), buf.size());
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        if (count == 0)
+        {
+            return true;
+        }
+        for (ssize_t done = 0; done < count;)
+        {
+            auto wrote = write(outFd, buf.data() + done, count - done);
+            if (wrote < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            done += wrote;
+        }
+    }
+}
+
+/** @brief Recursively copy a file or directory, following symbolic links,
+ *         the equivalent of "cp -Lr".
+ */
+bool copyTree(const std::filesystem::path& from,
+              const std::filesystem::path& to)
+{
+    std::error_code ec;
+    if (std::filesystem::is_directory(from, ec))
+    {
+        std::filesystem::create_directories(to, ec);
+        if (ec)
+        {
+            return false;
+        }
+        for (const auto& p : std::filesystem::directory_iterator(from, ec))
+        {
+            if (!copyTree(p.path(), to / p.path().filename()))
+            {
+                return false;
+            }
+        }
+        return !ec;
+    }
+
+    CustomFd in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in() < 0)
+    {
+        return false;
+    }
+    CustomFd out =
+        open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out() < 0)
+    {
+        return false;
+    }
+    return copyContents(in(), out());
+}
+
+/** @brief Merge a file or directory into an existing one, files are
+ *         appended to like the ">>" redirection of the plugins does.
+ */
+void mergeTree(const std::filesystem::path& from,
+               const std::filesystem::path& to)
+{
+    std::error_code ec;
+    if (std::filesystem::is_directory(from, ec))
+    {
+        for (const auto& p : std::filesystem::directory_iterator(from, ec))
+        {
+            auto target = to / p.path().filename();
+            if (std::filesystem::exists(target, ec))
+            {
+                mergeTree(p.path(), target);
+            }
+            else
+            {
+                std::filesystem::rename(p.path(), target, ec);
+            }
+        }
+        return;
+    }
+
+    CustomFd in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    CustomFd out = open(to.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (in() >= 0 && out() >= 0)
+    {
+        copyContents(in(), out());
+    }
+}
+
+/** @brief CPU time used by the calling thread */
+std::chrono::microseconds threadCpuTime()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec));
+}
+
+/** @brief Read the _PID of the process which logged an error log entry.
+ *  @param[in] objPath - Error log entry object path.
+ *  @return pid, 0 if not available.
+ */
+pid_t getElogPid(const std::string& objPath)
+{
+    using AdditionalData = std::map<std::string, std::string>;
+    try
+    {
+        auto bus = sdbusplus::bus::new_default();
+        auto data = std::get<AdditionalData>(
+            readDBusProperty<std::variant<AdditionalData>>(
+                bus, "xyz.openbmc_project.Logging", objPath,
+                "xyz.openbmc_project.Logging.Entry", "AdditionalData"));
+        auto iter = data.find("_PID");
+        if (iter != data.end())
+        {
+            return std::stoi(iter->second);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to read the elog pid, OBJPATH: {OBJPATH}, "
+                   "error: {ERROR}",
+                   "OBJPATH", objPath, "ERROR", e);
+    }
+    return 0;
+}
+
+/** @brief Threads and niceness of the archive compression, the
+ *         DUMP_COMPRESSION_THREADS environment variable overrides the
+ *         configured thread count, 0 uses one thread per CPU.
+ */
+archive::Parallelism compressionParallelism()
+{
+    unsigned threads = DUMP_COMPRESSION_THREADS;
+    if (auto* value = std::getenv("DUMP_COMPRESSION_THREADS");
+        value != nullptr && *value != '\0')
+    {
+        char* end = nullptr;
+        auto count = std::strtoul(value, &end, 10);
+        if (*end == '\0' && count <= UINT_MAX)
+        {
+            threads = count;
+        }
+        else
+        {
+            lg2::warning("Ignoring DUMP_COMPRESSION_THREADS={VALUE}", "VALUE",
+                         value);
+        }
+    }
+    if (threads == 0)
+    {
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    return {threads, DUMP_COMPRESSION_NICE};
+}
+
+/** @class Script
+ *  @brief Compatibility collector running a dreport plugin script.
+ */
+class Script : public Collector
+{
+  public:
+    Script(const std::string& name, const std::filesystem::path& script) :
+        Collector(name), script(script)
+    {}
+
+    Outcome collect(Context& ctx) override
+    {
+        auto rc = ctx.execute({script.string()}, ctx.scriptEnvironment(), -1);
+        return rc == 0 ? Outcome::Ok : Outcome::Failed;
+    }
+
+    bool isNative() const override
+    {
+        return false;
+    }
+
+  private:
+    /** @brief Path of the plugin script */
+    std::filesystem::path script;
+};
+
+} // namespace
+
+std::string outcomeToString(Outcome outcome)
+{
+    switch (outcome)
+    {
+        case Outcome::Ok:
+            return "ok";
+        case Outcome::Failed:
+            return "failed";
+        case Outcome::Skipped:
+            return "skipped";
+        case Outcome::Timeout:
+            return "timeout";
+        case Outcome::Oversize:
+            return "oversize";
+    }
+    return "unknown";
+}
+
+std::string archiveExtension()
+{
+    return archive::extension(archive::toAlgorithm(DUMP_COMPRESSION)
+                                  .value_or(archive::Algorithm::xz));
+}
+
+Dump::Dump(const Request& request) :
+    request(request),
+    epochTime(std::chrono::duration_cast<std::chrono::seconds>(
+                  std::chrono::system_clock::now().time_since_epoch())
+                  .count()),
+    dumpSize(static_cast<uint64_t>(request.allowedSize) * 1024),
+    reserved(request.reservedSize)
+{
+    name = "obmcdump_" + std::to_string(request.id) + "_" +
+           std::to_string(epochTime);
+    nameDir = std::filesystem::path(TMP_DIR) / name;
+}
+
+void Dump::log(const std::filesystem::path& file, const std::string& message)
+{
+    std::lock_guard lock(mutex);
+    std::ofstream os(file, std::ios::app);
+    os << timeStamp() << " " << message << "\n";
+}
+
+void Dump::logSummary(const std::string& message)
+{
+    log(nameDir / SUMMARY_LOG, message);
+}
+
+void Dump::logError(const std::string& message)
+{
+    log(nameDir / DREPORT_LOG, "ERROR: " + message);
+}
+
+void Dump::logWarning(const std::string& message)
+{
+    log(nameDir / DREPORT_LOG, "WARNING: " + message);
+}
+
+void Dump::logInfo(const std::string& message)
+{
+    log(nameDir / DREPORT_LOG, "INFO: " + message);
+}
+
+void Dump::addCpuTime(std::chrono::microseconds time)
+{
+    std::lock_guard lock(mutex);
+    cpuTime += time;
+}
+
+std::chrono::microseconds Dump::getCpuTime()
+{
+    std::lock_guard lock(mutex);
+    return cpuTime;
+}
+
+std::vector<std::string> Dump::scriptEnvironment(
+    const std::filesystem::path& outDir) const
+{
+    // The plugin writes into its own output directory, the size limit is
+    // applied by the engine once the output is moved into the dump.
+    const std::map<std::string, std::string> vars = {
+        {"TRUE", "1"},
+        {"FALSE", "0"},
+        {"UNLIMITED", "unlimited"},
+        {"SUMMARY_DUMP", SUMMARY_DUMP},
+        {"TYPE_USER", TYPE_USER},
+        {"TYPE_CORE", TYPE_CORE},
+        {"TYPE_ELOG", TYPE_ELOG},
+        {"TYPE_CHECKSTOP", TYPE_CHECKSTOP},
+        {"TYPE_RAMOOPS", TYPE_RAMOOPS},
+        {"SUMMARY_LOG", SUMMARY_LOG},
+        {"DREPORT_LOG", DREPORT_LOG},
+        {"TMP_DIR", TMP_DIR},
+        {"EPOCHTIME", std::to_string(epochTime)},
+        {"TIME_STAMP", "date -u"},
+        {"PLUGIN", PLUGIN_PREFIX},
+        {"DREPORT_SOURCE", DREPORT_SOURCE},
+        {"DREPORT_INCLUDE", std::string(DREPORT_SOURCE) + "/include.d"},
+        {"ZERO", "0"},
+        {"JOURNAL_LINE_LIMIT", "500"},
+        {"HEADER_EXTENSION",
+         std::string(DREPORT_SOURCE) + "/include.d/gendumpheader"},
+        {"SUCCESS", "0"},
+        {"INTERNAL_FAILURE", "1"},
+        {"RESOURCE_UNAVAILABLE", "2"},
+        {"name", name},
+        {"dump_dir", request.dumpDir.string()},
+        {"dump_id", std::to_string(request.id)},
+        {"dump_type", request.type},
+        {"verbose", "1"},
+        {"quiet", "1"},
+        {"dump_size", "unlimited"},
+        {"name_dir", outDir.string()},
+        {"optional_path", request.path},
+        {"dreport_log", (nameDir / DREPORT_LOG).string()},
+        {"summary_log", (nameDir / SUMMARY_LOG).string()},
+        {"cur_dump_size", "0"},
+        {"pid", std::to_string(pid)},
+        {"elog_id", elogId},
+    };
+
+    std::vector<std::string> env;
+    for (const auto& [key, value] : vars)
+    {
+        env.push_back(key + "=" + value);
+    }
+
+    // Keep the search path and locale of the dump manager
+    for (const auto* key : {"PATH", "LANG", "HOME"})
+    {
+        if (auto* value = std::getenv(key); value != nullptr)
+        {
+            env.push_back(std::string(key) + "=" + value);
+        }
+    }
+    return env;
+}
+
+pid_t Dump::spawn(const std::vector<std::string>& argv,
+                  const std::vector<std::string>& env, int inFd, int outFd,
+                  std::chrono::seconds cpuTime)
+{
+    // Everything the child needs is prepared before fork(), only async
+    // signal safe calls are allowed in the child of a threaded process.
+    std::vector<char*> args;
+    for (const auto& arg : argv)
+    {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    std::vector<char*> envp;
+    for (const auto& var : env)
+    {
+        envp.push_back(const_cast<char*>(var.c_str()));
+    }
+    envp.push_back(nullptr);
+    char** childEnv = env.empty() ? environ : envp.data();
+
+    sigset_t mask;
+    sigemptyset(&mask);
+
+    // Equal soft and hard limits, the command is killed with SIGKILL rather
+    // than SIGXCPU, which would leave a core dump behind.
+    struct rlimit cpuLimit{};
+    cpuLimit.rlim_cur = cpuLimit.rlim_max = cpuTime.count();
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // SIGCHLD and SIGPIPE are blocked in the dump manager
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+        // A process group of its own, so the command can be killed along
+        // with everything it started
+        setpgid(0, 0);
+        if (cpuTime.count() > 0)
+        {
+            setrlimit(RLIMIT_CPU, &cpuLimit);
+        }
+
+        int nullFd = open("/dev/null", O_RDWR);
+        dup2(inFd >= 0 ? inFd : nullFd, STDIN_FILENO);
+        if (outFd >= 0)
+        {
+            dup2(outFd, STDOUT_FILENO);
+        }
+        close_range(STDERR_FILENO + 1, ~0U, 0);
+
+        execvpe(args[0], args.data(), childEnv);
+        _exit(127);
+    }
+    else if (pid < 0)
+    {
+        auto error = errno;
+        lg2::error("Error occurred during fork, errno: {ERRNO}", "ERRNO",
+                   error);
+    }
+    else
+    {
+        // Also set by the parent, the child might not have run yet when it
+        // has to be killed
+        setpgid(pid, pid);
+    }
+    return pid;
+}
+
+int Dump::wait(pid_t pid, Budget& budget)
+{
+    if (budget.deadline != std::chrono::steady_clock::time_point::max())
+    {
+        CustomFd pidFd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+        if (pidFd() < 0)
+        {
+            lg2::error("Error occurred during pidfd_open, errno: {ERRNO}",
+                       "ERRNO", errno);
+        }
+        while (pidFd() >= 0)
+        {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(
+                budget.deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0)
+            {
+                kill(-pid, SIGKILL);
+                budget.overrun = "time limit";
+                break;
+            }
+
+            pollfd pfd{pidFd(), POLLIN, 0};
+            auto rc = poll(&pfd, 1,
+                           static_cast<int>(std::min<int64_t>(left.count(),
+                                                              INT_MAX)));
+            if (rc > 0 || (rc < 0 && errno != EINTR))
+            {
+                break;
+            }
+        }
+    }
+
+    int status = 0;
+    struct rusage usage{};
+    while (wait4(pid, &status, 0, &usage) < 0)
+    {
+        if (errno != EINTR)
+        {
+            lg2::error("Error occurred during wait4, errno: {ERRNO}", "ERRNO",
+                       errno);
+            return -1;
+        }
+    }
+
+    auto toTime = [](const timeval& tv) {
+        return std::chrono::seconds(tv.tv_sec) +
+               std::chrono::microseconds(tv.tv_usec);
+    };
+    auto used = toTime(usage.ru_utime) + toTime(usage.ru_stime);
+    addCpuTime(used);
+
+    // The accounted time is sampled and can be slightly below the limit
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL &&
+        budget.overrun.empty() && budget.cpuTime.count() > 0 &&
+        std::chrono::round<std::chrono::seconds>(used) >= budget.cpuTime)
+    {
+        budget.overrun = "CPU time limit";
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int Dump::execute(const std::vector<std::string>& argv,
+                  const std::vector<std::string>& env, int outFd,
+                  Budget& budget)
+{
+    auto pid = spawn(argv, env, -1, outFd, budget.cpuTime);
+    if (pid < 0)
+    {
+        return -1;
+    }
+    return wait(pid, budget);
+}
+
+bool Dump::openArchive()
+{
+    auto algorithm = archive::toAlgorithm(DUMP_COMPRESSION);
+    if (!algorithm)
+    {
+        lg2::error("Compression algorithm {ALGORITHM} is not supported",
+                   "ALGORITHM", DUMP_COMPRESSION);
+        return false;
+    }
+
+    std::shared_ptr<const archive::Dictionary> dictionary;
+    if (*algorithm == archive::Algorithm::zstd)
+    {
+        // Compress without the dictionary rather than failing the dump
+        dictionary = archive::Dictionary::configured();
+        dictionaryId = dictionary ? dictionary->getId() : 0;
+    }
+
+    try
+    {
+        archive = std::make_unique<archive::Writer>(
+            request.dumpDir / (name + "." + archiveExtension()), *algorithm,
+            std::move(dictionary), compressionParallelism());
+    }
+    catch (const std::system_error& e)
+    {
+        lg2::error("Failed to create the archive, ID: {ID}, error: {ERROR}",
+                   "ID", request.id, "ERROR", e);
+        return false;
+    }
+    return archive->addDirectory(name);
+}
+
+archive::Admission Dump::addItem(const std::filesystem::path& item)
+{
+    auto itemName = item.filename().string();
+    auto source = item;
+    std::string hash;
+    if (auto file = streamed.find(itemName); file != streamed.end())
+    {
+        // A file moved into the dump is never unchanged since a baseline,
+        // it is not hashed
+        source = file->second;
+    }
+    else if (BMC_DUMP_DELTA_WINDOW > 0)
+    {
+        hash = delta::hashItem(item);
+    }
+
+    auto admission = archive::Admission::failed;
+    if (archive && !hash.empty() && request.baseline)
+    {
+        auto iter = request.baseline->itemHashes.find(itemName);
+        if (iter != request.baseline->itemHashes.end() &&
+            iter->second == hash)
+        {
+            // Unchanged since the baseline, only listed in the manifest
+            baselineItems.push_back(itemName);
+            admission = archive::Admission::added;
+        }
+    }
+
+    if (archive && admission != archive::Admission::added)
+    {
+        auto entry = name + "/" + itemName;
+        if (dumpSize)
+        {
+            admission = archive->add(source, entry, reserveFor(source));
+        }
+        else
+        {
+            admission = archive->add(source, entry)
+                            ? archive::Admission::added
+                            : archive::Admission::failed;
+        }
+        if (admission == archive::Admission::added && source != item)
+        {
+            moved.push_back(source);
+        }
+
+        if (admission == archive::Admission::failed)
+        {
+            // A partially written entry leaves the archive unusable
+            lg2::error("Failed to add {ITEM} to the archive, ID: {ID}",
+                       "ITEM", item.filename(), "ID", request.id);
+            archive.reset();
+        }
+    }
+    if (admission == archive::Admission::added && !hash.empty())
+    {
+        itemHashes[itemName] = hash;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(item, ec);
+    return admission;
+}
+
+uint64_t Dump::reserveFor(const std::filesystem::path& item)
+{
+    if (!request.reserve)
+    {
+        return *dumpSize;
+    }
+
+    // Enough for the item stored uncompressed, the archive is limited to
+    // the space reserved if the space for that isn't available
+    auto wanted =
+        (std::min(*dumpSize, archive->size() + archive::tarSize(item)) +
+         1023) /
+        1024;
+    if (wanted > reserved && request.reserve(wanted))
+    {
+        reserved = wanted;
+    }
+    return std::min(*dumpSize, reserved * 1024);
+}
+
+std::filesystem::path Dump::closeArchive()
+{
+    if (!archive)
+    {
+        return {};
+    }
+
+    if (!itemHashes.empty())
+    {
+        nlohmann::json manifest;
+        manifest["items"] = itemHashes;
+        if (!baselineItems.empty())
+        {
+            logSummary("Baseline:      " + request.baseline->name + ", " +
+                       std::to_string(baselineItems.size()) +
+                       " items referenced");
+            manifest["baseline"] = {{"id", request.baseline->id},
+                                    {"name", request.baseline->name}};
+            manifest["baselineItems"] = baselineItems;
+        }
+
+        std::ofstream os(nameDir / delta::MANIFEST);
+        os << manifest.dump(4);
+        os.close();
+        if (!os || !archive->add(nameDir / delta::MANIFEST,
+                                 name + "/" + delta::MANIFEST))
+        {
+            lg2::error("Failed to add the manifest, ID: {ID}", "ID",
+                       request.id);
+            archive.reset();
+            return {};
+        }
+    }
+
+    // The logs are always part of the dump
+    for (const auto* log : {SUMMARY_LOG, DREPORT_LOG})
+    {
+        std::error_code ec;
+        auto file = nameDir / log;
+        if (std::filesystem::exists(file, ec) &&
+            !archive->add(file, name + "/" + log))
+        {
+            archive.reset();
+            return {};
+        }
+    }
+
+    std::filesystem::path path;
+    if (archive->commit())
+    {
+        path = request.dumpDir / (name + "." + archiveExtension());
+
+        // Free the unused part of the reservation while the archive is put
+        // in its place
+        if (request.reserve)
+        {
+            request.reserve((archive->size() + 1023) / 1024);
+        }
+
+        for (const auto& file : moved)
+        {
+            std::error_code ec;
+            std::filesystem::remove(file, ec);
+        }
+    }
+    archive.reset();
+    return path;
+}
+
+void Dump::streamItem(const std::string& item,
+                      const std::filesystem::path& file)
+{
+    std::lock_guard lock(mutex);
+    streamed.insert_or_assign(item, file);
+}
+
+bool Context::addCommandOutput(const std::vector<std::string>& argv,
+                               const std::string& fileName,
+                               const std::string& desc)
+{
+    auto file = outDir / fileName;
+    int rc = -1;
+    {
+        CustomFd fd = open(file.c_str(),
+                           O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd() >= 0)
+        {
+            rc = execute(argv, {}, fd());
+        }
+    }
+
+    if (rc != 0 && !getOverrun().empty())
+    {
+        // Keep what was collected up to the kill
+        logError("Failed to collect " + desc + ", " + getOverrun() +
+                 " exceeded");
+        return false;
+    }
+    if (rc != 0)
+    {
+        logError("Failed to collect " + desc);
+        std::error_code ec;
+        std::filesystem::remove(file, ec);
+        return false;
+    }
+    logInfo("Collected " + desc);
+    return true;
+}
+
+bool Context::addCopyFile(const std::filesystem::path& file,
+                          const std::string& desc)
+{
+    auto target = outDir / file.filename();
+    if (!copyTree(file, target))
+    {
+        logError("Failed to copy " + desc + " " + file.string());
+        std::error_code ec;
+        std::filesystem::remove_all(target, ec);
+        return false;
+    }
+    logInfo("Copied " + desc + " " + file.string());
+    return true;
+}
+
+bool Context::addMoveFile(const std::filesystem::path& file,
+                          const std::string& desc)
+{
+    // An empty placeholder keeps the place of the file among the items
+    std::error_code ec;
+    auto source = std::filesystem::canonical(file, ec);
+    auto target = outDir / file.filename();
+    if (ec || !std::filesystem::is_regular_file(source, ec) ||
+        !std::ofstream(target))
+    {
+        logError("Failed to move " + desc + " " + file.string());
+        std::filesystem::remove(target, ec);
+        return false;
+    }
+    dump.streamItem(file.filename().string(), source);
+    logInfo("Moved " + desc + " " + file.string());
+    return true;
+}
+
+bool Context::addFileContents(const std::filesystem::path& file,
+                              const std::string& fileName,
+                              const std::string& desc)
+{
+    auto target = outDir / fileName;
+    bool copied = false;
+    {
+        CustomFd in = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        CustomFd out = open(target.c_str(),
+                            O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        copied = in() >= 0 && out() >= 0 && copyContents(in(), out());
+    }
+
+    if (!copied)
+    {
+        logError("Failed to collect " + desc);
+        std::error_code ec;
+        std::filesystem::remove(target, ec);
+        return false;
+    }
+    logInfo("Collected " + desc);
+    return true;
+}
+
+bool Engine::initialize()
+{
+    std::error_code ec;
+    std::filesystem::create_directories(dump.nameDir, ec);
+    if (ec)
+    {
+        lg2::error("Failed to create the staging directory: {PATH}, "
+                   "error: {ERROR}",
+                   "PATH", dump.nameDir, "ERROR", ec.message());
+        return false;
+    }
+
+    std::filesystem::create_directories(request.dumpDir, ec);
+    if (ec)
+    {
+        lg2::error("Could not create the destination directory {PATH}, "
+                   "error: {ERROR}",
+                   "PATH", request.dumpDir, "ERROR", ec.message());
+        return false;
+    }
+    if (!dump.openArchive())
+    {
+        return false;
+    }
+
+    dump.logSummary("Name:          " + dump.name + "." + archiveExtension());
+    dump.logSummary("Epochtime:     " + std::to_string(dump.epochTime));
+    dump.logSummary("ID:            " + std::to_string(request.id));
+    dump.logSummary("Type:          " + request.type);
+    if (dump.dictionaryId != 0)
+    {
+        dump.logSummary("Dictionary:    " + std::to_string(dump.dictionaryId));
+    }
+    return true;
+}
+
+std::vector<std::vector<Plugin>> Engine::discover()
+{
+    if (request.type == TYPE_CORE)
+    {
+        dump.logSummary("Core: " + request.path);
+
+        // systemd-coredump file name format
+        // core.<comm>.<uid>.<boot id>.<pid>.<timestamp>
+        auto file = std::filesystem::path(request.path).filename().string();
+        size_t pos = 0;
+        for (int field = 0; field < 4 && pos != std::string::npos; ++field)
+        {
+            pos = file.find('.', pos);
+            pos = (pos == std::string::npos) ? pos : pos + 1;
+        }
+        if (pos != std::string::npos)
+        {
+            dump.pid = std::atoi(
+                file.substr(pos, file.find('.', pos) - pos).c_str());
+        }
+    }
+    else if (request.type == TYPE_RAMOOPS)
+    {
+        dump.logSummary("Ramoops: " + request.path);
+    }
+    else if (request.type == TYPE_ELOG || request.type == TYPE_CHECKSTOP)
+    {
+        dump.logSummary((request.type == TYPE_ELOG ? "ELOG: " : "CHECKSTOP: ") +
+                        request.path);
+        dump.elogId = std::filesystem::path(request.path).filename().string();
+        dump.pid = getElogPid(request.path);
+    }
+    else if (request.type != TYPE_USER)
+    {
+        dump.logError("Invalid -type, Only summary log is available");
+        return {};
+    }
+
+    auto pluginPath = std::filesystem::path(DREPORT_SOURCE) /
+                      (PLUGIN_PREFIX + request.type + ".d");
+    std::error_code ec;
+    if (!std::filesystem::is_directory(pluginPath, ec))
+    {
+        dump.logError(pluginPath.string() +
+                      " does not exist, skipping dump collection");
+        return {};
+    }
+
+    return makeBands(findPlugins(pluginPath));
+}
+
+void Engine::runBand(const std::vector<Plugin>& band, Result& result)
+{
+    std::vector<std::unique_ptr<Collector>> collectors;
+    std::vector<std::filesystem::path> outDirs;
+    for (const auto& plugin : band)
+    {
+        auto collector = makeNativeCollector(plugin.name);
+        if (!collector)
+        {
+            collector = std::make_unique<Script>(plugin.name, plugin.script);
+        }
+        collectors.push_back(std::move(collector));
+
+        auto outDir = dump.nameDir;
+        outDir += ".parts";
+        outDirs.push_back(outDir / plugin.name);
+    }
+
+    std::vector<Outcome> outcomes(collectors.size(), Outcome::Failed);
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> hits = 0;
+    auto worker = [&]() {
+        auto cpuStart = threadCpuTime();
+        for (size_t i = next++; i < collectors.size(); i = next++)
+        {
+            const auto& name = collectors[i]->getName();
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                dump.logSummary(name + ": skipped, dump time limit exceeded");
+                outcomes[i] = Outcome::Timeout;
+                continue;
+            }
+
+            std::error_code ec;
+            std::filesystem::create_directories(outDirs[i], ec);
+            if (ec)
+            {
+                dump.logError("Failed to create " + outDirs[i].string());
+                continue;
+            }
+
+            // The fingerprint is taken first, a change while the plugin
+            // runs only causes another run next time.
+            auto key = fingerprint(name);
+            if (key && cache.restore(name, *key, outDirs[i]))
+            {
+                dump.logSummary(name + ": cache hit");
+                outcomes[i] = Outcome::Ok;
+                ++hits;
+                continue;
+            }
+
+            Context ctx(dump, outDirs[i], makeBudget());
+            try
+            {
+                outcomes[i] = collectors[i]->collect(ctx);
+            }
+            catch (const std::exception& e)
+            {
+                lg2::error("Dump collector {PLUGIN} failed, error: {ERROR}",
+                           "PLUGIN", name, "ERROR", e);
+            }
+
+            // The partial output is kept, the summary tells it is incomplete
+            if (!ctx.getOverrun().empty())
+            {
+                dump.logSummary(name + ": " + ctx.getOverrun() +
+                                " exceeded, output truncated");
+                outcomes[i] = Outcome::Timeout;
+            }
+            else if (key && outcomes[i] == Outcome::Ok)
+            {
+                cache.store(name, *key, outDirs[i]);
+            }
+        }
+        dump.addCpuTime(std::chrono::duration_cast<std::chrono::microseconds>(
+            threadCpuTime() - cpuStart));
+    };
+
+    // The calling thread is one of the workers
+    size_t count = std::min<size_t>(
+        std::max(BMC_DUMP_COLLECTOR_WORKERS, 1), collectors.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < count; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // The collector each staged item belongs to
+    std::vector<std::string> staged;
+    std::vector<size_t> owners;
+    for (size_t i = 0; i < collectors.size(); ++i)
+    {
+        if (outcomes[i] == Outcome::Failed)
+        {
+            lg2::info("Dump collector {PLUGIN} failed, ID: {ID}", "PLUGIN",
+                      collectors[i]->getName(), "ID", request.id);
+        }
+        collectors[i]->isNative() ? ++result.nativeCount
+                                  : ++result.scriptCount;
+        owners.insert(owners.end(), commit(outDirs[i], staged), i);
+    }
+
+    // Stream the output into the archive in plugin order, so the size
+    // limit drops the same data as a sequential collection would.
+    for (size_t i = 0; i < staged.size(); ++i)
+    {
+        auto admission = dump.addItem(dump.nameDir / staged[i]);
+        if (admission == archive::Admission::rejected)
+        {
+            dump.logWarning("Skipping " + staged[i]);
+            auto& outcome = outcomes[owners[i]];
+            if (outcome == Outcome::Ok)
+            {
+                dump.logSummary(collectors[owners[i]]->getName() + ": " +
+                                staged[i] +
+                                " dropped, dump size limit reached");
+                outcome = Outcome::Oversize;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < collectors.size(); ++i)
+    {
+        result.outcomes[collectors[i]->getName()] = outcomes[i];
+    }
+    result.cacheHits += hits;
+}
+
+Budget Engine::makeBudget() const
+{
+    Budget budget;
+    budget.deadline = deadline;
+    if (BMC_DUMP_COLLECTOR_TIMEOUT > 0)
+    {
+        budget.deadline = std::min(
+            budget.deadline,
+            std::chrono::steady_clock::now() +
+                std::chrono::seconds(BMC_DUMP_COLLECTOR_TIMEOUT));
+    }
+    budget.cpuTime = std::chrono::seconds(BMC_DUMP_COLLECTOR_CPU_LIMIT);
+    return budget;
+}
+
+size_t Engine::commit(const std::filesystem::path& outDir,
+                      std::vector<std::string>& staged)
+{
+    size_t count = 0;
+    std::error_code ec;
+    std::vector<std::filesystem::path> items;
+    for (const auto& p : std::filesystem::directory_iterator(outDir, ec))
+    {
+        items.push_back(p.path());
+    }
+    std::sort(items.begin(), items.end());
+
+    for (const auto& item : items)
+    {
+        auto name = item.filename().string();
+        auto target = dump.nameDir / name;
+        if (std::filesystem::exists(target, ec))
+        {
+            // Output appended to the file of an earlier plugin of the band
+            mergeTree(item, target);
+            continue;
+        }
+
+        std::filesystem::rename(item, target, ec);
+        if (ec)
+        {
+            dump.logError("Failed to add " + name);
+            continue;
+        }
+        staged.push_back(name);
+        ++count;
+    }
+    std::filesystem::remove_all(outDir, ec);
+    return count;
+}
+
+Result Engine::run()
+{
+    auto start = std::chrono::steady_clock::now();
+    auto cpuStart = threadCpuTime();
+
+    Result result;
+    result.id = request.id;
+
+    if (BMC_DUMP_COLLECTION_SLA > 0)
+    {
+        deadline = start + std::chrono::seconds(BMC_DUMP_COLLECTION_SLA);
+    }
+
+    // The collection runs in the background of the BMC, the threads and
+    // commands started from here inherit the I/O priority.
+    int ioprio = BMC_DUMP_COLLECTOR_IO_CLASS << IOPRIO_CLASS_SHIFT;
+    if (BMC_DUMP_COLLECTOR_IO_CLASS == IOPRIO_CLASS_BE)
+    {
+        ioprio |= IOPRIO_BE_LOWEST;
+    }
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) < 0)
+    {
+        lg2::error("Failed to set the I/O priority, errno: {ERRNO}", "ERRNO",
+                   errno);
+    }
+
+    if (initialize())
+    {
+        for (const auto& band : discover())
+        {
+            runBand(band, result);
+        }
+        result.archive = dump.closeArchive();
+        if (!result.archive.empty())
+        {
+            result.itemHashes = dump.itemHashes;
+            if (!dump.baselineItems.empty())
+            {
+                result.baselineId = request.baseline->id;
+            }
+        }
+    }
+
+    // remove the staging directories
+    std::error_code ec;
+    auto partsDir = dump.nameDir;
+    partsDir += ".parts";
+    std::filesystem::remove_all(partsDir, ec);
+    std::filesystem::remove_all(dump.nameDir, ec);
+
+    result.wallTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    result.cpuTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+        threadCpuTime() - cpuStart + dump.getCpuTime());
+    return result;
+}
+
+} // namespace collector
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,627 @@
+#pragma once
+
+#include "dump_archive.hpp"
+#include "dump_plugin.hpp"
+#include "dump_result_cache.hpp"
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace collector
+{
+
+// Location of the dreport plugins and helper functions
+constexpr auto DREPORT_SOURCE = "/usr/share/dreport.d";
+
+// dreport plugin directory prefix, pl_<type>.d
+constexpr auto PLUGIN_PREFIX = "pl_";
+
+// Temporary directory used to stage the dump contents
+constexpr auto TMP_DIR = "/tmp";
+
+constexpr auto SUMMARY_LOG = "summary.log";
+constexpr auto DREPORT_LOG = "dreport.log";
+
+/** @struct Baseline
+ *  @brief A complete earlier dump which a delta dump takes its unchanged
+ *         items from.
+ */
+struct Baseline
+{
+    /** @brief Dump identifier */
+    uint32_t id;
+
+    /** @brief Dump name, obmcdump_<id>_<epochtime> */
+    std::string name;
+
+    /** @brief Content hash of every item of the dump, by item name */
+    std::map<std::string, std::string> itemHashes;
+};
+
+/** @struct Request
+ *  @brief The parameters of a dump collection, the native equivalent of
+ *         the dreport command line options.
+ */
+struct Request
+{
+    /** @brief Dump identifier */
+    uint32_t id;
+
+    /** @brief Collection type, for example "user", "core" or "elog" */
+    std::string type;
+
+    /** @brief Optional contents, core file or elog object path */
+    std::string path;
+
+    /** @brief Directory the archive is placed in, <BMC_DUMP_PATH>/<id> */
+    std::filesystem::path dumpDir;
+
+    /** @brief Maximum allowed size of the archive in kilobytes */
+    size_t allowedSize;
+
+    /** @brief Dump whose unchanged items are referenced instead of being
+     *         archived again, std::nullopt for a complete dump */
+    std::optional<Baseline> baseline;
+
+    /** @brief Space reserved for the archive in kilobytes when the
+     *         collection starts */
+    size_t reservedSize = 0;
+
+    /** @brief Grow or shrink the space reservation of the dump to a size in
+     *         kilobytes, returns false if the space is not available. The
+     *         archive is limited to allowedSize only if empty. */
+    std::function<bool(uint64_t)> reserve;
+};
+
+/** @brief Result of running a single collector */
+enum class Outcome
+{
+    Ok,
+    Failed,
+    Skipped,
+    Timeout,
+    Oversize,
+};
+
+/** @brief Convert an outcome to the name recorded with the dump entry,
+ *         "ok", "failed", "skipped", "timeout" or "oversize".
+ */
+std::string outcomeToString(Outcome outcome);
+
+/** @struct Budget
+ *  @brief Resource limits of a collector.
+ */
+struct Budget
+{
+    /** @brief Commands still running at this time are killed */
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+
+    /** @brief CPU time limit of each command, zero for no limit */
+    std::chrono::seconds cpuTime{0};
+
+    /** @brief The exceeded limit once a command was killed, empty
+     *         otherwise */
+    std::string overrun;
+};
+
+/** @struct Result
+ *  @brief Outcome of a complete dump collection.
+ */
+struct Result
+{
+    /** @brief Dump identifier */
+    uint32_t id = 0;
+
+    /** @brief The archive, empty if the collection failed */
+    std::filesystem::path archive;
+
+    /** @brief Wall-clock time spent on the collection */
+    std::chrono::milliseconds wallTime{0};
+
+    /** @brief CPU time of the collection threads and child processes */
+    std::chrono::milliseconds cpuTime{0};
+
+    /** @brief Number of collectors run natively */
+    size_t nativeCount = 0;
+
+    /** @brief Number of collectors run through their plugin script */
+    size_t scriptCount = 0;
+
+    /** @brief Number of collectors whose cached output was used */
+    size_t cacheHits = 0;
+
+    /** @brief Outcome of every collector, by plugin name */
+    std::map<std::string, Outcome> outcomes;
+
+    /** @brief Content hash of every item of the dump, by item name, empty
+     *         if delta dumps are disabled */
+    std::map<std::string, std::string> itemHashes;
+
+    /** @brief Dump the unchanged items are taken from, 0 if the archive
+     *         is complete */
+    uint32_t baselineId = 0;
+};
+
+/** @class Dump
+ *  @brief State of one dump collection shared by all its collectors.
+ *  @details The logging and command execution are safe to use from the
+ *  concurrently running collectors, the staging directory is only modified
+ *  by the engine thread.
+ */
+class Dump
+{
+  public:
+    Dump() = delete;
+    Dump(const Dump&) = delete;
+    Dump& operator=(const Dump&) = delete;
+    Dump(Dump&&) = delete;
+    Dump& operator=(Dump&&) = delete;
+    ~Dump() = default;
+
+    /** @brief Constructor
+     *  @param[in] request - The dump collection request.
+     */
+    explicit Dump(const Request& request);
+
+    /** @brief Create the archive, written to a hidden file in the dump
+     *         directory until closeArchive().
+     *  @return true on success.
+     */
+    bool openArchive();
+
+    /** @brief Append an item of the staging directory to the archive if it
+     *         keeps the dump within the allowed size, the item is removed
+     *         from the staging directory either way.
+     *  @details An item which is unchanged since the baseline of the
+     *  request is only listed in the manifest.
+     *  @param[in] item - File or directory in the staging directory.
+     *  @return Whether the item was added.
+     */
+    archive::Admission addItem(const std::filesystem::path& item);
+
+    /** @brief Append the manifest and the logs and move the archive to its
+     *         final path, then remove the sources of the streamed items
+     *         which were added.
+     *  @return Path of the archive, empty on failure.
+     */
+    std::filesystem::path closeArchive();
+
+    /** @brief Stream a file into the archive in place of an item of the
+     *         staging directory, instead of copying it there.
+     *  @param[in] item - Name of the item in the staging directory.
+     *  @param[in] file - The file, removed once the archive with it is
+     *                    committed.
+     */
+    void streamItem(const std::string& item,
+                    const std::filesystem::path& file);
+
+    /** @brief Run a command, without a shell.
+     *  @details The command runs in a process group of its own, which is
+     *  killed once the deadline of the budget passed.
+     *  @param[in] argv - Command and its arguments.
+     *  @param[in] env - Environment of the command, the current environment
+     *                   is used if empty.
+     *  @param[in] outFd - Descriptor receiving the standard output, -1 to
+     *                     keep the inherited one.
+     *  @param[in,out] budget - Limits of the command, records an overrun.
+     *  @return The exit status of the command, -1 if it could not be run
+     *          or was killed.
+     */
+    int execute(const std::vector<std::string>& argv,
+                const std::vector<std::string>& env, int outFd,
+                Budget& budget);
+
+    /** @brief Environment for running dreport plugin scripts
+     *  @param[in] outDir - Directory the plugin stores its output in.
+     */
+    std::vector<std::string> scriptEnvironment(
+        const std::filesystem::path& outDir) const;
+
+    /** @brief Add a line to the summary log */
+    void logSummary(const std::string& message);
+
+    /** @brief Add an error to the dreport log */
+    void logError(const std::string& message);
+
+    /** @brief Add a warning to the dreport log */
+    void logWarning(const std::string& message);
+
+    /** @brief Add an info message to the dreport log */
+    void logInfo(const std::string& message);
+
+    /** @brief Account the CPU time used by a collector thread */
+    void addCpuTime(std::chrono::microseconds time);
+
+    /** @brief CPU time used by the collector threads and the child
+     *         processes of this collection */
+    std::chrono::microseconds getCpuTime();
+
+    /** @brief The dump collection request */
+    const Request& request;
+
+    /** @brief Dump name, obmcdump_<id>_<epochtime> */
+    std::string name;
+
+    /** @brief Time of the collection start in seconds since the epoch */
+    uint64_t epochTime;
+
+    /** @brief Staging directory holding the logs and the output of the
+     *         running band */
+    std::filesystem::path nameDir;
+
+    /** @brief Process id associated with a core or elog dump */
+    pid_t pid = 0;
+
+    /** @brief Error log id of an elog dump */
+    std::string elogId;
+
+    /** @brief Id of the zstd dictionary of the archive, 0 for none */
+    uint32_t dictionaryId = 0;
+
+    /** @brief Content hash of every item of the dump, by item name */
+    std::map<std::string, std::string> itemHashes;
+
+    /** @brief Items taken from the baseline instead of being archived */
+    std::vector<std::string> baselineItems;
+
+  private:
+    /** @brief Start a command, without a shell.
+     *  @param[in] argv - Command and its arguments.
+     *  @param[in] env - Environment of the command.
+     *  @param[in] inFd - Descriptor for the standard input, -1 for
+     *                    /dev/null.
+     *  @param[in] outFd - Descriptor for the standard output, -1 to keep
+     *                     the inherited one.
+     *  @param[in] cpuTime - CPU time limit, zero for no limit.
+     *  @return pid of the command, -1 on failure.
+     */
+    pid_t spawn(const std::vector<std::string>& argv,
+                const std::vector<std::string>& env, int inFd, int outFd,
+                std::chrono::seconds cpuTime);
+
+    /** @brief Wait for a command started by spawn() and account its CPU
+     *         time, the command is killed when it overruns its budget.
+     *  @param[in] pid - pid of the command.
+     *  @param[in,out] budget - Limits of the command, records an overrun.
+     *  @return The exit status of the command, -1 on abnormal exit.
+     */
+    int wait(pid_t pid, Budget& budget);
+
+    /** @brief Append a time stamped line to a log file */
+    void log(const std::filesystem::path& file, const std::string& message);
+
+    /** @brief Grow the space reservation of the dump to cover an item.
+     *  @param[in] item - File or directory in the staging directory.
+     *  @return Size limit of the archive with the item in bytes.
+     */
+    uint64_t reserveFor(const std::filesystem::path& item);
+
+    /** @brief Maximum size of the dump in bytes, if limited */
+    std::optional<uint64_t> dumpSize;
+
+    /** @brief Space reserved for the dump in kilobytes */
+    uint64_t reserved;
+
+    /** @brief Files streamed into the archive, by item name */
+    std::map<std::string, std::filesystem::path> streamed;
+
+    /** @brief Streamed files added to the archive, removed after the
+     *         commit */
+    std::vector<std::filesystem::path> moved;
+
+    /** @brief The archive being written */
+    std::unique_ptr<archive::Writer> archive;
+
+    /** @brief CPU time used by the collector threads and child processes */
+    std::chrono::microseconds cpuTime{0};
+
+    /** @brief Serializes the log writes, the accounting and the streamed
+     *         items */
+    std::mutex mutex;
+};
+
+/** @class Context
+ *  @brief The view of the dump given to a single collector.
+ *  @details Provides the native equivalents of the helper functions in
+ *  dreport.d/include.d/functions. Every collector writes into its own
+ *  output directory, which allows collectors to run concurrently; the
+ *  output is moved into the dump once the collector completes.
+ */
+class Context
+{
+  public:
+    Context() = delete;
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+    Context(Context&&) = delete;
+    Context& operator=(Context&&) = delete;
+    ~Context() = default;
+
+    /** @brief Constructor
+     *  @param[in] dump - The dump being collected.
+     *  @param[in] outDir - Output directory of the collector.
+     *  @param[in] budget - Resource limits of the collector.
+     */
+    Context(Dump& dump, const std::filesystem::path& outDir,
+            const Budget& budget) :
+        request(dump.request), dump(dump), outDir(outDir), budget(budget)
+    {}
+
+    /** @brief Run a command and save its output into the dump.
+     *  @param[in] argv - Command and its arguments, run without a shell.
+     *  @param[in] fileName - Name of the file in the dump.
+     *  @param[in] desc - Description used for logging.
+     *  @return true if the output was added.
+     */
+    bool addCommandOutput(const std::vector<std::string>& argv,
+                          const std::string& fileName,
+                          const std::string& desc);
+
+    /** @brief Copy a file or directory into the dump.
+     *  @param[in] file - File or directory to copy, links are followed.
+     *  @param[in] desc - Description used for logging.
+     *  @return true if the file was added.
+     */
+    bool addCopyFile(const std::filesystem::path& file,
+                     const std::string& desc);
+
+    /** @brief Move a regular file into the dump, it is streamed into the
+     *         archive without a copy and removed once the archive is
+     *         committed.
+     *  @param[in] file - File to move, links are followed.
+     *  @param[in] desc - Description used for logging.
+     *  @return true if the file will be added.
+     */
+    bool addMoveFile(const std::filesystem::path& file,
+                     const std::string& desc);
+
+    /** @brief Append the contents of a file to a file in the dump.
+     *  @param[in] file - File to read, for example a /proc file.
+     *  @param[in] fileName - Name of the file in the dump.
+     *  @param[in] desc - Description used for logging.
+     *  @return true if the contents were added.
+     */
+    bool addFileContents(const std::filesystem::path& file,
+                         const std::string& fileName, const std::string& desc);
+
+    /** @brief Run a command within the budget of the collector, without a
+     *         shell, see Dump::execute()
+     */
+    int execute(const std::vector<std::string>& argv,
+                const std::vector<std::string>& env, int outFd)
+    {
+        return dump.execute(argv, env, outFd, budget);
+    }
+
+    /** @brief The limit exceeded by a command of the collector, empty if
+     *         none was killed */
+    const std::string& getOverrun() const
+    {
+        return budget.overrun;
+    }
+
+    /** @brief Whether the wall-clock limit of the collector passed, an in
+     *         process collector stops there and keeps its output so far.
+     */
+    bool expired()
+    {
+        if (budget.overrun.empty() &&
+            std::chrono::steady_clock::now() >= budget.deadline)
+        {
+            budget.overrun = "time limit";
+        }
+        return !budget.overrun.empty();
+    }
+
+    /** @brief Environment for running a dreport plugin script */
+    std::vector<std::string> scriptEnvironment() const
+    {
+        return dump.scriptEnvironment(outDir);
+    }
+
+    /** @brief Output directory of the collector */
+    const std::filesystem::path& getOutDir() const
+    {
+        return outDir;
+    }
+
+    /** @brief Process id associated with a core or elog dump, 0 if none */
+    pid_t getPid() const
+    {
+        return dump.pid;
+    }
+
+    /** @brief Add an error to the dreport log */
+    void logError(const std::string& message)
+    {
+        dump.logError(message);
+    }
+
+    /** @brief Add a warning to the dreport log */
+    void logWarning(const std::string& message)
+    {
+        dump.logWarning(message);
+    }
+
+    /** @brief Add an info message to the dreport log */
+    void logInfo(const std::string& message)
+    {
+        dump.logInfo(message);
+    }
+
+    /** @brief The dump collection request */
+    const Request& request;
+
+  private:
+    /** @brief The dump being collected */
+    Dump& dump;
+
+    /** @brief Output directory of the collector */
+    std::filesystem::path outDir;
+
+    /** @brief Resource limits of the collector */
+    Budget budget;
+};
+
+/** @class Collector
+ *  @brief A single unit of dump data collection.
+ *  @details There is one collector per dreport plugin. Plugins that have a
+ *  native implementation are run in process, all others fall back to
+ *  running the plugin script.
+ */
+class Collector
+{
+  public:
+    Collector() = delete;
+    Collector(const Collector&) = delete;
+    Collector& operator=(const Collector&) = delete;
+    Collector(Collector&&) = delete;
+    Collector& operator=(Collector&&) = delete;
+    virtual ~Collector() = default;
+
+    /** @brief Constructor
+     *  @param[in] name - Name of the plugin this collector implements.
+     */
+    explicit Collector(const std::string& name) : name(name) {}
+
+    /** @brief Collect the data into the dump.
+     *  @param[in] ctx - The dump being collected.
+     *  @return Outcome of the collection.
+     */
+    virtual Outcome collect(Context& ctx) = 0;
+
+    /** @brief Whether the collector runs without the plugin script */
+    virtual bool isNative() const
+    {
+        return true;
+    }
+
+    /** @brief Returns the plugin name */
+    const std::string& getName() const
+    {
+        return name;
+    }
+
+  protected:
+    /** @brief Plugin name */
+    std::string name;
+};
+
+/** @class Engine
+ *  @brief Native dump collection engine.
+ *  @details Runs the plugin set of the dump type as typed collectors and
+ *  streams the output into <dumpDir>/obmcdump_<id>_<epochtime>.<ext>,
+ *  producing the same archive layout as the dreport script. The output of
+ *  a band is appended to the archive as soon as the band completed, so the
+ *  staging area only holds the output of one band at a time.
+ *
+ *  The plugins are run in bands of equal priority taken from their config
+ *  header. A band only starts once the previous one completed, the plugins
+ *  within a band run concurrently on at most BMC_DUMP_COLLECTOR_WORKERS
+ *  threads.
+ *
+ *  The commands of a collector are killed once they exceed
+ *  BMC_DUMP_COLLECTOR_TIMEOUT or BMC_DUMP_COLLECTOR_CPU_LIMIT, their partial
+ *  output is kept. Collectors which did not start within
+ *  BMC_DUMP_COLLECTION_SLA are skipped, so the dump completes in time.
+ *
+ *  The output of plugins which rarely changes is taken from the result
+ *  cache while the fingerprint of their inputs is unchanged.
+ *
+ *  A request with a baseline produces a delta dump, the items whose hash
+ *  matches the baseline are listed in the manifest instead of being
+ *  archived.
+ */
+class Engine
+{
+  public:
+    Engine() = delete;
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+    Engine(Engine&&) = delete;
+    Engine& operator=(Engine&&) = delete;
+    ~Engine() = default;
+
+    /** @brief Constructor
+     *  @param[in] request - The dump collection request.
+     *  @param[in] cache - Outputs of earlier collections.
+     */
+    Engine(const Request& request, ResultCache& cache) :
+        request(request), dump(this->request), cache(cache)
+    {}
+
+    /** @brief Collect the dump, blocks until the archive is created.
+     *  @return Result of the collection.
+     */
+    Result run();
+
+  private:
+    /** @brief Prepare the staging directory and the summary log.
+     *  @return true on success.
+     */
+    bool initialize();
+
+    /** @brief Find the plugins enabled for the dump type, grouped into
+     *         priority bands.
+     */
+    std::vector<std::vector<Plugin>> discover();
+
+    /** @brief Run the collectors of a priority band concurrently.
+     *  @param[in] band - Plugins of the band.
+     *  @param[in,out] result - Collection result to update.
+     */
+    void runBand(const std::vector<Plugin>& band, Result& result);
+
+    /** @brief Resource limits of a collector starting now */
+    Budget makeBudget() const;
+
+    /** @brief Move the output of a collector into the staging directory.
+     *  @param[in] outDir - Output directory of the collector.
+     *  @param[in,out] staged - Names of the staged items, in order.
+     *  @return Number of items staged.
+     */
+    size_t commit(const std::filesystem::path& outDir,
+                  std::vector<std::string>& staged);
+
+    /** @brief The dump collection request */
+    Request request;
+
+    /** @brief State shared by the collectors */
+    Dump dump;
+
+    /** @brief Outputs of earlier collections */
+    ResultCache& cache;
+
+    /** @brief Time the complete collection has to finish by */
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+};
+
+/** @brief Archive file extension for the configured compression */
+std::string archiveExtension();
+
+/** @brief Create the native collector of a dreport plugin.
+ *  @param[in] plugin - Plugin name, for example "osrelease".
+ *  @return The collector, nullptr if the plugin has no native
+ *          implementation.
+ */
+std::unique_ptr<Collector> makeNativeCollector(const std::string& plugin);
+
+} // namespace collector
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,217 @@
+#include "dump_delta.hpp"
+
+#include "dump_archive.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <set>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace delta
+{
+
+namespace
+{
+
+// FNV-1a 64-bit parameters
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+// Largest manifest read from an archive
+constexpr uint64_t MAX_MANIFEST_SIZE = 16 * 1024 * 1024;
+
+/** @brief Add data to a FNV-1a hash */
+void update(uint64_t& hash, const void* data, size_t size)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+}
+
+/** @brief Add a string and its terminating NUL to a FNV-1a hash */
+void update(uint64_t& hash, const std::string& value)
+{
+    update(hash, value.c_str(), value.size() + 1);
+}
+
+/** @brief Hash a file or directory tree the way the archive stores it,
+ *         links are not followed and special files are skipped.
+ *  @return true on success.
+ */
+bool hashTree(const std::filesystem::path& path, const std::string& name,
+              uint64_t& hash)
+{
+    struct stat st{};
+    if (lstat(path.c_str(), &st) < 0)
+    {
+        return false;
+    }
+
+    if (S_ISDIR(st.st_mode))
+    {
+        update(hash, name + "/");
+        std::error_code ec;
+        std::vector<std::filesystem::path> children;
+        for (const auto& p : std::filesystem::directory_iterator(path, ec))
+        {
+            children.push_back(p.path());
+        }
+        std::sort(children.begin(), children.end());
+        for (const auto& child : children)
+        {
+            if (!hashTree(child, name + "/" + child.filename().string(), hash))
+            {
+                return false;
+            }
+        }
+        return !ec;
+    }
+
+    if (S_ISLNK(st.st_mode))
+    {
+        std::error_code ec;
+        auto target = std::filesystem::read_symlink(path, ec);
+        update(hash, name + " -> " + target.string());
+        return !ec;
+    }
+
+    if (!S_ISREG(st.st_mode))
+    {
+        return true;
+    }
+
+    update(hash, name);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    std::array<uint8_t, 64 * 1024> buf{};
+    uint64_t size = 0;
+    while (true)
+    {
+        auto count = read(fd, buf.data(), buf.size());
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            close(fd);
+            update(hash, &size, sizeof(size));
+            return count == 0;
+        }
+        update(hash, buf.data(), count);
+        size += count;
+    }
+}
+
+} // namespace
+
+std::string hashItem(const std::filesystem::path& item)
+{
+    uint64_t hash = FNV_OFFSET;
+    if (!hashTree(item, item.filename().string(), hash))
+    {
+        return {};
+    }
+    std::array<char, 17> hex{};
+    std::snprintf(hex.data(), hex.size(), "%016" PRIx64, hash);
+    return hex.data();
+}
+
+bool baselineItems(const std::filesystem::path& delta,
+                   const std::filesystem::path& baseline, int fd,
+                   const std::atomic<bool>& cancelled)
+{
+    auto dictionary = archive::Dictionary::configured();
+    try
+    {
+        // The manifest names the top directory and the items taken from
+        // the baseline
+        std::string name;
+        std::set<std::string> items;
+        {
+            archive::Reader reader(delta, dictionary);
+            archive::Member member;
+            while (reader.next(member))
+            {
+                auto slash = member.name.find('/');
+                if (slash == std::string::npos ||
+                    member.name.compare(slash + 1, std::string::npos,
+                                        MANIFEST) != 0)
+                {
+                    continue;
+                }
+                if (member.size > MAX_MANIFEST_SIZE)
+                {
+                    break;
+                }
+                std::string data(member.size, '\0');
+                if (reader.read(data.data(), data.size()) !=
+                    static_cast<ssize_t>(data.size()))
+                {
+                    break;
+                }
+                name = member.name.substr(0, slash);
+                items = nlohmann::json::parse(data)
+                            .value("baselineItems", std::set<std::string>{});
+                break;
+            }
+        }
+        if (name.empty())
+        {
+            lg2::error("No manifest in the delta dump {PATH}", "PATH", delta);
+            return false;
+        }
+
+        archive::Reader reader(baseline, dictionary);
+        archive::Writer writer(fd, reader.getAlgorithm(), dictionary);
+        archive::Member member;
+        while (!cancelled && reader.next(member))
+        {
+            // Members are <baseline name>/<item>[/...]
+            auto slash = member.name.find('/');
+            if (slash == std::string::npos)
+            {
+                continue;
+            }
+            auto path = member.name.substr(slash + 1);
+            if (items.contains(path.substr(0, path.find('/'))) &&
+                !writer.add(reader, member, name + "/" + path))
+            {
+                lg2::error("Failed to copy {ITEM} from the baseline {PATH}",
+                           "ITEM", path, "PATH", baseline);
+                return false;
+            }
+        }
+        return !cancelled && writer.finish();
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to read the baseline {PATH} of {DELTA}, "
+                   "error: {ERROR}",
+                   "PATH", baseline, "DELTA", delta, "ERROR", e);
+    }
+    return false;
+}
+
+} // namespace delta
+} // namespace dump
+} // namespace phosphor
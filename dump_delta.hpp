@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace delta
+{
+
+// Manifest of a dump archive, the items with their hashes and the items
+// taken from the baseline
+constexpr auto MANIFEST = "manifest.json";
+
+/** @brief Hash the contents of a dump item.
+ *  @details 64-bit FNV-1a over the relative paths, types and contents of
+ *  the files of the item in name order, so an unchanged item hashes the
+ *  same in every dump.
+ *  @param[in] item - File or directory of the staging directory.
+ *  @return The hash in hex, empty if the item can't be read.
+ */
+std::string hashItem(const std::filesystem::path& item);
+
+/** @brief Write the items a delta archive takes from its baseline to a
+ *         descriptor.
+ *  @details The items listed in the manifest of the delta are copied from
+ *  the baseline archive, renamed into the top directory of the delta, into
+ *  a compressed stream without the end of archive blocks. The stream
+ *  followed by the delta archive decompresses into the complete dump.
+ *  @param[in] delta - The delta archive.
+ *  @param[in] baseline - The archive of its baseline.
+ *  @param[in] fd - Descriptor the compressed stream is written to.
+ *  @param[in] cancelled - Set to stop the copy, checked for every member
+ *                         of the baseline.
+ *  @return true if the whole stream was written.
+ */
+bool baselineItems(const std::filesystem::path& delta,
+                   const std::filesystem::path& baseline, int fd,
+                   const std::atomic<bool>& cancelled);
+
+} // namespace delta
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,101 @@
+#include "config.h"
+
+#include "dump_dictionary.hpp"
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+
+#ifdef HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+namespace phosphor
+{
+namespace dump
+{
+namespace archive
+{
+
+bool readSamples(const std::filesystem::path& file,
+                 std::vector<std::string>& samples,
+                 const std::vector<uint8_t>& dictionary)
+{
+    try
+    {
+        std::shared_ptr<const Dictionary> zdict;
+        if (!dictionary.empty())
+        {
+            zdict = std::make_shared<const Dictionary>(dictionary);
+        }
+        Reader reader(file, std::move(zdict));
+
+        Member member;
+        while (reader.next(member))
+        {
+            if (member.type != '0' || member.size == 0)
+            {
+                continue;
+            }
+            std::string sample(std::min<uint64_t>(member.size, MAX_SAMPLE_SIZE),
+                               '\0');
+            if (reader.read(sample.data(), sample.size()) !=
+                static_cast<ssize_t>(sample.size()))
+            {
+                break;
+            }
+            samples.push_back(std::move(sample));
+        }
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to read {PATH}, error: {ERROR}", "PATH", file,
+                   "ERROR", e);
+        return false;
+    }
+    return true;
+}
+
+std::vector<uint8_t> trainDictionary(
+    [[maybe_unused]] const std::vector<std::string>& samples,
+    [[maybe_unused]] size_t size, [[maybe_unused]] uint32_t id)
+{
+#ifdef HAVE_ZSTD
+    std::string buffer;
+    std::vector<size_t> sizes;
+    for (const auto& sample : samples)
+    {
+        buffer += sample;
+        sizes.push_back(sample.size());
+    }
+
+    std::vector<uint8_t> dictionary(size);
+    auto rc = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(),
+                                    buffer.data(), sizes.data(), sizes.size());
+    if (ZDICT_isError(rc))
+    {
+        lg2::error("Dictionary training failed, error: {ERROR}", "ERROR",
+                   ZDICT_getErrorName(rc));
+        return {};
+    }
+    dictionary.resize(rc);
+
+    // The id follows the magic number, little endian
+    if (id != 0)
+    {
+        for (size_t i = 0; i < 4; ++i)
+        {
+            dictionary[4 + i] = static_cast<uint8_t>(id >> (8 * i));
+        }
+    }
+    return dictionary;
+#else
+    lg2::error("Dictionary training requires zstd");
+    return {};
+#endif
+}
+
+} // namespace archive
+} // namespace dump
+} // namespace phosphor
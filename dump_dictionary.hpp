@@ -0,0 +1,46 @@
+#pragma once
+
+#include "dump_archive.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace archive
+{
+
+// Largest sample taken from a single file of a dump
+constexpr size_t MAX_SAMPLE_SIZE = 128 * 1024;
+
+// Default dictionary size, the default of "zstd --train"
+constexpr size_t DEFAULT_DICTIONARY_SIZE = 112640;
+
+/** @brief Read the files of a dump archive as dictionary training samples.
+ *  @param[in] file - xz, gzip or zstd compressed tar archive.
+ *  @param[in,out] samples - Contents of the regular files of the archive,
+ *                           cut at MAX_SAMPLE_SIZE, are appended.
+ *  @param[in] dictionary - Contents of the dictionary a zstd archive was
+ *                          compressed with, empty for none.
+ *  @return true on success.
+ */
+bool readSamples(const std::filesystem::path& file,
+                 std::vector<std::string>& samples,
+                 const std::vector<uint8_t>& dictionary = {});
+
+/** @brief Train a zstd dictionary.
+ *  @param[in] samples - Training samples, see readSamples().
+ *  @param[in] size - Maximum size of the dictionary.
+ *  @param[in] id - Id of the dictionary, 0 for a random one.
+ *  @return The dictionary, empty on failure.
+ */
+std::vector<uint8_t> trainDictionary(const std::vector<std::string>& samples,
+                                     size_t size, uint32_t id);
+
+} // namespace archive
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,117 @@
+#include "config.h"
+
+#include "dump_dictionary.hpp"
+
+#include <getopt.h>
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+namespace
+{
+
+void usage(const char* name)
+{
+    std::cerr << "usage: " << name
+              << " [OPTION]... <dump directory> <dictionary file>\n";
+    std::cerr << "Train a zstd dictionary from the obmcdump_* archives in a "
+                 "directory tree.\n\n";
+    std::cerr << "  -s, --size <bytes>        Maximum dictionary size, default "
+              << phosphor::dump::archive::DEFAULT_DICTIONARY_SIZE << "\n";
+    std::cerr << "  -i, --id <id>             Dictionary id, default random\n";
+    std::cerr << "  -D, --dictionary <file>   Dictionary the zstd archives "
+                 "were compressed with\n";
+    std::cerr << "  -h, --help                Display this help and exit\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    using namespace phosphor::dump;
+
+    size_t size = archive::DEFAULT_DICTIONARY_SIZE;
+    uint32_t id = 0;
+    std::vector<uint8_t> previous;
+
+    const option options[] = {
+        {"size", required_argument, nullptr, 's'},
+        {"id", required_argument, nullptr, 'i'},
+        {"dictionary", required_argument, nullptr, 'D'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int opt = 0;
+    while ((opt = getopt_long(argc, argv, "s:i:D:h", options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                size = std::stoul(optarg);
+                break;
+            case 'i':
+                id = std::stoul(optarg);
+                break;
+            case 'D':
+            {
+                std::ifstream is(optarg, std::ios::binary);
+                previous.assign(std::istreambuf_iterator<char>(is),
+                                std::istreambuf_iterator<char>());
+                break;
+            }
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> samples;
+    size_t dumps = 0;
+    std::error_code ec;
+    for (const auto& p :
+         std::filesystem::recursive_directory_iterator(argv[optind], ec))
+    {
+        if (p.is_regular_file(ec) &&
+            p.path().filename().string().starts_with("obmcdump_") &&
+            archive::readSamples(p.path(), samples, previous))
+        {
+            ++dumps;
+        }
+    }
+    if (ec)
+    {
+        std::cerr << "Failed to read " << argv[optind] << ": " << ec.message()
+                  << "\n";
+        return 1;
+    }
+
+    auto dictionary = archive::trainDictionary(samples, size, id);
+    if (dictionary.empty())
+    {
+        std::cerr << "Failed to train the dictionary from " << samples.size()
+                  << " files of " << dumps << " dumps\n";
+        return 1;
+    }
+
+    std::ofstream os(argv[optind + 1], std::ios::binary);
+    os.write(reinterpret_cast<const char*>(dictionary.data()),
+             dictionary.size());
+    if (!os)
+    {
+        std::cerr << "Failed to write " << argv[optind + 1] << "\n";
+        return 1;
+    }
+
+    archive::Dictionary trained(dictionary);
+    std::cout << "Trained dictionary " << trained.getId() << ", "
+              << dictionary.size() << " bytes, from " << samples.size()
+              << " files of " << dumps << " dumps\n";
+    return 0;
+}
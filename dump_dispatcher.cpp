@@ -0,0 +1,80 @@
+#include "dump_dispatcher.hpp"
+
+#include <sys/eventfd.h>
+
+#include <phosphor-logging/elog-errors.hpp>
+#include <phosphor-logging/elog.hpp>
+#include <phosphor-logging/lg2.hpp>
+#include <xyz/openbmc_project/Common/error.hpp>
+
+namespace phosphor
+{
+namespace dump
+{
+
+using namespace phosphor::logging;
+using namespace sdbusplus::xyz::openbmc_project::Common::Error;
+
+namespace
+{
+
+int createEventFd()
+{
+    int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd < 0)
+    {
+        auto error = errno;
+        lg2::error("Error occurred during eventfd creation, errno: {ERRNO}",
+                   "ERRNO", error);
+        elog<InternalFailure>();
+    }
+    return fd;
+}
+
+} // namespace
+
+Dispatcher::Dispatcher(sd_event* event) : fd(createEventFd())
+{
+    source = std::make_unique<sdeventplus::source::IO>(
+        sdeventplus::Event(event), fd(), EPOLLIN,
+        [this](sdeventplus::source::IO&, int, uint32_t) { dispatch(); });
+}
+
+void Dispatcher::post(Callback callback)
+{
+    {
+        std::lock_guard lock(mutex);
+        pending.push_back(std::move(callback));
+    }
+
+    uint64_t one = 1;
+    if (write(fd(), &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        lg2::error("Failed to wake up the event loop, errno: {ERRNO}",
+                   "ERRNO", errno);
+    }
+}
+
+void Dispatcher::dispatch()
+{
+    uint64_t count = 0;
+    if (read(fd(), &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+        lg2::error("Failed to read the dispatcher eventfd, errno: {ERRNO}",
+                   "ERRNO", errno);
+    }
+
+    std::vector<Callback> ready;
+    {
+        std::lock_guard lock(mutex);
+        ready.swap(pending);
+    }
+
+    for (auto& callback : ready)
+    {
+        callback();
+    }
+}
+
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "dump_utils.hpp"
+
+#include <sdeventplus/event.hpp>
+#include <sdeventplus/source/io.hpp>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+
+/** @class Dispatcher
+ *  @brief Runs work handed over by worker threads on the sd_event loop.
+ *  @details The dump manager objects are not thread safe, so work done
+ *  on a worker thread posts its completion here and the callback is
+ *  invoked from the event loop, where it is safe to touch D-Bus objects.
+ */
+class Dispatcher
+{
+  public:
+    using Callback = std::function<void()>;
+
+    Dispatcher() = delete;
+    Dispatcher(const Dispatcher&) = delete;
+    Dispatcher& operator=(const Dispatcher&) = delete;
+    Dispatcher(Dispatcher&&) = delete;
+    Dispatcher& operator=(Dispatcher&&) = delete;
+    ~Dispatcher() = default;
+
+    /** @brief Constructor
+     *  @param[in] event - Dump manager sd_event loop.
+     */
+    explicit Dispatcher(sd_event* event);
+
+    /** @brief Queue a callback to be run from the event loop.
+     *  @details Safe to call from any thread.
+     *  @param[in] callback - Work to run on the event loop.
+     */
+    void post(Callback callback);
+
+  private:
+    /** @brief Run all the queued callbacks */
+    void dispatch();
+
+    /** @brief eventfd used to wake up the event loop */
+    CustomFd fd;
+
+    /** @brief Event source watching the eventfd */
+    std::unique_ptr<sdeventplus::source::IO> source;
+
+    /** @brief Protects the pending queue */
+    std::mutex mutex;
+
+    /** @brief Callbacks waiting to be run */
+    std::vector<Callback> pending;
+};
+
+} // namespace dump
+} // namespace phosphor
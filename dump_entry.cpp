@@ -1,8 +1,10 @@
 #include "dump_entry.hpp"
 
+#include "dump_chunk.hpp"
 #include "dump_manager.hpp"
 
 #include <fcntl.h>
+#include <unistd.h>
 
 #include <nlohmann/json.hpp>
 #include <phosphor-logging/elog-errors.hpp>
@@ -13,7 +15,9 @@
 #include <xyz/openbmc_project/Common/File/error.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
 
+#include <cerrno>
 #include <cstring>
+#include <system_error>
 
 namespace phosphor
 {
@@ -22,6 +26,16 @@ namespace dump
 
 using namespace phosphor::logging;
 
+Entry::~Entry()
+{
+    // A consumer which stopped reading holds up the writer until cancelled
+    writerCancelled = true;
+    if (archiveWriter.joinable())
+    {
+        archiveWriter.join();
+    }
+}
+
 void Entry::delete_()
 {
     // Remove Dump entry D-bus object
@@ -44,7 +58,9 @@ sdbusplus::message::unix_fd Entry::getFileHandle()
         return fdCloseEventSource->first;
     }
 
-    int fd = open(file.c_str(), O_RDONLY | O_NONBLOCK);
+    parent.offloadStarted(id);
+    int fd = chunk::isRecipe(file) ? openStream()
+                                   : open(file.c_str(), O_RDONLY | O_NONBLOCK);
     if (fd == -1)
     {
         auto err = errno;
@@ -64,13 +80,102 @@ sdbusplus::message::unix_fd Entry::getFileHandle()
     return fd;
 }
 
+int Entry::openStream()
+{
+    if (archiveWriter.joinable())
+    {
+        // One consumer at a time streams the archive
+        if (!writerDone)
+        {
+            errno = EBUSY;
+            return -1;
+        }
+        archiveWriter.join();
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+    {
+        return -1;
+    }
+    // The writer waits on a full pipe with a timeout, to be cancelled
+    if (fcntl(fds[1], F_SETFL, O_NONBLOCK) < 0)
+    {
+        auto err = errno;
+        close(fds[0]);
+        close(fds[1]);
+        errno = err;
+        return -1;
+    }
+
+    writerCancelled = false;
+    writerDone = false;
+    try
+    {
+        archiveWriter = std::thread([this, recipe = file, fd = fds[1]]() {
+            if (!chunk::writeArchive(recipe, fd, writerCancelled) &&
+                !writerCancelled)
+            {
+                lg2::info("Archive of dump {ID} not fully streamed", "ID",
+                          id);
+            }
+            close(fd);
+            writerDone = true;
+        });
+    }
+    catch (const std::system_error& e)
+    {
+        lg2::error("Failed to start the writer of dump {ID}: {ERROR}", "ID",
+                   id, "ERROR", e);
+        close(fds[0]);
+        close(fds[1]);
+        errno = EAGAIN;
+        return -1;
+    }
+    return fds[0];
+}
+
+record::Record Entry::toRecord() const
+{
+    record::Record r;
+    r.dumpId = id;
+    r.originatorId = originatorId();
+    r.originatorType = static_cast<uint8_t>(originatorType());
+    r.startTime = startTime();
+    r.collectorOutcomes = collectorOutcomes;
+    r.itemHashes = itemHashes;
+    r.baselineId = baselineId;
+    r.dumpType = dumpType;
+    r.offloaded = offloaded();
+    r.fileName = file.filename().string();
+    r.size = size();
+    r.completedTime = completedTime();
+    return r;
+}
+
+void Entry::applyRecord(const record::Record& r)
+{
+    originatorId(r.originatorId);
+    originatorType(static_cast<originatorTypes>(r.originatorType));
+    startTime(r.startTime);
+    collectorOutcomes = r.collectorOutcomes;
+    itemHashes = r.itemHashes;
+    baselineId = r.baselineId;
+    dumpType = r.dumpType;
+    offloaded(r.offloaded);
+}
+
 void Entry::serialize()
 {
+    // Updates the catalog of the manager, even if the record of the dump
+    // can't be written
+    parent.entryChanged(id);
+
     // Folder for serialized entry
     std::filesystem::path dir = file.parent_path() / PRESERVE;
 
     // Serialized entry file
-    std::filesystem::path serializePath = dir / SERIAL_FILE;
+    std::filesystem::path serializePath = dir / record::RECORD_FILE;
     try
     {
         if (!std::filesystem::exists(dir))
@@ -78,21 +183,15 @@ void Entry::serialize()
             std::filesystem::create_directories(dir);
         }
 
-        std::ofstream os(serializePath, std::ios::binary);
-        if (!os.is_open())
+        if (!record::save(serializePath, toRecord()))
         {
-            lg2::error("Failed to open file for serialization: {PATH} ", "PATH",
-                       serializePath);
+            // The previous record is still in place
             return;
         }
-        nlohmann::json j;
-        j["version"] = CLASS_SERIALIZATION_VERSION;
-        j["dumpId"] = id;
-        j["originatorId"] = originatorId();
-        j["originatorType"] = originatorType();
-        j["startTime"] = startTime();
 
-        os << j.dump(4);
+        // The JSON record of an earlier version is superseded
+        std::error_code ec;
+        std::filesystem::remove(dir / SERIAL_FILE, ec);
     }
     catch (const std::exception& e)
     {
@@ -120,7 +219,29 @@ void Entry::deserialize(const std::filesystem::path& dumpPath)
             return;
         }
 
-        // Serialized entry
+        // Binary record, written by serialize()
+        auto recordPath = dir / record::RECORD_FILE;
+        if (auto r = record::load(recordPath))
+        {
+            if (r->dumpId != id)
+            {
+                lg2::error("The id ({ID_IN_FILE}) is not matching the dump id "
+                           "({DUMPID}); skipping deserialization.",
+                           "ID_IN_FILE", r->dumpId, "DUMPID", id);
+                std::error_code ec;
+                std::filesystem::remove_all(dir, ec);
+                return;
+            }
+            applyRecord(*r);
+            return;
+        }
+        if (std::filesystem::exists(recordPath))
+        {
+            lg2::error("Corrupted dump entry record: {PATH}", "PATH",
+                       recordPath);
+        }
+
+        // JSON record of an earlier version
         std::filesystem::path serializePath = dir / SERIAL_FILE;
         std::ifstream is(serializePath, std::ios::binary);
         if (!is.is_open())
@@ -143,6 +264,29 @@ void Entry::deserialize(const std::filesystem::path& dumpPath)
                 originatorId(j["originatorId"].get<std::string>());
                 originatorType(j["originatorType"].get<originatorTypes>());
                 startTime(j["startTime"].get<uint64_t>());
+
+                // Optional, only recorded by the native collector
+                if (j.contains("collectorOutcomes"))
+                {
+                    collectorOutcomes =
+                        j["collectorOutcomes"].get<CollectorOutcomes>();
+                }
+                if (j.contains("itemHashes"))
+                {
+                    itemHashes = j["itemHashes"].get<ItemHashes>();
+                }
+                if (j.contains("baselineId"))
+                {
+                    baselineId = j["baselineId"].get<uint32_t>();
+                }
+                if (j.contains("dumpType"))
+                {
+                    dumpType = j["dumpType"].get<std::string>();
+                }
+                if (j.contains("offloaded"))
+                {
+                    offloaded(j["offloaded"].get<bool>());
+                }
             }
             else
             {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "dump_record.hpp"
 #include "xyz/openbmc_project/Common/OriginatedBy/server.hpp"
 #include "xyz/openbmc_project/Common/Progress/server.hpp"
 #include "xyz/openbmc_project/Dump/Entry/server.hpp"
@@ -12,22 +13,25 @@
 #include <sdeventplus/event.hpp>
 #include <sdeventplus/source/event.hpp>
 
+#include <atomic>
 #include <filesystem>
 #include <fstream>
+#include <map>
+#include <thread>
 
 namespace phosphor
 {
 namespace dump
 {
 
-// Current serialiation version of the class increment if there any change
-// in the serialized data members
+// Serialization version of the JSON record of earlier versions, the entries
+// are now stored as a binary record, see dump_record.hpp
 constexpr size_t CLASS_SERIALIZATION_VERSION = 1;
 
 // Folder to store serialized dump contents
 constexpr auto PRESERVE = ".preserve";
 
-// Binary file store the contents
+// JSON record of earlier versions, still read by deserialize()
 constexpr auto SERIAL_FILE = "serialized_entry.json";
 
 template <typename T>
@@ -50,6 +54,12 @@ using OperationStatus =
 using originatorTypes = sdbusplus::xyz::openbmc_project::Common::server::
     OriginatedBy::OriginatorTypes;
 
+// Outcome of the collectors which produced a dump [plugin:outcome]
+using CollectorOutcomes = std::map<std::string, std::string>;
+
+// Content hash of the items of a dump [item:hash]
+using ItemHashes = std::map<std::string, std::string>;
+
 class Manager;
 
 /** @class Entry
@@ -65,7 +75,9 @@ class Entry : public EntryIfaces
     Entry& operator=(const Entry&) = delete;
     Entry(Entry&&) = delete;
     Entry& operator=(Entry&&) = delete;
-    ~Entry() = default;
+
+    /** @brief Stops the writer of the archive of a recipe, if any */
+    ~Entry();
 
     /** @brief Constructor for the Dump Entry Object
      *  @param[in] bus - Bus to attach to.
@@ -130,15 +142,84 @@ class Entry : public EntryIfaces
         return id;
     }
 
+    /** @brief Returns the dump file, empty while the dump is in progress */
+    const std::filesystem::path& getFile() const
+    {
+        return file;
+    }
+
     /** @brief Method to get the file handle of the dump
+     *  @details The descriptor is of a regular file, a consumer wanting a
+     *  range of the dump reads it with pread(2). The archive of a dump in
+     *  the chunk store is streamed from its chunk files into a pipe by a
+     *  worker thread instead, a consumer reads it sequentially.
      *  @returns A Unix file descriptor to the dump file
      *  @throws sdbusplus::xyz::openbmc_project::Common::File::Error::Open on
-     *  failure to open the file
+     *  failure to open the file, with EBUSY while the archive of a dump in
+     *  the chunk store is still streamed to an earlier consumer
      *  @throws sdbusplus::xyz::openbmc_project::Common::Error::Unavailable if
      *  the file string is empty
      */
     sdbusplus::message::unix_fd getFileHandle() override;
 
+    /** @brief Set the outcome of the collectors which produced the dump,
+     *         stored along with the entry by serialize()
+     *  @param[in] outcomes - Outcome by plugin name, "ok", "timeout",
+     *                        "oversize", "failed" or "skipped".
+     */
+    void setCollectorOutcomes(const CollectorOutcomes& outcomes)
+    {
+        collectorOutcomes = outcomes;
+    }
+
+    /** @brief Set the content hashes of the items of the dump, which a
+     *         later delta dump is compared against, stored along with the
+     *         entry by serialize()
+     */
+    void setItemHashes(const ItemHashes& hashes)
+    {
+        itemHashes = hashes;
+    }
+
+    /** @brief Returns the content hashes of the items of the dump */
+    const ItemHashes& getItemHashes() const
+    {
+        return itemHashes;
+    }
+
+    /** @brief Set the dump a delta dump takes its unchanged items from,
+     *         stored along with the entry by serialize()
+     *  @param[in] baseline - Id of the baseline, 0 for a complete dump.
+     */
+    void setBaselineId(uint32_t baseline)
+    {
+        baselineId = baseline;
+    }
+
+    /** @brief Returns the id of the baseline, 0 for a complete dump */
+    uint32_t getBaselineId() const
+    {
+        return baselineId;
+    }
+
+    /** @brief Set the collection type of the dump, stored along with the
+     *         entry by serialize()
+     *  @param[in] type - Collection type, for example "user" or "elog".
+     */
+    void setDumpType(const std::string& type)
+    {
+        dumpType = type;
+    }
+
+    /** @brief Returns the collection type of the dump, empty if unknown */
+    const std::string& getDumpType() const
+    {
+        return dumpType;
+    }
+
+    /** @brief Returns the persisted properties of the entry */
+    record::Record toRecord() const;
+
     /**
      * @brief Serialize the dump entry attributes to a file.
      *
@@ -153,6 +234,11 @@ class Entry : public EntryIfaces
     virtual void deserialize(const std::filesystem::path& dumpPath);
 
   protected:
+    /** @brief Set the persisted properties of the entry, except for the
+     *         file and its size and completion time.
+     */
+    void applyRecord(const record::Record& r);
+
     /** @brief This entry's parent */
     Manager& parent;
 
@@ -162,7 +248,25 @@ class Entry : public EntryIfaces
     /** @Dump file name */
     std::filesystem::path file;
 
+    /** @brief Outcome of the collectors which produced the dump */
+    CollectorOutcomes collectorOutcomes;
+
+    /** @brief Content hash of the items of the dump */
+    ItemHashes itemHashes;
+
+    /** @brief Id of the baseline of a delta dump, 0 for a complete dump */
+    uint32_t baselineId = 0;
+
+    /** @brief Collection type of the dump */
+    std::string dumpType;
+
   private:
+    /** @brief Open a pipe the archive of the recipe is written into by
+     *         archiveWriter.
+     *  @return The read end, -1 with errno set on failure.
+     */
+    int openStream();
+
     /** @brief Closes the file descriptor and removes the corresponding event
      *  source.
      *
@@ -179,6 +283,15 @@ class Entry : public EntryIfaces
     /* @brief A pair of file descriptor and corresponding event source. */
     std::optional<std::pair<int, std::unique_ptr<sdeventplus::source::Defer>>>
         fdCloseEventSource;
+
+    /** @brief Writes the archive of a recipe into the pipe of openStream() */
+    std::thread archiveWriter;
+
+    /** @brief Set to stop archiveWriter */
+    std::atomic<bool> writerCancelled = false;
+
+    /** @brief Set by archiveWriter once it is done */
+    std::atomic<bool> writerDone = false;
 };
 
 } // namespace dump
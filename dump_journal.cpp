@@ -0,0 +1,356 @@
+#include "dump_journal.hpp"
+
+#include <systemd/sd-journal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string_view>
+#include <system_error>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace journal
+{
+
+namespace
+{
+
+// Output is written in blocks of this size
+constexpr size_t WRITE_SIZE = 64 * 1024;
+
+// Polling interval of the stop callback in entries
+constexpr size_t STOP_INTERVAL = 64;
+
+// Fields written as part of the entry line, or only of use to journald
+constexpr std::array<std::string_view, 10> knownFields = {
+    "MESSAGE",         "PRIORITY",   "SYSLOG_IDENTIFIER", "SYSLOG_PID",
+    "SYSLOG_FACILITY", "SYSLOG_RAW", "SYSLOG_TIMESTAMP",  "CODE_FILE",
+    "CODE_LINE",       "CODE_FUNC",
+};
+
+/** @brief Write all of the data.
+ *  @throws std::system_error on a write error.
+ */
+void writeAll(int fd, const std::string& data)
+{
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        auto count = ::write(fd, data.data() + offset, data.size() - offset);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to write the journal");
+        }
+        offset += count;
+    }
+}
+
+/** @brief Append a field value, control characters are escaped so every
+ *         entry stays on one line, the lines of a message are indented.
+ */
+void appendValue(std::string& line, std::string_view value, bool message)
+{
+    for (auto c : value)
+    {
+        if (c == '\n' && message)
+        {
+            line += "\n    ";
+        }
+        else if (c == '\n')
+        {
+            line += "\\n";
+        }
+        else if (static_cast<unsigned char>(c) < 0x20 && c != '\t')
+        {
+            std::array<char, 5> escaped{};
+            std::snprintf(escaped.data(), escaped.size(), "\\x%02x",
+                          static_cast<unsigned char>(c));
+            line += escaped.data();
+        }
+        else
+        {
+            line += c;
+        }
+    }
+}
+
+/** @brief The local time of an entry with microseconds, formatting the
+ *         seconds only when they change.
+ */
+class TimeFormat
+{
+  public:
+    const std::string& format(uint64_t usec)
+    {
+        time_t sec = usec / 1000000;
+        if (sec != last || text.empty())
+        {
+            tm local{};
+            localtime_r(&sec, &local);
+            std::array<char, 32> buf{};
+            prefix.assign(buf.data(), std::strftime(buf.data(), buf.size(),
+                                                    "%Y-%m-%dT%H:%M:%S",
+                                                    &local));
+            zone.assign(buf.data(),
+                        std::strftime(buf.data(), buf.size(), "%z", &local));
+            last = sec;
+        }
+        std::array<char, 8> fraction{};
+        std::snprintf(fraction.data(), fraction.size(), ".%06u",
+                      static_cast<unsigned>(usec % 1000000));
+        text = prefix + fraction.data() + zone;
+        return text;
+    }
+
+  private:
+    time_t last = 0;
+    std::string prefix;
+    std::string zone;
+    std::string text;
+};
+
+/** @brief The cursor of the current entry, empty on failure */
+std::string getCursor(sd_journal* journal)
+{
+    char* cursor = nullptr;
+    if (sd_journal_get_cursor(journal, &cursor) < 0)
+    {
+        return {};
+    }
+    std::string value(cursor);
+    free(cursor);
+    return value;
+}
+
+} // namespace
+
+Extractor::Extractor(const std::filesystem::path& directory)
+{
+    int rc = directory.empty()
+                 ? sd_journal_open(&journal, SD_JOURNAL_LOCAL_ONLY)
+                 : sd_journal_open_directory(&journal, directory.c_str(), 0);
+    if (rc < 0)
+    {
+        throw std::system_error(-rc, std::generic_category(),
+                                "Failed to open the journal");
+    }
+}
+
+Extractor::~Extractor()
+{
+    sd_journal_close(journal);
+}
+
+Extract Extractor::write(int fd, const Filter& filter,
+                         const std::function<bool()>& stop)
+{
+    sd_journal_flush_matches(journal);
+    std::vector<std::string> matches;
+    if (filter.pid != 0)
+    {
+        matches.push_back("_PID=" + std::to_string(filter.pid));
+    }
+    for (const auto& unit : filter.units)
+    {
+        matches.push_back("_SYSTEMD_UNIT=" + unit);
+    }
+    for (const auto& match : matches)
+    {
+        int rc = sd_journal_add_match(journal, match.data(), match.size());
+        if (rc < 0)
+        {
+            throw std::system_error(-rc, std::generic_category(),
+                                    "Invalid journal match " + match);
+        }
+    }
+
+    uint64_t cutoff = 0;
+    if (filter.window.count() > 0)
+    {
+        auto now = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch());
+        auto window = std::chrono::duration_cast<std::chrono::microseconds>(
+            filter.window);
+        cutoff = now > window ? (now - window).count() : 0;
+    }
+
+    // Walking backwards from the tail leaves out the entries added during
+    // the extraction
+    int rc = sd_journal_seek_tail(journal);
+    if (rc < 0)
+    {
+        throw std::system_error(-rc, std::generic_category(),
+                                "Failed to seek the journal");
+    }
+
+    Extract extract;
+    std::string out;
+    std::string line;
+    std::string identifier;
+    std::string comm;
+    std::string pid;
+    std::string message;
+    std::string fields;
+    char priority = '-';
+    TimeFormat time;
+
+    // Entries the journal moved past the last one written
+    size_t passed = 0;
+
+    auto flush = [&]() {
+        writeAll(fd, out);
+        extract.bytes += out.size();
+        out.clear();
+    };
+
+    while ((rc = sd_journal_previous(journal)) > 0)
+    {
+        ++passed;
+        if (stop && extract.entries % STOP_INTERVAL == 0 && stop())
+        {
+            extract.truncated = true;
+            break;
+        }
+
+        uint64_t usec = 0;
+        if (sd_journal_get_realtime_usec(journal, &usec) < 0)
+        {
+            continue;
+        }
+        if (usec < cutoff)
+        {
+            break;
+        }
+        if (filter.maxEntries != 0 && extract.entries >= filter.maxEntries)
+        {
+            extract.truncated = true;
+            break;
+        }
+
+        identifier.clear();
+        comm.clear();
+        pid.clear();
+        message.clear();
+        fields.clear();
+        priority = '-';
+
+        const void* data = nullptr;
+        size_t length = 0;
+        sd_journal_restart_data(journal);
+        while (sd_journal_enumerate_data(journal, &data, &length) > 0)
+        {
+            std::string_view field(static_cast<const char*>(data), length);
+            auto eq = field.find('=');
+            if (eq == std::string_view::npos)
+            {
+                continue;
+            }
+            auto name = field.substr(0, eq);
+            auto value = field.substr(eq + 1);
+            if (name == "MESSAGE")
+            {
+                message.assign(value);
+            }
+            else if (name == "PRIORITY" && !value.empty())
+            {
+                priority = value.front();
+            }
+            else if (name == "SYSLOG_IDENTIFIER")
+            {
+                identifier.assign(value);
+            }
+            else if (name == "_COMM")
+            {
+                comm.assign(value);
+            }
+            else if (name == "_PID" || (name == "SYSLOG_PID" && pid.empty()))
+            {
+                pid.assign(value);
+            }
+            else if (name.front() != '_' &&
+                     std::find(knownFields.begin(), knownFields.end(),
+                               name) == knownFields.end())
+            {
+                fields += ' ';
+                fields.append(name);
+                fields += '=';
+                appendValue(fields, value, false);
+            }
+        }
+
+        line = time.format(usec);
+        line += ' ';
+        line += priority;
+        line += ' ';
+        line += identifier.empty() ? (comm.empty() ? "unknown" : comm)
+                                   : identifier;
+        if (!pid.empty())
+        {
+            line += '[' + pid + ']';
+        }
+        line += ": ";
+        appendValue(line, message, true);
+        line += fields;
+        line += '\n';
+
+        if (extract.entries == 0)
+        {
+            out = "-- Newest first, starting at cursor " +
+                  getCursor(journal) + "\n";
+        }
+        if (filter.maxBytes != 0 &&
+            extract.bytes + out.size() + line.size() > filter.maxBytes)
+        {
+            extract.truncated = true;
+            break;
+        }
+
+        out += line;
+        passed = 0;
+        ++extract.entries;
+        if (out.size() >= WRITE_SIZE)
+        {
+            flush();
+        }
+    }
+    if (rc < 0)
+    {
+        throw std::system_error(-rc, std::generic_category(),
+                                "Failed to read the journal");
+    }
+
+    if (extract.entries == 0)
+    {
+        out = "-- No entries\n";
+    }
+    else
+    {
+        // Step back onto the oldest entry written for its cursor
+        for (; passed > 0; --passed)
+        {
+            sd_journal_next(journal);
+        }
+        extract.cursor = getCursor(journal);
+        out += "-- " + std::to_string(extract.entries) +
+               " entries, ending at cursor " + extract.cursor +
+               (extract.truncated ? ", older entries left out\n" : "\n");
+    }
+    flush();
+    return extract;
+}
+
+} // namespace journal
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <sys/types.h>
+
+struct sd_journal;
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace journal
+{
+
+/** @struct Filter
+ *  @brief Selects the journal entries written into a dump.
+ */
+struct Filter
+{
+    /** @brief Only entries of this process, 0 for all */
+    pid_t pid = 0;
+
+    /** @brief Only entries of these systemd units, empty for all */
+    std::vector<std::string> units;
+
+    /** @brief Only entries of this period before the extraction, zero for
+     *         no limit
+     */
+    std::chrono::seconds window{0};
+
+    /** @brief Maximum number of entries, 0 for no limit */
+    size_t maxEntries = 0;
+
+    /** @brief Maximum size of the output in bytes, 0 for no limit */
+    uint64_t maxBytes = 0;
+};
+
+/** @struct Extract
+ *  @brief Summary of an extraction.
+ */
+struct Extract
+{
+    /** @brief Number of entries written */
+    size_t entries = 0;
+
+    /** @brief Size of the output in bytes */
+    uint64_t bytes = 0;
+
+    /** @brief Whether older matching entries were left out because of the
+     *         entry or size limit, or because the extraction was stopped
+     */
+    bool truncated = false;
+
+    /** @brief Cursor of the oldest entry written, empty if none */
+    std::string cursor;
+};
+
+/** @class Extractor
+ *  @brief Writes the journal in a compact text format, newest entry first.
+ *  @details One line per entry, "<time> <priority> <identifier>[<pid>]:
+ *  <message>" followed by the fields the application attached to the entry.
+ *  The extraction starts at the newest entry when it is started, entries
+ *  added meanwhile are left out, and walks backwards until the filter
+ *  limits are reached; a size limited dump thereby keeps the most recent
+ *  entries. The first and last line name the cursors of the range, which
+ *  journalctl accepts with --cursor to read on.
+ */
+class Extractor
+{
+  public:
+    Extractor(const Extractor&) = delete;
+    Extractor& operator=(const Extractor&) = delete;
+    Extractor(Extractor&&) = delete;
+    Extractor& operator=(Extractor&&) = delete;
+    ~Extractor();
+
+    /** @brief Constructor
+     *  @param[in] directory - Directory of journal files to read, empty for
+     *                         the local journal of the system, which
+     *                         journalctl reads by default.
+     *  @throws std::system_error if the journal can't be opened.
+     */
+    explicit Extractor(const std::filesystem::path& directory = {});
+
+    /** @brief Write the matching entries.
+     *  @param[in] fd - Descriptor the output is written to.
+     *  @param[in] filter - The entries to write.
+     *  @param[in] stop - Polled between entries, the extraction ends once
+     *                    it returns true.
+     *  @return Summary of the extraction.
+     *  @throws std::system_error on a write or journal error.
+     */
+    Extract write(int fd, const Filter& filter,
+                  const std::function<bool()>& stop = {});
+
+  private:
+    /** @brief The open journal */
+    sd_journal* journal = nullptr;
+};
+
+} // namespace journal
+} // namespace dump
+} // namespace phosphor
@@ -12,13 +12,43 @@ void Manager::erase(uint32_t entryId)
 
 void Manager::deleteAll()
 {
-    auto iter = entries.begin();
-    while (iter != entries.end())
+    // Newest first, a delta dump has a higher id than its baseline
+    std::vector<uint32_t> ids;
+    for (const auto& [id, entry] : entries)
     {
-        auto& entry = iter->second;
-        ++iter;
-        entry->delete_();
+        ids.push_back(id);
     }
+    for (auto id = ids.rbegin(); id != ids.rend(); ++id)
+    {
+        auto iter = entries.find(*id);
+        if (iter != entries.end())
+        {
+            iter->second->delete_();
+        }
+    }
+}
+
+std::vector<uint32_t> Manager::getDeltas(uint32_t baselineId) const
+{
+    std::vector<uint32_t> deltas;
+    for (const auto& [id, entry] : entries)
+    {
+        if (entry->getBaselineId() == baselineId)
+        {
+            deltas.push_back(id);
+        }
+    }
+    return deltas;
+}
+
+std::filesystem::path Manager::getDumpFile(uint32_t entryId) const
+{
+    auto iter = entries.find(entryId);
+    if (iter == entries.end())
+    {
+        return {};
+    }
+    return iter->second->getFile();
 }
 
 } // namespace dump
@@ -6,6 +6,9 @@
 #include <sdbusplus/bus.hpp>
 #include <sdbusplus/server/object.hpp>
 
+#include <filesystem>
+#include <vector>
+
 #define CREATE_DUMP_MAX_PARAMS 2
 
 namespace phosphor
@@ -52,15 +55,38 @@ class Manager : public Iface
      */
     virtual void restore() = 0;
 
+    /** @brief Find the delta dumps which take items from a dump.
+     *  @param[in] baselineId - Id of the dump.
+     *  @return Ids of the delta dumps.
+     */
+    std::vector<uint32_t> getDeltas(uint32_t baselineId) const;
+
+    /** @brief Returns the file of a dump, empty if there is no such dump
+     *         or it is in progress.
+     */
+    std::filesystem::path getDumpFile(uint32_t entryId) const;
+
+    /** @brief Notification of a change of an entry, such as Offloaded,
+     *         called when the entry is serialized.
+     *  @param[in] entryId - unique identifier of the entry
+     */
+    virtual void entryChanged([[maybe_unused]] uint32_t entryId) {}
+
+    /** @brief Notification of the start of an offload of an entry, through
+     *         InitiateOffload or GetFileHandle.
+     *  @param[in] entryId - unique identifier of the entry
+     */
+    virtual void offloadStarted([[maybe_unused]] uint32_t entryId) {}
+
   protected:
     /** @brief Erase specified entry d-bus object
      *
      * @param[in] entryId - unique identifier of the entry
      */
-    void erase(uint32_t entryId);
+    virtual void erase(uint32_t entryId);
 
     /** @brief  Erase all BMC dump entries and  Delete all Dump files
-     * from Permanent location
+     * from Permanent location, delta dumps ahead of their baselines
      *
      */
     void deleteAll() override;
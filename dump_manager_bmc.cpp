@@ -7,16 +7,22 @@
 #include "xyz/openbmc_project/Common/error.hpp"
 #include "xyz/openbmc_project/Dump/Create/error.hpp"
 
+#include <signal.h>
 #include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <phosphor-logging/elog-errors.hpp>
 #include <phosphor-logging/elog.hpp>
 #include <phosphor-logging/lg2.hpp>
+#include <sdeventplus/clock.hpp>
 #include <sdeventplus/exception.hpp>
 #include <sdeventplus/source/base.hpp>
 
-#include <cmath>
+#include <chrono>
+#include <ctime>
+#include <set>
 
 namespace phosphor
 {
@@ -31,6 +37,10 @@ using namespace phosphor::logging;
 bool Manager::fUserDumpInProgress = false;
 constexpr auto BMC_DUMP = "BMC_DUMP";
 
+// dreport enforces the collection SLA on its plugins, the grace period
+// covers the packaging before dreport itself is killed.
+constexpr auto DREPORT_GRACE = std::chrono::seconds(60);
+
 sdbusplus::object_path Manager::createDump(
     phosphor::dump::DumpCreateParams params)
 {
@@ -69,11 +79,15 @@ sdbusplus::object_path Manager::createDump(
         elog<sdbusplus::xyz::openbmc_project::Common::Error::Unavailable>();
     }
 
+    // The collection takes precedence over the idle recompression
+    recompressCancelled = true;
+
     lg2::info("Initiating new BMC dump with type: {TYPE} path: {PATH}", "TYPE",
               dumpTypeToString(dumpType).value_or("unknown").c_str(), "PATH",
               path);
 
-    auto id = captureDump(dumpType, path);
+    std::optional<collector::Baseline> baseline;
+    auto id = captureDump(dumpType, path, baseline);
 
     // Entry Object path.
     auto objPath = std::filesystem::path(baseEntryPath) / std::to_string(id);
@@ -90,6 +104,14 @@ sdbusplus::object_path Manager::createDump(
                     bus, objPath.c_str(), id, timeStamp, 0, std::string(),
                     phosphor::dump::OperationStatus::InProgress, originatorId,
                     originatorType, *this)));
+
+        // The baseline can't be deleted while the delta is collected
+        if (baseline)
+        {
+            entries[id]->setBaselineId(baseline->id);
+        }
+        entries[id]->setDumpType(dumpTypeToString(dumpType).value_or(""));
+        indexEntry(id);
     }
     catch (const std::invalid_argument& e)
     {
@@ -106,15 +128,92 @@ sdbusplus::object_path Manager::createDump(
     return objPath.string();
 }
 
-uint32_t Manager::captureDump(DumpTypes type, const std::string& path)
+Manager::~Manager()
 {
-    // Get Dump size.
-    auto size = getAllowedSize();
+    // Let the native collections in progress finish
+    for (auto& [id, worker] : collections)
+    {
+        worker.join();
+    }
+    if (reconciler.joinable())
+    {
+        reconciler.join();
+    }
+    recompressCancelled = true;
+    if (recompressor.joinable())
+    {
+        recompressor.join();
+    }
+}
+
+uint32_t Manager::captureDump(
+    DumpTypes type, const std::string& path,
+    [[maybe_unused]] std::optional<collector::Baseline>& baseline)
+{
+#ifdef BMC_DUMP_NATIVE_COLLECTOR
+    auto id = lastEntryId + 1;
+    auto strType = dumpTypeToString(type).value_or("unknown");
+
+    // The dumps of the RAM-only types don't need space on flash, unless
+    // the RAM tier is full
+    size_t size = std::min<size_t>(BMC_DUMP_MAX_SIZE, BMC_DUMP_STAGING_SIZE);
+    auto staged = tier::isRamOnly(strType) ? stage(id, size) : std::nullopt;
+    size_t reserved = 0;
+    std::function<bool(uint64_t)> reserve;
+    if (!staged)
+    {
+        // The collection starts with the minimum and grows its reservation
+        // with every item, up to the maximum size
+        size = BMC_DUMP_MAX_SIZE;
+        reserved = reserveSpace(
+            id, std::min<size_t>(BMC_DUMP_MIN_SPACE_REQD, BMC_DUMP_MAX_SIZE));
+        reserve = [this, id](uint64_t size) {
+            return ledger.resize(id, size);
+        };
+        staged = stage(id, size);
+    }
+
+    // Looked up after the rotation, which may delete the candidate
+    baseline = findBaseline(type);
+
+    try
+    {
+        startCollection(
+            collector::Request{
+                id, strType, path,
+                staged.value_or(std::filesystem::path(dumpDir) /
+                                std::to_string(id)),
+                size, baseline, reserved, std::move(reserve)},
+            type);
+    }
+    catch (...)
+    {
+        ledger.release(id);
+        throw;
+    }
+#else
+    // dreport can't grow its reservation, it is limited to the space
+    // reserved up front
+    auto size = reserveSpace(lastEntryId + 1, BMC_DUMP_MAX_SIZE);
+
+    auto start = std::chrono::steady_clock::now();
+    struct rusage usage{};
+    getrusage(RUSAGE_CHILDREN, &usage);
+
+    sigset_t mask;
+    sigemptyset(&mask);
 
     pid_t pid = fork();
 
     if (pid == 0)
     {
+        // SIGCHLD and SIGPIPE are blocked in the dump manager
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+        // A process group of its own, so dreport can be killed along with
+        // its plugins
+        setpgid(0, 0);
+
         std::filesystem::path dumpPath(dumpDir);
         auto id = std::to_string(lastEntryId + 1);
         dumpPath /= id;
@@ -133,12 +232,34 @@ uint32_t Manager::captureDump(DumpTypes type, const std::string& path)
     }
     else if (pid > 0)
     {
-        Child::Callback callback = [this, type, pid](Child&, const siginfo_t*) {
+        auto id = lastEntryId + 1;
+        Child::Callback callback = [this, id, type, pid, start,
+                                    usage](Child&, const siginfo_t*) {
             if (type == DumpTypes::USER)
             {
                 lg2::info("User initiated dump completed, resetting flag");
                 Manager::fUserDumpInProgress = false;
             }
+
+            // The children are reaped by the event loop, the accounting
+            // covers every child which completed in the meantime.
+            auto cpuTime = [](const struct rusage& usage) {
+                return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+                       (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+            };
+            struct rusage now{};
+            getrusage(RUSAGE_CHILDREN, &now);
+            lg2::info("BMC dump collected by dreport, wall-clock: {WALL_MS} "
+                      "ms, CPU: {CPU_MS} ms",
+                      "WALL_MS",
+                      std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count(),
+                      "CPU_MS", cpuTime(now) - cpuTime(usage));
+            // The dump counts with its measured size from now on
+            ledger.update(id);
+            ledger.release(id);
+            this->deadlineMap.erase(pid);
             this->childPtrMap.erase(pid);
         };
         try
@@ -147,6 +268,33 @@ uint32_t Manager::captureDump(DumpTypes type, const std::string& path)
                                 std::make_unique<Child>(eventLoop.get(), pid,
                                                         WEXITED | WSTOPPED,
                                                         std::move(callback)));
+
+            // Kill a dreport which overruns the collection SLA, so a hung
+            // collection doesn't block further dumps
+            if (BMC_DUMP_COLLECTION_SLA > 0)
+            {
+                sdeventplus::Event event(eventLoop.get());
+                auto expiry = sdeventplus::Clock<ClockId::Monotonic>(event)
+                                  .now() +
+                              std::chrono::seconds(BMC_DUMP_COLLECTION_SLA) +
+                              DREPORT_GRACE;
+                deadlineMap.emplace(
+                    pid, std::make_unique<Deadline>(
+                             event, expiry, std::chrono::seconds(1),
+                             [this, pid, id](Deadline&, Deadline::TimePoint) {
+                                 lg2::error("dreport exceeded the dump time "
+                                            "limit, killing it, ID: {ID}",
+                                            "ID", id);
+                                 kill(-pid, SIGKILL);
+                                 auto entry = entries.find(id);
+                                 if (entry != entries.end())
+                                 {
+                                     entry->second->status(
+                                         OperationStatus::Failed);
+                                     indexEntry(id);
+                                 }
+                             }));
+            }
         }
         catch (const sdeventplus::SdEventError& ex)
         {
@@ -155,6 +303,7 @@ uint32_t Manager::captureDump(DumpTypes type, const std::string& path)
                 "Error occurred during the sdeventplus::source::Child creation "
                 "ex: {ERROR}",
                 "ERROR", ex);
+            ledger.release(id);
             elog<InternalFailure>();
         }
     }
@@ -163,11 +312,262 @@ uint32_t Manager::captureDump(DumpTypes type, const std::string& path)
         auto error = errno;
         lg2::error("Error occurred during fork, errno: {ERRNO}", "ERRNO",
                    error);
+        ledger.release(lastEntryId + 1);
         elog<InternalFailure>();
     }
+#endif
     return ++lastEntryId;
 }
 
+std::optional<collector::Baseline> Manager::findBaseline(DumpTypes type)
+{
+    // Other dump types are rare and collected complete
+    if (BMC_DUMP_DELTA_WINDOW == 0 || type != DumpTypes::ELOG)
+    {
+        return std::nullopt;
+    }
+#ifdef BMC_DUMP_CHUNK_STORE
+    // The chunk store shares the unchanged items without a baseline
+    return std::nullopt;
+#else
+    // The newest complete dump, a delta dump never serves as a baseline
+    for (auto iter = entries.rbegin(); iter != entries.rend(); ++iter)
+    {
+        const auto& entry = iter->second;
+        const auto& file = entry->getFile();
+        if (entry->status() != OperationStatus::Completed || file.empty() ||
+            entry->getBaselineId() != 0 || entry->getItemHashes().empty())
+        {
+            continue;
+        }
+
+        struct stat st{};
+        if (stat(file.c_str(), &st) < 0 ||
+            std::time(nullptr) - st.st_mtime > BMC_DUMP_DELTA_WINDOW)
+        {
+            return std::nullopt;
+        }
+
+        // The archive is <name>.<extension>
+        auto name = file.filename().string();
+        return collector::Baseline{iter->first, name.substr(0, name.find('.')),
+                                   entry->getItemHashes()};
+    }
+    return std::nullopt;
+#endif
+}
+
+std::optional<std::filesystem::path> Manager::stage(uint32_t id,
+                                                    uint64_t size)
+{
+    if (!staging.enabled())
+    {
+        return std::nullopt;
+    }
+
+    // Offloaded dumps held in the tier make room, the oldest first
+    std::vector<uint32_t> victims;
+    auto needed = staging.usage() + size;
+    for (const auto& [entryId, entry] : entries)
+    {
+        if (needed <= staging.getCapacity())
+        {
+            break;
+        }
+        if (entry->offloaded() &&
+            tier::of(entry->getFile()) == tier::Tier::ram &&
+            getDeltas(entryId).empty())
+        {
+            victims.push_back(entryId);
+            needed -= std::min(needed, staging.usage(entryId));
+        }
+    }
+    if (needed <= staging.getCapacity())
+    {
+        for (auto victim : victims)
+        {
+            lg2::info("Deleting the offloaded dump {ID} from the RAM tier",
+                      "ID", victim);
+            entries.at(victim)->delete_();
+        }
+    }
+    return staging.reserve(id, size);
+}
+
+std::filesystem::path Manager::storeArchive(
+    uint32_t id, const std::string& type, const std::filesystem::path& archive)
+{
+    std::error_code ec;
+    if (auto size = std::filesystem::file_size(archive, ec); !ec)
+    {
+        tier::written(archive, size);
+    }
+
+    // The dumps of the RAM-only types stay in the tier until deleted
+    auto staged = tier::of(archive) == tier::Tier::ram;
+    if (staged && tier::isRamOnly(type))
+    {
+        return archive;
+    }
+
+    auto dir = std::filesystem::path(dumpDir) / std::to_string(id);
+#ifdef BMC_DUMP_CHUNK_STORE
+    // Only the new chunks and the recipe are written to flash
+    auto recipe = dir / archive.filename();
+    recipe += chunk::RECIPE_SUFFIX;
+    if (chunkStore.ingest(id, archive, recipe))
+    {
+        return recipe;
+    }
+#endif
+    if (staged)
+    {
+        // Written to flash in one sequential pass, a dump which can't be
+        // committed is kept in the tier
+        return tier::commit(archive, dir).value_or(archive);
+    }
+    return archive;
+}
+
+void Manager::startCollection(const collector::Request& request,
+                              DumpTypes type)
+{
+    try
+    {
+        collections.emplace(
+            request.id, std::thread([this, request, type]() {
+                collector::Engine engine(request, resultCache);
+                auto result = engine.run();
+                if (!result.archive.empty())
+                {
+                    result.archive = storeArchive(result.id, request.type,
+                                                  result.archive);
+                }
+                dispatcher.post([this, result, type]() {
+                    collectionCompleted(result, type);
+                });
+            }));
+    }
+    catch (const std::system_error& e)
+    {
+        lg2::error("Failed to start the dump collection, ID: {ID}, "
+                   "error: {ERROR}",
+                   "ID", request.id, "ERROR", e);
+        elog<InternalFailure>();
+    }
+}
+
+void Manager::collectionCompleted(const collector::Result& result,
+                                  DumpTypes type)
+{
+    auto worker = collections.find(result.id);
+    if (worker != collections.end())
+    {
+        worker->second.join();
+        collections.erase(worker);
+    }
+
+    if (type == DumpTypes::USER)
+    {
+        lg2::info("User initiated dump completed, resetting flag");
+        Manager::fUserDumpInProgress = false;
+    }
+
+    // The dump counts with its measured size from now on, the unused part
+    // of its reservation is free again
+    ledger.update(result.id);
+    ledger.release(result.id);
+
+    lg2::info("BMC dump {ID} collected natively, wall-clock: {WALL_MS} ms, "
+              "CPU: {CPU_MS} ms, native collectors: {NATIVE}, "
+              "plugin scripts: {SCRIPTS}, cache hits: {CACHE_HITS}",
+              "ID", result.id, "WALL_MS", result.wallTime.count(), "CPU_MS",
+              result.cpuTime.count(), "NATIVE", result.nativeCount, "SCRIPTS",
+              result.scriptCount, "CACHE_HITS", result.cacheHits);
+
+    // A dump deleted while it was collected leaves nothing behind, its
+    // directory, its staged copy and the chunks it stored meanwhile are
+    // removed whether the collection succeeded or not
+    auto dumpEntry = entries.find(result.id);
+    if (dumpEntry == entries.end())
+    {
+        lg2::info("BMC dump {ID} was deleted while it was collected", "ID",
+                  result.id);
+        auto dir = std::filesystem::path(dumpDir) / std::to_string(result.id);
+        removeWatch(dir);
+        reaper.bury(dir, ledger.usage(result.id));
+        ledger.erase(result.id);
+        staging.release(result.id);
+        auto changed = chunkStore.release(result.id);
+        ledger.update(chunk::STORE_DIR, chunkStore.usage());
+        ledger.updateDeleted(trash::TRASH_DIR, reaper.usage());
+        for (auto id : changed)
+        {
+            indexEntry(id);
+        }
+        reportTiers();
+        return;
+    }
+
+    if (result.archive.empty())
+    {
+        lg2::error("BMC dump collection failed, ID: {ID}", "ID", result.id);
+
+        // The logs of the failed collection are left behind
+        staging.keep(result.id);
+        dumpEntry->second->status(OperationStatus::Failed);
+        dumpEntry->second->setBaselineId(0);
+        indexEntry(result.id);
+        reportTiers();
+        return;
+    }
+
+    CollectorOutcomes outcomes;
+    for (const auto& [plugin, outcome] : result.outcomes)
+    {
+        outcomes.emplace(plugin, collector::outcomeToString(outcome));
+    }
+
+    // The archive is complete, no need to wait for the inotify event
+    removeWatch(result.archive.parent_path());
+    if (chunk::isRecipe(result.archive))
+    {
+        // The archive was moved into the chunk store, it is removed here
+        // as the inotify event of its creation may still be pending
+        std::error_code ec;
+        std::filesystem::remove(
+            std::filesystem::path(result.archive).replace_extension(), ec);
+    }
+
+    // The staged copy of a dump committed to flash is dropped
+    if (tier::of(result.archive) == tier::Tier::ram)
+    {
+        staging.keep(result.id);
+    }
+    else
+    {
+        staging.release(result.id);
+    }
+
+    dumpEntry->second->setCollectorOutcomes(outcomes);
+    dumpEntry->second->setItemHashes(result.itemHashes);
+
+    // Released if no item was unchanged
+    dumpEntry->second->setBaselineId(result.baselineId);
+    if (dumpEntry->second->status() == OperationStatus::Completed &&
+        dumpEntry->second->getFile() == result.archive)
+    {
+        ledger.update(result.id);
+        ledger.update(chunk::STORE_DIR, chunkStore.usage());
+        dumpEntry->second->serialize();
+        indexEntry(result.id);
+        reportTiers();
+        return;
+    }
+    createEntry(result.archive);
+    reportTiers();
+}
+
 void Manager::createEntry(const std::filesystem::path& file)
 {
     auto dumpDetails = extractDumpDetails(file);
@@ -179,13 +579,22 @@ void Manager::createEntry(const std::filesystem::path& file)
     }
 
     auto [id, timestamp, size] = *dumpDetails;
+    ledger.update(id);
+    ledger.update(chunk::STORE_DIR, chunkStore.usage());
+    // A recipe is read as the archive streamed from its chunk files
+    // A recipe is read as the archive assembled from the chunk store
+    if (chunk::isRecipe(file))
+    {
+        size = chunk::archiveSize(file);
+    }
 
     // If there is an existing entry update it and return.
     auto dumpEntry = entries.find(id);
     if (dumpEntry != entries.end())
     {
         dynamic_cast<phosphor::dump::bmc::Entry*>(dumpEntry->second.get())
-            ->update(timestamp, std::filesystem::file_size(file), file);
+            ->update(timestamp, size, file);
+        indexEntry(id);
         return;
     }
 
@@ -198,10 +607,10 @@ void Manager::createEntry(const std::filesystem::path& file)
     {
         entries.insert(std::make_pair(
             id, std::make_unique<bmc::Entry>(
-                    bus, objPath.c_str(), id, timestamp,
-                    std::filesystem::file_size(file), file,
+                    bus, objPath.c_str(), id, timestamp, size, file,
                     phosphor::dump::OperationStatus::Completed, std::string(),
                     originatorTypes::Internal, *this)));
+        indexEntry(id);
     }
     catch (const std::invalid_argument& e)
     {
@@ -210,8 +619,7 @@ void Manager::createEntry(const std::filesystem::path& file)
             "OBJECTPATH: {OBJECT_PATH}, ID: {ID}, TIMESTAMP: {TIMESTAMP}, "
             "SIZE: {SIZE}, FILENAME: {FILENAME}",
             "ERROR", e, "OBJECT_PATH", objPath, "ID", id, "TIMESTAMP",
-            timestamp, "SIZE", std::filesystem::file_size(file), "FILENAME",
-            file);
+            timestamp, "SIZE", size, "FILENAME", file);
     }
 }
 
@@ -219,9 +627,16 @@ void Manager::watchCallback(const UserMap& fileInfo)
 {
     for (const auto& i : fileInfo)
     {
+        // Archives are written under a hidden name and renamed once
+        // complete, ignore the partial files.
+        if (i.first.filename().string().starts_with("."))
+        {
+            continue;
+        }
+
         // For any new dump file create dump entry object
         // and associated inotify watch.
-        if (IN_CLOSE_WRITE == i.second)
+        if (IN_CLOSE_WRITE == i.second || IN_MOVED_TO == i.second)
         {
             if (!std::filesystem::is_directory(i.first))
             {
@@ -242,7 +657,8 @@ void Manager::watchCallback(const UserMap& fileInfo)
                  std::filesystem::is_directory(i.first))
         {
             auto watchObj = std::make_unique<Watch>(
-                eventLoop, IN_NONBLOCK, IN_CLOSE_WRITE, EPOLLIN, i.first,
+                eventLoop, IN_NONBLOCK, IN_CLOSE_WRITE | IN_MOVED_TO, EPOLLIN,
+                i.first,
                 std::bind(
                     std::mem_fn(&phosphor::dump::bmc::Manager::watchCallback),
                     this, std::placeholders::_1));
@@ -260,104 +676,547 @@ void Manager::removeWatch(const std::filesystem::path& path)
 
 void Manager::restore()
 {
+    startReconciliation();
+    startRecompression();
+
     std::filesystem::path dir(dumpDir);
     if (!std::filesystem::exists(dir) || std::filesystem::is_empty(dir))
     {
+        restoreStaging();
+        for (const auto& [id, entry] : entries)
+        {
+            indexEntry(id);
+        }
+        reportTiers();
         return;
     }
 
-    // Dump file path: <DUMP_PATH>/<id>/<filename>
+    if (auto records = catalog.load())
+    {
+        restoreCatalog(*records);
+    }
+    else
+    {
+        lg2::info("No valid dump catalog, scanning the dump directory");
+
+        // Dump file path: <DUMP_PATH>/<id>/<filename>
+        for (const auto& p : std::filesystem::directory_iterator(dir))
+        {
+            restoreDirectory(p.path());
+        }
+
+        // The only walk of the dump directory on the D-Bus path, the ledger
+        // is kept up to date from the entry events afterwards
+        ledger.seed();
+
+        std::map<uint32_t, record::Record> records;
+        for (const auto& [id, entry] : entries)
+        {
+            records.emplace(id, entry->toRecord());
+        }
+        catalog.rebuild(records);
+    }
+
+    // After the flash tier, which holds the dumps committed before the
+    // restart, and without records in the catalog
+    restoreStaging();
+
+    // Deletions interrupted by the restart
+    reaper.resume();
+
+    // The references of the chunks are held by the recipes
+    std::map<uint32_t, std::filesystem::path> recipes;
+    for (const auto& [id, entry] : entries)
+    {
+        if (chunk::isRecipe(entry->getFile()))
+        {
+            recipes.emplace(id, entry->getFile());
+        }
+    }
+    chunkStore.load(recipes);
+    ledger.update(chunk::STORE_DIR, chunkStore.usage());
+
+    for (const auto& [id, entry] : entries)
+    {
+        indexEntry(id);
+    }
+    reportTiers();
+}
+
+void Manager::restoreCatalog(
+    const std::map<uint32_t, record::Record>& records)
+{
+    std::filesystem::path dir(dumpDir);
+
+    // The dump ids in the dump directory, without reading the dumps
+    std::set<uint32_t> present;
     for (const auto& p : std::filesystem::directory_iterator(dir))
     {
         auto idStr = p.path().filename().string();
-
-        // Consider only directories with dump id as name.
-        // Note: As per design one file per directory.
-        if ((std::filesystem::is_directory(p.path())) &&
+        if (p.is_directory() &&
             std::all_of(idStr.begin(), idStr.end(), ::isdigit))
         {
-            lastEntryId =
-                std::max(lastEntryId, static_cast<uint32_t>(std::stoul(idStr)));
-            for (const auto& file :
-                 std::filesystem::directory_iterator(p.path()))
-            {
-                // Skip .preserve directory
-                if (file.path().filename() == PRESERVE)
-                {
-                    continue;
-                }
+            present.insert(std::stoul(idStr));
+        }
+    }
+
+    std::map<std::string, uint64_t> estimates;
+    for (const auto& [id, record] : records)
+    {
+        if (!present.contains(id))
+        {
+            lg2::info("Dump {ID} of the catalog no longer exists", "ID", id);
+            catalog.erase(id);
+            continue;
+        }
+        if (record.fileName.empty())
+        {
+            continue;
+        }
+        present.erase(id);
+
+        auto idStr = std::to_string(id);
+        auto objPath = std::filesystem::path(baseEntryPath) / idStr;
+        entries.emplace(id, bmc::Entry::restoreEntry(
+                                bus, objPath.string(),
+                                dir / idStr / record.fileName, record, *this));
+        lastEntryId = std::max(lastEntryId, id);
+
+        // The dump file and its record, the chunks of a recipe are
+        // accounted to the chunk store
+        estimates.emplace(idStr, chunk::isRecipe(record.fileName)
+                                     ? 2
+                                     : (record.size + 1023) / 1024 + 1);
+    }
+
+    // Interrupted collections, and dumps which completed after the last
+    // append to the catalog
+    for (auto id : present)
+    {
+        auto path = dir / std::to_string(id);
+        restoreDirectory(path);
+        if (auto entry = entries.find(id); entry != entries.end())
+        {
+            catalog.put(entry->second->toRecord());
+        }
+        estimates.emplace(std::to_string(id), space::directorySize(path));
+    }
+
+    // The estimates are replaced by a measurement on a worker thread
+    ledger.seed(std::move(estimates));
+    reconcileSpace();
+}
+
+void Manager::restoreDirectory(const std::filesystem::path& path)
+{
+    auto idStr = path.filename().string();
+
+    // Consider only directories with dump id as name.
+    // Note: As per design one file per directory.
+    if (!std::filesystem::is_directory(path) ||
+        !std::all_of(idStr.begin(), idStr.end(), ::isdigit))
+    {
+        return;
+    }
+
+    lastEntryId =
+        std::max(lastEntryId, static_cast<uint32_t>(std::stoul(idStr)));
+    for (const auto& file : std::filesystem::directory_iterator(path))
+    {
+        // Skip .preserve directory
+        if (file.path().filename() == PRESERVE)
+        {
+            continue;
+        }
+
+        // Remove the partial archive of an interrupted collection, and an
+        // archive which was moved into the chunk store
+        auto recipe = file.path();
+        recipe += chunk::RECIPE_SUFFIX;
+        if (file.path().filename().string().starts_with(".") ||
+            std::filesystem::exists(recipe))
+        {
+            std::error_code ec;
+            std::filesystem::remove(file.path(), ec);
+            continue;
+        }
+
+        // Entry Object path.
+        auto objPath = std::filesystem::path(baseEntryPath) / idStr;
+        auto entry = Entry::deserializeEntry(
+            bus, std::stoul(idStr), objPath.string(), file.path(), *this);
+
+        if (entry != nullptr)
+        {
+            entries.insert(
+                std::make_pair(entry->getDumpId(), std::move(entry)));
+        }
+    }
+}
+
+void Manager::restoreStaging()
+{
+    std::error_code ec;
+    for (const auto& p :
+         std::filesystem::directory_iterator(staging.getDir(), ec))
+    {
+        // Committed to flash before the staged copy was removed
+        auto idStr = p.path().filename().string();
+        if (p.is_directory() &&
+            std::all_of(idStr.begin(), idStr.end(), ::isdigit) &&
+            entries.contains(std::stoul(idStr)))
+        {
+            std::filesystem::remove_all(p.path(), ec);
+            continue;
+        }
+        restoreDirectory(p.path());
+    }
+    staging.seed();
+}
+
+void Manager::reportTiers()
+{
+    tier::report(staging, ledger.usage(), BMC_DUMP_TOTAL_SIZE);
+}
+
+void Manager::erase(uint32_t entryId)
+{
+    // The recompression writes its archive into the dump directory, it is
+    // stopped before the directory is moved into the trash
+    if (recompressing == entryId)
+    {
+        recompressCancelled = true;
+        recompressor.join();
+        recompressing.reset();
+    }
+
+    // A collection in progress still writes to its directory, which
+    // collectionCompleted() removes
+    auto entry = entries.find(entryId);
+    auto inProgress = entry != entries.end() &&
+                      entry->second->status() == OperationStatus::InProgress;
+    if (entry != entries.end() && !inProgress)
+    {
+        reaper.bury(std::filesystem::path(dumpDir) / std::to_string(entryId),
+                    ledger.usage(entryId));
+    }
+    catalog.erase(entryId);
+    ledger.erase(entryId);
+    rotationIndex.erase(entryId);
+
+    // The staged directory of a collection in progress is released by
+    // collectionCompleted()
+    if (!inProgress)
+    {
+        staging.release(entryId);
+    }
+    auto changed = chunkStore.release(entryId);
+    ledger.update(chunk::STORE_DIR, chunkStore.usage());
+    ledger.updateDeleted(trash::TRASH_DIR, reaper.usage());
+    phosphor::dump::Manager::erase(entryId);
+
+    // Deleting these dumps frees the chunks they shared with this one now
+    for (auto id : changed)
+    {
+        indexEntry(id);
+    }
+    reportTiers();
+}
+
+void Manager::offloadStarted([[maybe_unused]] uint32_t entryId)
+{
+    recompressCancelled = true;
+}
+
+void Manager::entryChanged(uint32_t entryId)
+{
+    if (auto entry = entries.find(entryId); entry != entries.end())
+    {
+        // The dumps in the RAM tier don't survive a reboot
+        if (tier::of(entry->second->getFile()) == tier::Tier::ram)
+        {
+            catalog.erase(entryId);
+        }
+        else
+        {
+            catalog.put(entry->second->toRecord());
+        }
+    }
+    indexEntry(entryId);
+}
+
+void Manager::indexEntry(uint32_t id)
+{
+    auto iter = entries.find(id);
+    if (iter == entries.end())
+    {
+        rotationIndex.erase(id);
+        return;
+    }
+
+    const auto& entry = iter->second;
+    rotation::Candidate candidate;
+    candidate.id = id;
+    candidate.timestamp = entry->completedTime() != 0 ? entry->completedTime()
+                                                      : entry->startTime();
+    candidate.size = ledger.usage(id) + chunkStore.exclusiveUsage(id);
+    candidate.typeRank =
+        rotation::typeRank(BMC_DUMP_ROTATE_TYPE_ORDER, entry->getDumpType());
+    candidate.offloaded = entry->offloaded();
+    candidate.inProgress = entry->status() == OperationStatus::InProgress;
+    candidate.baselineId = entry->getBaselineId();
+    rotationIndex.insert(candidate);
+}
 
-                // Entry Object path.
-                auto objPath = std::filesystem::path(baseEntryPath) / idStr;
-                auto entry = Entry::deserializeEntry(
-                    bus, std::stoul(idStr), objPath.string(), file.path(),
-                    *this);
+void Manager::startReconciliation()
+{
+    if (BMC_DUMP_SPACE_RECONCILE_INTERVAL <= 0)
+    {
+        return;
+    }
 
-                if (entry != nullptr)
+    try
+    {
+        sdeventplus::Event event(eventLoop.get());
+        auto interval = std::chrono::seconds(BMC_DUMP_SPACE_RECONCILE_INTERVAL);
+        auto expiry =
+            sdeventplus::Clock<ClockId::Monotonic>(event).now() + interval;
+        reconcileTimer = std::make_unique<Deadline>(
+            event, expiry, std::chrono::seconds(1),
+            [this, interval](Deadline& timer, Deadline::TimePoint time) {
+                reconcileSpace();
+                timer.set_time(time + interval);
+                timer.set_enabled(sdeventplus::source::Enabled::OneShot);
+            });
+    }
+    catch (const sdeventplus::SdEventError& e)
+    {
+        lg2::error("Failed to start the dump space reconciliation, "
+                   "error: {ERROR}",
+                   "ERROR", e);
+    }
+}
+
+void Manager::reconcileSpace()
+{
+    // The previous measurement is still running on slow flash
+    if (reconciler.joinable())
+    {
+        return;
+    }
+
+    auto generation = ledger.getGeneration();
+    try
+    {
+        reconciler = std::thread([this, generation]() {
+            auto measured = space::measure(dumpDir);
+            dispatcher.post([this, measured = std::move(measured),
+                             generation]() mutable {
+                reconciler.join();
+                if (!ledger.reconcile(std::move(measured), generation))
                 {
-                    entries.insert(
-                        std::make_pair(entry->getDumpId(), std::move(entry)));
+                    lg2::info("Dumps changed during the space "
+                              "reconciliation, retrying in the next period");
                 }
-            }
-        }
+            });
+        });
+    }
+    catch (const std::system_error& e)
+    {
+        lg2::error("Failed to start the dump space reconciliation, "
+                   "error: {ERROR}",
+                   "ERROR", e);
     }
 }
 
-size_t getDirectorySize(const std::string dir)
+void Manager::startRecompression()
 {
-    auto size = 0;
-    for (const auto& p : std::filesystem::recursive_directory_iterator(dir))
+    if (BMC_DUMP_RECOMPRESS_INTERVAL <= 0)
+    {
+        return;
+    }
+
+    try
+    {
+        sdeventplus::Event event(eventLoop.get());
+        auto interval = std::chrono::seconds(BMC_DUMP_RECOMPRESS_INTERVAL);
+        auto expiry =
+            sdeventplus::Clock<ClockId::Monotonic>(event).now() + interval;
+        recompressTimer = std::make_unique<Deadline>(
+            event, expiry, std::chrono::seconds(1),
+            [this, interval](Deadline& timer, Deadline::TimePoint time) {
+                recompressIdle();
+                timer.set_time(time + interval);
+                timer.set_enabled(sdeventplus::source::Enabled::OneShot);
+            });
+    }
+    catch (const sdeventplus::SdEventError& e)
+    {
+        lg2::error("Failed to start the dump recompression, error: {ERROR}",
+                   "ERROR", e);
+    }
+}
+
+void Manager::recompressIdle()
+{
+    // One archive at a time, and only while the BMC has nothing else to do
+    if (recompressor.joinable() || !collections.empty() ||
+        !childPtrMap.empty() || !recompress::isIdle())
+    {
+        return;
+    }
+    auto algorithm = archive::toAlgorithm(BMC_DUMP_RECOMPRESS_ALGORITHM);
+    if (!algorithm)
+    {
+        return;
+    }
+
+    for (const auto& [id, entry] : entries)
     {
-        if (!std::filesystem::is_directory(p))
+        // The chunks of a recipe are compressed on their own
+        auto file = entry->getFile();
+        if (recompressed.contains(id) ||
+            entry->status() != OperationStatus::Completed ||
+            entry->offloaded() || file.empty() || chunk::isRecipe(file))
         {
-            std::uintmax_t fileSize = std::filesystem::file_size(p);
-            size += std::ceil(static_cast<double>(fileSize) / 1024.0);
+            continue;
         }
+        recompressed.insert(id);
+        if (!recompress::isCandidate(file, *algorithm,
+                                     BMC_DUMP_RECOMPRESS_LEVEL))
+        {
+            continue;
+        }
+
+        recompressCancelled = false;
+        try
+        {
+            recompressing = id;
+            recompressor = std::thread([this, id, file, algorithm]() {
+                auto result =
+                    recompress::run(id, file, *algorithm,
+                                    BMC_DUMP_RECOMPRESS_LEVEL,
+                                    recompressCancelled);
+                dispatcher.post([this, result]() {
+                    recompressionCompleted(result);
+                });
+            });
+        }
+        catch (const std::system_error& e)
+        {
+            recompressing.reset();
+            lg2::error("Failed to start the dump recompression, "
+                       "error: {ERROR}",
+                       "ERROR", e);
+        }
+        return;
     }
-    return size;
 }
 
-size_t Manager::getAllowedSize()
+void Manager::recompressionCompleted(const recompress::Result& result)
 {
-    // Get current size of the dump directory.
-    auto size = getDirectorySize(dumpDir);
+    // Joined by erase() if the dump was deleted meanwhile, another dump
+    // may be recompressed by now
+    if (recompressing == result.id)
+    {
+        recompressor.join();
+        recompressing.reset();
+    }
+    if (result.cancelled)
+    {
+        // Retried in the next idle period
+        lg2::info("Recompression of dump {ID} yielded", "ID", result.id);
+        recompressed.erase(result.id);
+    }
+    if (result.partial.empty())
+    {
+        return;
+    }
 
-    // Set the Dump size to Maximum  if the free space is greater than
-    // Dump max size otherwise return the available size.
+    // Deleted or offloaded in the meantime
+    auto entry = entries.find(result.id);
+    if (entry == entries.end() || entry->second->offloaded() ||
+        entry->second->getFile() != result.original)
+    {
+        std::error_code ec;
+        std::filesystem::remove(result.partial, ec);
+        return;
+    }
+    if (!recompress::replace(result))
+    {
+        return;
+    }
 
-    size = (size > BMC_DUMP_TOTAL_SIZE ? 0 : BMC_DUMP_TOTAL_SIZE - size);
+    auto* bmcEntry = dynamic_cast<bmc::Entry*>(entry->second.get());
+    bmcEntry->update(bmcEntry->elapsed(), result.size, result.archive);
+    ledger.update(result.id);
+    reclaimed += result.originalSize - result.size;
+    lg2::info("Dump {ID} recompressed from {ORIGINAL} to {SIZE} bytes, "
+              "{RECLAIMED} bytes reclaimed in total",
+              "ID", result.id, "ORIGINAL", result.originalSize, "SIZE",
+              result.size, "RECLAIMED", reclaimed);
+    reportTiers();
+}
+
+size_t Manager::reserveSpace(uint32_t id, size_t size)
+{
+    // Space neither used nor reserved by the collections in progress, the
+    // deleted dumps are removed in the background and count as free
+    auto available = ledger.available();
 
 #ifdef BMC_DUMP_ROTATE_CONFIG
-    // Delete the first existing file until the space is enough
-    while (size < BMC_DUMP_MIN_SPACE_REQD)
+    // Evict in the order of the rotation policy until the space is enough,
+    // the victims are selected in a single pass. Deleting a dump a client
+    // still reads through GetFileHandle would not free its space, nor would
+    // deleting a dump held in the RAM tier.
+    if (available < BMC_DUMP_MIN_SPACE_REQD)
     {
-        auto delEntry = min_element(
-            entries.begin(), entries.end(),
-            [](const auto& l, const auto& r) { return l.first < r.first; });
-        auto delPath = std::filesystem::path(dumpDir) /
-                       std::to_string(delEntry->first);
-
-        size += getDirectorySize(delPath);
+        auto openFiles = rotation::openFiles();
+        auto isPinned = [this, &openFiles](uint32_t id) {
+            struct stat st{};
+            auto file = getDumpFile(id);
+            return !file.empty() &&
+                   (tier::of(file) == tier::Tier::ram ||
+                    (stat(file.c_str(), &st) == 0 &&
+                     openFiles.contains({st.st_dev, st.st_ino})));
+        };
 
-        delEntry->second->delete_();
+        // Chunks shared only by the victims are not accounted to any of
+        // them, the space is measured again after every pass
+        while (available < BMC_DUMP_MIN_SPACE_REQD)
+        {
+            auto victims = rotationIndex.select(
+                BMC_DUMP_MIN_SPACE_REQD - available, isPinned);
+            if (victims.empty())
+            {
+                break;
+            }
+            for (auto id : victims)
+            {
+                entries.at(id)->delete_();
+            }
+            available = ledger.available();
+        }
     }
-#else
+#endif
+
+    // Taken in one step, a collection in progress may grow its own
+    // reservation concurrently
+    auto reserved = ledger.reserve(id, size);
+
+#ifndef BMC_DUMP_ROTATE_CONFIG
     using namespace sdbusplus::xyz::openbmc_project::Dump::Create::Error;
     using Reason = xyz::openbmc_project::Dump::Create::QuotaExceeded::REASON;
 
-    if (size < BMC_DUMP_MIN_SPACE_REQD)
+    if (reserved < std::min<size_t>(size, BMC_DUMP_MIN_SPACE_REQD))
     {
         // Reached to maximum limit
+        ledger.release(id);
         elog<QuotaExceeded>(Reason("Not enough space: Delete old dumps"));
     }
 #endif
 
-    if (size > BMC_DUMP_MAX_SIZE)
-    {
-        size = BMC_DUMP_MAX_SIZE;
-    }
-
-    return size;
+    return reserved;
 }
 
 } // namespace bmc
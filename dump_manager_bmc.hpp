@@ -1,15 +1,31 @@
 #pragma once
 
+#include "config.h"
+
+#include "dump_catalog.hpp"
+#include "dump_chunk.hpp"
+#include "dump_collector.hpp"
+#include "dump_dispatcher.hpp"
 #include "dump_entry.hpp"
 #include "dump_manager.hpp"
+#include "dump_recompress.hpp"
+#include "dump_rotation.hpp"
+#include "dump_space.hpp"
+#include "dump_tier.hpp"
+#include "dump_trash.hpp"
 #include "dump_utils.hpp"
 #include "watch.hpp"
 
 #include <sdeventplus/source/child.hpp>
+#include <sdeventplus/source/time.hpp>
 #include <xyz/openbmc_project/Dump/Create/server.hpp>
 
+#include <atomic>
 #include <filesystem>
 #include <map>
+#include <optional>
+#include <set>
+#include <thread>
 
 namespace phosphor
 {
@@ -24,7 +40,9 @@ using CreateIface = sdbusplus::server::object_t<
 using UserMap = phosphor::dump::inotify::UserMap;
 
 using Watch = phosphor::dump::inotify::Watch;
+using ::sdeventplus::ClockId;
 using ::sdeventplus::source::Child;
+using Deadline = ::sdeventplus::source::Time<ClockId::Monotonic>;
 
 /** @class Manager
  *  @brief OpenBMC Dump  manager implementation.
@@ -41,7 +59,7 @@ class Manager :
     Manager& operator=(const Manager&) = delete;
     Manager(Manager&&) = delete;
     Manager& operator=(Manager&&) = delete;
-    virtual ~Manager() = default;
+    virtual ~Manager();
 
     /** @brief Constructor to put object onto bus at a dbus path.
      *  @param[in] bus - Bus to attach to.
@@ -60,7 +78,19 @@ class Manager :
             filePath,
             std::bind(std::mem_fn(&phosphor::dump::bmc::Manager::watchCallback),
                       this, std::placeholders::_1)),
-        dumpDir(filePath)
+        dumpDir(filePath), dispatcher(eventLoop.get()),
+        resultCache(BMC_DUMP_RESULT_CACHE_SIZE * 1024),
+        ledger(filePath, BMC_DUMP_TOTAL_SIZE),
+        rotationIndex(rotation::parsePolicy(BMC_DUMP_ROTATE_POLICY)),
+        catalog(std::filesystem::path(filePath) / catalog::CATALOG_FILE),
+        chunkStore(std::filesystem::path(filePath) / chunk::STORE_DIR,
+                   &reaper),
+        staging(BMC_DUMP_STAGING_PATH, BMC_DUMP_STAGING_SIZE),
+        reaper(filePath, [this]() {
+            dispatcher.post([this]() {
+                ledger.updateDeleted(trash::TRASH_DIR, reaper.usage());
+            });
+        })
     {}
 
     /** @brief Implementation of dump watch call back
@@ -81,6 +111,22 @@ class Manager :
     sdbusplus::object_path createDump(
         phosphor::dump::DumpCreateParams params) override;
 
+    /** @brief Record an entry in the catalog and update its position in
+     *         the eviction order
+     */
+    void entryChanged(uint32_t entryId) override;
+
+    /** @brief Make the idle recompression yield to the offload */
+    void offloadStarted(uint32_t entryId) override;
+
+  protected:
+    /** @brief Erase an entry, move its directory to the trash, release
+     *         its chunks and its RAM tier, and remove it from the eviction
+     *         order and the catalog
+     *  @param[in] entryId - unique identifier of the entry
+     */
+    void erase(uint32_t entryId) override;
+
   private:
     /** @brief Create Dump entry d-bus object
      *  @param[in] fullPath - Full path of the Dump file name
@@ -91,9 +137,55 @@ class Manager :
      *  @param[in] type - Type of the dump to pass to dreport
      *  @param[in] path - An absolute path to the file
      *             to be included as part of Dump package.
+     *  @param[out] baseline - Baseline of a delta dump, std::nullopt for a
+     *              complete dump.
      *  @return id - The Dump entry id number.
      */
-    uint32_t captureDump(DumpTypes type, const std::string& path);
+    uint32_t captureDump(DumpTypes type, const std::string& path,
+                         std::optional<collector::Baseline>& baseline);
+
+    /** @brief Find the baseline of a delta dump, the most recent complete
+     *         dump collected within BMC_DUMP_DELTA_WINDOW. The chunk store
+     *         shares the unchanged items instead.
+     *  @param[in] type - Type of the dump.
+     *  @return The baseline, std::nullopt if the dump has to be complete.
+     */
+    std::optional<collector::Baseline> findBaseline(DumpTypes type);
+
+    /** @brief Reserve the RAM tier for a collection, deleting offloaded
+     *         dumps held in the tier if it is full.
+     *  @param[in] id - Dump id.
+     *  @param[in] size - Allowed size of the dump in kilobytes.
+     *  @return The directory to collect the dump into, std::nullopt to
+     *          collect it on flash.
+     */
+    std::optional<std::filesystem::path> stage(uint32_t id, uint64_t size);
+
+    /** @brief Put a collected archive in its place, runs on the collection
+     *         worker. A staged archive is committed to flash unless its
+     *         type is RAM-only, into the chunk store if BMC_DUMP_CHUNK_STORE
+     *         is set.
+     *  @param[in] id - Dump id.
+     *  @param[in] type - Collection type.
+     *  @param[in] archive - The archive written by the collection.
+     *  @return The dump file.
+     */
+    std::filesystem::path storeArchive(uint32_t id, const std::string& type,
+                                       const std::filesystem::path& archive);
+
+    /** @brief Collect a BMC dump with the native collection engine on a
+     *         worker thread, which then stores the archive.
+     *  @param[in] request - The dump collection request.
+     *  @param[in] type - Type of the dump.
+     */
+    void startCollection(const collector::Request& request, DumpTypes type);
+
+    /** @brief Handle the completion of a native dump collection, runs on
+     *         the event loop.
+     *  @param[in] result - Result of the collection.
+     *  @param[in] type - Type of the dump.
+     */
+    void collectionCompleted(const collector::Result& result, DumpTypes type);
 
     /** @brief Remove specified watch object pointer from the
      *        watch map and associated entry from the map.
@@ -101,11 +193,67 @@ class Manager :
      */
     void removeWatch(const std::filesystem::path& path);
 
-    /** @brief Calculate per dump allowed size based on the available
-     *        size in the dump location.
-     *  @returns dump size in kilobytes.
+    /** @brief Reserve space for a dump in the dump location, rotating the
+     *         dumps out if BMC_DUMP_ROTATE_CONFIG is set.
+     *  @details The reservation is held until the collection completed or
+     *  failed, concurrent collections reserve from the space left.
+     *  @param[in] id - Dump id.
+     *  @param[in] size - Kilobytes wanted, at most BMC_DUMP_MAX_SIZE.
+     *  @return Kilobytes reserved, at least BMC_DUMP_MIN_SPACE_REQD unless
+     *          that is more than wanted.
+     */
+    size_t reserveSpace(uint32_t id, size_t size);
+
+    /** @brief Create the entries of the catalog, the dump directories
+     *         missing from it are scanned.
+     *  @param[in] records - The records of the catalog by dump id.
+     */
+    void restoreCatalog(const std::map<uint32_t, record::Record>& records);
+
+    /** @brief Create the entry of a dump directory from its files.
+     *  @param[in] path - The dump directory, <dumpDir>/<id>.
+     */
+    void restoreDirectory(const std::filesystem::path& path);
+
+    /** @brief Create the entries of the dumps held in the RAM tier, which
+     *         survive a restart of the service but not a reboot.
+     */
+    void restoreStaging();
+
+    /** @brief Publish the usage and the bytes written of the tiers */
+    void reportTiers();
+
+    /** @brief Add an entry to the eviction order or update it.
+     *  @param[in] id - Dump id.
+     */
+    void indexEntry(uint32_t id);
+
+    /** @brief Reconcile the space ledger with the dump directory every
+     *         BMC_DUMP_SPACE_RECONCILE_INTERVAL seconds.
      */
-    size_t getAllowedSize();
+    void startReconciliation();
+
+    /** @brief Measure the dump directory on a worker thread and replace
+     *         the space ledger with the result on the event loop.
+     */
+    void reconcileSpace();
+
+    /** @brief Look for an archive to recompress every
+     *         BMC_DUMP_RECOMPRESS_INTERVAL seconds.
+     */
+    void startRecompression();
+
+    /** @brief Recompress the oldest archive which is neither offloaded nor
+     *         recompressed yet on a worker thread, if the BMC is idle and no
+     *         dump is collected.
+     */
+    void recompressIdle();
+
+    /** @brief Put a recompressed archive in place of the original and
+     *         update its entry, runs on the event loop.
+     *  @param[in] result - Outcome of the recompression.
+     */
+    void recompressionCompleted(const recompress::Result& result);
 
     /** @brief sdbusplus Dump event loop */
     EventPtr eventLoop;
@@ -127,6 +275,64 @@ class Manager :
 
     /** @brief map of SDEventPlus child pointer added to event loop */
     std::map<pid_t, std::unique_ptr<Child>> childPtrMap;
+
+    /** @brief Time limits of the running dreport processes */
+    std::map<pid_t, std::unique_ptr<Deadline>> deadlineMap;
+
+    /** @brief Hands the native collection results back to the event loop */
+    Dispatcher dispatcher;
+
+    /** @brief Native dump collections in progress [id:worker thread] */
+    std::map<uint32_t, std::thread> collections;
+
+    /** @brief Outputs of slow-changing plugins, shared by the native
+     *         collections */
+    collector::ResultCache resultCache;
+
+    /** @brief Space used by the dumps */
+    space::Ledger ledger;
+
+    /** @brief The dumps in the order of the rotation policy */
+    rotation::Index rotationIndex;
+
+    /** @brief Log of the entries, replayed by restore() */
+    catalog::Catalog catalog;
+
+    /** @brief Chunks of the dump archives, shared between the dumps */
+    chunk::Store chunkStore;
+
+    /** @brief The RAM tier the dumps are collected into */
+    tier::Staging staging;
+
+    /** @brief Removes the files of the deleted dumps in the background */
+    trash::Reaper reaper;
+
+    /** @brief Timer of the space ledger reconciliation */
+    std::unique_ptr<Deadline> reconcileTimer;
+
+    /** @brief Measures the dump directory for the reconciliation */
+    std::thread reconciler;
+
+    /** @brief Timer of the idle recompression */
+    std::unique_ptr<Deadline> recompressTimer;
+
+    /** @brief Recompresses an archive */
+    std::thread recompressor;
+
+    /** @brief Dump the recompressor works on */
+    std::optional<uint32_t> recompressing;
+
+    /** @brief Set to make the recompression yield to a collection or an
+     *         offload */
+    std::atomic<bool> recompressCancelled = false;
+
+    /** @brief Dumps recompressed, or not worth it, since the start of the
+     *         service */
+    std::set<uint32_t> recompressed;
+
+    /** @brief Bytes reclaimed by the recompression since the start of the
+     *         service */
+    uint64_t reclaimed = 0;
 };
 
 } // namespace bmc
@@ -34,7 +34,9 @@ int main()
     phosphor::dump::EventPtr eventP{event};
     event = nullptr;
 
-    // Blocking SIGCHLD is needed for calling sd_event_add_child
+    // Blocking SIGCHLD is needed for calling sd_event_add_child, with
+    // SIGPIPE blocked an offload client closing its socket fails the write
+    // with EPIPE rather than killing the dump manager
     sigset_t mask;
     if (sigemptyset(&mask) < 0)
     {
@@ -43,7 +45,7 @@ int main()
         return EXIT_FAILURE;
     }
 
-    if (sigaddset(&mask, SIGCHLD) < 0)
+    if (sigaddset(&mask, SIGCHLD) < 0 || sigaddset(&mask, SIGPIPE) < 0)
     {
         lg2::error("Unable to add signal to signal set, errno: {ERRNO}",
                    "ERRNO", errno);
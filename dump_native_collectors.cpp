@@ -0,0 +1,318 @@
+#include "config.h"
+
+#include "dump_collector.hpp"
+#include "dump_journal.hpp"
+#include "dump_utils.hpp"
+
+#include <fcntl.h>
+
+#include <cerrno>
+#include <functional>
+#include <map>
+#include <system_error>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace collector
+{
+
+namespace
+{
+
+/** @class CopyFile
+ *  @brief Copies a file into the dump, native add_copy_file plugins.
+ */
+class CopyFile : public Collector
+{
+  public:
+    CopyFile(const std::string& name, const std::string& desc,
+             const std::filesystem::path& file) :
+        Collector(name), desc(desc), file(file)
+    {}
+
+    Outcome collect(Context& ctx) override
+    {
+        return ctx.addCopyFile(file, desc) ? Outcome::Ok : Outcome::Failed;
+    }
+
+  private:
+    std::string desc;
+    std::filesystem::path file;
+};
+
+/** @class FileContents
+ *  @brief Saves the contents of a file under a new name, native
+ *         "cat <file>" plugins.
+ */
+class FileContents : public Collector
+{
+  public:
+    FileContents(const std::string& name, const std::string& desc,
+                 const std::filesystem::path& file,
+                 const std::string& fileName, bool optional = false) :
+        Collector(name), desc(desc), file(file), fileName(fileName),
+        optional(optional)
+    {}
+
+    Outcome collect(Context& ctx) override
+    {
+        std::error_code ec;
+        if (optional && !std::filesystem::exists(file, ec))
+        {
+            return Outcome::Skipped;
+        }
+        return ctx.addFileContents(file, fileName, desc) ? Outcome::Ok
+                                                         : Outcome::Failed;
+    }
+
+  private:
+    std::string desc;
+    std::filesystem::path file;
+    std::string fileName;
+    bool optional;
+};
+
+/** @class Command
+ *  @brief Saves the output of a command run without a shell, native
+ *         add_cmd_output plugins.
+ */
+class Command : public Collector
+{
+  public:
+    Command(const std::string& name, const std::string& desc,
+            const std::vector<std::string>& argv,
+            const std::string& fileName) :
+        Collector(name), desc(desc), argv(argv), fileName(fileName)
+    {}
+
+    Outcome collect(Context& ctx) override
+    {
+        return ctx.addCommandOutput(argv, fileName, desc) ? Outcome::Ok
+                                                          : Outcome::Failed;
+    }
+
+  private:
+    std::string desc;
+    std::vector<std::string> argv;
+    std::string fileName;
+};
+
+/** @class MoveFiles
+ *  @brief Moves the file(s) passed with the dump request into the dump,
+ *         they are streamed into the archive and removed once it is
+ *         committed.
+ */
+class MoveFiles : public Collector
+{
+  public:
+    MoveFiles(const std::string& name, const std::string& desc,
+              bool directory) :
+        Collector(name), desc(desc), directory(directory)
+    {}
+
+    Outcome collect(Context& ctx) override
+    {
+        if (ctx.request.path.empty())
+        {
+            if (!directory)
+            {
+                ctx.logError(desc + " does not exist");
+            }
+            return Outcome::Skipped;
+        }
+
+        std::vector<std::filesystem::path> files;
+        std::error_code ec;
+        if (directory)
+        {
+            for (const auto& p :
+                 std::filesystem::directory_iterator(ctx.request.path, ec))
+            {
+                if (p.is_regular_file(ec))
+                {
+                    files.push_back(p.path());
+                }
+            }
+        }
+        else
+        {
+            files.emplace_back(ctx.request.path);
+        }
+
+        auto outcome = Outcome::Ok;
+        for (const auto& file : files)
+        {
+            if (!ctx.addMoveFile(file, desc))
+            {
+                outcome = Outcome::Failed;
+            }
+        }
+        return outcome;
+    }
+
+  private:
+    std::string desc;
+    bool directory;
+};
+
+/** @class Journal
+ *  @brief Writes the most recent journal entries in a compact format,
+ *         native journalpretty and journalpid plugins.
+ *  @details Instead of the whole journal in a verbose format, which the
+ *  dump size limit mostly drops again, the entries are read newest first
+ *  until the share of the dump size limit given to the journal is used.
+ */
+class Journal : public Collector
+{
+  public:
+    Journal(const std::string& name, bool byPid) :
+        Collector(name), byPid(byPid)
+    {}
+
+    Outcome collect(Context& ctx) override
+    {
+        // Compact journal text compresses at least this well
+        constexpr uint64_t compressionRatio = 6;
+        // Entries collected without a pid, as dreport
+        constexpr size_t lineLimit = 500;
+
+        journal::Filter filter;
+        filter.maxBytes = static_cast<uint64_t>(ctx.request.allowedSize) *
+                          1024 * BMC_DUMP_JOURNAL_SHARE / 100 *
+                          compressionRatio;
+        std::string desc = "Journal log";
+        std::string fileName = "journal-compact.log";
+        if (byPid)
+        {
+            filter.pid = ctx.getPid();
+            desc = "Journal pid:" + std::to_string(filter.pid) + " log";
+            if (filter.pid == 0)
+            {
+                ctx.logWarning("Missing PID, Collecting last " +
+                               std::to_string(lineLimit) +
+                               " journal entries");
+                filter.maxEntries = lineLimit;
+                fileName = "journal.log";
+            }
+            else
+            {
+                fileName = "journal-pid-" + std::to_string(filter.pid) + ".log";
+            }
+        }
+        else
+        {
+            filter.window = std::chrono::seconds(BMC_DUMP_JOURNAL_WINDOW);
+        }
+
+        auto file = ctx.getOutDir() / fileName;
+        try
+        {
+            journal::Extractor extractor;
+            CustomFd fd = open(file.c_str(),
+                               O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd() < 0)
+            {
+                throw std::system_error(errno, std::generic_category(),
+                                        "Failed to create " + fileName);
+            }
+            auto extract = extractor.write(fd(), filter,
+                                           [&ctx]() { return ctx.expired(); });
+            if (ctx.expired())
+            {
+                ctx.logError("Failed to collect " + desc + ", " +
+                             ctx.getOverrun() + " exceeded");
+                return Outcome::Timeout;
+            }
+            ctx.logInfo("Collected " + desc + ", " +
+                        std::to_string(extract.entries) + " entries" +
+                        (extract.truncated ? ", older entries left out" : ""));
+            return Outcome::Ok;
+        }
+        catch (const std::exception& e)
+        {
+            ctx.logError("Failed to collect " + desc + ", " + e.what());
+        }
+        std::error_code ec;
+        std::filesystem::remove(file, ec);
+        return Outcome::Failed;
+    }
+
+  private:
+    bool byPid;
+};
+
+using Factory = std::function<std::unique_ptr<Collector>(const std::string&)>;
+
+template <typename T, typename... Args>
+Factory make(Args... args)
+{
+    return [=](const std::string& name) {
+        return std::make_unique<T>(name, args...);
+    };
+}
+
+// Plugins with a native implementation, the remaining plugins are run
+// through their script until they are migrated.
+const std::map<std::string, Factory> natives = {
+    {"corefile", make<MoveFiles>("Core file", false)},
+    {"cpuinfo", make<CopyFile>("CPU info", "/proc/cpuinfo")},
+    {"dbuslist",
+     make<Command>("dbus list", std::vector<std::string>{"busctl", "-l"},
+                   "dbus-list.log")},
+    {"diskusage",
+     make<Command>("disk usage", std::vector<std::string>{"df", "-hT"},
+                   "disk-usage.log")},
+    {"dmesginfo",
+     make<Command>("dmesg", std::vector<std::string>{"dmesg"}, "dmesg.log")},
+    {"emconfig",
+     make<FileContents>("entity-manager configuration",
+                        "/var/configuration/system.json", "em-system.json",
+                        true)},
+    {"failedservices",
+     make<Command>("failed services",
+                   std::vector<std::string>{"systemctl", "--failed"},
+                   "failed-services.log")},
+    {"hostnamectl",
+     make<Command>("hostnamectl",
+                   std::vector<std::string>{"hostnamectl", "status"},
+                   "hostnamectl.log")},
+    {"journalpid", make<Journal>(true)},
+    {"journalpretty", make<Journal>(false)},
+    {"kernlcmdline", make<FileContents>("Kernel command line parameters",
+                                        "/proc/cmdline", "kernalcmdline.log")},
+    {"lktrace",
+     make<CopyFile>("Linux Kernel trace", "/sys/kernel/tracing/trace")},
+    {"meminfo", make<CopyFile>("Memory info", "/proc/meminfo")},
+    {"mountinfo",
+     make<Command>("mount info", std::vector<std::string>{"mount"},
+                   "mountinfo.log")},
+    {"osrelease", make<CopyFile>("OS release info", "/etc/os-release")},
+    {"ramoops", make<MoveFiles>("Ramoops file", true)},
+    {"softIRQs",
+     make<FileContents>("SoftIRQs", "/proc/softirqs", "softIRQs.log")},
+    {"top",
+     make<Command>("top", std::vector<std::string>{"top", "-n", "1", "-b"},
+                   "top.log")},
+    {"traceevents",
+     make<CopyFile>("Kernel event traces", "/sys/kernel/tracing/trace")},
+    {"uptime",
+     make<Command>("uptime", std::vector<std::string>{"uptime"}, "uptime.log")},
+};
+
+} // namespace
+
+std::unique_ptr<Collector> makeNativeCollector(const std::string& plugin)
+{
+    auto iter = natives.find(plugin);
+    if (iter == natives.end())
+    {
+        return nullptr;
+    }
+    return iter->second(plugin);
+}
+
+} // namespace collector
+} // namespace dump
+} // namespace phosphor
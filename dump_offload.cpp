@@ -2,7 +2,17 @@
 
 #include "dump_offload.hpp"
 
+#include "dump_delta.hpp"
+#include "dump_recompress.hpp"
+#include "dump_transfer.hpp"
+
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -14,8 +24,12 @@
 #include <xyz/openbmc_project/Common/File/error.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <ios>
 #include <span>
+#include <string_view>
+#include <utility>
 
 namespace phosphor
 {
@@ -27,59 +41,103 @@ namespace offload
 using namespace sdbusplus::xyz::openbmc_project::Common::Error;
 using namespace phosphor::logging;
 
-/** @brief API to write data on unix socket.
- *
- * @param[in] socket     - unix socket
- * @param[in] buf        - buffer
- * @param[in] blockSize  - size of data
- *
- * @return  void
- */
-void writeOnUnixSocket(const int socket, const char* buf,
-                       const uint64_t blockSize)
+namespace
+{
+
+// Sessions in progress, they are all created and destroyed on the event
+// loop
+size_t sessions = 0;
+
+/** @brief Parse an unsigned decimal number, std::nullopt if malformed */
+std::optional<uint64_t> toNumber(std::string_view text)
 {
-    ssize_t numOfBytesWrote = 0;
+    uint64_t value = 0;
+    auto [ptr, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || ptr != text.data() + text.size() || text.empty())
+    {
+        return std::nullopt;
+    }
+    return value;
+}
+
+} // namespace
 
-    for (uint64_t i = 0; i < blockSize; i = i + numOfBytesWrote)
+std::optional<Target> parseUri(const std::string& uri)
+{
+    auto query = uri.find('?');
+    Target target;
+    target.path = uri.substr(0, query);
+    if (target.path.empty())
     {
-        numOfBytesWrote = 0;
-        fd_set writeFileDescriptor;
-        struct timeval timeVal;
-        timeVal.tv_sec = 5;
-        timeVal.tv_usec = 0;
+        return std::nullopt;
+    }
 
-        FD_ZERO(&writeFileDescriptor);
-        FD_SET(socket, &writeFileDescriptor);
-        int nextFileDescriptor = socket + 1;
+    std::string_view rest;
+    if (query != std::string::npos)
+    {
+        rest = std::string_view(uri).substr(query + 1);
+    }
+    while (!rest.empty())
+    {
+        auto param = rest.substr(0, rest.find('&'));
+        rest.remove_prefix(std::min(rest.size(), param.size() + 1));
 
-        int retVal = select(nextFileDescriptor, nullptr, &writeFileDescriptor,
-                            nullptr, &timeVal);
-        if (retVal <= 0)
+        // As a trailing '&', an empty parameter is ignored
+        if (param.empty())
+        {
+            continue;
+        }
+        auto equals = param.find('=');
+        if (equals == std::string_view::npos)
         {
-            lg2::error("writeOnUnixSocket: select() failed, errno: {ERRNO}",
-                       "ERRNO", errno);
-            std::string msg = "select() failed " + std::string(strerror(errno));
-            throw std::runtime_error(msg);
+            return std::nullopt;
         }
-        if ((retVal > 0) && (FD_ISSET(socket, &writeFileDescriptor)))
+        auto key = param.substr(0, equals);
+        auto text = param.substr(equals + 1);
+        if (key == "codec")
         {
-            numOfBytesWrote = write(socket, buf + i, blockSize - i);
-            if (numOfBytesWrote < 0)
+            target.codec = archive::toAlgorithm(std::string(text));
+            if (!target.codec)
             {
-                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
-                {
-                    numOfBytesWrote = 0;
-                    continue;
-                }
-                lg2::error("writeOnUnixSocket: write() failed, errno: {ERRNO}",
-                           "ERRNO", errno);
-                std::string msg =
-                    "write() on socket failed " + std::string(strerror(errno));
-                throw std::runtime_error(msg);
+                return std::nullopt;
             }
+            continue;
         }
+
+        auto value = toNumber(text);
+        if (!value)
+        {
+            return std::nullopt;
+        }
+        if (key == "offset")
+        {
+            target.range.offset = *value;
+        }
+        else if (key == "length")
+        {
+            target.range.length = *value;
+        }
+        else
+        {
+            return std::nullopt;
+        }
+    }
+    return target;
+}
+
+std::string makeUri(const Target& target)
+{
+    auto uri = target.path + "?offset=" + std::to_string(target.range.offset);
+    if (target.range.length)
+    {
+        uri += "&length=" + std::to_string(*target.range.length);
+    }
+    if (target.codec)
+    {
+        uri += "&codec=" + archive::toString(*target.codec);
     }
-    return;
+    return uri;
 }
 
 /**@brief API to setup unix socket.
@@ -135,8 +193,13 @@ int socketInit(const std::string& sockPath)
     return unixSocket;
 }
 
-void requestOffload(std::filesystem::path file, uint32_t dumpId,
-                    std::string writePath)
+Session::Session(const sdeventplus::Event& event,
+                 const std::filesystem::path& file, uint32_t dumpId,
+                 const Target& target, const std::filesystem::path& baseline,
+                 Callback callback) :
+    event(event), file(file), dumpId(dumpId), writePath(target.path),
+    callback(std::move(callback)), baseline(baseline), range(target.range),
+    position(range.offset), readOffset(range.offset), codec(target.codec)
 {
     using namespace sdbusplus::xyz::openbmc_project::Common::File::Error;
     using ErrnoOpen = xyz::openbmc_project::Common::File::Open::ERRNO;
@@ -144,92 +207,450 @@ void requestOffload(std::filesystem::path file, uint32_t dumpId,
     using ErrnoWrite = xyz::openbmc_project::Common::File::Write::ERRNO;
     using PathWrite = xyz::openbmc_project::Common::File::Write::PATH;
 
-    try
+    if (sessions >= static_cast<size_t>(BMC_DUMP_MAX_OFFLOADS))
     {
-        CustomFd unixSocket = socketInit(writePath);
+        lg2::error("{COUNT} dump offloads are in progress, DUMP_ID: "
+                   "{DUMP_ID}",
+                   "COUNT", sessions, "DUMP_ID", dumpId);
+        elog<Unavailable>();
+    }
 
-        fd_set readFD;
-        struct timeval timeVal;
-        timeVal.tv_sec = 1;
-        timeVal.tv_usec = 0;
+    // The archive of a recipe is sent from the chunk files of the store,
+    // it is never assembled
+    if (chunk::isRecipe(file))
+    {
+        recipe = chunk::loadRecipe(file);
+        if (!recipe)
+        {
+            lg2::error("Invalid dump recipe, DUMPFILE: {DUMP_FILE}, "
+                       "DUMP_ID: {DUMP_ID}",
+                       "DUMP_FILE", file, "DUMP_ID", dumpId);
+            elog<Open>(ErrnoOpen(EINVAL), PathOpen(file.c_str()));
+        }
+    }
+    else
+    {
+        dumpFD.emplace(open(file.c_str(), O_RDONLY | O_CLOEXEC));
+        if ((*dumpFD)() < 0)
+        {
+            // Unable to open the dump file
+            auto err = errno;
+            lg2::error("Failed to open the dump from file, errno: {ERRNO}, "
+                       "DUMPFILE: {DUMP_FILE}, DUMP_ID: {DUMP_ID}",
+                       "ERRNO", err, "DUMP_FILE", file, "DUMP_ID", dumpId);
+            elog<Open>(ErrnoOpen(err), PathOpen(file.c_str()));
+        }
+    }
 
-        FD_ZERO(&readFD);
-        FD_SET(unixSocket(), &readFD);
-        int numOfFDs = unixSocket() + 1;
+    lg2::info("Opening File for RW, FILENAME: {FILENAME}", "FILENAME",
+              file.filename().c_str());
 
-        int retVal = select(numOfFDs, &readFD, nullptr, nullptr, &timeVal);
-        if (retVal <= 0)
+    try
+    {
+        if (recipe)
         {
-            lg2::error("select() failed, errno: {ERRNO}, DUMP_ID: {DUMP_ID}",
-                       "ERRNO", errno, "DUMP_ID", dumpId);
-            std::string msg = "select() failed " + std::string(strerror(errno));
-            throw std::runtime_error(msg);
+            for (const auto& piece : recipe->pieces)
+            {
+                size += piece.stored;
+            }
         }
-        else if ((retVal > 0) && (FD_ISSET(unixSocket(), &readFD)))
+        else
         {
-            CustomFd socketFD = accept(unixSocket(), nullptr, nullptr);
-            if (socketFD() < 0)
+            // get file size
+            struct stat st{};
+            if (fstat((*dumpFD)(), &st) < 0)
             {
-                lg2::error(
-                    "accept() failed, errno: {ERRNO}, DUMP_ID: {DUMP_ID}",
-                    "ERRNO", errno, "DUMP_ID", dumpId);
-                std::string msg =
-                    "accept() failed " + std::string(strerror(errno));
-                throw std::runtime_error(msg);
+                throw std::ios_base::failure("fstat() failed " +
+                                             std::string(strerror(errno)));
             }
+            size = st.st_size;
+        }
+
+        // Sent as stored if that is the algorithm asked for
+        if (codec && (recipe ? recipe->algorithm
+                             : archive::Reader(dumpPath()).getAlgorithm()) ==
+                         *codec)
+        {
+            codec.reset();
+        }
 
-            std::ifstream infile{file, std::ios::in | std::ios::binary};
-            if (!infile.good())
+        end = UINT64_MAX;
+        if (codec || !baseline.empty())
+        {
+            // The items of the baseline are a compressed stream of their
+            // own
+            if (codec && !baseline.empty())
             {
-                // Unable to open the dump file
-                lg2::error("Failed to open the dump from file, errno: {ERRNO}, "
-                           "DUMPFILE: {DUMP_FILE}, DUMP_ID: {DUMP_ID}",
-                           "ERRNO", errno, "DUMP_FILE", file, "DUMP_ID",
-                           dumpId);
-                elog<Open>(ErrnoOpen(errno), PathOpen(file.c_str()));
+                throw std::invalid_argument(
+                    "A delta dump is offloaded as stored only");
             }
 
-            infile.exceptions(std::ifstream::failbit | std::ifstream::badbit |
-                              std::ifstream::eofbit);
-
-            lg2::info("Opening File for RW, FILENAME: {FILENAME}", "FILENAME",
-                      file.filename().c_str());
-
-            std::filebuf* pbuf = infile.rdbuf();
-
-            // get file size using buffer's members
-            std::size_t size = pbuf->pubseekoff(0, infile.end, infile.in);
-            pbuf->pubseekpos(0, infile.in);
-
-            // allocate memory to contain file data
-            std::unique_ptr<char[]> buffer(new char[size]);
-            // get file data
-            pbuf->sgetn(buffer.get(), static_cast<std::streamsize>(size));
-            infile.close();
-
-            writeOnUnixSocket(socketFD(), buffer.get(), size);
+            // The recompressed dump or the items of the baseline are
+            // written into a pipe once the client connects, the size of
+            // the stream is known at their end
+            headSize = UINT64_MAX;
+            buffer.resize(TRANSCODE_BUFFER);
         }
+        else
+        {
+            streamSize = size;
+            if (range.offset > streamSize)
+            {
+                throw std::invalid_argument(
+                    "The offset is past the end of the dump " +
+                    std::to_string(streamSize));
+            }
+            end = streamSize;
+        }
+        if (range.length && *range.length < end - range.offset)
+        {
+            end = range.offset + *range.length;
+        }
+
+        listenFD.emplace(socketInit(writePath));
+        io = std::make_unique<sdeventplus::source::IO>(
+            event, (*listenFD)(), EPOLLIN,
+            [this](sdeventplus::source::IO&, int, uint32_t) { accept(); });
+        expireIn(ACCEPT_TIMEOUT);
+        ++sessions;
     }
-    catch (const std::ifstream::failure& oe)
+    catch (const std::ios_base::failure& oe)
     {
-        std::remove(writePath.c_str());
         auto err = errno;
         lg2::error("Failed to open, errormsg: {ERROR}, "
                    "OPENINTERFACE: {OPEN_INTERFACE}, DUMP_ID: {DUMP_ID}",
                    "ERROR", oe, "OPEN_INTERFACE", file, "DUMP_ID", dumpId);
         elog<Open>(ErrnoOpen(err), PathOpen(file.c_str()));
     }
+    catch (const std::invalid_argument& e)
+    {
+        using Argument = xyz::openbmc_project::Common::InvalidArgument;
+        lg2::error("Invalid offload URI, errormsg: {ERROR}, "
+                   "DUMP_ID: {DUMP_ID}",
+                   "ERROR", e, "DUMP_ID", dumpId);
+        elog<InvalidArgument>(
+            Argument::ARGUMENT_NAME("URI"),
+            Argument::ARGUMENT_VALUE(makeUri(target).c_str()));
+    }
     catch (const std::exception& e)
     {
-        std::remove(writePath.c_str());
         auto err = errno;
+        std::remove(writePath.c_str());
         lg2::error("Failed to offload dump, errormsg: {ERROR}, "
                    "DUMPFILE: {DUMP_FILE}, DUMP_ID: {DUMP_ID}",
                    "ERROR", e, "DUMP_FILE", writePath, "DUMP_ID", dumpId);
         elog<Write>(ErrnoWrite(err), PathWrite(writePath.c_str()));
     }
+}
+
+Session::~Session()
+{
+    // A producer blocked on the pipe fails once its read end is closed
+    cancelled = true;
+    pipeFD.reset();
+    if (producer.joinable())
+    {
+        producer.join();
+    }
+    --sessions;
     std::remove(writePath.c_str());
-    return;
+}
+
+size_t Session::inProgress()
+{
+    return sessions;
+}
+
+void Session::accept()
+{
+    int fd = accept4((*listenFD)(), nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            return;
+        }
+        lg2::error("accept() failed, errno: {ERRNO}, DUMP_ID: {DUMP_ID}",
+                   "ERRNO", errno, "DUMP_ID", dumpId);
+        finish(false);
+        return;
+    }
+
+    // A single client per offload, the socket is written to from now on
+    socketFD.emplace(fd);
+    listenFD.reset();
+    io = std::make_unique<sdeventplus::source::IO>(
+        event, fd, EPOLLOUT,
+        [this](sdeventplus::source::IO&, int, uint32_t) { send(); });
+    expireIn(std::chrono::seconds(transfer::SOCKET_TIMEOUT));
+    if (headSize > 0)
+    {
+        startProducing();
+    }
+}
+
+std::string Session::dumpPath() const
+{
+    // A recipe is read chunk by chunk from the store
+    if (recipe)
+    {
+        return file;
+    }
+    return "/proc/self/fd/" + std::to_string((*dumpFD)());
+}
+
+void Session::startProducing()
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+    {
+        lg2::error("pipe() failed, errno: {ERRNO}, DUMP_ID: {DUMP_ID}",
+                   "ERRNO", errno, "DUMP_ID", dumpId);
+        finish(false);
+        return;
+    }
+    pipeFD.emplace(fds[0]);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    // The socket is written to once data was read from the pipe, the
+    // producer may take longer than the client to read it
+    io->set_enabled(sdeventplus::source::Enabled::Off);
+    timer->set_enabled(sdeventplus::source::Enabled::Off);
+    pipeIO = std::make_unique<sdeventplus::source::IO>(
+        event, fds[0], EPOLLIN,
+        [this](sdeventplus::source::IO&, int, uint32_t) { receive(); });
+    producer = std::thread([this, fd = fds[1], path = dumpPath()]() {
+        // The items of the baseline followed by the delta archive
+        // decompress into the complete dump
+        produced = codec ? recompress::transcode(path, *codec, fd, cancelled)
+                         : delta::baselineItems(path, baseline, fd,
+                                                cancelled);
+        close(fd);
+    });
+}
+
+void Session::receive()
+{
+    while (bufferEnd < buffer.size())
+    {
+        auto count = read((*pipeFD)(), buffer.data() + bufferEnd,
+                          buffer.size() - bufferEnd);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        if (count < 0)
+        {
+            lg2::error("read() of the pipe failed, errno: {ERRNO}, "
+                       "DUMP_ID: {DUMP_ID}",
+                       "ERRNO", errno, "DUMP_ID", dumpId);
+            finish(false);
+            return;
+        }
+
+        if (count == 0)
+        {
+            producer.join();
+            headSize = received;
+            streamSize = codec ? received : received + size;
+            if (!produced || range.offset > streamSize)
+            {
+                lg2::error("Failed to produce the offload stream, "
+                           "DUMP_ID: {DUMP_ID}, SIZE: {SIZE}",
+                           "DUMP_ID", dumpId, "SIZE", streamSize);
+                finish(false);
+                return;
+            }
+            end = std::min(end, streamSize);
+            pipeIO->set_enabled(sdeventplus::source::Enabled::Off);
+            break;
+        }
+
+        // The stream is produced from its start, the part before the
+        // range is dropped
+        received += count;
+        bufferEnd += count;
+        if (received <= range.offset)
+        {
+            bufferEnd = 0;
+        }
+        else if (received - count < range.offset)
+        {
+            bufferStart = bufferEnd - (received - range.offset);
+        }
+    }
+
+    if (position == end)
+    {
+        finish(true);
+    }
+    else if (bufferStart < bufferEnd || position >= headSize)
+    {
+        pipeIO->set_enabled(sdeventplus::source::Enabled::Off);
+        io->set_enabled(sdeventplus::source::Enabled::On);
+        expireIn(std::chrono::seconds(transfer::SOCKET_TIMEOUT));
+    }
+}
+
+void Session::send()
+{
+    try
+    {
+        uint64_t count = 0;
+        if (position < headSize)
+        {
+            count = transfer::sendSome(
+                (*socketFD)(), buffer.data() + bufferStart,
+                std::min<uint64_t>(bufferEnd - bufferStart, end - position));
+            bufferStart += count;
+        }
+        else if (position < end)
+        {
+            count = sendStored(position - headSize, end - position);
+        }
+        position += count;
+        acknowledged();
+
+        if (position == end)
+        {
+            finish(true);
+        }
+        else if (position < headSize && bufferStart == bufferEnd)
+        {
+            // More of the stream is read from the pipe
+            bufferStart = bufferEnd = 0;
+            io->set_enabled(sdeventplus::source::Enabled::Off);
+            pipeIO->set_enabled(sdeventplus::source::Enabled::On);
+            timer->set_enabled(sdeventplus::source::Enabled::Off);
+        }
+        else if (count > 0)
+        {
+            expireIn(std::chrono::seconds(transfer::SOCKET_TIMEOUT));
+        }
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to offload dump, errormsg: {ERROR}, "
+                   "DUMPFILE: {DUMP_FILE}, DUMP_ID: {DUMP_ID}",
+                   "ERROR", e, "DUMP_FILE", writePath, "DUMP_ID", dumpId);
+        finish(false);
+    }
+}
+
+uint64_t Session::sendStored(uint64_t offset, uint64_t size)
+{
+    // Streamed from the page cache, the dump is never held in memory
+    if (!recipe)
+    {
+        return transfer::sendFileSome((*socketFD)(), (*dumpFD)(), offset,
+                                      size);
+    }
+
+    // The chunk files follow each other in the archive, from the one
+    // holding the offset
+    const auto& pieces = recipe->pieces;
+    while (offset >= pieceStart + pieces[piece].stored)
+    {
+        pieceStart += pieces[piece].stored;
+        ++piece;
+        pieceFD.reset();
+    }
+    if (!pieceFD)
+    {
+        auto path = chunk::chunkFile(file, pieces[piece].key);
+        pieceFD.emplace(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if ((*pieceFD)() < 0)
+        {
+            auto error = std::string(strerror(errno));
+            pieceFD.reset();
+            throw std::runtime_error("Failed to open the chunk " +
+                                     path.string() + " " + error);
+        }
+    }
+    return transfer::sendFileSome(
+        (*socketFD)(), (*pieceFD)(), offset - pieceStart,
+        std::min<uint64_t>(size, pieceStart + pieces[piece].stored - offset));
+}
+
+void Session::finish(bool sent)
+{
+    if (done)
+    {
+        return;
+    }
+    io->set_enabled(sdeventplus::source::Enabled::Off);
+    timer->set_enabled(sdeventplus::source::Enabled::Off);
+    if (pipeIO)
+    {
+        pipeIO->set_enabled(sdeventplus::source::Enabled::Off);
+    }
+
+    Result result;
+    result.sent = sent;
+    result.complete = sent && end == streamSize;
+    result.rest.offset = sent ? end : acknowledged();
+    if (range.length)
+    {
+        result.rest.length = end - result.rest.offset;
+    }
+    if (!sent)
+    {
+        lg2::info("The offload can be resumed, DUMP_ID: {DUMP_ID}, "
+                  "OFFSET: {OFFSET}",
+                  "DUMP_ID", dumpId, "OFFSET", result.rest.offset);
+    }
+
+    done = std::make_unique<sdeventplus::source::Defer>(
+        event, [this, result](auto& /*source*/) {
+            done->set_enabled(sdeventplus::source::Enabled::Off);
+
+            // Kept out of the session, which the callback may destroy
+            auto finished = std::move(callback);
+            finished(result);
+        });
+}
+
+uint64_t Session::acknowledged()
+{
+    // SIOCOUTQ counts the memory of the queued buffers, which exceeds the
+    // bytes queued, so the offset is at most the one the client read. The
+    // hang up is checked after it, a queue taken before the client closed
+    // its end is still valid.
+    int queued = 0;
+    struct pollfd state{};
+    state.fd = socketFD ? (*socketFD)() : -1;
+    if (socketFD && ioctl(state.fd, SIOCOUTQ, &queued) == 0 &&
+        poll(&state, 1, 0) >= 0 && !(state.revents & (POLLHUP | POLLERR)))
+    {
+        readOffset = std::max(readOffset,
+                              position - std::min<uint64_t>(position, queued));
+    }
+    return readOffset;
+}
+
+void Session::expireIn(std::chrono::microseconds timeout)
+{
+    auto time = sdeventplus::Clock<sdeventplus::ClockId::Monotonic>(event)
+                    .now() +
+                timeout;
+    if (!timer)
+    {
+        timer = std::make_unique<Timer>(
+            event, time, std::chrono::milliseconds(100),
+            [this](Timer&, Timer::TimePoint) {
+                lg2::error("Offload timed out, DUMP_ID: {DUMP_ID}",
+                           "DUMP_ID", dumpId);
+                finish(false);
+            });
+        return;
+    }
+    timer->set_time(time);
+    timer->set_enabled(sdeventplus::source::Enabled::OneShot);
 }
 
 } // namespace offload
@@ -1,6 +1,25 @@
 #pragma once
 
+#include "dump_archive.hpp"
+#include "dump_chunk.hpp"
+#include "dump_utils.hpp"
+
+#include <sdeventplus/clock.hpp>
+#include <sdeventplus/event.hpp>
+#include <sdeventplus/source/event.hpp>
+#include <sdeventplus/source/io.hpp>
+#include <sdeventplus/source/time.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace phosphor
 {
@@ -9,17 +28,285 @@ namespace dump
 namespace offload
 {
 
-/**
- * @brief Kicks off the instructions to
- *        start offload of the dump using dbus
- *
- * @param[in] file - dump filename with relative path.
- * @param[in] dumpId - id of the dump.
- * @param[in] writePath[in] - path to write the dump file.
- *
- **/
-void requestOffload(std::filesystem::path file, uint32_t dumpId,
-                    std::string writePath);
+using Timer = sdeventplus::source::Time<sdeventplus::ClockId::Monotonic>;
+
+// Time the offload client has to connect to the socket
+constexpr auto ACCEPT_TIMEOUT = std::chrono::seconds(1);
+
+// Most data read from the pipe ahead of the socket
+constexpr size_t TRANSCODE_BUFFER = 256 * 1024;
+
+/** @struct Range
+ *  @brief A byte range of the offload stream, the items of the baseline of
+ *         a delta dump followed by the dump, or the recompressed dump.
+ */
+struct Range
+{
+    /** @brief Offset of the range */
+    uint64_t offset = 0;
+
+    /** @brief Size of the range, up to the end of the stream if not set */
+    std::optional<uint64_t> length;
+};
+
+/** @struct Target
+ *  @brief What an offload URI asks for.
+ */
+struct Target
+{
+    /** @brief Path of the unix socket */
+    std::string path;
+
+    /** @brief The range of the stream to send */
+    Range range;
+
+    /** @brief Algorithm the dump is recompressed with while it is sent,
+     *         the one it is stored with if not set
+     */
+    std::optional<archive::Algorithm> codec;
+};
+
+/** @struct Result
+ *  @brief The outcome of an offload session.
+ */
+struct Result
+{
+    /** @brief Whether the range was sent completely */
+    bool sent = false;
+
+    /** @brief Whether the range reached the end of the stream, the client
+     *         has the whole dump only if it has the stream up to the start
+     *         of the range too
+     */
+    bool complete = false;
+
+    /** @brief The part of the range the client didn't read, from an offset
+     *         the client read at least up to.
+     */
+    Range rest;
+};
+
+/** @brief Split an offload URI into the socket path, the range of the
+ *         stream to send and the algorithm to send it in.
+ *  @details They are given by the query of the URI,
+ *  "<socket path>?offset=<bytes>&length=<bytes>&codec=<xz|gzip|zstd>", all
+ *  parameters are optional and a URI without a query offloads the whole
+ *  dump as it is stored.
+ *  @param[in] uri - The URI.
+ *  @return The target, std::nullopt if the URI is malformed or the codec
+ *          is not built in.
+ */
+std::optional<Target> parseUri(const std::string& uri);
+
+/** @brief The URI of a target, the inverse of parseUri().
+ *  @param[in] target - The target.
+ *  @return The URI.
+ */
+std::string makeUri(const Target& target);
+
+/** @class Session
+ *  @brief The offload of a dump to a unix socket, driven by the sd_event
+ *         loop.
+ *  @details The socket is listened on and written to from event sources,
+ *  each dispatch sends at most transfer::SEND_SIZE bytes of the dump, so
+ *  the D-Bus calls and the other offloads are served while it proceeds.
+ *  Every session has its own socket, so the offloads of different dumps
+ *  run concurrently, up to BMC_DUMP_MAX_OFFLOADS of them.
+ */
+class Session
+{
+  public:
+    /** @brief Invoked from the event loop once the offload finished, with
+     *         its result. The session may be destroyed from it.
+     */
+    using Callback = std::function<void(const Result&)>;
+
+    Session() = delete;
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+    Session(Session&&) = delete;
+    Session& operator=(Session&&) = delete;
+
+    /** @brief Open the dump and listen on the socket, the offload proceeds
+     *         from the event loop once the client connects.
+     *
+     * @param[in] event - Dump manager sd_event loop.
+     * @param[in] file - dump filename with relative path.
+     * @param[in] dumpId - id of the dump.
+     * @param[in] target - The socket, range and algorithm to send the dump
+     *                     to, in and with.
+     * @param[in] baseline - archive of the baseline of a delta dump, the
+     *                       items taken from it are sent ahead of the dump,
+     *                       empty for a complete dump.
+     * @param[in] callback - Invoked once the offload finished.
+     *
+     * @throws sdbusplus::xyz::openbmc_project::Common::File::Error::Open
+     *         if the dump can't be opened,
+     *         sdbusplus::xyz::openbmc_project::Common::File::Error::Write
+     *         if the socket can't be set up and
+     *         sdbusplus::xyz::openbmc_project::Common::Error::Unavailable
+     *         if BMC_DUMP_MAX_OFFLOADS offloads are in progress and
+     *         sdbusplus::xyz::openbmc_project::Common::Error::InvalidArgument
+     *         if the range starts past the end of a complete dump sent as
+     *         stored or a delta dump is asked for in another algorithm.
+     */
+    Session(const sdeventplus::Event& event,
+            const std::filesystem::path& file, uint32_t dumpId,
+            const Target& target, const std::filesystem::path& baseline,
+            Callback callback);
+
+    /** @brief Stop the offload if still in progress and remove the
+     *         socket */
+    ~Session();
+
+    /** @brief Number of offloads in progress */
+    static size_t inProgress();
+
+  private:
+    /** @brief Accept the client on the listening socket */
+    void accept();
+
+    /** @brief Send the next piece to the client */
+    void send();
+
+    /** @brief Send a part of the dump as it is stored, the archive of a
+     *         recipe from its chunk files.
+     *  @param[in] offset - Offset in the archive.
+     *  @param[in] size - Most bytes to send.
+     *  @return Bytes sent, 0 if the socket is full.
+     */
+    uint64_t sendStored(uint64_t offset, uint64_t size);
+
+    /** @brief Path the dump is read from by the producer */
+    std::string dumpPath() const;
+
+    /** @brief Start writing the start of the stream into a pipe on a
+     *         thread of its own, the recompressed dump or the items of the
+     *         baseline of a delta dump */
+    void startProducing();
+
+    /** @brief Read the start of the stream from the pipe */
+    void receive();
+
+    /** @brief Stop the event sources and invoke the callback from the
+     *         event loop.
+     *  @param[in] sent - Whether the whole range was sent.
+     */
+    void finish(bool sent);
+
+    /** @brief Offset of the stream the client read at least up to.
+     *  @details The data queued on the socket is taken as unread. Once the
+     *  client closed its end the queue is dropped, the offset is the one
+     *  seen last while it was connected.
+     */
+    uint64_t acknowledged();
+
+    /** @brief Fail the offload if no progress is made until a time.
+     *  @param[in] timeout - Time from now.
+     */
+    void expireIn(std::chrono::microseconds timeout);
+
+    /** @brief The sd_event loop */
+    sdeventplus::Event event;
+
+    /** @brief Path of the dump file */
+    std::filesystem::path file;
+
+    /** @brief Id of the dump */
+    uint32_t dumpId;
+
+    /** @brief Path of the unix socket */
+    std::string writePath;
+
+    /** @brief Invoked once the offload finished */
+    Callback callback;
+
+    /** @brief The dump, unless kept in the chunk store */
+    std::optional<CustomFd> dumpFD;
+
+    /** @brief The chunks of the dump, if kept in the chunk store */
+    std::optional<chunk::Recipe> recipe;
+
+    /** @brief Index in the recipe of the chunk being sent */
+    size_t piece = 0;
+
+    /** @brief Offset in the archive of the chunk being sent */
+    uint64_t pieceStart = 0;
+
+    /** @brief The chunk file being sent */
+    std::optional<CustomFd> pieceFD;
+
+    /** @brief The listening socket */
+    std::optional<CustomFd> listenFD;
+
+    /** @brief The socket of the client */
+    std::optional<CustomFd> socketFD;
+
+    /** @brief Archive of the baseline of a delta dump */
+    std::filesystem::path baseline;
+
+    /** @brief Size of the dump archive */
+    uint64_t size = 0;
+
+    /** @brief The range to send */
+    Range range;
+
+    /** @brief End of the range in the stream */
+    uint64_t end = 0;
+
+    /** @brief Offset in the stream of the next byte to send */
+    uint64_t position = 0;
+
+    /** @brief Offset the client read at least up to */
+    uint64_t readOffset = 0;
+
+    /** @brief Size of the part of the stream read from the pipe, not known
+     *         before its end */
+    uint64_t headSize = 0;
+
+    /** @brief Size of the stream, not known before the end of the part
+     *         read from the pipe */
+    uint64_t streamSize = UINT64_MAX;
+
+    /** @brief Algorithm the dump is recompressed with, if any */
+    std::optional<archive::Algorithm> codec;
+
+    /** @brief Read end of the pipe of the start of the stream */
+    std::optional<CustomFd> pipeFD;
+
+    /** @brief Writes the start of the stream into the pipe */
+    std::thread producer;
+
+    /** @brief Stops the producer */
+    std::atomic<bool> cancelled = false;
+
+    /** @brief Whether the producer wrote its whole part of the stream */
+    std::atomic<bool> produced = false;
+
+    /** @brief Bytes read from the pipe */
+    uint64_t received = 0;
+
+    /** @brief Data read from the pipe ahead of the socket */
+    std::vector<uint8_t> buffer;
+
+    /** @brief Offset in the buffer of the next byte to send */
+    size_t bufferStart = 0;
+
+    /** @brief Offset in the buffer of the end of the data read */
+    size_t bufferEnd = 0;
+
+    /** @brief Watches the listening socket, then the client socket */
+    std::unique_ptr<sdeventplus::source::IO> io;
+
+    /** @brief Watches the pipe of the start of the stream */
+    std::unique_ptr<sdeventplus::source::IO> pipeIO;
+
+    /** @brief Fails the offload when the client doesn't connect or read */
+    std::unique_ptr<Timer> timer;
+
+    /** @brief Invokes the callback once finished */
+    std::unique_ptr<sdeventplus::source::Defer> done;
+};
 
 } // namespace offload
 } // namespace dump
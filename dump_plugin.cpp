@@ -0,0 +1,100 @@
+#include "dump_plugin.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <regex>
+#include <tuple>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace collector
+{
+
+// The header is expected within the first few lines of the script
+constexpr auto MAX_HEADER_LINES = 10;
+
+std::optional<Config> parseConfig(std::istream& is)
+{
+    static const std::regex configRegex(
+        R"(^#\s*config:?\s+([0-9]+)\s+([0-9]+)\s*$)");
+
+    std::string line;
+    for (int count = 0; count < MAX_HEADER_LINES && std::getline(is, line);
+         ++count)
+    {
+        std::smatch match;
+        if (std::regex_match(line, match, configRegex))
+        {
+            try
+            {
+                return Config{match[1], static_cast<unsigned>(
+                                            std::stoul(match[2]))};
+            }
+            catch (const std::out_of_range&)
+            {
+                return std::nullopt;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<Plugin> findPlugins(const std::filesystem::path& dir)
+{
+    std::vector<Plugin> plugins;
+
+    std::error_code ec;
+    for (const auto& p : std::filesystem::directory_iterator(dir, ec))
+    {
+        auto link = p.path().filename().string();
+        auto start = link.find_first_not_of("E0123456789");
+        if (start == std::string::npos)
+        {
+            continue;
+        }
+
+        Plugin plugin{link.substr(start), p.path(), DEFAULT_PRIORITY};
+
+        std::ifstream is(p.path());
+        if (auto config = parseConfig(is))
+        {
+            plugin.priority = config->priority;
+        }
+        else if (start > 1 && link.front() == 'E')
+        {
+            try
+            {
+                plugin.priority = static_cast<unsigned>(
+                    std::stoul(link.substr(1, start - 1)));
+            }
+            catch (const std::out_of_range&)
+            {}
+        }
+        plugins.push_back(std::move(plugin));
+    }
+
+    std::sort(plugins.begin(), plugins.end(), [](const auto& l, const auto& r) {
+        return std::tie(l.priority, l.name) < std::tie(r.priority, r.name);
+    });
+    return plugins;
+}
+
+std::vector<std::vector<Plugin>> makeBands(const std::vector<Plugin>& plugins)
+{
+    std::vector<std::vector<Plugin>> bands;
+    for (const auto& plugin : plugins)
+    {
+        if (bands.empty() || bands.back().front().priority != plugin.priority)
+        {
+            bands.emplace_back();
+        }
+        bands.back().push_back(plugin);
+    }
+    return bands;
+}
+
+} // namespace collector
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace collector
+{
+
+// Priority of the plugins without a usable config header, run them last
+constexpr unsigned DEFAULT_PRIORITY = 100;
+
+/** @struct Config
+ *  @brief The "# config: <types> <priority>" header of a dreport plugin.
+ */
+struct Config
+{
+    /** @brief Dump type numbers the plugin is enabled for, e.g. "123" */
+    std::string types;
+
+    /** @brief Priority, plugins with a lower value run first */
+    unsigned priority;
+};
+
+/** @struct Plugin
+ *  @brief A dreport plugin enabled for a dump type.
+ */
+struct Plugin
+{
+    /** @brief Plugin name, for example "bmcstate" */
+    std::string name;
+
+    /** @brief Path of the plugin script */
+    std::filesystem::path script;
+
+    /** @brief Priority from the config header */
+    unsigned priority;
+};
+
+/** @brief Parse the config header of a plugin script.
+ *  @param[in] is - The plugin script.
+ *  @return The config, std::nullopt if the script has no valid header.
+ */
+std::optional<Config> parseConfig(std::istream& is);
+
+/** @brief Find the plugins in a pl_<type>.d directory.
+ *  @details The plugins are linked as E<priority><name>, the priority is
+ *  taken from the config header of the script and from the link name if
+ *  the header is missing.
+ *  @param[in] dir - The plugin directory.
+ *  @return The plugins sorted by priority and name.
+ */
+std::vector<Plugin> findPlugins(const std::filesystem::path& dir);
+
+/** @brief Group sorted plugins into priority bands.
+ *  @details All the plugins of a band have the same priority, a band may
+ *  only start once the previous band completed.
+ *  @param[in] plugins - Plugins sorted by priority.
+ *  @return The bands in execution order.
+ */
+std::vector<std::vector<Plugin>> makeBands(const std::vector<Plugin>& plugins);
+
+} // namespace collector
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,267 @@
+#include "dump_recompress.hpp"
+
+#include "dump_chunk.hpp"
+#include "dump_tier.hpp"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace recompress
+{
+
+namespace
+{
+
+// ioprio_set(2) constants, not all C libraries provide them
+constexpr int IOPRIO_WHO_PROCESS = 1;
+constexpr int IOPRIO_CLASS_SHIFT = 13;
+constexpr int IOPRIO_CLASS_IDLE = 3;
+
+// Size of the reads of the tar stream, the cancellation is checked between
+// them
+constexpr size_t READ_SIZE = 64 * 1024;
+
+/** @brief Run the calling thread at the lowest CPU and I/O priority, both
+ *         apply to the calling thread only on Linux */
+void lowerPriority()
+{
+    setpriority(PRIO_PROCESS, 0, 19);
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0)
+    {
+        lg2::error("Failed to set the I/O priority, errno: {ERRNO}", "ERRNO",
+                   errno);
+    }
+}
+
+/** @brief Pass the decompressed data of a compressed file to a sink.
+ *  @return false on an error, if cancelled or if the sink failed.
+ */
+bool readFile(const std::filesystem::path& archive,
+              const std::shared_ptr<const archive::Dictionary>& dictionary,
+              const std::atomic<bool>& cancelled,
+              const std::function<bool(const uint8_t*, size_t)>& sink)
+{
+    try
+    {
+        archive::Reader reader(archive, dictionary);
+        std::vector<uint8_t> buffer(READ_SIZE);
+        while (!cancelled)
+        {
+            auto count = reader.readStream(buffer.data(), buffer.size());
+            if (count <= 0)
+            {
+                return count == 0;
+            }
+            if (!sink(buffer.data(), count))
+            {
+                return false;
+            }
+        }
+    }
+    catch (const std::system_error& e)
+    {
+        lg2::error("Failed to read the dump archive {PATH}, error: {ERROR}",
+                   "PATH", archive, "ERROR", e);
+    }
+    return false;
+}
+
+/** @brief Pass the tar stream of an archive to a sink, the one of a recipe
+ *         is read chunk by chunk from the chunk store.
+ *  @return false on an error, if cancelled or if the sink failed.
+ */
+bool readStream(const std::filesystem::path& archive,
+                const std::shared_ptr<const archive::Dictionary>& dictionary,
+                const std::atomic<bool>& cancelled,
+                const std::function<bool(const uint8_t*, size_t)>& sink)
+{
+    if (!chunk::isRecipe(archive))
+    {
+        return readFile(archive, dictionary, cancelled, sink);
+    }
+
+    auto recipe = chunk::loadRecipe(archive);
+    if (!recipe)
+    {
+        lg2::error("Invalid dump recipe {PATH}", "PATH", archive);
+        return false;
+    }
+    for (const auto& piece : recipe->pieces)
+    {
+        if (!readFile(chunk::chunkFile(archive, piece.key), dictionary,
+                      cancelled, sink))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool isIdle()
+{
+    double load = 0;
+    auto cpus = std::max(1U, std::thread::hardware_concurrency());
+    return getloadavg(&load, 1) == 1 && load / cpus < IDLE_LOAD;
+}
+
+bool isCandidate(const std::filesystem::path& archive,
+                 archive::Algorithm algorithm, int level)
+{
+    try
+    {
+        archive::Reader reader(archive);
+        return reader.getAlgorithm() != algorithm ||
+               level > archive::defaultLevel(algorithm);
+    }
+    catch (const std::system_error&)
+    {
+        return false;
+    }
+}
+
+Result run(uint32_t id, const std::filesystem::path& archive,
+           archive::Algorithm algorithm, int level,
+           const std::atomic<bool>& cancelled)
+{
+    // The archive is <name>.<extension>
+    auto name = archive.filename().string();
+    Result result;
+    result.id = id;
+    result.original = archive;
+    result.archive = archive.parent_path() /
+                     (name.substr(0, name.find('.')) + "." +
+                      archive::extension(algorithm));
+
+    lowerPriority();
+    std::error_code ec;
+    result.originalSize = std::filesystem::file_size(archive, ec);
+    if (ec)
+    {
+        return result;
+    }
+
+    // The xz dictionary needs not be larger than the tar stream
+    auto dictionary = archive::Dictionary::configured();
+    uint64_t streamSize = 0;
+    if (!readStream(archive, dictionary, cancelled,
+                    [&streamSize](const uint8_t*, size_t size) {
+                        streamSize += size;
+                        return true;
+                    }))
+    {
+        result.cancelled = cancelled;
+        return result;
+    }
+
+    auto partial = archive::Writer::partialPath(result.archive);
+    int fd = open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (fd < 0)
+    {
+        auto error = errno;
+        lg2::error("Failed to create {PATH}, errno: {ERRNO}", "PATH", partial,
+                   "ERRNO", error);
+        return result;
+    }
+
+    uint64_t size = 0;
+    {
+        auto compressor = archive::makeLevelCompressor(
+            algorithm, fd, level, streamSize, dictionary.get());
+        auto written =
+            compressor != nullptr &&
+            readStream(archive, dictionary, cancelled,
+                       [&compressor, &result](const uint8_t* data,
+                                              size_t count) {
+                           // No gain once it is as large as the original
+                           return compressor->write(data, count) &&
+                                  compressor->getOutputSize() <
+                                      result.originalSize;
+                       }) &&
+            compressor->finish() && fsync(fd) == 0;
+        if (written)
+        {
+            size = compressor->getOutputSize();
+        }
+    }
+    close(fd);
+
+    result.cancelled = cancelled;
+    if (size == 0 || size >= result.originalSize || result.cancelled)
+    {
+        std::filesystem::remove(partial, ec);
+        return result;
+    }
+    tier::written(partial, size);
+    result.partial = partial;
+    result.size = size;
+    return result;
+}
+
+bool transcode(const std::filesystem::path& archive,
+               archive::Algorithm algorithm, int fd,
+               const std::atomic<bool>& cancelled)
+{
+    lowerPriority();
+
+    // Compressed without the dictionary, which the client doesn't have
+    auto dictionary = archive::Dictionary::configured();
+    auto compressor = archive::makeLevelCompressor(
+        algorithm, fd, archive::defaultLevel(algorithm), 0);
+    return compressor != nullptr &&
+           readStream(archive, dictionary, cancelled,
+                      [&compressor](const uint8_t* data, size_t count) {
+                          return compressor->write(data, count);
+                      }) &&
+           compressor->finish();
+}
+
+bool replace(const Result& result)
+{
+    std::error_code ec;
+    std::filesystem::rename(result.partial, result.archive, ec);
+    if (ec)
+    {
+        lg2::error("Failed to replace the dump archive {PATH}, "
+                   "error: {ERROR}",
+                   "PATH", result.original, "ERROR", ec.message());
+        std::filesystem::remove(result.partial, ec);
+        return false;
+    }
+    if (result.archive != result.original)
+    {
+        std::filesystem::remove(result.original, ec);
+    }
+
+    // Persist the rename, errors only keep the original on a power loss
+    int fd = open(result.archive.parent_path().c_str(),
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+    return true;
+}
+
+} // namespace recompress
+} // namespace dump
+} // namespace phosphor
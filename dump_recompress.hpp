@@ -0,0 +1,102 @@
+#pragma once
+
+#include "dump_archive.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace recompress
+{
+
+// Load average per CPU below which the BMC is considered idle
+constexpr double IDLE_LOAD = 0.5;
+
+/** @struct Result
+ *  @brief Outcome of the recompression of a dump archive.
+ */
+struct Result
+{
+    /** @brief Dump id */
+    uint32_t id = 0;
+
+    /** @brief The archive which was recompressed */
+    std::filesystem::path original;
+
+    /** @brief Path the recompressed archive replaces it at, the extension
+     *         follows the algorithm */
+    std::filesystem::path archive;
+
+    /** @brief The recompressed archive under its hidden temporary name,
+     *         empty if it is not smaller, failed or was cancelled */
+    std::filesystem::path partial;
+
+    /** @brief Size of the original archive in bytes */
+    uint64_t originalSize = 0;
+
+    /** @brief Size of the recompressed archive in bytes */
+    uint64_t size = 0;
+
+    /** @brief Whether the recompression yielded to other work */
+    bool cancelled = false;
+};
+
+/** @brief Whether the BMC is idle, by its load average */
+bool isIdle();
+
+/** @brief Whether an archive would be compressed better with the target
+ *         algorithm and level than at the time of its collection.
+ *  @param[in] archive - The dump archive.
+ *  @param[in] algorithm - Target algorithm.
+ *  @param[in] level - Target level.
+ */
+bool isCandidate(const std::filesystem::path& archive,
+                 archive::Algorithm algorithm, int level);
+
+/** @brief Recompress a dump archive into a hidden file next to it, at the
+ *         lowest CPU and I/O priority of the calling thread.
+ *  @details The tar stream is read twice, once to size the xz dictionary
+ *  to it and once to compress it. The recompressed archive is kept only if
+ *  it is smaller, and synced, but not moved into place.
+ *  @param[in] id - Dump id.
+ *  @param[in] archive - The dump archive.
+ *  @param[in] algorithm - Target algorithm.
+ *  @param[in] level - Target level.
+ *  @param[in] cancelled - Set to stop the recompression, checked for every
+ *                         block read.
+ *  @return The outcome.
+ */
+Result run(uint32_t id, const std::filesystem::path& archive,
+           archive::Algorithm algorithm, int level,
+           const std::atomic<bool>& cancelled);
+
+/** @brief Recompress the tar stream of a dump archive into a descriptor,
+ *         at the lowest CPU and I/O priority of the calling thread.
+ *  @details For the offload of a dump with another algorithm, the stream is
+ *  read once and compressed at the default level of the algorithm, through
+ *  buffers of a bounded size.
+ *  @param[in] archive - The dump archive, or the recipe of one in the
+ *                       chunk store.
+ *  @param[in] algorithm - Target algorithm.
+ *  @param[in] fd - Descriptor the recompressed archive is written to.
+ *  @param[in] cancelled - Set to stop the recompression, checked for every
+ *                         block read.
+ *  @return true if the whole archive was written.
+ */
+bool transcode(const std::filesystem::path& archive,
+               archive::Algorithm algorithm, int fd,
+               const std::atomic<bool>& cancelled);
+
+/** @brief Replace the original archive with the recompressed one.
+ *  @param[in] result - A result with a recompressed archive.
+ *  @return true on success, the recompressed archive is removed otherwise.
+ */
+bool replace(const Result& result);
+
+} // namespace recompress
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,352 @@
+#include "dump_record.hpp"
+
+#include "dump_tier.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace record
+{
+
+namespace
+{
+
+constexpr std::string_view MAGIC = "PDER";
+
+// Magic, version, header size, length and CRC-32 of the fields
+constexpr size_t HEADER_SIZE = 16;
+
+/** @brief Field tags, never reuse the value of a removed field */
+enum class Tag : uint16_t
+{
+    dumpId = 1,
+    originatorId = 2,
+    originatorType = 3,
+    startTime = 4,
+    collectorOutcome = 5,
+    itemHash = 6,
+    baselineId = 7,
+    dumpType = 8,
+    offloaded = 9,
+    fileName = 10,
+    size = 11,
+    completedTime = 12,
+};
+
+void putInt(std::string& out, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+uint64_t getInt(std::string_view in, size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+void putField(std::string& out, Tag tag, std::string_view value)
+{
+    putInt(out, static_cast<uint16_t>(tag), 2);
+    putInt(out, value.size(), 4);
+    out.append(value);
+}
+
+void putField(std::string& out, Tag tag, uint64_t value, size_t bytes)
+{
+    putInt(out, static_cast<uint16_t>(tag), 2);
+    putInt(out, bytes, 4);
+    putInt(out, value, bytes);
+}
+
+/** @brief A map entry is the length of the key, the key and the value */
+void putPairs(std::string& out, Tag tag,
+              const std::map<std::string, std::string>& pairs)
+{
+    for (const auto& [key, value] : pairs)
+    {
+        std::string field;
+        putInt(field, key.size(), 2);
+        field.append(key);
+        field.append(value);
+        putField(out, tag, field);
+    }
+}
+
+bool getPair(std::string_view field, std::map<std::string, std::string>& pairs)
+{
+    if (field.size() < 2)
+    {
+        return false;
+    }
+    auto keySize = getInt(field, 2);
+    if (field.size() - 2 < keySize)
+    {
+        return false;
+    }
+    pairs.insert_or_assign(std::string(field.substr(2, keySize)),
+                           std::string(field.substr(2 + keySize)));
+    return true;
+}
+
+} // namespace
+
+uint32_t crc32(std::string_view data, uint32_t crc)
+{
+    static const auto table = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < table.size(); ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }();
+
+    crc = ~crc;
+    for (auto c : data)
+    {
+        crc = table[(crc ^ static_cast<uint8_t>(c)) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+std::string encode(const Record& record)
+{
+    std::string fields;
+    putField(fields, Tag::dumpId, record.dumpId, 4);
+    if (!record.originatorId.empty())
+    {
+        putField(fields, Tag::originatorId, record.originatorId);
+    }
+    putField(fields, Tag::originatorType, record.originatorType, 1);
+    putField(fields, Tag::startTime, record.startTime, 8);
+    putPairs(fields, Tag::collectorOutcome, record.collectorOutcomes);
+    putPairs(fields, Tag::itemHash, record.itemHashes);
+    if (record.baselineId != 0)
+    {
+        putField(fields, Tag::baselineId, record.baselineId, 4);
+    }
+    if (!record.dumpType.empty())
+    {
+        putField(fields, Tag::dumpType, record.dumpType);
+    }
+    if (record.offloaded)
+    {
+        putField(fields, Tag::offloaded, 1, 1);
+    }
+    if (!record.fileName.empty())
+    {
+        putField(fields, Tag::fileName, record.fileName);
+    }
+    if (record.size != 0)
+    {
+        putField(fields, Tag::size, record.size, 8);
+    }
+    if (record.completedTime != 0)
+    {
+        putField(fields, Tag::completedTime, record.completedTime, 8);
+    }
+
+    std::string out(MAGIC);
+    putInt(out, VERSION, 2);
+    putInt(out, HEADER_SIZE, 2);
+    putInt(out, fields.size(), 4);
+    putInt(out, crc32(fields), 4);
+    out.append(fields);
+    return out;
+}
+
+std::optional<Record> decode(std::string_view data)
+{
+    if (data.size() < HEADER_SIZE || !data.starts_with(MAGIC))
+    {
+        return std::nullopt;
+    }
+    auto version = getInt(data.substr(4), 2);
+    auto headerSize = getInt(data.substr(6), 2);
+    auto length = getInt(data.substr(8), 4);
+    auto crc = getInt(data.substr(12), 4);
+    if (version == 0 || version > VERSION || headerSize < HEADER_SIZE ||
+        data.size() < headerSize || data.size() - headerSize != length)
+    {
+        return std::nullopt;
+    }
+
+    auto fields = data.substr(headerSize);
+    if (crc32(fields) != crc)
+    {
+        return std::nullopt;
+    }
+
+    Record record;
+    while (!fields.empty())
+    {
+        if (fields.size() < 6)
+        {
+            return std::nullopt;
+        }
+        auto tag = static_cast<Tag>(getInt(fields, 2));
+        auto size = getInt(fields.substr(2), 4);
+        if (fields.size() - 6 < size)
+        {
+            return std::nullopt;
+        }
+        auto value = fields.substr(6, size);
+        fields.remove_prefix(6 + size);
+
+        auto number = [&value]() {
+            return getInt(value, std::min<size_t>(value.size(), 8));
+        };
+        switch (tag)
+        {
+            case Tag::dumpId:
+                record.dumpId = number();
+                break;
+            case Tag::originatorId:
+                record.originatorId = value;
+                break;
+            case Tag::originatorType:
+                record.originatorType = number();
+                break;
+            case Tag::startTime:
+                record.startTime = number();
+                break;
+            case Tag::collectorOutcome:
+                if (!getPair(value, record.collectorOutcomes))
+                {
+                    return std::nullopt;
+                }
+                break;
+            case Tag::itemHash:
+                if (!getPair(value, record.itemHashes))
+                {
+                    return std::nullopt;
+                }
+                break;
+            case Tag::baselineId:
+                record.baselineId = number();
+                break;
+            case Tag::dumpType:
+                record.dumpType = value;
+                break;
+            case Tag::offloaded:
+                record.offloaded = number() != 0;
+                break;
+            case Tag::fileName:
+                record.fileName = value;
+                break;
+            case Tag::size:
+                record.size = number();
+                break;
+            case Tag::completedTime:
+                record.completedTime = number();
+                break;
+            default:
+                // Written by a later version
+                break;
+        }
+    }
+    return record;
+}
+
+bool replaceFile(const std::filesystem::path& path, std::string_view data)
+{
+    auto temp = path.parent_path() / ("." + path.filename().string() + ".tmp");
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        auto error = errno;
+        lg2::error("Failed to create {PATH}, errno: {ERRNO}", "PATH", temp,
+                   "ERRNO", error);
+        return false;
+    }
+
+    auto size = data.size();
+    while (!data.empty())
+    {
+        auto written = write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written < 0)
+        {
+            break;
+        }
+        data.remove_prefix(written);
+    }
+    if (!data.empty() || fsync(fd) < 0)
+    {
+        auto error = errno;
+        lg2::error("Failed to write {PATH}, errno: {ERRNO}", "PATH", temp,
+                   "ERRNO", error);
+        close(fd);
+        unlink(temp.c_str());
+        return false;
+    }
+    close(fd);
+
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec)
+    {
+        lg2::error("Failed to rename {PATH}, error: {ERROR}", "PATH", temp,
+                   "ERROR", ec.message());
+        unlink(temp.c_str());
+        return false;
+    }
+    tier::written(path, size);
+
+    // Persist the rename, errors only lose the update on a power loss
+    fd = open(path.parent_path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+    return true;
+}
+
+bool save(const std::filesystem::path& path, const Record& record)
+{
+    return replaceFile(path, encode(record));
+}
+
+std::optional<Record> load(const std::filesystem::path& path)
+{
+    std::ifstream is(path, std::ios::binary);
+    if (!is.is_open())
+    {
+        return std::nullopt;
+    }
+    std::string data{std::istreambuf_iterator<char>(is),
+                     std::istreambuf_iterator<char>()};
+    return decode(data);
+}
+
+} // namespace record
+} // namespace dump
+} // namespace phosphor
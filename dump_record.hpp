@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace record
+{
+
+// Binary record of a dump entry
+constexpr auto RECORD_FILE = "entry.rec";
+
+// Current version of the record layout, fields are added as new tags
+// without a change of the version
+constexpr uint16_t VERSION = 1;
+
+/** @struct Record
+ *  @brief The persisted properties of a dump entry.
+ */
+struct Record
+{
+    /** @brief Dump id */
+    uint32_t dumpId = 0;
+
+    /** @brief Id of the originator of the dump */
+    std::string originatorId;
+
+    /** @brief Type of the originator, OriginatorTypes of OriginatedBy */
+    uint8_t originatorType = 0;
+
+    /** @brief Start time of the collection in microseconds */
+    uint64_t startTime = 0;
+
+    /** @brief Outcome of the collectors [plugin:outcome] */
+    std::map<std::string, std::string> collectorOutcomes;
+
+    /** @brief Content hash of the items [item:hash] */
+    std::map<std::string, std::string> itemHashes;
+
+    /** @brief Id of the baseline of a delta dump, 0 for a complete dump */
+    uint32_t baselineId = 0;
+
+    /** @brief Collection type of the dump */
+    std::string dumpType;
+
+    /** @brief Whether the dump was offloaded */
+    bool offloaded = false;
+
+    /** @brief Name of the dump file in the dump directory */
+    std::string fileName;
+
+    /** @brief Size of the dump file in bytes */
+    uint64_t size = 0;
+
+    /** @brief Completion time of the collection in microseconds */
+    uint64_t completedTime = 0;
+};
+
+/** @brief Encode a record.
+ *  @details A fixed header with a magic number, the version, the length of
+ *  the fields and a CRC-32 of the fields, followed by the fields as
+ *  tag-length-value triples in little endian byte order. Empty fields are
+ *  left out.
+ */
+std::string encode(const Record& record);
+
+/** @brief Decode a record, fields of unknown tags are skipped.
+ *  @return The record, std::nullopt if the data is truncated, corrupt or of
+ *          a newer version.
+ */
+std::optional<Record> decode(std::string_view data);
+
+/** @brief CRC-32 (IEEE 802.3) of data */
+uint32_t crc32(std::string_view data, uint32_t crc = 0);
+
+/** @brief Replace a file with data, crash consistently.
+ *  @details The data is written to a temporary file in the same directory
+ *  and synced before it is renamed over the file, a power loss leaves
+ *  either the old or the new file.
+ *  @return false on error, the file is unchanged then.
+ */
+bool replaceFile(const std::filesystem::path& path, std::string_view data);
+
+/** @brief Write a record file */
+bool save(const std::filesystem::path& path, const Record& record);
+
+/** @brief Read a record file.
+ *  @return The record, std::nullopt if the file is missing or invalid.
+ */
+std::optional<Record> load(const std::filesystem::path& path);
+
+} // namespace record
+} // namespace dump
+} // namespace phosphor
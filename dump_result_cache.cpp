@@ -0,0 +1,282 @@
+#include "dump_result_cache.hpp"
+
+#include "dump_utils.hpp"
+
+#include <sys/stat.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <variant>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace collector
+{
+
+namespace
+{
+
+// Age limit of outputs whose inputs change without any indication
+constexpr std::chrono::hours UNTRACKED_MAX_AGE{1};
+
+constexpr auto BOOT_ID = "/proc/sys/kernel/random/boot_id";
+
+/** @brief Read a small file.
+ *  @return The contents, std::nullopt if the file can't be read.
+ */
+std::optional<std::string> readFile(const std::filesystem::path& file)
+{
+    std::ifstream is(file, std::ios::binary);
+    if (!is.is_open())
+    {
+        return std::nullopt;
+    }
+    return std::string((std::istreambuf_iterator<char>(is)),
+                       std::istreambuf_iterator<char>());
+}
+
+/** @brief Identity and modification time of a file, links are followed */
+std::string fileStamp(const std::filesystem::path& file)
+{
+    struct stat st{};
+    if (stat(file.c_str(), &st) < 0)
+    {
+        return file.string() + ": none\n";
+    }
+    return file.string() + ": " + std::to_string(st.st_dev) + ":" +
+           std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) +
+           ":" + std::to_string(st.st_mtim.tv_sec) + "." +
+           std::to_string(st.st_mtim.tv_nsec) + "\n";
+}
+
+/** @brief Hash of the contents of a file, for files without a meaningful
+ *         modification time like the ones in /proc.
+ */
+std::optional<std::string> fileHash(const std::filesystem::path& file)
+{
+    auto contents = readFile(file);
+    if (!contents)
+    {
+        return std::nullopt;
+    }
+    return file.string() + ": " + std::to_string(contents->size()) + ":" +
+           std::to_string(std::hash<std::string>{}(*contents)) + "\n";
+}
+
+/** @brief The boot id, which changes with every boot */
+std::optional<std::string> bootId()
+{
+    return readFile(BOOT_ID);
+}
+
+/** @brief The redundancy priorities of the BMC firmware images, which
+ *         change when an image is activated.
+ */
+std::optional<std::string> redundancyPriorities()
+{
+    constexpr auto updater = "xyz.openbmc_project.Software.BMC.Updater";
+    constexpr auto priorityIntf =
+        "xyz.openbmc_project.Software.RedundancyPriority";
+    try
+    {
+        auto bus = sdbusplus::bus::new_default();
+        auto method = bus.new_method_call(
+            "xyz.openbmc_project.ObjectMapper",
+            "/xyz/openbmc_project/object_mapper",
+            "xyz.openbmc_project.ObjectMapper", "GetSubTreePaths");
+        method.append("/xyz/openbmc_project/software", 0,
+                      std::vector<std::string>{priorityIntf});
+        std::vector<std::string> paths;
+        bus.call(method).read(paths);
+        std::sort(paths.begin(), paths.end());
+
+        std::string priorities;
+        for (const auto& path : paths)
+        {
+            auto priority = std::get<uint8_t>(
+                readDBusProperty<std::variant<uint8_t>>(
+                    bus, updater, path, priorityIntf, "Priority"));
+            priorities += path + ": " + std::to_string(priority) + "\n";
+        }
+        return priorities;
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to read the firmware priorities, error: {ERROR}",
+                   "ERROR", e);
+    }
+    return std::nullopt;
+}
+
+/** @brief Fingerprint of the U-Boot environment, which fw_setenv changes
+ *         without any indication.
+ */
+std::optional<Fingerprint> ubootEnvironment(const std::filesystem::path& config)
+{
+    auto id = bootId();
+    if (!id)
+    {
+        return std::nullopt;
+    }
+    return Fingerprint{*id + fileStamp(config), UNTRACKED_MAX_AGE};
+}
+
+using Fingerprinter = std::function<std::optional<Fingerprint>()>;
+
+/** @brief Fingerprint built from a single input */
+Fingerprinter from(std::function<std::optional<std::string>()> input)
+{
+    return [input]() -> std::optional<Fingerprint> {
+        auto value = input();
+        if (!value)
+        {
+            return std::nullopt;
+        }
+        return Fingerprint{*value};
+    };
+}
+
+// Plugins whose output rarely changes, by plugin name
+const std::map<std::string, Fingerprinter> fingerprinters = {
+    {"altfwprintenv",
+     []() { return ubootEnvironment("/etc/alt_fw_env.config"); }},
+    {"cpuinfo", from(bootId)},
+    {"fwprintenv", []() { return ubootEnvironment("/etc/fw_env.config"); }},
+    {"kernlcmdline", from(bootId)},
+    {"mountinfo", from([]() { return fileHash("/proc/self/mountinfo"); })},
+    {"osrelease", from([]() { return fileStamp("/etc/os-release"); })},
+    {"redundantosrelease", from(redundancyPriorities)},
+};
+
+} // namespace
+
+std::optional<Fingerprint> fingerprint(const std::string& plugin)
+{
+    auto iter = fingerprinters.find(plugin);
+    if (iter == fingerprinters.end())
+    {
+        return std::nullopt;
+    }
+    return iter->second();
+}
+
+bool ResultCache::restore(const std::string& plugin,
+                          const Fingerprint& fingerprint,
+                          const std::filesystem::path& outDir)
+{
+    std::vector<std::pair<std::string, std::string>> files;
+    {
+        std::lock_guard lock(mutex);
+        auto iter = entries.find(plugin);
+        if (iter == entries.end())
+        {
+            return false;
+        }
+        auto& entry = iter->second;
+        if (entry.fingerprint != fingerprint.value ||
+            (fingerprint.maxAge.count() > 0 &&
+             std::chrono::steady_clock::now() - entry.collected >=
+                 fingerprint.maxAge))
+        {
+            used -= entry.size;
+            entries.erase(iter);
+            return false;
+        }
+        entry.used = ++uses;
+        files = entry.files;
+    }
+
+    for (const auto& [name, contents] : files)
+    {
+        std::ofstream os(outDir / name, std::ios::binary);
+        os.write(contents.data(), contents.size());
+        if (!os)
+        {
+            lg2::error("Failed to restore the cached {FILE} of {PLUGIN}",
+                       "FILE", name, "PLUGIN", plugin);
+
+            // Leave an empty directory for the plugin to run
+            std::error_code ec;
+            for (const auto& [file, unused] : files)
+            {
+                std::filesystem::remove(outDir / file, ec);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+void ResultCache::store(const std::string& plugin,
+                        const Fingerprint& fingerprint,
+                        const std::filesystem::path& outDir)
+{
+    if (capacity == 0)
+    {
+        return;
+    }
+
+    Entry entry;
+    entry.fingerprint = fingerprint.value;
+    entry.collected = std::chrono::steady_clock::now();
+    std::error_code ec;
+    for (const auto& p : std::filesystem::directory_iterator(outDir, ec))
+    {
+        // Directories and links are left to the plugin
+        if (p.is_symlink(ec) || !p.is_regular_file(ec))
+        {
+            return;
+        }
+        auto contents = readFile(p.path());
+        if (!contents)
+        {
+            return;
+        }
+        auto name = p.path().filename().string();
+        entry.size += name.size() + contents->size();
+        if (entry.size > capacity)
+        {
+            return;
+        }
+        entry.files.emplace_back(std::move(name), std::move(*contents));
+    }
+    if (ec)
+    {
+        return;
+    }
+
+    std::lock_guard lock(mutex);
+    if (auto iter = entries.find(plugin); iter != entries.end())
+    {
+        used -= iter->second.size;
+        entries.erase(iter);
+    }
+    while (used + entry.size > capacity)
+    {
+        auto lru = std::min_element(
+            entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+                return a.second.used < b.second.used;
+            });
+        used -= lru->second.size;
+        entries.erase(lru);
+    }
+    entry.used = ++uses;
+    used += entry.size;
+    entries.emplace(plugin, std::move(entry));
+}
+
+size_t ResultCache::size()
+{
+    std::lock_guard lock(mutex);
+    return used;
+}
+
+} // namespace collector
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace collector
+{
+
+/** @struct Fingerprint
+ *  @brief Identifies the inputs of a plugin whose output rarely changes.
+ */
+struct Fingerprint
+{
+    /** @brief Whatever the output depends on, the inode and modification
+     *         time of a file, the boot id or D-Bus properties.
+     */
+    std::string value;
+
+    /** @brief Age after which the output is collected again, for inputs
+     *         without a change indication, zero for no limit.
+     */
+    std::chrono::seconds maxAge{0};
+};
+
+/** @brief Fingerprint the inputs of a plugin.
+ *  @param[in] plugin - Plugin name, for example "osrelease".
+ *  @return The fingerprint, std::nullopt if the output of the plugin is
+ *          not cached or the fingerprint could not be determined.
+ */
+std::optional<Fingerprint> fingerprint(const std::string& plugin);
+
+/** @class ResultCache
+ *  @brief Outputs of slow-changing plugins, kept in RAM across dumps.
+ *  @details The output of a plugin is reused as long as the fingerprint of
+ *  its inputs is unchanged. Only outputs consisting of regular files are
+ *  cached. The least recently used outputs are evicted to stay within the
+ *  capacity.
+ */
+class ResultCache
+{
+  public:
+    ResultCache() = delete;
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+    ResultCache(ResultCache&&) = delete;
+    ResultCache& operator=(ResultCache&&) = delete;
+    ~ResultCache() = default;
+
+    /** @brief Constructor
+     *  @param[in] capacity - Maximum size of the cached outputs in bytes,
+     *                        0 disables the cache.
+     */
+    explicit ResultCache(size_t capacity) : capacity(capacity) {}
+
+    /** @brief Write the cached output of a plugin into its output
+     *         directory.
+     *  @param[in] plugin - Plugin name.
+     *  @param[in] fingerprint - Current fingerprint of the plugin inputs.
+     *  @param[in] outDir - Output directory of the plugin.
+     *  @return true on a cache hit, the output directory holds the output.
+     */
+    bool restore(const std::string& plugin, const Fingerprint& fingerprint,
+                 const std::filesystem::path& outDir);
+
+    /** @brief Cache the output of a plugin.
+     *  @param[in] plugin - Plugin name.
+     *  @param[in] fingerprint - Fingerprint of the plugin inputs, taken
+     *                           before the plugin was run.
+     *  @param[in] outDir - Output directory of the plugin.
+     */
+    void store(const std::string& plugin, const Fingerprint& fingerprint,
+               const std::filesystem::path& outDir);
+
+    /** @brief Size of the cached outputs in bytes */
+    size_t size();
+
+  private:
+    /** @struct Entry
+     *  @brief The cached output of a plugin.
+     */
+    struct Entry
+    {
+        /** @brief Fingerprint of the inputs of the output */
+        std::string fingerprint;
+
+        /** @brief The files of the output, contents by name */
+        std::vector<std::pair<std::string, std::string>> files;
+
+        /** @brief Size of the file contents */
+        size_t size = 0;
+
+        /** @brief Time the output was collected */
+        std::chrono::steady_clock::time_point collected;
+
+        /** @brief Last use, for the eviction */
+        uint64_t used = 0;
+    };
+
+    /** @brief Maximum size of the cached outputs */
+    size_t capacity;
+
+    /** @brief Size of the cached outputs */
+    size_t used = 0;
+
+    /** @brief Use counter */
+    uint64_t uses = 0;
+
+    /** @brief Cached outputs by plugin name */
+    std::map<std::string, Entry> entries;
+
+    /** @brief Serializes the access of concurrent collections */
+    std::mutex mutex;
+};
+
+} // namespace collector
+} // namespace dump
+} // namespace phosphor
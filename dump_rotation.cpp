@@ -0,0 +1,200 @@
+#include "dump_rotation.hpp"
+
+#include <sys/stat.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <sstream>
+#include <unordered_set>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace rotation
+{
+
+namespace
+{
+
+/** @brief Split a comma separated list, blanks are removed */
+std::vector<std::string> split(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        std::erase_if(item, [](unsigned char c) { return std::isspace(c); });
+        if (!item.empty())
+        {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+} // namespace
+
+std::vector<Criterion> parsePolicy(const std::string& policy)
+{
+    static const std::map<std::string, Criterion> names = {
+        {"offloaded", Criterion::offloaded},
+        {"type", Criterion::type},
+        {"oldest", Criterion::oldest},
+        {"largest", Criterion::largest},
+    };
+
+    std::vector<Criterion> criteria;
+    for (const auto& name : split(policy))
+    {
+        auto iter = names.find(name);
+        if (iter == names.end())
+        {
+            lg2::error("Unknown dump rotation criterion {NAME}", "NAME",
+                       name);
+            continue;
+        }
+        if (std::find(criteria.begin(), criteria.end(), iter->second) ==
+            criteria.end())
+        {
+            criteria.push_back(iter->second);
+        }
+    }
+    return criteria;
+}
+
+unsigned typeRank(const std::string& order, const std::string& type)
+{
+    auto types = split(order);
+    return std::find(types.begin(), types.end(), type) - types.begin();
+}
+
+std::set<std::pair<dev_t, ino_t>> openFiles()
+{
+    std::set<std::pair<dev_t, ino_t>> files;
+    std::error_code ec;
+    for (const auto& process : std::filesystem::directory_iterator("/proc", ec))
+    {
+        auto pid = process.path().filename().string();
+        if (!std::all_of(pid.begin(), pid.end(), ::isdigit))
+        {
+            continue;
+        }
+
+        // Processes exit and close files meanwhile, errors are skipped
+        std::error_code fdError;
+        for (const auto& fd : std::filesystem::directory_iterator(
+                 process.path() / "fd", fdError))
+        {
+            struct stat st{};
+            if (stat(fd.path().c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            {
+                files.emplace(st.st_dev, st.st_ino);
+            }
+        }
+    }
+    return files;
+}
+
+Index::Index(const std::vector<Criterion>& policy) :
+    policy(policy.begin(),
+           policy.begin() + std::min(policy.size(), Key().size() - 1))
+{}
+
+Index::Key Index::makeKey(const Candidate& candidate) const
+{
+    Key key{};
+    for (size_t i = 0; i < policy.size(); ++i)
+    {
+        switch (policy[i])
+        {
+            case Criterion::offloaded:
+                key[i] = candidate.offloaded ? 0 : 1;
+                break;
+            case Criterion::type:
+                key[i] = candidate.typeRank;
+                break;
+            case Criterion::oldest:
+                key[i] = candidate.timestamp;
+                break;
+            case Criterion::largest:
+                key[i] = UINT64_MAX - candidate.size;
+                break;
+        }
+    }
+    key.back() = candidate.id;
+    return key;
+}
+
+void Index::insert(const Candidate& candidate)
+{
+    erase(candidate.id);
+    order.insert(makeKey(candidate));
+    candidates.emplace(candidate.id, candidate);
+    if (candidate.baselineId != 0)
+    {
+        ++deltas[candidate.baselineId];
+    }
+}
+
+void Index::erase(uint32_t id)
+{
+    auto iter = candidates.find(id);
+    if (iter == candidates.end())
+    {
+        return;
+    }
+    order.erase(makeKey(iter->second));
+    if (auto base = iter->second.baselineId; base != 0 && --deltas[base] == 0)
+    {
+        deltas.erase(base);
+    }
+    candidates.erase(iter);
+}
+
+std::vector<uint32_t> Index::select(
+    uint64_t needed, const std::function<bool(uint32_t)>& pinned) const
+{
+    std::vector<uint32_t> victims;
+    uint64_t freed = 0;
+
+    // Delta dumps selected by baseline id, and baselines waiting for them
+    std::unordered_map<uint32_t, size_t> evicted;
+    std::unordered_set<uint32_t> deferred;
+
+    for (auto key = order.begin(); key != order.end() && freed < needed; ++key)
+    {
+        const auto& candidate = candidates.at(key->back());
+        if (candidate.inProgress || (pinned && pinned(candidate.id)))
+        {
+            continue;
+        }
+        if (auto count = deltas.find(candidate.id);
+            count != deltas.end() && evicted[candidate.id] < count->second)
+        {
+            deferred.insert(candidate.id);
+            continue;
+        }
+
+        victims.push_back(candidate.id);
+        freed += candidate.size;
+
+        // A baseline passed over follows the last of its delta dumps
+        auto base = candidate.baselineId;
+        if (base != 0 && ++evicted[base] == deltas.at(base) &&
+            deferred.erase(base) != 0 && freed < needed)
+        {
+            victims.push_back(base);
+            freed += candidates.at(base).size;
+        }
+    }
+    return victims;
+}
+
+} // namespace rotation
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace rotation
+{
+
+/** @brief Criteria of the eviction order */
+enum class Criterion
+{
+    /** @brief Dumps which were offloaded first */
+    offloaded,
+
+    /** @brief Dumps of the lowest priority type first */
+    type,
+
+    /** @brief Oldest dumps first */
+    oldest,
+
+    /** @brief Largest dumps first */
+    largest,
+};
+
+/** @brief Parse an eviction policy.
+ *  @param[in] policy - Comma separated criteria, most significant first,
+ *                      for example "offloaded,oldest".
+ *  @return The criteria, unknown names are logged and ignored.
+ */
+std::vector<Criterion> parsePolicy(const std::string& policy);
+
+/** @brief Rank of a dump type in the eviction order.
+ *  @param[in] order - Comma separated dump types, the first is evicted
+ *                     first, for example "elog,core,user".
+ *  @param[in] type - Collection type of the dump, for example "elog".
+ *  @return The position of the type, types not listed rank last.
+ */
+unsigned typeRank(const std::string& order, const std::string& type);
+
+/** @brief Files which are open in any process, by device and inode.
+ *  @details Reads /proc/<pid>/fd of all processes, used to keep the dumps
+ *  a client is reading through GetFileHandle, which deleting would not
+ *  free.
+ */
+std::set<std::pair<dev_t, ino_t>> openFiles();
+
+/** @struct Candidate
+ *  @brief The properties of a dump which the eviction order uses.
+ */
+struct Candidate
+{
+    /** @brief Dump id */
+    uint32_t id = 0;
+
+    /** @brief Completion time */
+    uint64_t timestamp = 0;
+
+    /** @brief Space used in kilobytes */
+    uint64_t size = 0;
+
+    /** @brief Rank of the dump type, see typeRank() */
+    unsigned typeRank = 0;
+
+    /** @brief Whether the dump was offloaded */
+    bool offloaded = false;
+
+    /** @brief Whether the dump is being collected, which is never evicted
+     */
+    bool inProgress = false;
+
+    /** @brief Id of the baseline of a delta dump, 0 for a complete dump */
+    uint32_t baselineId = 0;
+};
+
+/** @class Index
+ *  @brief The dumps in eviction order.
+ *  @details The dumps are kept ordered by the criteria of the policy, with
+ *  the dump id breaking ties, so updating a dump and finding the next
+ *  victim are O(log n). A baseline is only evicted after the delta dumps
+ *  which take items from it.
+ */
+class Index
+{
+  public:
+    Index() = delete;
+    Index(const Index&) = delete;
+    Index& operator=(const Index&) = delete;
+    Index(Index&&) = delete;
+    Index& operator=(Index&&) = delete;
+    ~Index() = default;
+
+    /** @brief Constructor
+     *  @param[in] policy - The criteria of the eviction order, most
+     *                      significant first; dumps are evicted by id if
+     *                      empty.
+     */
+    explicit Index(const std::vector<Criterion>& policy);
+
+    /** @brief Add a dump or update it */
+    void insert(const Candidate& candidate);
+
+    /** @brief Remove a dump */
+    void erase(uint32_t id);
+
+    /** @brief Number of dumps */
+    size_t size() const
+    {
+        return candidates.size();
+    }
+
+    /** @brief Select the dumps to evict to free space, in a single pass in
+     *         eviction order.
+     *  @param[in] needed - Space to free in kilobytes.
+     *  @param[in] pinned - Dumps which must not be evicted, none if empty.
+     *  @return The victims in the order to delete them, fewer than needed
+     *          if not enough dumps can be evicted.
+     */
+    std::vector<uint32_t> select(
+        uint64_t needed,
+        const std::function<bool(uint32_t)>& pinned = {}) const;
+
+  private:
+    // Criteria values followed by the dump id, ascending in eviction order
+    using Key = std::array<uint64_t, 5>;
+
+    /** @brief The eviction key of a dump */
+    Key makeKey(const Candidate& candidate) const;
+
+    /** @brief Criteria of the eviction order */
+    std::vector<Criterion> policy;
+
+    /** @brief The dumps in eviction order */
+    std::set<Key> order;
+
+    /** @brief The dumps by id */
+    std::unordered_map<uint32_t, Candidate> candidates;
+
+    /** @brief Number of delta dumps by baseline id */
+    std::unordered_map<uint32_t, size_t> deltas;
+};
+
+} // namespace rotation
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,214 @@
+#include "dump_space.hpp"
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace space
+{
+
+namespace
+{
+
+/** @brief Space used by a file in kilobytes, rounded up */
+uint64_t fileSize(const std::filesystem::directory_entry& p)
+{
+    std::error_code ec;
+    auto size = p.file_size(ec);
+    return ec ? 0 : (size + 1023) / 1024;
+}
+
+/** @brief Space used by an entry of the dump directory in kilobytes */
+uint64_t entrySize(const std::filesystem::directory_entry& p)
+{
+    std::error_code ec;
+    if (p.is_directory(ec))
+    {
+        return directorySize(p.path());
+    }
+    return p.is_regular_file(ec) ? fileSize(p) : 0;
+}
+
+} // namespace
+
+uint64_t directorySize(const std::filesystem::path& dir)
+{
+    uint64_t size = 0;
+    std::error_code ec;
+    for (auto p = std::filesystem::recursive_directory_iterator(dir, ec);
+         !ec && p != std::filesystem::recursive_directory_iterator();
+         p.increment(ec))
+    {
+        if (!p->is_directory(ec))
+        {
+            size += fileSize(*p);
+        }
+    }
+    return size;
+}
+
+std::map<std::string, uint64_t> measure(const std::filesystem::path& dumpDir)
+{
+    std::map<std::string, uint64_t> measured;
+    std::error_code ec;
+    for (const auto& p : std::filesystem::directory_iterator(dumpDir, ec))
+    {
+        measured.emplace(p.path().filename().string(), entrySize(p));
+    }
+    return measured;
+}
+
+void Ledger::seed()
+{
+    seed(measure(dumpDir));
+}
+
+void Ledger::seed(std::map<std::string, uint64_t>&& estimates)
+{
+    std::lock_guard lock(mutex);
+    entries = std::move(estimates);
+    total = 0;
+    for (const auto& [name, size] : entries)
+    {
+        total += size;
+    }
+    ++generation;
+}
+
+void Ledger::update(uint32_t id)
+{
+    auto name = std::to_string(id);
+    auto size = directorySize(dumpDir / name);
+    std::lock_guard lock(mutex);
+    set(name, size);
+}
+
+void Ledger::update(const std::string& name, uint64_t size)
+{
+    std::lock_guard lock(mutex);
+    set(name, size);
+}
+
+void Ledger::updateDeleted(const std::string& name, uint64_t size)
+{
+    std::lock_guard lock(mutex);
+    deleted.insert(name);
+    set(name, size);
+}
+
+void Ledger::erase(uint32_t id)
+{
+    std::lock_guard lock(mutex);
+    set(std::to_string(id), 0);
+}
+
+uint64_t Ledger::usage(uint32_t id) const
+{
+    std::lock_guard lock(mutex);
+    auto iter = entries.find(std::to_string(id));
+    return iter == entries.end() ? 0 : iter->second;
+}
+
+uint64_t Ledger::available() const
+{
+    std::lock_guard lock(mutex);
+    return free();
+}
+
+uint64_t Ledger::reserve(uint32_t id, uint64_t size)
+{
+    std::lock_guard lock(mutex);
+    auto granted = std::min(size, reservations[id] + free());
+    reservations[id] = granted;
+    return granted;
+}
+
+bool Ledger::resize(uint32_t id, uint64_t size)
+{
+    std::lock_guard lock(mutex);
+    auto& reserved = reservations[id];
+    if (size > reserved + free())
+    {
+        return false;
+    }
+    reserved = size;
+    return true;
+}
+
+void Ledger::release(uint32_t id)
+{
+    std::lock_guard lock(mutex);
+    reservations.erase(id);
+}
+
+uint64_t Ledger::free() const
+{
+    // A dump counts with the larger of its reservation and its measured
+    // size, which the collection grows into
+    auto used = total;
+    for (const auto& [id, reserved] : reservations)
+    {
+        auto iter = entries.find(std::to_string(id));
+        auto measured = iter == entries.end() ? 0 : iter->second;
+        used += reserved - std::min(reserved, measured);
+    }
+    for (const auto& name : deleted)
+    {
+        auto iter = entries.find(name);
+        if (iter != entries.end())
+        {
+            used -= std::min(used, iter->second);
+        }
+    }
+    return used > capacity ? 0 : capacity - used;
+}
+
+bool Ledger::reconcile(std::map<std::string, uint64_t>&& measured,
+                       uint64_t generation)
+{
+    std::lock_guard lock(mutex);
+    if (generation != this->generation)
+    {
+        return false;
+    }
+
+    uint64_t sum = 0;
+    for (const auto& [name, size] : measured)
+    {
+        sum += size;
+    }
+    if (sum != total)
+    {
+        lg2::info("Dump space ledger corrected, recorded: {RECORDED} KiB, "
+                  "used: {USED} KiB",
+                  "RECORDED", total, "USED", sum);
+    }
+    entries = std::move(measured);
+    total = sum;
+    ++this->generation;
+    return true;
+}
+
+void Ledger::set(const std::string& name, uint64_t size)
+{
+    auto iter = entries.find(name);
+    if (iter != entries.end())
+    {
+        total -= iter->second;
+        entries.erase(iter);
+    }
+    if (size > 0)
+    {
+        entries.emplace(name, size);
+        total += size;
+    }
+    ++generation;
+}
+
+} // namespace space
+} // namespace dump
+} // namespace phosphor
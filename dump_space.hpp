@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace space
+{
+
+/** @brief Space used by the files of a directory tree in kilobytes, every
+ *         file rounded up to a full kilobyte.
+ */
+uint64_t directorySize(const std::filesystem::path& dir);
+
+/** @brief Space used by the entries of the dump directory.
+ *  @details Walks the complete dump directory, which is slow on flash with
+ *  many dumps, meant to run on a worker thread.
+ *  @param[in] dumpDir - The dump directory.
+ *  @return Kilobytes by entry name, the dump id for a dump.
+ */
+std::map<std::string, uint64_t> measure(const std::filesystem::path& dumpDir);
+
+/** @class Ledger
+ *  @brief Space used by the dumps, kept up to date from the entry events.
+ *  @details The ledger is seeded with a walk of the dump directory at
+ *  startup, afterwards only the directory of a dump created or updated is
+ *  measured, which makes the quota decisions of CreateDump independent of
+ *  the number of dumps. A periodic reconciliation replaces the ledger with
+ *  a walk of the dump directory taken on a worker thread, which picks up
+ *  changes the events miss.
+ *
+ *  The space of the dumps being collected is reserved from the capacity
+ *  of the dump directory, a dump counts with the larger of its reservation
+ *  and its measured size, so the concurrent collections share the free
+ *  space without overrunning it. The reservations are resized by the
+ *  collection threads, all the methods are thread-safe.
+ */
+class Ledger
+{
+  public:
+    Ledger() = delete;
+    Ledger(const Ledger&) = delete;
+    Ledger& operator=(const Ledger&) = delete;
+    Ledger(Ledger&&) = delete;
+    Ledger& operator=(Ledger&&) = delete;
+    ~Ledger() = default;
+
+    /** @brief Constructor
+     *  @param[in] dumpDir - The dump directory, <dumpDir>/<id> per dump.
+     *  @param[in] capacity - Space the dumps may use in kilobytes.
+     */
+    Ledger(const std::filesystem::path& dumpDir, uint64_t capacity) :
+        dumpDir(dumpDir), capacity(capacity)
+    {}
+
+    /** @brief Measure every entry of the dump directory */
+    void seed();
+
+    /** @brief Seed the ledger with estimates, which the next
+     *         reconciliation replaces.
+     *  @param[in] estimates - Kilobytes by entry name.
+     */
+    void seed(std::map<std::string, uint64_t>&& estimates);
+
+    /** @brief Measure a dump which was created or updated.
+     *  @param[in] id - Dump id.
+     */
+    void update(uint32_t id);
+
+    /** @brief Set the space used by an entry of the dump directory which
+     *         is not a dump, the chunk store among others.
+     *  @param[in] name - Name of the entry.
+     *  @param[in] size - Kilobytes, 0 to remove it.
+     */
+    void update(const std::string& name, uint64_t size);
+
+    /** @brief Set the space used by an entry of the dump directory which
+     *         is being removed in the background, it is counted as free
+     *         by the reservations.
+     *  @param[in] name - Name of the entry.
+     *  @param[in] size - Kilobytes, 0 to remove it.
+     */
+    void updateDeleted(const std::string& name, uint64_t size);
+
+    /** @brief Remove a deleted dump.
+     *  @param[in] id - Dump id.
+     */
+    void erase(uint32_t id);
+
+    /** @brief Space used by the dump directory in kilobytes */
+    uint64_t usage() const
+    {
+        std::lock_guard lock(mutex);
+        return total;
+    }
+
+    /** @brief Space used by a dump in kilobytes, 0 if unknown */
+    uint64_t usage(uint32_t id) const;
+
+    /** @brief Space neither used nor reserved in kilobytes */
+    uint64_t available() const;
+
+    /** @brief Reserve space for a dump, up to the space available.
+     *  @param[in] id - Dump id.
+     *  @param[in] size - Kilobytes wanted.
+     *  @return Kilobytes reserved, which may be less than wanted.
+     */
+    uint64_t reserve(uint32_t id, uint64_t size);
+
+    /** @brief Grow or shrink the reservation of a dump.
+     *  @param[in] id - Dump id.
+     *  @param[in] size - Kilobytes of the new reservation.
+     *  @return false if the space to grow it is not available, the
+     *          reservation is then unchanged.
+     */
+    bool resize(uint32_t id, uint64_t size);
+
+    /** @brief Release the reservation of a dump, which then counts with its
+     *         measured size only.
+     *  @param[in] id - Dump id.
+     */
+    void release(uint32_t id);
+
+    /** @brief Number of changes so far, taken before measure() to
+     *         reconcile with its result.
+     */
+    uint64_t getGeneration() const
+    {
+        std::lock_guard lock(mutex);
+        return generation;
+    }
+
+    /** @brief Replace the ledger with a measurement of the dump directory.
+     *  @param[in] measured - Result of measure().
+     *  @param[in] generation - getGeneration() before the measurement.
+     *  @return false if the ledger changed during the measurement, which
+     *          may then be out of date, and was kept.
+     */
+    bool reconcile(std::map<std::string, uint64_t>&& measured,
+                   uint64_t generation);
+
+  private:
+    /** @brief Set the space used by an entry of the dump directory, with
+     *         the mutex held */
+    void set(const std::string& name, uint64_t size);
+
+    /** @brief Space neither used nor reserved, with the mutex held */
+    uint64_t free() const;
+
+    /** @brief The dump directory */
+    std::filesystem::path dumpDir;
+
+    /** @brief Space the dumps may use in kilobytes */
+    uint64_t capacity;
+
+    /** @brief Kilobytes by entry name of the dump directory */
+    std::map<std::string, uint64_t> entries;
+
+    /** @brief Sum of the entries */
+    uint64_t total = 0;
+
+    /** @brief Names of the entries being removed in the background */
+    std::set<std::string> deleted;
+
+    /** @brief Kilobytes reserved by dump id */
+    std::map<uint32_t, uint64_t> reservations;
+
+    /** @brief Change counter */
+    uint64_t generation = 0;
+
+    /** @brief Serializes the collection threads and the event loop */
+    mutable std::mutex mutex;
+};
+
+} // namespace space
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,299 @@
+#include "config.h"
+
+#include "dump_tier.hpp"
+
+#include "dump_space.hpp"
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace tier
+{
+
+namespace
+{
+
+// Most bytes copied by a call when committing an archive
+constexpr size_t COPY_SIZE = 1024 * 1024;
+
+std::atomic<uint64_t> ramWritten{0};
+std::atomic<uint64_t> flashWritten{0};
+
+/** @brief Copy a file from its start into another, in the kernel where
+ *         supported.
+ *  @return true on success.
+ */
+bool copyFile(int in, int out, uint64_t size)
+{
+    off_t offset = 0;
+    while (static_cast<uint64_t>(offset) < size)
+    {
+        auto count = sendfile(out, in, &offset,
+                              std::min<uint64_t>(COPY_SIZE, size - offset));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0 && (errno == EINVAL || errno == ENOSYS))
+        {
+            break;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+    }
+
+    // Not a file sendfile(2) copies, through a buffer of a fixed size
+    auto buffer = std::make_unique<char[]>(COPY_SIZE);
+    while (static_cast<uint64_t>(offset) < size)
+    {
+        auto count = pread(in, buffer.get(),
+                           std::min<uint64_t>(COPY_SIZE, size - offset),
+                           offset);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        for (ssize_t done = 0; done < count;)
+        {
+            auto written = write(out, buffer.get() + done, count - done);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written < 0)
+            {
+                return false;
+            }
+            done += written;
+        }
+        offset += count;
+    }
+    return true;
+}
+
+} // namespace
+
+Tier of(const std::filesystem::path& path)
+{
+    auto relative = path.lexically_normal().lexically_relative(
+        std::filesystem::path(BMC_DUMP_STAGING_PATH).lexically_normal());
+    return relative.empty() || *relative.begin() == ".." ? Tier::flash
+                                                         : Tier::ram;
+}
+
+void written(const std::filesystem::path& path, uint64_t bytes)
+{
+    (of(path) == Tier::ram ? ramWritten : flashWritten) += bytes;
+}
+
+uint64_t bytesWritten(Tier tier)
+{
+    return tier == Tier::ram ? ramWritten.load() : flashWritten.load();
+}
+
+bool isRamOnly(const std::string& type)
+{
+    std::istringstream types(BMC_DUMP_STAGING_RAM_ONLY_TYPES);
+    std::string name;
+    while (std::getline(types, name, ','))
+    {
+        if (name == type)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::optional<std::filesystem::path> commit(
+    const std::filesystem::path& archive, const std::filesystem::path& dir)
+{
+    int in = open(archive.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st{};
+    if (in < 0 || fstat(in, &st) < 0)
+    {
+        auto error = errno;
+        lg2::error("Failed to read the staged dump {PATH}, errno: {ERRNO}",
+                   "PATH", archive, "ERRNO", error);
+        if (in >= 0)
+        {
+            close(in);
+        }
+        return std::nullopt;
+    }
+
+    // Copied under a hidden name and renamed into place once synced
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    auto path = dir / archive.filename();
+    auto temp = dir / ("." + archive.filename().string() + ".tmp");
+    int out = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644);
+    auto copied = out >= 0 && copyFile(in, out, st.st_size) &&
+                  fsync(out) == 0;
+    auto error = errno;
+    close(in);
+    if (out >= 0)
+    {
+        close(out);
+    }
+    if (copied)
+    {
+        std::filesystem::rename(temp, path, ec);
+        error = ec.value();
+    }
+    if (!copied || ec)
+    {
+        lg2::error("Failed to commit the staged dump {PATH} to flash, "
+                   "errno: {ERRNO}",
+                   "PATH", archive, "ERRNO", error);
+        std::filesystem::remove(temp, ec);
+        return std::nullopt;
+    }
+    written(path, st.st_size);
+
+    // Persist the rename, errors only lose the dump on a power loss
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+    return path;
+}
+
+std::optional<std::filesystem::path> Staging::reserve(uint32_t id,
+                                                      uint64_t size)
+{
+    if (!enabled() || total + size > capacity)
+    {
+        return std::nullopt;
+    }
+
+    auto path = dir / std::to_string(id);
+    std::error_code ec;
+    std::filesystem::create_directories(path, ec);
+    if (ec)
+    {
+        lg2::error("Failed to create the staging directory {PATH}, "
+                   "error: {ERROR}",
+                   "PATH", path, "ERROR", ec.message());
+        return std::nullopt;
+    }
+    set(id, size);
+    return path;
+}
+
+void Staging::keep(uint32_t id)
+{
+    set(id, space::directorySize(dir / std::to_string(id)));
+}
+
+void Staging::release(uint32_t id)
+{
+    std::error_code ec;
+    std::filesystem::remove_all(dir / std::to_string(id), ec);
+    set(id, 0);
+}
+
+void Staging::seed()
+{
+    dumps.clear();
+    total = 0;
+    std::error_code ec;
+    for (const auto& p : std::filesystem::directory_iterator(dir, ec))
+    {
+        auto idStr = p.path().filename().string();
+        if (p.is_directory() && !idStr.empty() &&
+            std::all_of(idStr.begin(), idStr.end(), ::isdigit))
+        {
+            set(std::stoul(idStr), space::directorySize(p.path()));
+        }
+    }
+}
+
+void Staging::set(uint32_t id, uint64_t size)
+{
+    auto iter = dumps.find(id);
+    if (iter != dumps.end())
+    {
+        total -= iter->second;
+        dumps.erase(iter);
+    }
+    if (size > 0)
+    {
+        dumps.emplace(id, size);
+        total += size;
+    }
+}
+
+void report(const Staging& staging, uint64_t flashUsage,
+            uint64_t flashCapacity)
+{
+    nlohmann::json usage = {
+        {"ram",
+         {{"usedKiB", staging.usage()},
+          {"capacityKiB", staging.getCapacity()},
+          {"bytesWritten", bytesWritten(Tier::ram)}}},
+        {"flash",
+         {{"usedKiB", flashUsage},
+          {"capacityKiB", flashCapacity},
+          {"bytesWritten", bytesWritten(Tier::flash)}}}};
+
+    // Replaced in one step for the readers, not synced as it is in RAM
+    std::error_code ec;
+    std::filesystem::create_directories(staging.getDir(), ec);
+    auto path = staging.getDir() / USAGE_FILE;
+    auto temp = staging.getDir() / ("." + std::string(USAGE_FILE) + ".tmp");
+    {
+        std::ofstream os(temp, std::ios::trunc);
+        os << usage.dump() << "\n";
+        if (!os.good())
+        {
+            lg2::error("Failed to write the dump tier usage to {PATH}",
+                       "PATH", temp);
+            return;
+        }
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec)
+    {
+        lg2::error("Failed to publish the dump tier usage, error: {ERROR}",
+                   "ERROR", ec.message());
+    }
+
+    lg2::debug("Dump tiers, RAM: {RAM_KIB} KiB of {RAM_CAPACITY} KiB, "
+               "{RAM_WRITTEN} bytes written, flash: {FLASH_KIB} KiB of "
+               "{FLASH_CAPACITY} KiB, {FLASH_WRITTEN} bytes written",
+               "RAM_KIB", staging.usage(), "RAM_CAPACITY",
+               staging.getCapacity(), "RAM_WRITTEN", bytesWritten(Tier::ram),
+               "FLASH_KIB", flashUsage, "FLASH_CAPACITY", flashCapacity,
+               "FLASH_WRITTEN", bytesWritten(Tier::flash));
+}
+
+} // namespace tier
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace tier
+{
+
+// Usage and bytes written of the tiers, <BMC_DUMP_STAGING_PATH>/<USAGE_FILE>
+constexpr auto USAGE_FILE = "tier-usage.json";
+
+/** @brief Tiers of the dump storage */
+enum class Tier
+{
+    ram,
+    flash,
+};
+
+/** @brief Tier of a path of the dump storage, the RAM tier below
+ *         BMC_DUMP_STAGING_PATH and flash otherwise.
+ */
+Tier of(const std::filesystem::path& path);
+
+/** @brief Account data written to the dump storage, thread-safe.
+ *  @param[in] path - Path of the file written.
+ *  @param[in] bytes - Number of bytes written.
+ */
+void written(const std::filesystem::path& path, uint64_t bytes);
+
+/** @brief Bytes written to a tier since the start of the service */
+uint64_t bytesWritten(Tier tier);
+
+/** @brief Whether dumps of a type stay in the RAM tier until they are
+ *         offloaded, see BMC_DUMP_STAGING_RAM_ONLY_TYPES.
+ */
+bool isRamOnly(const std::string& type);
+
+/** @brief Commit an archive assembled in the RAM tier to flash.
+ *  @details The archive is copied in large sequential writes, without
+ *  being held in memory, and synced once, instead of the many small writes
+ *  and rewrites of its assembly.
+ *  @param[in] archive - The archive in the RAM tier.
+ *  @param[in] dir - The dump directory on flash, <BMC_DUMP_PATH>/<id>.
+ *  @return Path of the archive on flash, std::nullopt on failure.
+ */
+std::optional<std::filesystem::path> commit(
+    const std::filesystem::path& archive, const std::filesystem::path& dir);
+
+/** @class Staging
+ *  @brief The RAM tier of the dump storage, bounded in size.
+ *  @details Dumps are collected into <dir>/<id> and committed to flash
+ *  once complete, the dumps of RAM-only types stay until they are
+ *  offloaded and deleted. A collection reserves its allowed size, which
+ *  is replaced by the size of the dump once it completes.
+ */
+class Staging
+{
+  public:
+    Staging() = delete;
+    Staging(const Staging&) = delete;
+    Staging& operator=(const Staging&) = delete;
+    Staging(Staging&&) = delete;
+    Staging& operator=(Staging&&) = delete;
+    ~Staging() = default;
+
+    /** @brief Constructor
+     *  @param[in] dir - The staging directory.
+     *  @param[in] capacity - Size of the tier in kilobytes, 0 disables it.
+     */
+    Staging(const std::filesystem::path& dir, uint64_t capacity) :
+        dir(dir), capacity(capacity)
+    {}
+
+    /** @brief Whether the tier is enabled */
+    bool enabled() const
+    {
+        return capacity != 0;
+    }
+
+    /** @brief Reserve space for a collection.
+     *  @param[in] id - Dump id.
+     *  @param[in] size - Allowed size of the dump in kilobytes.
+     *  @return The directory of the dump in the tier, std::nullopt if the
+     *          tier is disabled or full.
+     */
+    std::optional<std::filesystem::path> reserve(uint32_t id, uint64_t size);
+
+    /** @brief Replace the reservation of a completed dump which stays in
+     *         the tier with its size.
+     */
+    void keep(uint32_t id);
+
+    /** @brief Remove a dump from the tier, once committed or deleted */
+    void release(uint32_t id);
+
+    /** @brief Measure the dumps left in the tier by an earlier instance of
+     *         the service.
+     */
+    void seed();
+
+    /** @brief The directory of the tier */
+    const std::filesystem::path& getDir() const
+    {
+        return dir;
+    }
+
+    /** @brief Space used and reserved in kilobytes */
+    uint64_t usage() const
+    {
+        return total;
+    }
+
+    /** @brief Space used or reserved by a dump in kilobytes */
+    uint64_t usage(uint32_t id) const
+    {
+        auto iter = dumps.find(id);
+        return iter != dumps.end() ? iter->second : 0;
+    }
+
+    /** @brief Size of the tier in kilobytes */
+    uint64_t getCapacity() const
+    {
+        return capacity;
+    }
+
+  private:
+    /** @brief Set the space of a dump */
+    void set(uint32_t id, uint64_t size);
+
+    /** @brief The staging directory */
+    std::filesystem::path dir;
+
+    /** @brief Size of the tier in kilobytes */
+    uint64_t capacity;
+
+    /** @brief Kilobytes by dump id */
+    std::map<uint32_t, uint64_t> dumps;
+
+    /** @brief Sum of the dumps */
+    uint64_t total = 0;
+};
+
+/** @brief Publish the usage of the tiers and their bytes written to
+ *         <BMC_DUMP_STAGING_PATH>/<USAGE_FILE>, which is in RAM.
+ *  @param[in] staging - The RAM tier.
+ *  @param[in] flashUsage - Space of the dumps on flash in kilobytes.
+ *  @param[in] flashCapacity - Size of the dump space on flash in kilobytes.
+ */
+void report(const Staging& staging, uint64_t flashUsage,
+            uint64_t flashCapacity);
+
+} // namespace tier
+} // namespace dump
+} // namespace phosphor
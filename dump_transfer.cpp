@@ -0,0 +1,119 @@
+#include "dump_transfer.hpp"
+
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace transfer
+{
+
+namespace
+{
+
+/** @brief Whether an error means the socket is full for now */
+bool isFull(int error)
+{
+    return error == EAGAIN || error == EWOULDBLOCK || error == EINTR;
+}
+
+} // namespace
+
+uint64_t sendSome(int socket, const void* data, uint64_t size)
+{
+    const auto* bytes = static_cast<const char*>(data);
+    uint64_t done = 0;
+    while (done < size)
+    {
+        auto count = write(socket, bytes + done, size - done);
+        if (count >= 0)
+        {
+            done += count;
+            continue;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if (isFull(errno))
+        {
+            break;
+        }
+        lg2::error("write() on the socket failed, errno: {ERRNO}", "ERRNO",
+                   errno);
+        throw std::runtime_error("write() on socket failed " +
+                                 std::string(strerror(errno)));
+    }
+    return done;
+}
+
+uint64_t sendFileSome(int socket, int fd, uint64_t offset, uint64_t size)
+{
+    // sendfile(2) returns 0 for an empty range without setting errno
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    off_t position = offset;
+    auto count = std::min(SEND_SIZE, size);
+    while (true)
+    {
+        auto sent = sendfile(socket, fd, &position, count);
+        if (sent > 0)
+        {
+            return sent;
+        }
+        if (sent == 0)
+        {
+            throw std::runtime_error("The file is shorter than expected");
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if (isFull(errno))
+        {
+            return 0;
+        }
+        if (errno == EINVAL || errno == ENOSYS)
+        {
+            break;
+        }
+        lg2::error("sendfile() failed, errno: {ERRNO}", "ERRNO", errno);
+        throw std::runtime_error("sendfile() failed " +
+                                 std::string(strerror(errno)));
+    }
+
+    // Not a file sendfile(2) reads from, copied through a buffer
+    auto buffer = std::make_unique<char[]>(count);
+    ssize_t read = 0;
+    while ((read = pread(fd, buffer.get(), count, offset)) < 0 &&
+           errno == EINTR)
+    {}
+    if (read == 0)
+    {
+        throw std::runtime_error("The file is shorter than expected");
+    }
+    if (read < 0)
+    {
+        throw std::runtime_error("read() failed " +
+                                 std::string(strerror(errno)));
+    }
+    return sendSome(socket, buffer.get(), read);
+}
+
+} // namespace transfer
+} // namespace dump
+} // namespace phosphor
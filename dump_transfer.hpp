@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace transfer
+{
+
+// Largest piece handed to sendfile(2) at a time, bounds the time a send
+// holds up the event loop
+constexpr uint64_t SEND_SIZE = 1024 * 1024;
+
+// Seconds a non-blocking socket may stay full before the transfer fails
+constexpr int SOCKET_TIMEOUT = 5;
+
+/** @brief Write as much of a buffer as a non-blocking socket takes without
+ *         blocking.
+ *  @param[in] socket - The socket.
+ *  @param[in] data - The data.
+ *  @param[in] size - Size of the data in bytes.
+ *  @return Bytes written, 0 if the socket is full.
+ *  @throws std::runtime_error on a failure.
+ */
+uint64_t sendSome(int socket, const void* data, uint64_t size);
+
+/** @brief Send as much of a range of a file as a non-blocking socket takes
+ *         without blocking, at most SEND_SIZE bytes.
+ *  @param[in] socket - The socket.
+ *  @param[in] fd - Descriptor of the file.
+ *  @param[in] offset - Offset of the range in the file.
+ *  @param[in] size - Size of the range in bytes.
+ *  @return Bytes sent, 0 if the socket is full.
+ *  @throws std::runtime_error on a failure or if the file is shorter than
+ *          the range.
+ */
+uint64_t sendFileSome(int socket, int fd, uint64_t offset, uint64_t size);
+
+} // namespace transfer
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,309 @@
+#include "dump_trash.hpp"
+
+#include "dump_space.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace trash
+{
+
+namespace
+{
+
+/** @brief Persist the entries of a directory, errors only bring a
+ *         deletion back on a power loss */
+void syncDirectory(const std::filesystem::path& dir)
+{
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+} // namespace
+
+Reaper::~Reaper()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    queued.notify_all();
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+bool Reaper::bury(const std::filesystem::path& dir, uint64_t size)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(trash, ec);
+
+    // A dump id reused after a restart may still be in the trash
+    while (true)
+    {
+        auto path = trash / (dir.filename().string() + "." +
+                             std::to_string(sequence++));
+        if (rename(dir.c_str(), path.c_str()) == 0)
+        {
+            enqueue(Job{path, size, {}, {}});
+            return true;
+        }
+        if (errno != EEXIST && errno != ENOTEMPTY)
+        {
+            break;
+        }
+    }
+
+    auto error = errno;
+    if (error == ENOENT)
+    {
+        return false;
+    }
+
+    // Removed in place then, blocking the caller
+    lg2::error("Failed to move {PATH} to the trash, errno: {ERRNO}", "PATH",
+               dir, "ERRNO", error);
+    std::filesystem::remove_all(dir, ec);
+    return true;
+}
+
+void Reaper::discard(std::vector<std::filesystem::path>&& files,
+                     uint64_t size, Remover remover)
+{
+    if (!files.empty())
+    {
+        enqueue(Job{{}, size, std::move(files), std::move(remover)});
+    }
+}
+
+void Reaper::resume()
+{
+    std::error_code ec;
+    for (const auto& p : std::filesystem::directory_iterator(trash, ec))
+    {
+        enqueue(Job{p.path(), std::nullopt, {}, {}});
+    }
+}
+
+uint64_t Reaper::usage() const
+{
+    std::lock_guard lock(mutex);
+    return pending - std::min(currentFreed, currentSize);
+}
+
+void Reaper::enqueue(Job&& job)
+{
+    std::lock_guard lock(mutex);
+    pending += job.size.value_or(0);
+    queue.push_back(std::move(job));
+    queued.notify_one();
+
+    // Started with the lock held, jobs are queued from several threads
+    if (!worker.joinable())
+    {
+        try
+        {
+            worker = std::thread(&Reaper::work, this);
+        }
+        catch (const std::system_error& e)
+        {
+            // The trash is removed after the next start
+            lg2::error("Failed to start the dump removal, error: {ERROR}",
+                       "ERROR", e);
+        }
+    }
+}
+
+void Reaper::work()
+{
+    // Jobs queued before the last sync of the dump directory
+    size_t covered = 0;
+    while (true)
+    {
+        Job job;
+        bool sync = false;
+        {
+            std::unique_lock lock(mutex);
+            queued.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (stopping)
+            {
+                return;
+            }
+            if (covered == 0)
+            {
+                sync = true;
+                covered = queue.size();
+            }
+            --covered;
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        // The renames into the trash are made durable once for every batch
+        // of deletions queued meanwhile
+        if (sync)
+        {
+            syncDirectory(dumpDir);
+        }
+
+        // Left by an earlier instance of the service
+        auto size = job.size ? *job.size : space::directorySize(job.path);
+        {
+            std::lock_guard lock(mutex);
+            if (!job.size)
+            {
+                pending += size;
+            }
+            currentSize = size;
+            currentFreed = 0;
+        }
+
+        if (job.remover)
+        {
+            if (!removeFiles(job))
+            {
+                lg2::error("Failed to remove {COUNT} discarded files",
+                           "COUNT", job.files.size());
+            }
+        }
+        else
+        {
+            int fd = open(trash.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            auto done = fd >= 0 &&
+                        removeTree(fd, job.path.filename().string());
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            if (!done)
+            {
+                lg2::error("Failed to remove the deleted dump {PATH}", "PATH",
+                           job.path);
+            }
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            pending -= std::min(pending, size);
+            currentSize = 0;
+            currentFreed = 0;
+            unlinked = 0;
+        }
+        progress();
+    }
+}
+
+bool Reaper::removeTree(int parent, const std::string& name)
+{
+    int fd = openat(parent, name.c_str(),
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return errno == ENOENT;
+    }
+    auto* dir = fdopendir(fd);
+    if (dir == nullptr)
+    {
+        close(fd);
+        return false;
+    }
+
+    // Read completely before the directory changes
+    std::vector<std::string> names;
+    while (auto* entry = readdir(dir))
+    {
+        std::string_view entryName(entry->d_name);
+        if (entryName != "." && entryName != "..")
+        {
+            names.emplace_back(entryName);
+        }
+    }
+
+    auto done = true;
+    for (const auto& entryName : names)
+    {
+        struct stat st{};
+        if (fstatat(fd, entryName.c_str(), &st, AT_SYMLINK_NOFOLLOW) < 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            done = removeTree(fd, entryName);
+        }
+        else if (unlinkat(fd, entryName.c_str(), 0) == 0 || errno == ENOENT)
+        {
+            done = removed(S_ISREG(st.st_mode) ? (st.st_size + 1023) / 1024
+                                               : 0);
+        }
+        else
+        {
+            done = false;
+        }
+        if (!done)
+        {
+            break;
+        }
+    }
+    closedir(dir);
+    return done && (unlinkat(parent, name.c_str(), AT_REMOVEDIR) == 0 ||
+                    errno == ENOENT);
+}
+
+bool Reaper::removeFiles(const Job& job)
+{
+    auto done = true;
+    for (const auto& file : job.files)
+    {
+        done = job.remover(file) && done;
+
+        // The space is accounted once all the files are removed
+        if (!removed(0))
+        {
+            return false;
+        }
+    }
+    return done;
+}
+
+bool Reaper::removed(uint64_t size)
+{
+    bool batch = false;
+    {
+        std::lock_guard lock(mutex);
+        if (stopping)
+        {
+            return false;
+        }
+        currentFreed += size;
+        batch = ++unlinked % BATCH_SIZE == 0;
+    }
+    if (batch)
+    {
+        progress();
+    }
+    return true;
+}
+
+} // namespace trash
+} // namespace dump
+} // namespace phosphor
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace phosphor
+{
+namespace dump
+{
+namespace trash
+{
+
+// Dumps being deleted, <dumpDir>/<TRASH_DIR>/<id>.<sequence>
+constexpr auto TRASH_DIR = ".trash";
+
+// Files unlinked between two reports of the freed space
+constexpr uint64_t BATCH_SIZE = 64;
+
+/** @class Reaper
+ *  @brief Removes the files of deleted dumps on a worker thread.
+ *  @details A deleted dump directory is renamed into the trash, which is
+ *  a single metadata update, and removed in the background with unlinkat()
+ *  relative to the open directories. The trash is the tombstone of the
+ *  deletion, a dump found there at startup is removed again and is no
+ *  longer in the dump directory to be restored.
+ *
+ *  bury() and resume() are called on the event loop, discard() from any
+ *  thread.
+ */
+class Reaper
+{
+  public:
+    /** @brief Notification of a batch of files removed, called on the
+     *         worker thread */
+    using Progress = std::function<void()>;
+
+    /** @brief Removes a discarded file, called on the worker thread.
+     *  @return false on failure.
+     */
+    using Remover = std::function<bool(const std::filesystem::path&)>;
+
+    Reaper() = delete;
+    Reaper(const Reaper&) = delete;
+    Reaper& operator=(const Reaper&) = delete;
+    Reaper(Reaper&&) = delete;
+    Reaper& operator=(Reaper&&) = delete;
+
+    /** @brief Constructor
+     *  @param[in] dumpDir - The dump directory.
+     *  @param[in] progress - Called after every BATCH_SIZE files removed and
+     *                        after every dump.
+     */
+    Reaper(const std::filesystem::path& dumpDir, Progress progress) :
+        dumpDir(dumpDir), trash(dumpDir / TRASH_DIR),
+        progress(std::move(progress))
+    {}
+
+    /** @brief Destructor, stops after the file being removed, the rest of
+     *         the trash is removed after the next start.
+     */
+    ~Reaper();
+
+    /** @brief Delete a dump directory in the background.
+     *  @param[in] dir - The dump directory, <dumpDir>/<id>.
+     *  @param[in] size - Space of the dump in kilobytes.
+     *  @return false if the directory doesn't exist.
+     */
+    bool bury(const std::filesystem::path& dir, uint64_t size);
+
+    /** @brief Delete files outside of the dump directories in the
+     *         background.
+     *  @details The files are not renamed into the trash, the owner of the
+     *  files removes those left by a restart itself. The remover is called
+     *  for every file, so the owner can keep a file which is in use again
+     *  by the time it is removed.
+     *  @param[in] files - The files.
+     *  @param[in] size - Space of the files in kilobytes.
+     *  @param[in] remover - Removes a file.
+     */
+    void discard(std::vector<std::filesystem::path>&& files, uint64_t size,
+                 Remover remover);
+
+    /** @brief Remove the trash left by an earlier instance of the service */
+    void resume();
+
+    /** @brief Space of the dumps not removed yet in kilobytes */
+    uint64_t usage() const;
+
+  private:
+    /** @struct Job
+     *  @brief A dump to remove.
+     */
+    struct Job
+    {
+        /** @brief The dump in the trash */
+        std::filesystem::path path;
+
+        /** @brief Space of the dump in kilobytes, std::nullopt to measure
+         *         it */
+        std::optional<uint64_t> size;
+
+        /** @brief Discarded files, removed instead of the path if there is
+         *         a remover */
+        std::vector<std::filesystem::path> files;
+
+        /** @brief Removes the discarded files */
+        Remover remover;
+    };
+
+    /** @brief Queue a dump and start the worker if needed */
+    void enqueue(Job&& job);
+
+    /** @brief Remove the queued dumps, runs on the worker thread */
+    void work();
+
+    /** @brief Remove a directory tree below an open directory.
+     *  @param[in] parent - Descriptor of the parent directory.
+     *  @param[in] name - Name of the tree.
+     *  @return true on success, false on an error or when stopping.
+     */
+    bool removeTree(int parent, const std::string& name);
+
+    /** @brief Remove discarded files.
+     *  @return true on success, false on an error or when stopping.
+     */
+    bool removeFiles(const Job& job);
+
+    /** @brief Account a removed file.
+     *  @param[in] size - Space of the file in kilobytes.
+     *  @return false when stopping.
+     */
+    bool removed(uint64_t size);
+
+    /** @brief The dump directory */
+    std::filesystem::path dumpDir;
+
+    /** @brief The trash directory */
+    std::filesystem::path trash;
+
+    /** @brief Notification of the removals */
+    Progress progress;
+
+    /** @brief Sequence of the names in the trash */
+    uint64_t sequence = 0;
+
+    /** @brief Guards the members below */
+    mutable std::mutex mutex;
+
+    /** @brief Signals a queued dump or stopping */
+    std::condition_variable queued;
+
+    /** @brief Dumps to remove */
+    std::deque<Job> queue;
+
+    /** @brief Kilobytes of the queued dumps and of the one being removed */
+    uint64_t pending = 0;
+
+    /** @brief Space of the dump being removed in kilobytes */
+    uint64_t currentSize = 0;
+
+    /** @brief Kilobytes of the dump being removed freed so far */
+    uint64_t currentFreed = 0;
+
+    /** @brief Files removed since the last progress notification */
+    uint64_t unlinked = 0;
+
+    /** @brief Whether the worker has to exit */
+    bool stopping = false;
+
+    /** @brief The worker, started by the first dump to remove */
+    std::thread worker;
+};
+
+} // namespace trash
+} // namespace dump
+} // namespace phosphor
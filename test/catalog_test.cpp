@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <dump_catalog.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace phosphor::dump;
+using namespace phosphor::dump::catalog;
+
+namespace
+{
+
+// Magic, version and a reserved field
+constexpr size_t HEADER_SIZE = 8;
+
+// Event type and length of the record
+constexpr size_t EVENT_HEADER_SIZE = 5;
+
+record::Record makeRecord(uint32_t id, uint64_t size = 1024)
+{
+    record::Record record;
+    record.dumpId = id;
+    record.dumpType = "user";
+    record.fileName = "BMCDUMP." + std::to_string(id) + ".tar.xz";
+    record.size = size;
+    return record;
+}
+
+size_t eventSize(const record::Record& record)
+{
+    return EVENT_HEADER_SIZE + record::encode(record).size();
+}
+
+class CatalogTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        dir = std::filesystem::temp_directory_path() / "catalog_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        path = dir / CATALOG_FILE;
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    void appendRaw(const std::string& data)
+    {
+        std::ofstream os(path, std::ios::binary | std::ios::app);
+        os.write(data.data(), data.size());
+    }
+
+    std::string contents()
+    {
+        std::ifstream is(path, std::ios::binary);
+        return {std::istreambuf_iterator<char>(is),
+                std::istreambuf_iterator<char>()};
+    }
+
+    std::filesystem::path dir;
+    std::filesystem::path path;
+};
+
+} // namespace
+
+TEST_F(CatalogTest, MissingCatalogFails)
+{
+    Catalog catalog(path);
+    EXPECT_FALSE(catalog.load());
+}
+
+TEST_F(CatalogTest, ReplaysPuts)
+{
+    {
+        Catalog catalog(path);
+        catalog.put(makeRecord(1));
+        catalog.put(makeRecord(2));
+        catalog.put(makeRecord(1, 2048));
+    }
+
+    Catalog catalog(path);
+    auto records = catalog.load();
+    ASSERT_TRUE(records);
+    ASSERT_EQ(records->size(), 2U);
+    EXPECT_EQ(records->at(1).size, 2048U);
+    EXPECT_EQ(records->at(2).fileName, "BMCDUMP.2.tar.xz");
+}
+
+TEST_F(CatalogTest, ReplaysErases)
+{
+    {
+        Catalog catalog(path);
+        catalog.put(makeRecord(1));
+        catalog.put(makeRecord(2));
+        catalog.erase(1);
+    }
+
+    Catalog catalog(path);
+    auto records = catalog.load();
+    ASSERT_TRUE(records);
+    ASSERT_EQ(records->size(), 1U);
+    EXPECT_TRUE(records->contains(2));
+
+    // Nothing is appended for a dump which is not in the catalog
+    auto size = std::filesystem::file_size(path);
+    catalog.erase(1);
+    catalog.erase(7);
+    EXPECT_EQ(std::filesystem::file_size(path), size);
+}
+
+TEST_F(CatalogTest, DropsTornTail)
+{
+    {
+        Catalog catalog(path);
+        catalog.put(makeRecord(1));
+        catalog.put(makeRecord(2));
+    }
+    auto size = std::filesystem::file_size(path);
+
+    // An event header promising more than was written
+    appendRaw(std::string("\x01\x64\x00\x00\x00PDER", 9));
+
+    Catalog catalog(path);
+    auto records = catalog.load();
+    ASSERT_TRUE(records);
+    EXPECT_EQ(records->size(), 2U);
+    EXPECT_EQ(std::filesystem::file_size(path), size);
+
+    // Appends continue after the dropped event
+    catalog.put(makeRecord(3));
+    Catalog reloaded(path);
+    records = reloaded.load();
+    ASSERT_TRUE(records);
+    EXPECT_EQ(records->size(), 3U);
+}
+
+TEST_F(CatalogTest, DropsTornEventHeader)
+{
+    {
+        Catalog catalog(path);
+        catalog.put(makeRecord(1));
+    }
+    auto size = std::filesystem::file_size(path);
+    appendRaw(std::string("\x01\x10", 2));
+
+    Catalog catalog(path);
+    auto records = catalog.load();
+    ASSERT_TRUE(records);
+    EXPECT_EQ(records->size(), 1U);
+    EXPECT_EQ(std::filesystem::file_size(path), size);
+}
+
+TEST_F(CatalogTest, DamagedEventFails)
+{
+    {
+        Catalog catalog(path);
+        catalog.put(makeRecord(1));
+        catalog.put(makeRecord(2));
+    }
+
+    // A flipped bit in the first record fails its CRC
+    auto data = contents();
+    data[HEADER_SIZE + EVENT_HEADER_SIZE + 20] ^= 0x01;
+    std::filesystem::remove(path);
+    appendRaw(data);
+
+    Catalog catalog(path);
+    EXPECT_FALSE(catalog.load());
+
+    // The directory scan rebuilds the catalog
+    std::map<uint32_t, record::Record> scanned{{1, makeRecord(1)},
+                                               {2, makeRecord(2)}};
+    catalog.rebuild(scanned);
+    Catalog rebuilt(path);
+    auto records = rebuilt.load();
+    ASSERT_TRUE(records);
+    EXPECT_EQ(records->size(), 2U);
+}
+
+TEST_F(CatalogTest, UnknownEventFails)
+{
+    {
+        Catalog catalog(path);
+        catalog.put(makeRecord(1));
+    }
+    auto data = contents();
+    data[HEADER_SIZE] = 3;
+    std::filesystem::remove(path);
+    appendRaw(data);
+
+    Catalog catalog(path);
+    EXPECT_FALSE(catalog.load());
+}
+
+TEST_F(CatalogTest, BadHeaderFails)
+{
+    appendRaw(std::string("PDCT\x02\x00\x00\x00", 8));
+    Catalog catalog(path);
+    EXPECT_FALSE(catalog.load());
+
+    std::filesystem::remove(path);
+    appendRaw("PDC");
+    EXPECT_FALSE(catalog.load());
+}
+
+TEST_F(CatalogTest, CompactsOnceEventsOutnumberDumps)
+{
+    Catalog catalog(path);
+    auto record = makeRecord(1);
+    for (size_t i = 0; i < COMPACT_MIN_EVENTS; ++i)
+    {
+        catalog.put(record);
+    }
+    EXPECT_EQ(std::filesystem::file_size(path),
+              HEADER_SIZE + COMPACT_MIN_EVENTS * eventSize(record));
+
+    // The next event rewrites the catalog with the one record
+    catalog.put(record);
+    EXPECT_EQ(std::filesystem::file_size(path),
+              HEADER_SIZE + eventSize(record));
+
+    Catalog reloaded(path);
+    auto records = reloaded.load();
+    ASSERT_TRUE(records);
+    EXPECT_EQ(records->size(), 1U);
+}
+
+TEST_F(CatalogTest, CompactsNotBelowTwiceTheDumps)
+{
+    // 40 dumps, compacted at 80 events rather than COMPACT_MIN_EVENTS
+    constexpr size_t dumps = 40;
+    Catalog catalog(path);
+    size_t size = HEADER_SIZE;
+    for (uint32_t id = 1; id <= dumps; ++id)
+    {
+        catalog.put(makeRecord(id));
+        size += eventSize(makeRecord(id));
+    }
+    for (uint32_t id = 1; id <= dumps; ++id)
+    {
+        catalog.put(makeRecord(id, 4096));
+        size += eventSize(makeRecord(id, 4096));
+    }
+    EXPECT_EQ(std::filesystem::file_size(path), size);
+
+    catalog.erase(1);
+    size = HEADER_SIZE;
+    for (uint32_t id = 2; id <= dumps; ++id)
+    {
+        size += eventSize(makeRecord(id, 4096));
+    }
+    EXPECT_EQ(std::filesystem::file_size(path), size);
+
+    Catalog reloaded(path);
+    auto records = reloaded.load();
+    ASSERT_TRUE(records);
+    EXPECT_EQ(records->size(), dumps - 1);
+    EXPECT_EQ(records->at(2).size, 4096U);
+}
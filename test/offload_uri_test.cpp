@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <dump_offload.hpp>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace phosphor::dump;
+using namespace phosphor::dump::offload;
+
+TEST(OffloadUri, ParsesUriWithoutQuery)
+{
+    for (const auto& uri : {"/tmp/socket", "/tmp/socket?"})
+    {
+        auto target = parseUri(uri);
+        ASSERT_TRUE(target) << uri;
+        EXPECT_EQ(target->path, "/tmp/socket");
+        EXPECT_EQ(target->range.offset, 0U);
+        EXPECT_FALSE(target->range.length);
+        EXPECT_FALSE(target->codec);
+    }
+}
+
+TEST(OffloadUri, RejectsEmptyPath)
+{
+    EXPECT_FALSE(parseUri(""));
+    EXPECT_FALSE(parseUri("?"));
+    EXPECT_FALSE(parseUri("?offset=10"));
+}
+
+TEST(OffloadUri, ParsesRange)
+{
+    auto target = parseUri("/tmp/socket?offset=1024&length=4096");
+    ASSERT_TRUE(target);
+    EXPECT_EQ(target->path, "/tmp/socket");
+    EXPECT_EQ(target->range.offset, 1024U);
+    EXPECT_EQ(target->range.length, 4096U);
+
+    // The last of a repeated parameter applies
+    target = parseUri("/tmp/socket?offset=1&offset=2");
+    ASSERT_TRUE(target);
+    EXPECT_EQ(target->range.offset, 2U);
+}
+
+TEST(OffloadUri, RejectsEmptyValues)
+{
+    EXPECT_FALSE(parseUri("/tmp/socket?offset="));
+    EXPECT_FALSE(parseUri("/tmp/socket?length="));
+    EXPECT_FALSE(parseUri("/tmp/socket?codec="));
+    EXPECT_FALSE(parseUri("/tmp/socket?offset"));
+    EXPECT_FALSE(parseUri("/tmp/socket?="));
+}
+
+TEST(OffloadUri, IgnoresEmptyParameters)
+{
+    for (const auto& uri :
+         {"/tmp/socket?offset=1&&length=2", "/tmp/socket?&offset=1&length=2",
+          "/tmp/socket?offset=1&length=2&", "/tmp/socket?offset=1&&&length=2"})
+    {
+        auto target = parseUri(uri);
+        ASSERT_TRUE(target) << uri;
+        EXPECT_EQ(target->range.offset, 1U) << uri;
+        EXPECT_EQ(target->range.length, 2U) << uri;
+    }
+}
+
+TEST(OffloadUri, RejectsUnknownKeys)
+{
+    EXPECT_FALSE(parseUri("/tmp/socket?foo=1"));
+    EXPECT_FALSE(parseUri("/tmp/socket?offset=1&Offset=2"));
+    EXPECT_FALSE(parseUri("/tmp/socket?offset=1&size=2"));
+}
+
+TEST(OffloadUri, RejectsMalformedNumbers)
+{
+    auto target = parseUri("/tmp/socket?offset=18446744073709551615");
+    ASSERT_TRUE(target);
+    EXPECT_EQ(target->range.offset, UINT64_MAX);
+
+    for (const auto& text : {"18446744073709551616", "99999999999999999999999",
+                             "-1", "+1", "1x", " 1", "1 ", "0x10", "1.5"})
+    {
+        EXPECT_FALSE(parseUri(std::string("/tmp/socket?offset=") + text))
+            << text;
+        EXPECT_FALSE(parseUri(std::string("/tmp/socket?length=") + text))
+            << text;
+    }
+}
+
+TEST(OffloadUri, ParsesCodecNames)
+{
+    for (const auto& name : {"xz", "gzip", "zstd"})
+    {
+        auto algorithm = archive::toAlgorithm(name);
+        auto target = parseUri(std::string("/tmp/socket?codec=") + name);
+        if (!algorithm)
+        {
+            // Not built in
+            EXPECT_FALSE(target) << name;
+            continue;
+        }
+        ASSERT_TRUE(target) << name;
+        EXPECT_EQ(target->codec, algorithm);
+    }
+
+    for (const auto& name : {"lz4", "XZ", "zst", "gz", "tar.xz", "none"})
+    {
+        EXPECT_FALSE(parseUri(std::string("/tmp/socket?codec=") + name))
+            << name;
+    }
+}
+
+TEST(OffloadUri, MakesUri)
+{
+    Target target;
+    target.path = "/tmp/socket";
+    EXPECT_EQ(makeUri(target), "/tmp/socket?offset=0");
+
+    target.range.offset = 10;
+    target.range.length = 0;
+    EXPECT_EQ(makeUri(target), "/tmp/socket?offset=10&length=0");
+
+    if (auto zstd = archive::toAlgorithm("zstd"))
+    {
+        target.codec = zstd;
+        EXPECT_EQ(makeUri(target), "/tmp/socket?offset=10&length=0&codec=zstd");
+    }
+}
+
+TEST(OffloadUri, RoundTrips)
+{
+    for (const auto& uri :
+         {"/tmp/socket", "/tmp/socket?", "/tmp/socket?length=0",
+          "/tmp/socket?offset=18446744073709551615&length=1",
+          "/tmp/socket?length=5&offset=7&&", "/tmp/socket?codec=xz",
+          "/tmp/socket?codec=gzip&offset=3", "/tmp/socket?codec=zstd&length=9"})
+    {
+        auto target = parseUri(uri);
+        if (!target)
+        {
+            // A codec which is not built in
+            continue;
+        }
+        auto again = parseUri(makeUri(*target));
+        ASSERT_TRUE(again) << uri;
+        EXPECT_EQ(again->path, target->path) << uri;
+        EXPECT_EQ(again->range.offset, target->range.offset) << uri;
+        EXPECT_EQ(again->range.length, target->range.length) << uri;
+        EXPECT_EQ(again->codec, target->codec) << uri;
+        EXPECT_EQ(makeUri(*again), makeUri(*target)) << uri;
+    }
+}
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <dump_plugin.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace phosphor::dump::collector;
+
+class TestPluginConfig : public ::testing::Test
+{
+  public:
+    TestPluginConfig() = default;
+
+    void SetUp()
+    {
+        char tmpdir[] = "/tmp/plugins.XXXXXX";
+        std::span<char> tmpdirSpan(reinterpret_cast<char*>(tmpdir),
+                                   sizeof(tmpdir));
+        auto dirPtr = mkdtemp(tmpdirSpan.data());
+        if (dirPtr == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        pluginDir = dirPtr;
+    }
+    void TearDown()
+    {
+        std::filesystem::remove_all(pluginDir);
+    }
+
+    void addPlugin(const std::string& link, const std::string& header)
+    {
+        std::ofstream os(pluginDir / link);
+        os << "#!/bin/bash\n#\n"
+           << header << "\n\n. $DREPORT_INCLUDE/functions\n";
+    }
+
+    std::filesystem::path pluginDir;
+};
+
+TEST(PluginConfig, ParseHeader)
+{
+    std::istringstream is("#!/bin/bash\n#\n# config: 1234 25\n# @brief x\n");
+    auto config = parseConfig(is);
+    ASSERT_TRUE(config);
+    EXPECT_EQ(config->types, "1234");
+    EXPECT_EQ(config->priority, 25);
+}
+
+TEST(PluginConfig, ParseHeaderWithoutColon)
+{
+    std::istringstream is("#!/bin/bash\n# config 2 5\n");
+    auto config = parseConfig(is);
+    ASSERT_TRUE(config);
+    EXPECT_EQ(config->types, "2");
+    EXPECT_EQ(config->priority, 5);
+}
+
+TEST(PluginConfig, MissingHeader)
+{
+    std::istringstream is("#!/bin/bash\n# @brief no config\necho\n");
+    EXPECT_FALSE(parseConfig(is));
+}
+
+TEST(PluginConfig, InvalidHeader)
+{
+    std::istringstream is("#!/bin/bash\n# config: 12 high\n");
+    EXPECT_FALSE(parseConfig(is));
+}
+
+TEST_F(TestPluginConfig, SortedByPriority)
+{
+    addPlugin("E20b", "# config: 1 20");
+    addPlugin("E5c", "# config: 12 5");
+    addPlugin("E20a", "# config: 1 20");
+    addPlugin("E7d", "");
+
+    auto plugins = findPlugins(pluginDir);
+    ASSERT_EQ(plugins.size(), 4);
+    EXPECT_EQ(plugins[0].name, "c");
+    EXPECT_EQ(plugins[1].name, "d");
+    EXPECT_EQ(plugins[1].priority, 7);
+    EXPECT_EQ(plugins[2].name, "a");
+    EXPECT_EQ(plugins[3].name, "b");
+    EXPECT_EQ(plugins[3].script, pluginDir / "E20b");
+}
+
+TEST_F(TestPluginConfig, Bands)
+{
+    addPlugin("E20b", "# config: 1 20");
+    addPlugin("E5c", "# config: 12 5");
+    addPlugin("E20a", "# config: 1 20");
+    addPlugin("Ed", "");
+
+    auto bands = makeBands(findPlugins(pluginDir));
+    ASSERT_EQ(bands.size(), 3);
+    EXPECT_EQ(bands[0].size(), 1);
+    EXPECT_EQ(bands[1].size(), 2);
+    EXPECT_EQ(bands[1][0].name, "a");
+    EXPECT_EQ(bands[2][0].name, "d");
+    EXPECT_EQ(bands[2][0].priority, DEFAULT_PRIORITY);
+}
+
+TEST(PluginConfig, NoPlugins)
+{
+    EXPECT_TRUE(findPlugins("/nonexistent/pl_user.d").empty());
+    EXPECT_TRUE(makeBands({}).empty());
+}
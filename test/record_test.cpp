@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <dump_record.hpp>
+
+#include <filesystem>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace phosphor::dump::record;
+
+namespace
+{
+
+Record makeRecord()
+{
+    Record record;
+    record.dumpId = 42;
+    record.originatorId = "admin";
+    record.originatorType = 1;
+    record.startTime = 1'700'000'000'000'000;
+    record.collectorOutcomes = {{"journal", "ok"}, {"kernel", "timeout"}};
+    record.itemHashes = {{"journal", "0123456789abcdef"}, {"ps", ""}};
+    record.baselineId = 41;
+    record.dumpType = "user";
+    record.offloaded = true;
+    record.fileName = "BMCDUMP.XXXXXXX.00000042.20231114221320.tar.xz";
+    record.size = 5 * 1024 * 1024;
+    record.completedTime = 1'700'000'012'345'678;
+    return record;
+}
+
+void expectEqual(const Record& actual, const Record& expected)
+{
+    EXPECT_EQ(actual.dumpId, expected.dumpId);
+    EXPECT_EQ(actual.originatorId, expected.originatorId);
+    EXPECT_EQ(actual.originatorType, expected.originatorType);
+    EXPECT_EQ(actual.startTime, expected.startTime);
+    EXPECT_EQ(actual.collectorOutcomes, expected.collectorOutcomes);
+    EXPECT_EQ(actual.itemHashes, expected.itemHashes);
+    EXPECT_EQ(actual.baselineId, expected.baselineId);
+    EXPECT_EQ(actual.dumpType, expected.dumpType);
+    EXPECT_EQ(actual.offloaded, expected.offloaded);
+    EXPECT_EQ(actual.fileName, expected.fileName);
+    EXPECT_EQ(actual.size, expected.size);
+    EXPECT_EQ(actual.completedTime, expected.completedTime);
+}
+
+void putInt(std::string& out, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+std::string field(uint16_t tag, const std::string& value)
+{
+    std::string out;
+    putInt(out, tag, 2);
+    putInt(out, value.size(), 4);
+    out.append(value);
+    return out;
+}
+
+/** @brief A record with a valid header around raw fields */
+std::string makeData(const std::string& fields, uint16_t version = VERSION,
+                     uint16_t headerSize = 16)
+{
+    std::string out("PDER");
+    putInt(out, version, 2);
+    putInt(out, headerSize, 2);
+    putInt(out, fields.size(), 4);
+    putInt(out, crc32(fields), 4);
+    out.append(headerSize - 16, '\0');
+    out.append(fields);
+    return out;
+}
+
+/** @brief The fields of an encoded record */
+std::string fieldsOf(const std::string& data)
+{
+    return data.substr(16);
+}
+
+} // namespace
+
+TEST(Record, ComputesCrc32)
+{
+    EXPECT_EQ(crc32("123456789"), 0xCBF43926U);
+    EXPECT_EQ(crc32(""), 0U);
+    EXPECT_EQ(crc32("6789", crc32("12345")), crc32("123456789"));
+}
+
+TEST(Record, RoundTripsEveryField)
+{
+    auto record = makeRecord();
+    auto decoded = decode(encode(record));
+    ASSERT_TRUE(decoded);
+    expectEqual(*decoded, record);
+}
+
+TEST(Record, RoundTripsEmptyFields)
+{
+    Record record;
+    record.dumpId = 7;
+    auto decoded = decode(encode(record));
+    ASSERT_TRUE(decoded);
+    expectEqual(*decoded, record);
+}
+
+TEST(Record, RejectsCrcMismatch)
+{
+    auto data = encode(makeRecord());
+    for (auto offset : {size_t(12), size_t(16), data.size() - 1})
+    {
+        auto damaged = data;
+        damaged[offset] ^= 0x01;
+        EXPECT_FALSE(decode(damaged)) << "offset " << offset;
+    }
+}
+
+TEST(Record, RejectsTruncatedHeader)
+{
+    auto data = encode(makeRecord());
+    for (size_t size = 0; size < 16; ++size)
+    {
+        EXPECT_FALSE(decode(std::string_view(data).substr(0, size)))
+            << "size " << size;
+    }
+}
+
+TEST(Record, RejectsTruncatedFields)
+{
+    auto data = encode(makeRecord());
+    EXPECT_FALSE(decode(std::string_view(data).substr(0, data.size() - 1)));
+    EXPECT_FALSE(decode(data + '\0'));
+
+    // The header matches, a field is cut short
+    auto fields = fieldsOf(data);
+    EXPECT_FALSE(decode(makeData(fields.substr(0, fields.size() - 1))));
+    EXPECT_FALSE(decode(makeData(fields + std::string(5, '\0'))));
+}
+
+TEST(Record, RejectsBadHeader)
+{
+    auto fields = fieldsOf(encode(makeRecord()));
+    EXPECT_FALSE(decode(makeData(fields, 0)));
+    EXPECT_FALSE(decode(makeData(fields, VERSION + 1)));
+
+    auto data = makeData(fields);
+    data[0] = 'X';
+    EXPECT_FALSE(decode(data));
+
+    // A header size below the fixed header or past the data
+    for (uint16_t headerSize : {0, 8, 15, 0xFFFF})
+    {
+        auto bad = makeData(fields);
+        bad[6] = static_cast<char>(headerSize & 0xFF);
+        bad[7] = static_cast<char>(headerSize >> 8);
+        EXPECT_FALSE(decode(bad)) << "header size " << headerSize;
+    }
+}
+
+TEST(Record, SkipsLargerHeader)
+{
+    auto record = makeRecord();
+    auto decoded = decode(makeData(fieldsOf(encode(record)), VERSION, 24));
+    ASSERT_TRUE(decoded);
+    expectEqual(*decoded, record);
+}
+
+TEST(Record, SkipsUnknownTags)
+{
+    auto record = makeRecord();
+    auto fields = field(999, "added later") + fieldsOf(encode(record)) +
+                  field(1000, "") + field(0, std::string(3, '\xFF'));
+    auto decoded = decode(makeData(fields));
+    ASSERT_TRUE(decoded);
+    expectEqual(*decoded, record);
+}
+
+TEST(Record, RejectsMalformedPair)
+{
+    // Tag 5 is a collector outcome, the key length is 2 bytes
+    EXPECT_FALSE(decode(makeData(field(5, ""))));
+    EXPECT_FALSE(decode(makeData(field(5, "\x01"))));
+    EXPECT_FALSE(decode(makeData(field(5, std::string("\x05\x00key", 5)))));
+
+    // The key takes the whole field, the value is empty
+    auto decoded = decode(makeData(field(5, std::string("\x03\x00key", 5))));
+    ASSERT_TRUE(decoded);
+    EXPECT_EQ(decoded->collectorOutcomes.at("key"), "");
+}
+
+TEST(Record, SavesAndLoads)
+{
+    auto dir = std::filesystem::temp_directory_path() / "record_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    auto path = dir / RECORD_FILE;
+
+    EXPECT_FALSE(load(path));
+    auto record = makeRecord();
+    ASSERT_TRUE(save(path, record));
+    record.offloaded = false;
+    ASSERT_TRUE(save(path, record));
+
+    auto loaded = load(path);
+    ASSERT_TRUE(loaded);
+    expectEqual(*loaded, record);
+
+    // Only the record is left behind
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(dir),
+                            std::filesystem::directory_iterator()),
+              1);
+    std::filesystem::remove_all(dir);
+}
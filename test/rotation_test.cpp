@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <dump_rotation.hpp>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace phosphor::dump::rotation;
+
+namespace
+{
+
+Candidate makeCandidate(uint32_t id, uint64_t timestamp, uint64_t size,
+                        unsigned typeRank = 0, bool offloaded = false,
+                        uint32_t baselineId = 0)
+{
+    Candidate candidate;
+    candidate.id = id;
+    candidate.timestamp = timestamp;
+    candidate.size = size;
+    candidate.typeRank = typeRank;
+    candidate.offloaded = offloaded;
+    candidate.baselineId = baselineId;
+    return candidate;
+}
+
+} // namespace
+
+TEST(RotationPolicy, ParsesCriteria)
+{
+    EXPECT_EQ(parsePolicy("offloaded, type,oldest,largest"),
+              (std::vector<Criterion>{Criterion::offloaded, Criterion::type,
+                                      Criterion::oldest, Criterion::largest}));
+    EXPECT_EQ(parsePolicy("oldest,bogus,oldest"),
+              std::vector<Criterion>{Criterion::oldest});
+    EXPECT_TRUE(parsePolicy("").empty());
+}
+
+TEST(RotationPolicy, RanksTypes)
+{
+    EXPECT_EQ(typeRank("elog,core,user", "elog"), 0U);
+    EXPECT_EQ(typeRank("elog,core,user", "user"), 2U);
+    EXPECT_EQ(typeRank("elog,core,user", "ramoops"), 3U);
+    EXPECT_EQ(typeRank("elog,core,user", ""), 3U);
+}
+
+TEST(RotationIndex, EvictsOldestFirst)
+{
+    Index index({Criterion::oldest});
+    index.insert(makeCandidate(1, 300, 10));
+    index.insert(makeCandidate(2, 100, 10));
+    index.insert(makeCandidate(3, 200, 10));
+
+    EXPECT_EQ(index.select(10), std::vector<uint32_t>{2});
+    EXPECT_EQ(index.select(25), (std::vector<uint32_t>{2, 3, 1}));
+    EXPECT_EQ(index.select(100), (std::vector<uint32_t>{2, 3, 1}));
+}
+
+TEST(RotationIndex, EvictsByIdWithoutPolicy)
+{
+    Index index(std::vector<Criterion>{});
+    index.insert(makeCandidate(3, 100, 10));
+    index.insert(makeCandidate(1, 300, 10));
+    index.insert(makeCandidate(2, 200, 10));
+
+    EXPECT_EQ(index.select(30), (std::vector<uint32_t>{1, 2, 3}));
+}
+
+TEST(RotationIndex, CombinesCriteria)
+{
+    Index index({Criterion::offloaded, Criterion::type, Criterion::largest});
+    index.insert(makeCandidate(1, 0, 5, 0, false));
+    index.insert(makeCandidate(2, 0, 50, 1, true));
+    index.insert(makeCandidate(3, 0, 20, 0, true));
+    index.insert(makeCandidate(4, 0, 30, 0, true));
+
+    EXPECT_EQ(index.select(1000), (std::vector<uint32_t>{4, 3, 2, 1}));
+}
+
+TEST(RotationIndex, SelectsBatchForReservation)
+{
+    Index index({Criterion::oldest});
+    for (uint32_t id = 1; id <= 10; ++id)
+    {
+        index.insert(makeCandidate(id, id, 4));
+    }
+
+    // Just enough victims for the requested space
+    EXPECT_EQ(index.select(9), (std::vector<uint32_t>{1, 2, 3}));
+    EXPECT_EQ(index.select(12), (std::vector<uint32_t>{1, 2, 3}));
+    EXPECT_TRUE(index.select(0).empty());
+}
+
+TEST(RotationIndex, UpdatesAndErases)
+{
+    Index index({Criterion::offloaded, Criterion::oldest});
+    index.insert(makeCandidate(1, 100, 10));
+    index.insert(makeCandidate(2, 200, 10));
+    EXPECT_EQ(index.select(10), std::vector<uint32_t>{1});
+
+    // Offloading moves a dump ahead
+    index.insert(makeCandidate(2, 200, 10, 0, true));
+    EXPECT_EQ(index.size(), 2U);
+    EXPECT_EQ(index.select(10), std::vector<uint32_t>{2});
+
+    index.erase(2);
+    index.erase(42);
+    EXPECT_EQ(index.size(), 1U);
+    EXPECT_EQ(index.select(100), std::vector<uint32_t>{1});
+}
+
+TEST(RotationIndex, SkipsPinnedAndInProgress)
+{
+    Index index({Criterion::oldest});
+    index.insert(makeCandidate(1, 100, 10));
+    index.insert(makeCandidate(2, 200, 10));
+    auto running = makeCandidate(3, 50, 10);
+    running.inProgress = true;
+    index.insert(running);
+
+    auto pinned = [](uint32_t id) { return id == 1; };
+    EXPECT_EQ(index.select(100, pinned), std::vector<uint32_t>{2});
+}
+
+TEST(RotationIndex, EvictsBaselineAfterDeltas)
+{
+    Index index({Criterion::oldest});
+    index.insert(makeCandidate(1, 100, 10));
+    index.insert(makeCandidate(2, 200, 1, 0, false, 1));
+    index.insert(makeCandidate(3, 300, 1, 0, false, 1));
+    index.insert(makeCandidate(4, 400, 10));
+
+    EXPECT_EQ(index.select(5), (std::vector<uint32_t>{2, 3, 1}));
+    EXPECT_EQ(index.select(1), std::vector<uint32_t>{2});
+
+    // A delta which can't be evicted keeps its baseline
+    auto pinned = [](uint32_t id) { return id == 3; };
+    EXPECT_EQ(index.select(100, pinned), (std::vector<uint32_t>{2, 4}));
+
+    index.erase(2);
+    index.erase(3);
+    EXPECT_EQ(index.select(5), std::vector<uint32_t>{1});
+}